@@ -0,0 +1,98 @@
+"""Per-worker memory cost of reading a preloaded LRUDict after fork().
+
+A parent process fills an LRUDict and forks a number of workers, as a
+pre-forking server would. Each worker looks up every key a few times and then
+reports how much of its memory has become private (i.e. copied on write) since
+the fork. This is done once with a plain LRUDict and once with a frozen one.
+
+Linux only (reads /proc/self/smaps_rollup).
+
+Usage: python bench/fork_rss.py [-n ITEMS] [-w WORKERS] [-r ROUNDS] [-s]
+"""
+import argparse
+import gc
+import os
+import sys
+from lru_ng import LRUDict
+
+
+def make_key(i):
+    return "key-%d" % i
+
+
+def private_kib():
+    """Sum of Private_Clean and Private_Dirty of this process, in KiB."""
+    total = 0
+    with open("/proc/self/smaps_rollup") as f:
+        for line in f:
+            if line.startswith(("Private_Clean:", "Private_Dirty:")):
+                total += int(line.split()[1])
+    return total
+
+
+def worker(cache, n_items, rounds, wfd):
+    # Keys are re-created here so that iterating over them does not touch
+    # objects shared with the parent.
+    keys = [make_key(i) for i in range(n_items)]
+    before = private_kib()
+    for _ in range(rounds):
+        for k in keys:
+            cache[k]
+    after = private_kib()
+    os.write(wfd, ("%d\n" % (after - before)).encode())
+    os._exit(0)
+
+
+def run(frozen, n_items, n_workers, rounds, distinct):
+    cache = LRUDict(n_items)
+    for i in range(n_items):
+        cache[make_key(i)] = ("value", i) if distinct else None
+    if frozen:
+        cache.freeze()
+    gc.collect()
+    if hasattr(gc, "freeze"):
+        gc.freeze()
+
+    pids = []
+    rfd, wfd = os.pipe()
+    for _ in range(n_workers):
+        pid = os.fork()
+        if pid == 0:
+            os.close(rfd)
+            worker(cache, n_items, rounds, wfd)
+        pids.append(pid)
+    os.close(wfd)
+    with os.fdopen(rfd) as r:
+        growth = [int(line) for line in r]
+    for pid in pids:
+        os.waitpid(pid, 0)
+    if hasattr(gc, "unfreeze"):
+        gc.unfreeze()
+    return growth
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-n", "--items", type=int, default=1000000)
+    parser.add_argument("-w", "--workers", type=int, default=4)
+    parser.add_argument("-r", "--rounds", type=int, default=2)
+    parser.add_argument("-s", "--shared-value", action="store_true",
+                        help=("use the same value object for all keys; before"
+                              " CPython 3.12 (no immortal objects), this"
+                              " separates the cost of INCREF'ing the value"
+                              " from that of the cache itself"))
+    args = parser.parse_args()
+
+    print("Python %s, %d items, %d workers"
+          % (sys.version.split()[0], args.items, args.workers))
+    for frozen in (False, True):
+        growth = run(frozen, args.items, args.workers, args.rounds,
+                     not args.shared_value)
+        print("%-8s private memory gained per worker: mean %8.1f MiB,"
+              " max %8.1f MiB"
+              % ("frozen" if frozen else "plain",
+                 sum(growth) / len(growth) / 1024, max(growth) / 1024))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,69 @@
+"""Hit and miss latency of LRUDict lookups, for comparison across Python versions.
+
+Each case times one kind of lookup on a full LRUDict with timeit and reports
+the best of several repeats in nanoseconds per lookup. A plain dict is timed
+alongside as a baseline, which helps to tell changes in LRUDict apart from
+changes in the interpreter itself.
+
+Usage: python bench/lookup.py [-n ITEMS] [-l LOOPS] [-r REPEATS]
+"""
+import argparse
+import sys
+import timeit
+from lru_ng import LRUDict
+
+
+SETUP = """
+keys = [%(kexpr)s for i in range(n)]
+missing = [%(kexpr)s for i in range(n, 2 * n)]
+d = {k: k for k in keys}
+r = LRUDict(n)
+for k in keys:
+    r[k] = k
+"""
+
+
+CASES = [
+    # (name, statement run for each key)
+    ("subscript hit", "r[k]"),
+    ("get hit", "r.get(k)"),
+    ("get miss", "r.get(k)"),
+    ("contains miss", "k in r"),
+    ("setitem replace", "r[k] = k"),
+    ("dict subscript hit", "d[k]"),
+    ("dict get miss", "d.get(k)"),
+]
+
+
+KEY_KINDS = [
+    ("str", "'key-%d' % i"),
+    ("int", "i * 7919"),
+]
+
+
+def time_case(stmt, missing, kexpr, n, loops, repeats):
+    source = "missing" if missing else "keys"
+    loop = "for k in %s:\n    %s" % (source, stmt)
+    timer = timeit.Timer(loop, SETUP % {"kexpr": kexpr},
+                         globals={"LRUDict": LRUDict, "n": n})
+    best = min(timer.repeat(repeats, loops))
+    return best / loops / n * 1e9
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-n", "--items", type=int, default=10000)
+    parser.add_argument("-l", "--loops", type=int, default=50)
+    parser.add_argument("-r", "--repeats", type=int, default=5)
+    args = parser.parse_args()
+
+    print("Python %s, %d items" % (sys.version.split()[0], args.items))
+    for kind, kexpr in KEY_KINDS:
+        for name, stmt in CASES:
+            ns = time_case(stmt, "miss" in name, kexpr, args.items,
+                           args.loops, args.repeats)
+            print("%-4s %-20s %7.1f ns" % (kind, name, ns))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,99 @@
+"""LRUDict against the usual OrderedDict-based LRU cache written in Python.
+
+This is mainly for PyPy, where lru_ng is provided by the cffi backend and the
+OrderedDict recipe is the common fallback, but it runs on any interpreter. Each
+case runs a stream of keys through a cache at about 80% hit rate (keys drawn
+uniformly from 1.25 times the capacity), or only hits, or only misses, and
+reports the best of several repeats in nanoseconds per access. On PyPy, the
+first repeats also serve to warm up the JIT.
+
+Usage: python bench/ordereddict_lru.py [-n ITEMS] [-a ACCESSES] [-r REPEATS]
+"""
+import argparse
+import collections
+import platform
+import random
+import sys
+import timeit
+from lru_ng import LRUDict
+
+
+class OrderedDictLRU(object):
+    """The textbook LRU cache: an OrderedDict kept in recency order."""
+
+    def __init__(self, size):
+        self.size = size
+        self.od = collections.OrderedDict()
+
+    def __getitem__(self, key):
+        od = self.od
+        value = od[key]
+        od.move_to_end(key)
+        return value
+
+    def get(self, key, default=None):
+        od = self.od
+        try:
+            value = od[key]
+        except KeyError:
+            return default
+        od.move_to_end(key)
+        return value
+
+    def __setitem__(self, key, value):
+        od = self.od
+        od[key] = value
+        od.move_to_end(key)
+        if len(od) > self.size:
+            od.popitem(last=False)
+
+
+# Get the value of a key, and insert it on a miss.
+STMT = """
+for k in stream:
+    if c.get(k) is None:
+        c[k] = k
+"""
+
+
+def make_streams(n, accesses):
+    rng = random.Random(1234)
+    return [
+        ("mixed, 80% hits",
+         [rng.randrange(n * 5 // 4) for _ in range(accesses)]),
+        ("hits only", [rng.randrange(n) for _ in range(accesses)]),
+        ("misses only", list(range(n, n + accesses))),
+    ]
+
+
+def time_case(factory, n, stream, repeats):
+    def setup():
+        c = factory(n)
+        for k in range(n):
+            c[k] = k
+        return c
+    times = []
+    for _ in range(repeats):
+        timer = timeit.Timer(STMT, globals={"c": setup(), "stream": stream})
+        times.append(timer.timeit(1))
+    return min(times) / len(stream) * 1e9
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-n", "--items", type=int, default=10000)
+    parser.add_argument("-a", "--accesses", type=int, default=1000000)
+    parser.add_argument("-r", "--repeats", type=int, default=7)
+    args = parser.parse_args()
+
+    print("%s %s, %d items" % (platform.python_implementation(),
+                               sys.version.split()[0], args.items))
+    for name, stream in make_streams(args.items, args.accesses):
+        lru = time_case(LRUDict, args.items, stream, args.repeats)
+        od = time_case(OrderedDictLRU, args.items, stream, args.repeats)
+        print("%-16s LRUDict %7.1f ns  OrderedDict %7.1f ns  (x%.2f)"
+              % (name, lru, od, od / lru))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,117 @@
+"""Training and timing workload for the profile-guided build of lru_ng.
+
+It exercises the hot paths of LRUDict in proportions meant to resemble real
+use: lookups that mostly hit, lookups that miss, inserts with eviction (with
+and without callback), replacement of values, update() from a dict, and a
+little of everything else. setup.py runs it on the instrumented build to
+collect the profile, and with --time to compare the optimized build to a
+default one; see LRU_NG_PGO in setup.py.
+
+Usage: python bench/pgo_train.py [--path DIR] [--scale N] [--time [REPEATS]]
+"""
+import argparse
+import sys
+import time
+
+
+def mixed_keys(n):
+    # Half str, half int, as both have their own fast paths in dict.
+    return ["key-%d" % i for i in range(n // 2)] + list(range(n // 2, n))
+
+
+def run_lookups(LRUDict, keys, rounds):
+    n = len(keys)
+    r = LRUDict(n)
+    for k in keys:
+        r[k] = k
+    missing = ["miss-%d" % i for i in range(n // 4)]
+    get = r.get
+    for _ in range(rounds):
+        for k in keys:
+            r[k]
+        for k in keys[::3]:
+            get(k)
+        for k in missing:
+            get(k)
+            k in r
+    return r.get_stats()
+
+
+def run_inserts(LRUDict, keys, rounds, callback=None):
+    # Capacity of 3/4 of the keys, cycled through: every insert of a new key
+    # evicts.
+    r = LRUDict(len(keys) * 3 // 4, callback)
+    for _ in range(rounds):
+        for k in keys:
+            r[k] = k
+        for k in keys[-len(keys) // 8:]:
+            r[k] = None     # replace
+    return len(r)
+
+
+def run_update(LRUDict, keys, rounds):
+    src = {k: k for k in keys}
+    r = LRUDict(len(keys) // 2)
+    for _ in range(rounds):
+        r.update(src)
+        r.update(a=1, b=2)
+    return len(r)
+
+
+def run_misc(LRUDict, keys, rounds):
+    r = LRUDict(len(keys))
+    for _ in range(rounds):
+        for k in keys:
+            r.setdefault(k, k)
+        for k in keys[::2]:
+            r.pop(k)
+            r.pop(k, None)
+        while len(r) > len(keys) // 4:
+            r.popitem(True)
+        r.peek_first_item()
+        r.peek_last_item()
+        r.items()
+        r.to_dict()
+        r.size = len(keys) // 8
+        r.size = len(keys)
+        for k in r.keys()[::16]:
+            del r[k]
+    r.clear()
+
+
+def workload(LRUDict, scale):
+    keys = mixed_keys(2000 * scale)
+    evicted = []
+    run_lookups(LRUDict, keys, 20)
+    run_inserts(LRUDict, keys, 10)
+    run_inserts(LRUDict, keys, 5, lambda k, v: evicted.append(k))
+    run_update(LRUDict, keys, 5)
+    run_misc(LRUDict, keys, 2)
+    return len(evicted)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--path", help="import lru_ng from this directory")
+    parser.add_argument("--scale", type=int, default=10)
+    parser.add_argument("--time", type=int, nargs="?", const=5, default=0,
+                        metavar="REPEATS",
+                        help="print the best time of REPEATS runs in seconds")
+    args = parser.parse_args()
+    if args.path:
+        sys.path.insert(0, args.path)
+    from lru_ng import LRUDict
+
+    if not args.time:
+        workload(LRUDict, args.scale)
+        return
+    best = float("inf")
+    for _ in range(args.time):
+        t0 = time.perf_counter()
+        workload(LRUDict, args.scale)
+        best = min(best, time.perf_counter() - t0)
+    print("%.6f" % best)
+
+
+if __name__ == "__main__":
+    main()
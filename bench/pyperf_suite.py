@@ -0,0 +1,454 @@
+"""Benchmark suite of the hot paths of LRUDict and its usual alternatives, on pyperf.
+
+Every benchmark times one operation over a batch of keys and is reported per
+operation. It runs for each combination of key type (int, str, tuple), size
+(number of items, 1e3 to 1e7 by default) and target: LRUDict, a plain dict
+(no eviction, as a lower bound), the OrderedDict-based LRU of
+bench/ordereddict_lru.py, functools.lru_cache, and lru.LRU (from the lru-dict
+package, if installed). A target is skipped for an operation it has no
+equivalent for. Benchmarks are named "operation/target/keytype/size".
+
+The operations are:
+
+  getitem_hit, getitem_miss   c[k] with present or absent keys
+  get_hit, get_miss           c.get(k), likewise
+  insert_evict                c[k] = v with new keys on a full cache; the
+                              variants _unsafe (values of a Python class,
+                              whose release LRUDict has to defer) and
+                              _callback (with a callback) also run
+  replace                     c[k] = v with present keys
+  update                      c.update(d) with a dict of size new keys
+  shrink                      halving the size of a full cache (the refill
+                              is not timed); reported per evicted item
+  items, to_dict              the whole cache, reported per item
+  popitem                     c.popitem() on a full cache (the refill is not
+                              timed)
+
+For lru_cache, a call of the cached function stands for get and getitem, and a
+miss inserts. As usual with pyperf, each benchmark runs in fresh worker
+processes, and the results can be written as JSON with -o for regression
+tracking, then compared with "python -m pyperf compare_to OLD.json NEW.json".
+The full matrix takes long; use --bench, --target, --keys and --sizes to select
+part of it, and pyperf's --fast for a rough run.
+
+Usage: python bench/pyperf_suite.py [pyperf options] [--bench NAME,...]
+           [--target NAME,...] [--keys int,str,tuple] [--sizes N,...]
+           [-o RESULT.json]
+"""
+import collections
+import functools
+import random
+import pyperf
+from lru_ng import LRUDict
+from ordereddict_lru import OrderedDictLRU
+try:
+    from lru import LRU
+except ImportError:
+    LRU = None
+
+
+# Upper bound of the number of keys in a batch. A batch is drawn at random from
+# the whole cache, so that large caches are not only accessed in a hot corner.
+BATCH = 10000
+SIZES = "1e3,1e4,1e5,1e6,1e7"
+
+
+class Unsafe(object):
+    """Value type whose deallocation LRUDict cannot rule out to run code."""
+    __slots__ = ("v",)
+
+    def __init__(self, v):
+        self.v = v
+
+
+KEY_MAKERS = {
+    "int": lambda i: i * 7919,
+    "str": lambda i: "key-%d" % i,
+    "tuple": lambda i: ("key", i),
+}
+
+
+def consume(iterator):
+    collections.deque(iterator, maxlen=0)
+
+
+def miss_loop(getitem, batch):
+    for k in batch:
+        try:
+            getitem(k)
+        except KeyError:
+            pass
+
+
+def identity(x):
+    return x
+
+
+class Target(object):
+    """Uniform access to one kind of cache. An operation the target has no
+    equivalent for is None in the class."""
+
+    name = None
+    # Whether a lookup of an absent key leaves the cache as it was.
+    can_miss = True
+    can_callback = False
+
+    def __init__(self, size, callback=None):
+        self.c = self.make(size, callback)
+
+    def fill(self, keys, values):
+        consume(map(self.c.__setitem__, keys, values))
+
+
+class LRUDictTarget(Target):
+    name = "LRUDict"
+    can_callback = True
+
+    def make(self, size, callback):
+        return LRUDict(size, callback)
+
+    def getitem(self):
+        return self.c.__getitem__
+
+    def get(self):
+        return self.c.get
+
+    def setitem(self):
+        return self.c.__setitem__
+
+    insert = setitem
+
+    def update(self):
+        return self.c.update
+
+    def resize(self, size):
+        self.c.size = size
+
+    def items(self):
+        return self.c.items()
+
+    def to_dict(self):
+        return self.c.to_dict()
+
+    def popitem(self):
+        return self.c.popitem
+
+
+class DictTarget(LRUDictTarget):
+    """A dict that is never full: a lower bound for lookups and replacing."""
+    name = "dict"
+    can_callback = False
+    insert = resize = None
+
+    def make(self, size, callback):
+        return {}
+
+    def items(self):
+        return list(self.c.items())
+
+    def to_dict(self):
+        return dict(self.c)
+
+
+class OrderedDictTarget(Target):
+    name = "OrderedDict"
+    update = resize = to_dict = popitem = None
+
+    def make(self, size, callback):
+        return OrderedDictLRU(size)
+
+    def getitem(self):
+        return self.c.__getitem__
+
+    def get(self):
+        return self.c.get
+
+    def setitem(self):
+        return self.c.__setitem__
+
+    insert = setitem
+
+    def items(self):
+        return list(self.c.od.items())
+
+
+class LRUCacheTarget(Target):
+    """functools.lru_cache around the identity function: the key is the
+    argument, and the value is the key itself."""
+    name = "lru_cache"
+    can_miss = False
+    setitem = update = resize = items = to_dict = popitem = None
+
+    def make(self, size, callback):
+        return functools.lru_cache(maxsize=size)(identity)
+
+    def fill(self, keys, values):
+        consume(map(self.c, keys))
+
+    def getitem(self):
+        return self.c
+
+    get = getitem
+
+    def insert(self):
+        # Takes the value too, which is ignored.
+        return lambda key, value, f=self.c: f(key)
+
+
+class LRUTarget(LRUDictTarget):
+    name = "lru.LRU"
+    to_dict = None
+    if LRU is None or not hasattr(LRU, "popitem"):
+        popitem = None
+
+    def make(self, size, callback):
+        return LRU(size, callback) if callback else LRU(size)
+
+    def resize(self, size):
+        self.c.set_size(size)
+
+
+TARGETS = [LRUDictTarget, DictTarget, OrderedDictTarget, LRUCacheTarget]
+if LRU is not None:
+    TARGETS.append(LRUTarget)
+
+
+# Each benchmark function takes (target class, keys, size), and returns the
+# timed function of loops and the number of operations per loop. keys has
+# 2 * size items: the first half fills the cache, the second half is new to it.
+
+def sample(keys, size):
+    return random.Random(size).sample(keys, min(size, BATCH))
+
+
+def filled(target_cls, keys, size, callback=None):
+    t = target_cls(size, callback)
+    t.fill(keys[:size], keys[:size])
+    return t
+
+
+def timed_map(func, *iterables):
+    def run(loops):
+        t0 = pyperf.perf_counter()
+        for _ in range(loops):
+            consume(map(func, *iterables))
+        return pyperf.perf_counter() - t0
+    return run
+
+
+def bench_getitem(target_cls, keys, size, hit):
+    getitem = filled(target_cls, keys, size).getitem()
+    batch = sample(keys[:size] if hit else keys[size:], size)
+    if hit:
+        return timed_map(getitem, batch), len(batch)
+
+    def run(loops):
+        t0 = pyperf.perf_counter()
+        for _ in range(loops):
+            miss_loop(getitem, batch)
+        return pyperf.perf_counter() - t0
+    return run, len(batch)
+
+
+def bench_get(target_cls, keys, size, hit):
+    get = filled(target_cls, keys, size).get()
+    batch = sample(keys[:size] if hit else keys[size:], size)
+    return timed_map(get, batch), len(batch)
+
+
+def bench_insert_evict(target_cls, keys, size, unsafe=False, callback=None):
+    insert = filled(target_cls, keys, size, callback).insert()
+    values = [Unsafe(i) for i in range(2 * size)] if unsafe else keys
+    # Cycling through all 2 * size keys, each one is new to the cache when its
+    # turn comes, and evicts the least recent.
+    batch = min(size, BATCH)
+    pos = [size]
+
+    def run(loops):
+        p = pos[0]
+        dt = 0.0
+        for _ in range(loops):
+            if p + batch > 2 * size:
+                p = 0
+            ks = keys[p:p + batch]
+            vs = values[p:p + batch]
+            t0 = pyperf.perf_counter()
+            consume(map(insert, ks, vs))
+            dt += pyperf.perf_counter() - t0
+            p += batch
+        pos[0] = p
+        return dt
+    return run, batch
+
+
+def bench_replace(target_cls, keys, size):
+    setitem = filled(target_cls, keys, size).setitem()
+    batch = sample(keys[:size], size)
+    return timed_map(setitem, batch, batch), len(batch)
+
+
+def bench_update(target_cls, keys, size):
+    update = filled(target_cls, keys, size).update()
+    # Alternate between the two halves, which are new to the cache in turn.
+    sources = [dict.fromkeys(keys[size:]), dict.fromkeys(keys[:size])]
+
+    def run(loops):
+        t0 = pyperf.perf_counter()
+        for i in range(loops):
+            update(sources[i & 1])
+        return pyperf.perf_counter() - t0
+    return run, size
+
+
+def bench_shrink(target_cls, keys, size):
+    t = target_cls(size)
+    half = size // 2
+    fill_keys = keys[:size]
+
+    def run(loops):
+        dt = 0.0
+        for _ in range(loops):
+            t.resize(size)
+            t.fill(fill_keys, fill_keys)
+            t0 = pyperf.perf_counter()
+            t.resize(half)
+            dt += pyperf.perf_counter() - t0
+        return dt
+    return run, size - half
+
+
+def bench_whole(target_cls, keys, size, method):
+    func = getattr(filled(target_cls, keys, size), method)
+
+    def run(loops):
+        t0 = pyperf.perf_counter()
+        for _ in range(loops):
+            func()
+        return pyperf.perf_counter() - t0
+    return run, size
+
+
+def bench_popitem(target_cls, keys, size):
+    t = filled(target_cls, keys, size)
+    popitem = t.popitem()
+    batch = min(size, BATCH)
+    refill = keys[:batch]
+
+    def run(loops):
+        dt = 0.0
+        for _ in range(loops):
+            t0 = pyperf.perf_counter()
+            for _ in range(batch):
+                popitem()
+            dt += pyperf.perf_counter() - t0
+            t.fill(refill, refill)
+        return dt
+    return run, batch
+
+
+def noop(*args):
+    pass
+
+
+def has(op, **flags):
+    """Predicate of a target class: whether it supports op (and has the true
+    flags)."""
+    def check(target_cls):
+        return (getattr(target_cls, op) is not None and
+                all(getattr(target_cls, f) for f in flags))
+    return check
+
+
+# Name: (benchmark function, predicate of target classes it applies to)
+BENCHMARKS = collections.OrderedDict([
+    ("getitem_hit", (functools.partial(bench_getitem, hit=True),
+                     has("getitem"))),
+    ("getitem_miss", (functools.partial(bench_getitem, hit=False),
+                      has("getitem", can_miss=True))),
+    ("get_hit", (functools.partial(bench_get, hit=True), has("get"))),
+    ("get_miss", (functools.partial(bench_get, hit=False),
+                  has("get", can_miss=True))),
+    ("insert_evict", (bench_insert_evict, has("insert"))),
+    ("insert_evict_unsafe", (functools.partial(bench_insert_evict,
+                                               unsafe=True),
+                             has("insert"))),
+    ("insert_evict_callback", (functools.partial(bench_insert_evict,
+                                                 callback=noop),
+                               has("insert", can_callback=True))),
+    ("replace", (bench_replace, has("setitem"))),
+    ("update", (bench_update, has("update"))),
+    ("shrink", (bench_shrink, has("resize"))),
+    ("items", (functools.partial(bench_whole, method="items"),
+               has("items"))),
+    ("to_dict", (functools.partial(bench_whole, method="to_dict"),
+                 has("to_dict"))),
+    ("popitem", (bench_popitem, has("popitem"))),
+])
+
+
+def comma_list(choices=None):
+    def parse(text):
+        items = [s.strip() for s in text.split(",") if s.strip()]
+        if choices is not None:
+            for s in items:
+                if s not in choices:
+                    raise ValueError("unknown name: %s" % s)
+        return items
+    return parse
+
+
+def add_cmdline_args(cmd, args):
+    cmd.extend(("--bench", ",".join(args.bench),
+                "--target", ",".join(args.target),
+                "--keys", ",".join(args.keys),
+                "--sizes", ",".join(args.sizes)))
+
+
+def main():
+    target_names = [cls.name for cls in TARGETS]
+    runner = pyperf.Runner(add_cmdline_args=add_cmdline_args)
+    runner.metadata["description"] = __doc__.splitlines()[0]
+    parser = runner.argparser
+    parser.add_argument("--bench", type=comma_list(BENCHMARKS),
+                        default=list(BENCHMARKS))
+    parser.add_argument("--target", type=comma_list(target_names),
+                        default=target_names)
+    parser.add_argument("--keys", type=comma_list(KEY_MAKERS),
+                        default=list(KEY_MAKERS))
+    parser.add_argument("--sizes", type=comma_list(), default=SIZES.split(","))
+    args = runner.parse_args()
+
+    sizes = [int(float(s)) for s in args.sizes]
+    targets = [cls for cls in TARGETS if cls.name in args.target]
+    for kind in args.keys:
+        make_key = KEY_MAKERS[kind]
+        for size in sizes:
+            # Built lazily, since most worker processes run one benchmark.
+            keys = []
+
+            def get_keys():
+                if not keys:
+                    keys.extend(make_key(i) for i in range(2 * size))
+                return keys
+
+            for bench in args.bench:
+                bench_func, applies = BENCHMARKS[bench]
+                for target_cls in filter(applies, targets):
+                    name = "%s/%s/%s/%d" % (bench, target_cls.name, kind,
+                                            size)
+                    runner.bench_time_func(name, run_bench, bench_func,
+                                           target_cls, get_keys, size)
+
+
+def run_bench(loops, bench_func, target_cls, get_keys, size, _cache={}):
+    # pyperf calls this repeatedly with varying loops; set up only once.
+    key = (bench_func, target_cls, size)
+    if key not in _cache:
+        _cache.clear()
+        _cache[key] = bench_func(target_cls, get_keys(), size)
+    run, inner_loops = _cache[key]
+    return run(loops) / inner_loops
+
+
+if __name__ == "__main__":
+    main()
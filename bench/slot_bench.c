@@ -0,0 +1,503 @@
+/*
+ * C-level microbenchmark of LRUDict, with hardware performance counters.
+ *
+ * This program embeds the interpreter, imports lru_ng, and calls the mapping
+ * slots (mp_subscript, mp_ass_subscript) of LRUDict and, as the baseline,
+ * dict directly in tight loops, so that no bytecode is executed between the
+ * calls. For each case it reports the time per operation and, on
+ * Linux, the following counters per operation, read with perf_event_open(2):
+ *
+ *  cycles, instructions, cache misses (usually of the last-level cache), and
+ *  branch misses.
+ *
+ * Counters that cannot be opened (e.g. in a VM, or with a restrictive
+ * kernel.perf_event_paranoid) are reported as "-".
+ *
+ * The difference between a hit in LRUDict and one in dict is mostly the
+ * promotion of the node to the head of the list, which touches the node and
+ * its two neighbours. With many items in random order, those are cache misses,
+ * and they show up in the miss count per hit.
+ *
+ * Build with "python setup.py build_ext --inplace build_cbench", which puts
+ * the executable in build/. Usage:
+ *
+ *  build/slot_bench [-n ITEMS] [-r ROUNDS] [-k int|str] [-p PATH]
+ *
+ * where PATH is the directory to import lru_ng from (default: the current
+ * directory).
+ */
+#define PY_SSIZE_T_CLEAN
+#include "Python.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#define HAVE_PERF_EVENT 1
+#endif
+
+
+#define N_COUNTERS 4
+
+
+static const char *counter_names[N_COUNTERS] = {
+    "cycles", "instr", "cache-miss", "br-miss",
+};
+
+
+typedef struct {
+    int fd[N_COUNTERS];
+    double value[N_COUNTERS];   /* scaled; -1 if unavailable */
+} counters;
+
+
+#ifdef HAVE_PERF_EVENT
+static const uint64_t counter_configs[N_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+
+static void
+counters_open(counters *c)
+{
+    for (int i = 0; i < N_COUNTERS; i++) {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = counter_configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        /* The counters are opened separately rather than as a group, so that
+         * those available are used even if some are not. They may then be
+         * multiplexed, and are scaled by the time they ran. */
+        attr.read_format = (PERF_FORMAT_TOTAL_TIME_ENABLED |
+                            PERF_FORMAT_TOTAL_TIME_RUNNING);
+        c->fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+
+static void
+counters_start(counters *c)
+{
+    for (int i = 0; i < N_COUNTERS; i++) {
+        if (c->fd[i] >= 0) {
+            ioctl(c->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(c->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+
+static void
+counters_stop(counters *c)
+{
+    for (int i = 0; i < N_COUNTERS; i++) {
+        uint64_t buf[3];    /* value, time enabled, time running */
+
+        c->value[i] = -1.0;
+        if (c->fd[i] < 0) {
+            continue;
+        }
+        ioctl(c->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(c->fd[i], buf, sizeof(buf)) == (ssize_t)sizeof(buf) &&
+            buf[2] > 0)
+        {
+            c->value[i] = (double)buf[0] * ((double)buf[1] / (double)buf[2]);
+        }
+    }
+}
+
+
+static void
+counters_close(counters *c)
+{
+    for (int i = 0; i < N_COUNTERS; i++) {
+        if (c->fd[i] >= 0) {
+            close(c->fd[i]);
+        }
+    }
+}
+#else
+static void
+counters_open(counters *c)
+{
+    for (int i = 0; i < N_COUNTERS; i++) {
+        c->fd[i] = -1;
+    }
+}
+
+
+static void counters_start(counters *c) { (void)c; }
+
+
+static void
+counters_stop(counters *c)
+{
+    for (int i = 0; i < N_COUNTERS; i++) {
+        c->value[i] = -1.0;
+    }
+}
+
+
+static void counters_close(counters *c) { (void)c; }
+#endif
+
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+
+/* Benchmark state. keys has 2 * n items: the first n fill the cache and the
+ * rest are absent from it. order is a random permutation of the first n. */
+typedef struct {
+    Py_ssize_t n;
+    long rounds;
+    PyObject **keys;
+    PyObject **order;
+    PyObject **missing;
+} bench;
+
+
+/* A case runs one kind of operation on obj, and returns the number of
+ * operations, or -1 on error. */
+typedef long (*case_func)(const bench *b, PyObject *obj);
+
+
+static long
+case_hit(const bench *b, PyObject *obj)
+{
+    binaryfunc subscript = Py_TYPE(obj)->tp_as_mapping->mp_subscript;
+
+    for (long r = 0; r < b->rounds; r++) {
+        for (Py_ssize_t i = 0; i < b->n; i++) {
+            PyObject *v = subscript(obj, b->order[i]);
+
+            if (v == NULL) {
+                return -1;
+            }
+            Py_DECREF(v);
+        }
+    }
+    return b->rounds * (long)b->n;
+}
+
+
+static long
+case_miss(const bench *b, PyObject *obj)
+{
+    binaryfunc subscript = Py_TYPE(obj)->tp_as_mapping->mp_subscript;
+
+    for (long r = 0; r < b->rounds; r++) {
+        for (Py_ssize_t i = 0; i < b->n; i++) {
+            PyObject *v = subscript(obj, b->missing[i]);
+
+            if (v != NULL || !PyErr_ExceptionMatches(PyExc_KeyError)) {
+                Py_XDECREF(v);
+                return -1;
+            }
+            PyErr_Clear();
+        }
+    }
+    return b->rounds * (long)b->n;
+}
+
+
+static long
+case_replace(const bench *b, PyObject *obj)
+{
+    objobjargproc ass = Py_TYPE(obj)->tp_as_mapping->mp_ass_subscript;
+
+    for (long r = 0; r < b->rounds; r++) {
+        for (Py_ssize_t i = 0; i < b->n; i++) {
+            if (ass(obj, b->order[i], b->order[i]) < 0) {
+                return -1;
+            }
+        }
+    }
+    return b->rounds * (long)b->n;
+}
+
+
+/* Insert keys that are not in the full cache, each evicting the LRU one. Going
+ * through all 2n keys in turn, each key has been evicted by its next turn. */
+static long
+case_insert_evict(const bench *b, PyObject *obj)
+{
+    objobjargproc ass = Py_TYPE(obj)->tp_as_mapping->mp_ass_subscript;
+
+    for (long r = 0; r < b->rounds; r++) {
+        for (Py_ssize_t i = 0; i < 2 * b->n; i++) {
+            PyObject *k = b->keys[(i + b->n) % (2 * b->n)];
+
+            if (ass(obj, k, k) < 0) {
+                return -1;
+            }
+        }
+    }
+    return b->rounds * 2 * (long)b->n;
+}
+
+
+static const struct {
+    const char *name;
+    case_func func;
+    int evicts;     /* not applicable to dict */
+} cases[] = {
+    {"subscript hit", case_hit, 0},
+    {"subscript miss", case_miss, 0},
+    {"replace", case_replace, 0},
+    {"insert evict", case_insert_evict, 1},
+};
+
+
+/* New full cache of the type (or a dict if type is NULL). */
+static PyObject *
+make_filled(const bench *b, PyObject *type)
+{
+    PyObject *obj = (type == NULL ? PyDict_New()
+                     : PyObject_CallFunction(type, "n", b->n));
+
+    if (obj == NULL) {
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < b->n; i++) {
+        if (PyObject_SetItem(obj, b->keys[i], b->keys[i]) < 0) {
+            Py_DECREF(obj);
+            return NULL;
+        }
+    }
+    return obj;
+}
+
+
+static uint64_t
+xorshift64(uint64_t *s)
+{
+    uint64_t x = *s;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+
+static int
+bench_init(bench *b, Py_ssize_t n, long rounds, int str_keys)
+{
+    uint64_t seed = 0x9E3779B97F4A7C15u;
+
+    b->n = n;
+    b->rounds = rounds;
+    b->keys = PyMem_Calloc(2 * (size_t)n, sizeof(PyObject *));
+    b->order = PyMem_Calloc((size_t)n, sizeof(PyObject *));
+    if (b->keys == NULL || b->order == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    b->missing = b->keys + n;
+    for (Py_ssize_t i = 0; i < 2 * n; i++) {
+        b->keys[i] = (str_keys ? PyUnicode_FromFormat("key-%zd", i)
+                      : PyLong_FromSsize_t(i * 7919));
+        if (b->keys[i] == NULL) {
+            return -1;
+        }
+    }
+    memcpy(b->order, b->keys, (size_t)n * sizeof(PyObject *));
+    for (Py_ssize_t i = n - 1; i > 0; i--) {
+        Py_ssize_t j = (Py_ssize_t)(xorshift64(&seed) % (uint64_t)(i + 1));
+        PyObject *t = b->order[i];
+
+        b->order[i] = b->order[j];
+        b->order[j] = t;
+    }
+    return 0;
+}
+
+
+static void
+bench_fini(bench *b)
+{
+    if (b->keys != NULL) {
+        for (Py_ssize_t i = 0; i < 2 * b->n; i++) {
+            Py_XDECREF(b->keys[i]);
+        }
+    }
+    PyMem_Free(b->keys);
+    PyMem_Free(b->order);
+}
+
+
+static void
+print_value(double v, long ops)
+{
+    if (v < 0) {
+        printf(" %11s", "-");
+    }
+    else {
+        printf(" %11.2f", v / (double)ops);
+    }
+}
+
+
+static int
+run_case(const bench *b, const char *target, PyObject *type, int i)
+{
+    counters c;
+    PyObject *obj;
+    double t;
+    long ops;
+
+    if ((obj = make_filled(b, type)) == NULL) {
+        return -1;
+    }
+    counters_open(&c);
+    t = now();
+    counters_start(&c);
+    ops = cases[i].func(b, obj);
+    counters_stop(&c);
+    t = now() - t;
+    counters_close(&c);
+    Py_DECREF(obj);
+    if (ops < 0) {
+        return -1;
+    }
+
+    printf("%-12s %-15s %9.1f", target, cases[i].name, t * 1e9 / ops);
+    for (int j = 0; j < N_COUNTERS; j++) {
+        print_value(c.value[j], ops);
+    }
+    printf("\n");
+    return 0;
+}
+
+
+static int
+run_all(const bench *b, const char *path)
+{
+    static const char *targets[] = {"LRUDict", "dict"};
+    PyObject *sys_path, *p, *mod;
+    int status = 0;
+
+    sys_path = PySys_GetObject("path");     /* borrowed */
+    if (sys_path == NULL || (p = PyUnicode_DecodeFSDefault(path)) == NULL) {
+        return -1;
+    }
+    status = PyList_Insert(sys_path, 0, p);
+    Py_DECREF(p);
+    if (status < 0 || (mod = PyImport_ImportModule("lru_ng")) == NULL) {
+        return -1;
+    }
+
+    printf("%-12s %-15s %9s", "target", "case", "ns/op");
+    for (int j = 0; j < N_COUNTERS; j++) {
+        printf(" %11s", counter_names[j]);
+    }
+    printf("\n");
+
+    for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+        int is_dict = (strcmp(targets[t], "dict") == 0);
+        PyObject *type = NULL;
+
+        if (!is_dict &&
+            (type = PyObject_GetAttrString(mod, targets[t])) == NULL)
+        {
+            status = -1;
+            break;
+        }
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            if (is_dict && cases[i].evicts) {
+                continue;
+            }
+            if ((status = run_case(b, targets[t], type, (int)i)) < 0) {
+                break;
+            }
+        }
+        Py_XDECREF(type);
+        if (status < 0) {
+            break;
+        }
+    }
+    Py_DECREF(mod);
+    return status;
+}
+
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-n ITEMS] [-r ROUNDS] [-k int|str] [-p PATH]\n",
+            prog);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    Py_ssize_t n = 100000;
+    long rounds = 10;
+    int str_keys = 0;
+    const char *path = ".";
+    bench b = {0, 0, NULL, NULL, NULL};
+    int opt, status;
+
+    while ((opt = getopt(argc, argv, "n:r:k:p:")) != -1) {
+        switch (opt) {
+        case 'n':
+            n = (Py_ssize_t)strtol(optarg, NULL, 10);
+            break;
+        case 'r':
+            rounds = strtol(optarg, NULL, 10);
+            break;
+        case 'k':
+            str_keys = (strcmp(optarg, "str") == 0);
+            break;
+        case 'p':
+            path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (n <= 0 || rounds <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    Py_Initialize();
+    printf("Python %s, %zd %s keys, %ld rounds\n", Py_GetVersion(), n,
+           str_keys ? "str" : "int", rounds);
+    status = bench_init(&b, n, rounds, str_keys);
+    if (status == 0) {
+        status = run_all(&b, path);
+    }
+    if (status < 0) {
+        PyErr_Print();
+    }
+    bench_fini(&b);
+    if (Py_FinalizeEx() < 0) {
+        status = -1;
+    }
+    return status < 0 ? 1 : 0;
+}
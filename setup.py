@@ -1,17 +1,186 @@
+import glob
+import os
+import platform
+import shlex
+import shutil
+import subprocess
+import sys
+import sysconfig
 try:
-    from setuptools import Extension, setup
+    from setuptools import Command, Extension, setup
+    from setuptools.command.build_ext import build_ext
 except ModuleNotFoundError:
-    from distutils.core import Extension, setup
+    from distutils.core import Command, Extension, setup
+    from distutils.command.build_ext import build_ext
+
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+PGO_WORKLOAD = os.path.join(HERE, "bench", "pgo_train.py")
+CBENCH_SOURCE = os.path.join(HERE, "bench", "slot_bench.c")
 
 
 modextension = Extension("lru_ng",
                          sources=["src/lrudict.c",
-                                  "src/lrudict_pq.c"],
+                                  "src/lrudict_pq.c",
+                                  "src/lrudict_shm.c",
+                                  "src/lrudict_trace.c",
+                                  "src/lrudict_sim.c",
+                                  "src/lrudict_hot.c",
+                                  "src/lrudict_lat.c"],
                          depends=["src/lrudict.h",
                                   "src/tinyset.c",
                                   "src/lrudict_exctype.h",
                                   "src/lrudict_statstype.h",
-                                  "src/lrudict_pq.h"])
+                                  "src/lrudict_pq.h",
+                                  "src/lrudict_shm.h",
+                                  "src/lrudict_trace.h",
+                                  "src/lrudict_sim.h",
+                                  "src/lrudict_hot.h",
+                                  "src/lrudict_lat.h",
+                                  "src/lrudict_probes.h",
+                                  "src/lru_ng_capi.h",
+                                  "src/lrung_core.h"],
+                         # shm_open() lives in librt with older glibc.
+                         libraries=(["rt"] if sys.platform.startswith("linux")
+                                    else []))
+
+
+class build_ext_pgo(build_ext):
+    """Build the extension as usual, unless the environment variable LRU_NG_PGO
+    is set to a non-empty value. In that case, build it three times: with the
+    default flags, as the baseline; instrumented, to collect a profile by
+    running the workload in bench/pgo_train.py; and with profile-guided and
+    link-time optimization. Then report the speedup of the last build over the
+    baseline on the same workload.
+
+    GCC and Clang (with llvm-profdata) are supported; with other compilers, the
+    build goes on without PGO.
+    """
+
+    def build_extensions(self):
+        kind = os.environ.get("LRU_NG_PGO") and self._pgo_compiler_kind()
+        if not kind:
+            if os.environ.get("LRU_NG_PGO"):
+                self.warn("LRU_NG_PGO: unsupported compiler, building"
+                          " without PGO")
+            build_ext.build_extensions(self)
+            return
+        for ext in self.extensions:
+            self._build_pgo(ext, kind)
+
+    def _pgo_compiler_kind(self):
+        if self.compiler.compiler_type != "unix":
+            return None
+        try:
+            out = subprocess.run([self.compiler.compiler_so[0], "--version"],
+                                 stdout=subprocess.PIPE,
+                                 stderr=subprocess.STDOUT).stdout.decode()
+        except OSError:
+            return None
+        if "clang" in out:
+            return "clang" if shutil.which("llvm-profdata") else None
+        if "Free Software Foundation" in out:
+            return "gcc"
+        return None
+
+    def _build_stage(self, ext, build_temp, extra_args):
+        saved = (self.build_temp, ext.extra_compile_args, ext.extra_link_args)
+        self.build_temp = build_temp
+        ext.extra_compile_args = list(saved[1]) + extra_args
+        ext.extra_link_args = list(saved[2]) + extra_args
+        # Always rebuild, as the sources did not change between stages.
+        self.force = self.compiler.force = True
+        try:
+            self.build_extension(ext)
+        finally:
+            self.build_temp, ext.extra_compile_args, ext.extra_link_args = saved
+
+    def _run_workload(self, path, *args):
+        out = subprocess.run([sys.executable, PGO_WORKLOAD, "--path", path] +
+                             list(args), stdout=subprocess.PIPE,
+                             check=True).stdout
+        return float(out) if args else None
+
+    def _build_pgo(self, ext, kind):
+        target = self.get_ext_fullpath(ext.name)
+        out_dir = os.path.dirname(os.path.abspath(target))
+        base_dir = os.path.abspath(os.path.join(self.build_temp, "pgo-base"))
+        profile_dir = os.path.abspath(os.path.join(self.build_temp,
+                                                   "pgo-profile"))
+        # The instrumented and the final stage must compile to the same object
+        # paths, which GCC uses to name the profile data files.
+        pgo_temp = os.path.join(self.build_temp, "pgo")
+        for d in (base_dir, profile_dir):
+            shutil.rmtree(d, ignore_errors=True)
+            os.makedirs(d)
+
+        self._build_stage(ext, self.build_temp, [])
+        shutil.copy(target, base_dir)
+
+        self._build_stage(ext, pgo_temp, ["-fprofile-generate=" + profile_dir])
+        self._run_workload(out_dir)
+
+        if kind == "clang":
+            profdata = os.path.join(profile_dir, "merged.profdata")
+            self.spawn(["llvm-profdata", "merge", "-output=" + profdata] +
+                       glob.glob(os.path.join(profile_dir, "*.profraw")))
+            use = ["-fprofile-use=" + profdata]
+        else:
+            use = ["-fprofile-use=" + profile_dir, "-fprofile-correction"]
+        self._build_stage(ext, pgo_temp, use + ["-flto"])
+
+        # Alternate the timing runs, so that both builds see the same noise.
+        t_base = t_opt = float("inf")
+        for _ in range(3):
+            t_base = min(t_base, self._run_workload(base_dir, "--time"))
+            t_opt = min(t_opt, self._run_workload(out_dir, "--time"))
+        print("LRU_NG_PGO: workload time %.3f s with default flags, %.3f s"
+              " with PGO and LTO (speedup x%.2f)"
+              % (t_base, t_opt, t_base / t_opt))
+
+
+class build_cbench(Command):
+    """Build the C-level benchmark driver bench/slot_bench.c, which embeds the
+    interpreter, into build/slot_bench. It imports lru_ng at run time, so build
+    the extension (e.g. with build_ext --inplace) to run it."""
+
+    description = "build the C benchmark driver bench/slot_bench.c"
+    user_options = []
+
+    def initialize_options(self):
+        pass
+
+    def finalize_options(self):
+        pass
+
+    def run(self):
+        cfg = sysconfig.get_config_var
+        out_dir = os.path.join(HERE, "build")
+        os.makedirs(out_dir, exist_ok=True)
+        libs = ["-L" + cfg("LIBPL"), "-L" + cfg("LIBDIR"),
+                "-lpython" + cfg("LDVERSION")]
+        if cfg("Py_ENABLE_SHARED"):
+            libs.append("-Wl,-rpath," + cfg("LIBDIR"))
+        for var in ("LIBS", "SYSLIBS", "LINKFORSHARED"):
+            libs += shlex.split(cfg(var) or "")
+        self.spawn(shlex.split(cfg("CC")) +
+                   ["-O2", "-g", "-I", sysconfig.get_paths()["include"],
+                    CBENCH_SOURCE, "-o", os.path.join(out_dir, "slot_bench")] +
+                   libs)
+
+
+if platform.python_implementation() == "CPython":
+    backend = {"ext_modules": [modextension],
+               "cmdclass": {"build_ext": build_ext_pgo,
+                            "build_cbench": build_cbench}}
+else:
+    # The extension relies on CPython internals. Elsewhere (e.g. PyPy), a
+    # Python module provides LRUDict over the C core, compiled with cffi.
+    backend = {"package_dir": {"": "src/cffi"},
+               "py_modules": ["lru_ng"],
+               "cffi_modules": ["src/cffi/lru_ng_build.py:ffibuilder"],
+               "setup_requires": ["cffi>=1.0.0"],
+               "install_requires": ["cffi>=1.0.0"]}
 
 
 setup(name="lru_ng",
@@ -35,7 +204,6 @@ setup(name="lru_ng",
       url="https://github.com/congma/lru_ng",
       license="GNU GPL 3",
       keywords=["mapping", "container", "dict", "cache", "lru"],
-      ext_modules=[modextension],
       classifiers=[
           "Development Status :: 4 - Beta",
           "Intended Audience :: Developers",
@@ -48,5 +216,11 @@ setup(name="lru_ng",
           "Programming Language :: Python :: 3.7",
           "Programming Language :: Python :: 3.8",
           "Programming Language :: Python :: 3.9",
+          "Programming Language :: Python :: 3.10",
+          "Programming Language :: Python :: 3.11",
+          "Programming Language :: Python :: 3.12",
+          "Programming Language :: Python :: 3.13",
           "Programming Language :: Python :: Implementation :: CPython",
-          "Topic :: Software Development :: Libraries :: Python Modules"])
+          "Programming Language :: Python :: Implementation :: PyPy",
+          "Topic :: Software Development :: Libraries :: Python Modules"],
+      **backend)
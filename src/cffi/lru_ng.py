@@ -0,0 +1,827 @@
+"""lru_ng for Python implementations other than CPython, such as PyPy.
+
+This module provides the same LRUDict API as the C extension, on top of the
+lrung core compiled with cffi (see lru_ng_build.py). Keys are mapped to integer
+ids by a dict; the core keeps the ids in recency order and picks the ones to
+evict. Keys and values themselves never leave Python.
+
+Unlike the C extension, the methods are not atomic by virtue of the GIL, so the
+critical section is also a lock between threads. Reentrance from the same
+thread (e.g. through a key's __hash__ or __eq__) raises LRUDictBusyError as
+before. Freezing does not make anything immortal, and the C API capsule and
+SharedLRUCache are not available.
+"""
+import collections
+import operator
+import sys
+import threading
+import time
+import weakref
+from _lru_ng_cffi import ffi, lib
+
+
+__all__ = ["LRUDict", "LRUDictBusyError", "instances"]
+
+
+class LRUDictBusyError(RuntimeError):
+    """Exception indicating an LRUDict method cannot begin operation because
+    another method has not finished"""
+
+
+LRUDictStats = collections.namedtuple("LRUDictStats", ["hits", "misses"])
+LRUDictExtStats = collections.namedtuple(
+    "LRUDictExtStats",
+    ["hits", "misses", "contains_true", "contains_false", "inserts",
+     "replacements", "deletions", "evictions", "evictions_staged",
+     "evictions_direct", "purges", "callbacks", "callback_errors",
+     "evictions_dropped", "purge_queue_peak"])
+LRUDictInfo = collections.namedtuple(
+    "LRUDictInfo",
+    ["name", "size", "len", "hits", "misses", "evictions",
+     "purge_queue_len"])
+
+
+_MISSING = object()
+_MAX_PENDING_DEFAULT = 8192
+_MAX_PENDING_LIMIT = 65535
+_OVERFLOW_POLICIES = ("purge", "drop", "raise")
+# Shrinking by at least this many items without a callback releases them
+# together after leaving the critical section; as in the C module.
+_SHRINK_BULK_MIN = 64
+# Exceptions from a callback that are passed on instead of suppressed.
+_CALLBACK_FATAL = (RecursionError, SystemError, MemoryError, SystemExit)
+# Types whose release runs no other code, so that evicting them without a
+# callback need not be staged; as in the C module.
+_SAFE_TYPES = frozenset((type(None), str, int, bytes, bytearray, bool, float,
+                         complex))
+# Live LRUDict objects by id(), for instances(). LRUDict is unhashable, so a
+# WeakSet cannot hold it.
+_registry = weakref.WeakValueDictionary()
+
+
+def _write_unraisable(exc, obj):
+    hook = getattr(sys, "unraisablehook", None)
+    if hook is not None:
+        args = _UnraisableArgs(type(exc), exc, exc.__traceback__, None, obj)
+        try:
+            hook(args)
+            return
+        except Exception:
+            pass
+    print("Exception ignored in: %r" % (obj,), file=sys.stderr)
+    sys.excepthook(type(exc), exc, exc.__traceback__)
+
+
+_UnraisableArgs = collections.namedtuple(
+    "UnraisableHookArgs",
+    ["exc_type", "exc_value", "exc_traceback", "err_msg", "object"])
+
+
+def _check_size(value):
+    n = operator.index(value)
+    if n > sys.maxsize:
+        raise OverflowError("size is greater than sys.maxsize")
+    if n <= 0:
+        raise ValueError("size must be positive")
+    return n
+
+
+def _check_bound(value, name):
+    if value is None:
+        return None
+    if not isinstance(value, int):
+        raise TypeError("%s must be an integer or None" % name)
+    if value < 1:
+        raise ValueError("%s must be positive" % name)
+    return value
+
+
+class LRUDict(object):
+    """LRUDict(size, callback=None) -> new LRUDict that can store up to
+    ``size`` elements
+
+    An LRUDict behaves like a Python ``dict``, except that it stores only a
+    fixed number of key-value pairs. Once the number of stored elements goes
+    beyond the capacity, it evicts the least-recently used items. If a
+    callback is set, it will be called with the evicted key and item and they
+    exit the LRUDict.
+    """
+
+    __hash__ = None
+
+    def __init__(self, size, callback=None, *, name=None, reserve=None):
+        if getattr(self, "_frozen", False):
+            self._fail_if_frozen()
+        capacity = _check_size(size)
+        if name is not None and not isinstance(name, str):
+            raise TypeError("name must be str or None, not %s" %
+                            type(name).__name__)
+        if reserve is not None and operator.index(reserve) < 0:
+            raise ValueError("reserve must not be negative")
+        self._cache = ffi.gc(lib.lrung_id_new(capacity), lib.lrung_free)
+        if self._cache == ffi.NULL:
+            raise MemoryError("core cache allocation failure")
+        self._capacity = capacity
+        self._ids = {}          # key -> id
+        self._keys = [None]     # id -> key; id 0 is never used
+        self._values = [None]   # id -> value
+        self._free_ids = []
+        self._staged = collections.deque()
+        self._n_active = 0
+        self._max_pending = _MAX_PENDING_DEFAULT
+        self._max_staged = None
+        self._overflow = "purge"
+        self._purge_due = False
+        self._purge_budget = None
+        self._purge_budget_us = None
+        self._lock = threading.Lock()
+        self._owner = None
+        self._hits = 0
+        self._misses = 0
+        # Counters of get_ext_stats() that are not derived from others, and
+        # the hits and misses at the last clear().
+        self._xstats = collections.Counter()
+        # Hot-key tracker: key hash -> [key, count, error], and the keys of
+        # replaced counters, released outside the critical section.
+        self._hot = None
+        self._hot_k = 0
+        self._hot_retired = []
+        # Evicted items released right after leaving the critical section.
+        self._garbage = []
+        self._purge_suspended = False
+        self._detect_conflict_flag = True
+        self._frozen = False
+        self._callback = None
+        self.set_callback(callback)
+        self._name = name
+        _registry[id(self)] = self
+
+    # Critical section: blocks other threads, fails on reentrance.
+    def _enter(self):
+        me = threading.get_ident()
+        if self._owner == me:
+            if self._detect_conflict_flag:
+                raise LRUDictBusyError("attempted entry into LRUDict critical"
+                                       " section while busy")
+            return False
+        self._lock.acquire()
+        self._owner = me
+        return True
+
+    def _leave(self, acquired):
+        if acquired:
+            self._owner = None
+            self._lock.release()
+            # Where their finalizers may use self.
+            if self._garbage:
+                garbage, self._garbage = self._garbage, []
+                del garbage
+
+    def _fail_if_frozen(self):
+        if self._frozen:
+            raise TypeError("LRUDict instance is frozen and cannot be"
+                            " modified")
+
+    # Internal helpers; must be called within the critical section.
+    def _new_id(self, key, value):
+        if self._free_ids:
+            i = self._free_ids.pop()
+            self._keys[i] = key
+            self._values[i] = value
+        else:
+            i = len(self._keys)
+            self._keys.append(key)
+            self._values.append(value)
+        return i
+
+    def _release_id(self, i):
+        key = self._keys[i]
+        value = self._values[i]
+        self._keys[i] = self._values[i] = None
+        self._free_ids.append(i)
+        return key, value
+
+    def _count_hot(self, key):
+        hot = self._hot
+        if hot is None:
+            return
+        kh = hash(key)
+        counter = hot.get(kh)
+        if counter is not None:
+            counter[1] += 1
+        elif len(hot) < self._hot_k:
+            hot[kh] = [key, 1, 0]
+        else:
+            least = min(hot, key=lambda h: hot[h][1])
+            old_key, count, _ = hot.pop(least)
+            self._hot_retired.append(old_key)
+            hot[kh] = [key, count + 1, count]
+
+    def _flush_hot(self):
+        if self._hot_retired:
+            del self._hot_retired[:]
+
+    def _set_impl(self, key, value):
+        i = self._ids.get(key)
+        if i is not None:
+            self._values[i] = value
+            lib.lrung_id_touch(self._cache, i)
+            self._xstats["replacements"] += 1
+            self._count_hot(key)
+            return
+        if len(self._ids) >= self._capacity:
+            self._check_overflow(1)
+        i = self._new_id(key, value)
+        if lib.lrung_id_set(self._cache, i) == -1:
+            self._release_id(i)
+            raise MemoryError("core cache insertion failure")
+        self._ids[key] = i
+        self._xstats["inserts"] += 1
+        self._count_hot(key)
+        self._take_evicted()
+
+    def _evict_staged(self, key, value):
+        return (self._callback is not None or type(key) not in _SAFE_TYPES or
+                type(value) not in _SAFE_TYPES)
+
+    # Whether evicting the k least recently used items would stage more than
+    # max_staged under the "raise" policy.
+    def _check_overflow(self, k):
+        if self._overflow != "raise" or self._max_staged is None:
+            return
+        room = self._max_staged - len(self._staged)
+        if room >= k:
+            return
+        if self._callback is None:
+            buf = ffi.new("size_t[]", k)
+            n = lib.lrung_id_dump(self._cache, buf, k, True)
+            k = sum(self._evict_staged(self._keys[buf[j]], self._values[buf[j]])
+                    for j in range(n))
+        if room < k:
+            raise LRUDictBusyError("purge queue is full")
+
+    def _stage_quota(self):
+        if self._max_staged is None:
+            return True
+        room = self._max_staged - len(self._staged)
+        if room > 1:
+            return True
+        if self._overflow == "purge":
+            self._purge_due = True
+        return self._overflow == "raise" or room > 0
+
+    # Under the "purge" policy, purge a full queue before an operation that
+    # may evict, even if purging is suspended.
+    def _make_room(self):
+        if (self._overflow == "purge" and self._max_staged is not None and
+                len(self._staged) >= self._max_staged):
+            self._purge_due = True
+            self._purge_impl()
+
+    def _staging_pressed(self):
+        return self._max_staged is not None and (
+            self._purge_due or (not self._purge_suspended and
+                                len(self._staged) >= self._max_staged))
+
+    def _take_evicted(self, bulk=False):
+        while True:
+            i = lib.lrung_id_take_staged(self._cache)
+            if i == 0:
+                break
+            key, value = self._release_id(i)
+            del self._ids[key]
+            if bulk:
+                self._garbage.append((key, value))
+                self._xstats["evictions_direct"] += 1
+                continue
+            stage = self._evict_staged(key, value)
+            if stage and not self._stage_quota():
+                self._garbage.append((key, value))
+                self._xstats["evictions_direct"] += 1
+                self._xstats["evictions_dropped"] += 1
+            elif stage:
+                self._staged.append((key, value))
+                self._xstats["evictions_staged"] += 1
+                if len(self._staged) > self._xstats["purge_queue_peak"]:
+                    self._xstats["purge_queue_peak"] = len(self._staged)
+            else:
+                self._xstats["evictions_direct"] += 1
+
+    def _pop_impl(self, key):
+        i = self._ids.pop(key)
+        lib.lrung_id_pop(self._cache, i)
+        self._xstats["deletions"] += 1
+        return self._release_id(i)[1]
+
+    def _purge_impl(self, force=False):
+        if self._purge_suspended and not force and not self._purge_due:
+            return 0
+        self._purge_due = False
+        if not self._staged:
+            return 0
+        if self._n_active >= self._max_pending:
+            return 0
+        n = 0
+        # Only an automatic purge is on a budget.
+        budget = None if force else self._purge_budget
+        deadline = None
+        if not force and self._purge_budget_us is not None:
+            deadline = time.perf_counter() + self._purge_budget_us / 1e6
+        self._xstats["purges"] += 1
+        self._n_active += 1
+        try:
+            while budget is None or n < budget:
+                if (n > 0 and deadline is not None and
+                        time.perf_counter() >= deadline):
+                    break
+                try:
+                    key, value = self._staged.popleft()
+                except IndexError:
+                    break
+                n += 1
+                callback = self._callback
+                if callback is None:
+                    continue
+                self._xstats["callbacks"] += 1
+                try:
+                    callback(key, value)
+                except _CALLBACK_FATAL:
+                    self._xstats["callback_errors"] += 1
+                    raise
+                except BaseException as exc:
+                    self._xstats["callback_errors"] += 1
+                    _write_unraisable(exc, callback)
+        finally:
+            self._n_active -= 1
+        return n
+
+    def _ids_in_order(self, lru_first=False):
+        n = lib.lrung_len(self._cache)
+        buf = ffi.new("size_t[]", n)
+        n = lib.lrung_id_dump(self._cache, buf, n, lru_first)
+        return [buf[i] for i in range(n)]
+
+    # Mapping protocol
+    def __len__(self):
+        return len(self._ids)
+
+    def __contains__(self, key):
+        acquired = self._enter()
+        try:
+            found = key in self._ids
+            self._xstats["contains_true" if found else "contains_false"] += 1
+            return found
+        finally:
+            self._leave(acquired)
+
+    def has_key(self, key):
+        return self.__contains__(key)
+
+    def _lookup(self, key):
+        # Return the value for key, counting a hit, or _MISSING, counting a
+        # miss.
+        acquired = self._enter()
+        try:
+            i = self._ids.get(key)
+            if i is None:
+                self._misses += 1
+                return _MISSING
+            self._hits += 1
+            if not self._frozen:
+                lib.lrung_id_touch(self._cache, i)
+            return self._values[i]
+        finally:
+            if not self._frozen:
+                self._count_hot(key)
+            self._leave(acquired)
+            self._flush_hot()
+
+    def __getitem__(self, key):
+        value = self._lookup(key)
+        if value is _MISSING:
+            raise KeyError(key)
+        return value
+
+    def get(self, key, default=None):
+        value = self._lookup(key)
+        return default if value is _MISSING else value
+
+    def __setitem__(self, key, value):
+        self._fail_if_frozen()
+        self._make_room()
+        acquired = self._enter()
+        try:
+            self._set_impl(key, value)
+        finally:
+            self._leave(acquired)
+            self._flush_hot()
+        self._purge_impl()
+
+    def __delitem__(self, key):
+        self._fail_if_frozen()
+        acquired = self._enter()
+        try:
+            if not self._ids:
+                hash(key)   # unhashable is TypeError even when empty
+            self._pop_impl(key)
+        finally:
+            self._leave(acquired)
+
+    def setdefault(self, key, default=None):
+        if not self._frozen:
+            self._make_room()
+        acquired = self._enter()
+        try:
+            i = self._ids.get(key)
+            if i is not None:
+                self._hits += 1
+                if not self._frozen:
+                    lib.lrung_id_touch(self._cache, i)
+                return self._values[i]
+            self._fail_if_frozen()
+            self._set_impl(key, default)
+        finally:
+            self._leave(acquired)
+        self._purge_impl()
+        return default
+
+    def pop(self, key, *default):
+        if len(default) > 1:
+            raise TypeError("pop expected at most 2 arguments, got %d"
+                            % (len(default) + 1))
+        self._fail_if_frozen()
+        acquired = self._enter()
+        try:
+            try:
+                value = self._pop_impl(key)
+            except KeyError:
+                self._misses += 1
+                if default:
+                    return default[0]
+                raise
+            self._hits += 1
+            return value
+        finally:
+            self._leave(acquired)
+
+    def popitem(self, least_recent=False):
+        self._fail_if_frozen()
+        acquired = self._enter()
+        try:
+            if least_recent:
+                i = lib.lrung_id_last(self._cache)
+            else:
+                i = lib.lrung_id_first(self._cache)
+            if i == 0:
+                raise KeyError("popitem(): LRUDict instance is empty")
+            lib.lrung_id_pop(self._cache, i)
+            key, value = self._release_id(i)
+            del self._ids[key]
+            self._xstats["deletions"] += 1
+            return key, value
+        finally:
+            self._leave(acquired)
+
+    def update(self, *args, **kwargs):
+        if len(args) > 1:
+            raise TypeError("update() takes at most one positional-only"
+                            " parameter")
+        self._fail_if_frozen()
+        try:
+            for src in (args[0] if args else None, kwargs):
+                if not isinstance(src, dict):
+                    continue
+                items = iter(src.items())
+                pressed = True
+                while pressed:
+                    self._make_room()
+                    acquired = self._enter()
+                    try:
+                        pressed = False
+                        for key, value in items:
+                            self._set_impl(key, value)
+                            if self._staging_pressed():
+                                pressed = True
+                                break
+                    finally:
+                        self._leave(acquired)
+                        self._flush_hot()
+                    if pressed:
+                        self._purge_impl()
+        finally:
+            self._purge_impl()
+
+    def clear(self):
+        self._fail_if_frozen()
+        acquired = self._enter()
+        try:
+            lib.lrung_clear(self._cache)
+            ids = self._ids
+            keys, values = self._keys, self._values
+            self._ids = {}
+            self._keys = [None]
+            self._values = [None]
+            del self._free_ids[:]
+            self._xstats["hits_cleared"] = self._hits
+            self._xstats["misses_cleared"] = self._misses
+        finally:
+            self._leave(acquired)
+        # Let the old contents go outside of the critical section.
+        del ids, keys, values
+
+    def reserve(self, n):
+        # A Python dict cannot be presized.
+        if operator.index(n) < 0:
+            raise ValueError("n must not be negative")
+        self._fail_if_frozen()
+
+    def compact(self):
+        self._fail_if_frozen()
+        acquired = self._enter()
+        try:
+            # A copy is sized to its contents.
+            self._ids = dict(self._ids)
+        finally:
+            self._leave(acquired)
+
+    def keys(self):
+        acquired = self._enter()
+        try:
+            keys = self._keys
+            return [keys[i] for i in self._ids_in_order()]
+        finally:
+            self._leave(acquired)
+
+    def values(self):
+        acquired = self._enter()
+        try:
+            values = self._values
+            return [values[i] for i in self._ids_in_order()]
+        finally:
+            self._leave(acquired)
+
+    def items(self):
+        acquired = self._enter()
+        try:
+            keys, values = self._keys, self._values
+            return [(keys[i], values[i]) for i in self._ids_in_order()]
+        finally:
+            self._leave(acquired)
+
+    def to_dict(self):
+        acquired = self._enter()
+        try:
+            keys, values = self._keys, self._values
+            return {keys[i]: values[i] for i in self._ids_in_order(True)}
+        finally:
+            self._leave(acquired)
+
+    def _peek(self, i, msg):
+        if i == 0:
+            raise KeyError("%s: LRUDict instance is empty" % msg)
+        return self._keys[i], self._values[i]
+
+    def peek_first_item(self):
+        return self._peek(lib.lrung_id_first(self._cache),
+                          "peek_first_item()")
+
+    def peek_last_item(self):
+        return self._peek(lib.lrung_id_last(self._cache), "peek_last_item()")
+
+    def get_stats(self):
+        return LRUDictStats(self._hits - self._xstats["hits_cleared"],
+                            self._misses - self._xstats["misses_cleared"])
+
+    def get_ext_stats(self):
+        x = self._xstats
+        return LRUDictExtStats(
+            self._hits, self._misses, x["contains_true"],
+            x["contains_false"], x["inserts"], x["replacements"],
+            x["deletions"], x["evictions_staged"] + x["evictions_direct"],
+            x["evictions_staged"], x["evictions_direct"], x["purges"],
+            x["callbacks"], x["callback_errors"], x["evictions_dropped"],
+            x["purge_queue_peak"])
+
+    def reset_stats(self):
+        self._hits = self._misses = 0
+        self._xstats = collections.Counter(
+            purge_queue_peak=len(self._staged))
+
+    def track_hot_keys(self, k):
+        k = operator.index(k)
+        if k < 0 or k > 1 << 24:
+            raise ValueError("k must be between 1 and 2**24")
+        acquired = self._enter()
+        try:
+            self._hot_retired.extend((self._hot or {}).values())
+            self._hot = {} if k else None
+            self._hot_k = k
+        finally:
+            self._leave(acquired)
+            self._flush_hot()
+
+    def top_keys(self, n=-1):
+        n = operator.index(n)
+        counters = sorted((self._hot or {}).values(), key=lambda c: c[1],
+                          reverse=True)
+        return [tuple(c) for c in (counters if n < 0 else counters[:n])]
+
+    def purge(self):
+        return self._purge_impl(force=True)
+
+    def freeze(self, immortalize=False):
+        if self._frozen:
+            return
+        self._purge_impl(force=True)
+        self._frozen = True
+
+    # Size and callback
+    @property
+    def size(self):
+        return self._capacity
+
+    @size.setter
+    def size(self, value):
+        if not isinstance(value, int):
+            raise TypeError("size must be an integer")
+        self.set_size(value)
+
+    @size.deleter
+    def size(self):
+        raise AttributeError("can't delete size")
+
+    def get_size(self):
+        return self._capacity
+
+    def set_size(self, size):
+        capacity = _check_size(size)
+        self._fail_if_frozen()
+        # Under the "purge" policy, evict in steps of at most the room left in
+        # the queue, purging after each.
+        step = None
+        while step != capacity:
+            step = capacity
+            if (self._overflow == "purge" and self._max_staged is not None and
+                    self._callback is not None):
+                room = self._max_staged - len(self._staged)
+                if 0 < room < len(self._ids) - capacity:
+                    step = len(self._ids) - room
+            acquired = self._enter()
+            try:
+                k = len(self._ids) - step
+                bulk = k >= _SHRINK_BULK_MIN and self._callback is None
+                if k > 0 and not bulk:
+                    self._check_overflow(k)
+                lib.lrung_resize(self._cache, step)
+                self._capacity = step
+                self._take_evicted(bulk)
+            finally:
+                self._leave(acquired)
+            self._purge_impl()
+
+    @property
+    def callback(self):
+        return self._callback
+
+    @callback.setter
+    def callback(self, value):
+        self.set_callback(value)
+
+    @callback.deleter
+    def callback(self):
+        raise AttributeError("can't delete callback; set it to None to"
+                             " disable")
+
+    def set_callback(self, callback):
+        self._fail_if_frozen()
+        if callback is not None and not callable(callback):
+            raise TypeError("callback object must be callable")
+        self._callback = callback
+
+    @property
+    def max_staged(self):
+        return self._max_staged
+
+    @max_staged.setter
+    def max_staged(self, value):
+        self._max_staged = _check_bound(value, "max_staged")
+
+    @max_staged.deleter
+    def max_staged(self):
+        raise AttributeError("can't delete max_staged")
+
+    @property
+    def purge_budget(self):
+        return self._purge_budget
+
+    @purge_budget.setter
+    def purge_budget(self, value):
+        self._purge_budget = _check_bound(value, "purge_budget")
+
+    @purge_budget.deleter
+    def purge_budget(self):
+        raise AttributeError("can't delete purge_budget")
+
+    @property
+    def purge_budget_us(self):
+        return self._purge_budget_us
+
+    @purge_budget_us.setter
+    def purge_budget_us(self, value):
+        self._purge_budget_us = _check_bound(value, "purge_budget_us")
+
+    @purge_budget_us.deleter
+    def purge_budget_us(self):
+        raise AttributeError("can't delete purge_budget_us")
+
+    @property
+    def overflow(self):
+        return self._overflow
+
+    @overflow.setter
+    def overflow(self, value):
+        if not isinstance(value, str):
+            raise TypeError("overflow must be a str")
+        if value not in _OVERFLOW_POLICIES:
+            raise ValueError("overflow must be 'purge', 'drop', or 'raise'")
+        self._overflow = value
+
+    @overflow.deleter
+    def overflow(self):
+        raise AttributeError("can't delete overflow")
+
+    @property
+    def frozen(self):
+        return self._frozen
+
+    @property
+    def name(self):
+        return self._name
+
+    # Less-common and experimental
+    @property
+    def _suspend_purge(self):
+        return self._purge_suspended
+
+    @_suspend_purge.setter
+    def _suspend_purge(self, value):
+        self._purge_suspended = bool(value)
+
+    @property
+    def _detect_conflict(self):
+        return self._detect_conflict_flag
+
+    @_detect_conflict.setter
+    def _detect_conflict(self, value):
+        self._detect_conflict_flag = bool(value)
+
+    @property
+    def _purge_queue_size(self):
+        return len(self._staged)
+
+    @property
+    def _max_pending_callbacks(self):
+        return self._max_pending
+
+    @_max_pending_callbacks.setter
+    def _max_pending_callbacks(self, value):
+        n = operator.index(value)
+        if not 1 <= n <= _MAX_PENDING_LIMIT:
+            raise ValueError("value must be between 1 and %u"
+                             % _MAX_PENDING_LIMIT)
+        self._max_pending = n
+
+    def __repr__(self):
+        try:
+            dict_repr = repr(dict(self.items()))
+        except Exception:
+            dict_repr = "<error formatting repr>"
+        if len(dict_repr) > 128:
+            dict_repr = "{...}"
+        if self._callback is None:
+            cb_repr = ""
+        else:
+            cb_repr = ", callback=%s" % getattr(self._callback, "__name__",
+                                                repr(self._callback))
+        return "<LRUDict(%d%s) object with dict %s at %#x>" % (
+            self._capacity, cb_repr, dict_repr, id(self))
+
+    def __del__(self):
+        # One last chance to honour any callback.
+        if "_staged" not in self.__dict__:
+            return      # __init__ failed
+        try:
+            self._purge_impl(force=True)
+        except Exception as exc:
+            _write_unraisable(exc, self)
+
+
+def instances():
+    """Return snapshots of the live LRUDict objects."""
+    infos = []
+    for r in list(_registry.values()):
+        x = r._xstats
+        infos.append(LRUDictInfo(
+            r._name, r._capacity, len(r._ids), r._hits, r._misses,
+            x["evictions_staged"] + x["evictions_direct"], len(r._staged)))
+    return infos
@@ -0,0 +1,165 @@
+"""cffi build script for the lru_ng backend used on Python implementations
+other than CPython (such as PyPy), where the C extension cannot be built.
+
+It compiles the lrung core (src/lrung_core.c) into the module _lru_ng_cffi.
+The cache entries there are bare integer ids: the Python side (lru_ng.py in
+this directory) maps keys to ids with a dict, so that hashing and comparison
+stay in Python, and the core keeps the recency order and decides evictions.
+This way no call is made from C back into Python.
+
+Used by setup.py through cffi_modules; it can also be run by itself to build
+the module in place.
+"""
+import os
+from cffi import FFI
+
+
+SRC_DIR = os.path.relpath(os.path.dirname(os.path.dirname(
+    os.path.abspath(__file__))))
+
+
+CDEF = """
+typedef struct _lrung_cache lrung_cache;
+
+lrung_cache *lrung_id_new(size_t capacity);
+void lrung_free(lrung_cache *c);
+void lrung_clear(lrung_cache *c);
+int lrung_resize(lrung_cache *c, size_t capacity);
+size_t lrung_len(const lrung_cache *c);
+
+int lrung_id_touch(lrung_cache *c, size_t id);
+int lrung_id_set(lrung_cache *c, size_t id);
+int lrung_id_pop(lrung_cache *c, size_t id);
+size_t lrung_id_take_staged(lrung_cache *c);
+size_t lrung_id_first(const lrung_cache *c);
+size_t lrung_id_last(const lrung_cache *c);
+size_t lrung_id_dump(const lrung_cache *c, size_t *out, size_t n,
+                     int lru_first);
+"""
+
+
+SOURCE = r"""
+#include "lrung_core.h"
+
+/* Ids are nonzero, so that 0 can mean "none". */
+#define ID_PTR(id)  ((void *)(uintptr_t)(id))
+#define PTR_ID(p)   ((size_t)(uintptr_t)(p))
+
+
+static uint64_t
+lrung_id_hash(const void *key, void *ud)
+{
+    uint64_t x = (uint64_t)(uintptr_t)key;
+    (void)ud;
+    /* Fibonacci hashing; the core masks the low bits. */
+    x *= UINT64_C(0x9E3779B97F4A7C15);
+    return x ^ (x >> 32);
+}
+
+
+static int
+lrung_id_equal(const void *a, const void *b, void *ud)
+{
+    (void)ud;
+    return a == b;
+}
+
+
+/* A cache of ids without any ops but hashing; evictions are staged for good,
+ * to be taken by lrung_id_take_staged(). */
+static lrung_cache *
+lrung_id_new(size_t capacity)
+{
+    lrung_ops ops = {lrung_id_hash, lrung_id_equal, NULL, NULL, NULL, NULL};
+    lrung_cache *c = lrung_new(capacity, &ops);
+
+    if (c != NULL) {
+        lrung_suspend_purge(c, 1);
+    }
+    return c;
+}
+
+
+/* Make id the most recent. Return 1, or 0 if not there. */
+static int
+lrung_id_touch(lrung_cache *c, size_t id)
+{
+    return lrung_get(c, ID_PTR(id), NULL);
+}
+
+
+static int
+lrung_id_set(lrung_cache *c, size_t id)
+{
+    return lrung_set(c, ID_PTR(id), NULL);
+}
+
+
+static int
+lrung_id_pop(lrung_cache *c, size_t id)
+{
+    return lrung_pop(c, ID_PTR(id), NULL, NULL);
+}
+
+
+/* Return the oldest evicted id, or 0 if there is none. */
+static size_t
+lrung_id_take_staged(lrung_cache *c)
+{
+    void *key, *value;
+
+    return lrung_take_staged(c, &key, &value) ? PTR_ID(key) : 0;
+}
+
+
+static size_t
+lrung_id_first(const lrung_cache *c)
+{
+    void *key = NULL;
+
+    lrung_iter_next(c, NULL, &key, NULL);
+    return PTR_ID(key);
+}
+
+
+static size_t
+lrung_id_last(const lrung_cache *c)
+{
+    void *key = NULL;
+
+    lrung_iter_prev(c, NULL, &key, NULL);
+    return PTR_ID(key);
+}
+
+
+/* Write up to n ids to out, in MRU-to-LRU order (or the reverse if lru_first
+ * is nonzero). Return the number written. */
+static size_t
+lrung_id_dump(const lrung_cache *c, size_t *out, size_t n, int lru_first)
+{
+    const void *it = NULL;
+    void *key;
+    size_t i = 0;
+
+    while (i < n) {
+        it = lru_first ? lrung_iter_prev(c, it, &key, NULL)
+                       : lrung_iter_next(c, it, &key, NULL);
+        if (it == NULL) {
+            break;
+        }
+        out[i++] = PTR_ID(key);
+    }
+    return i;
+}
+"""
+
+
+ffibuilder = FFI()
+ffibuilder.cdef(CDEF)
+ffibuilder.set_source("_lru_ng_cffi", SOURCE,
+                      sources=[os.path.join(SRC_DIR, "lrung_core.c")],
+                      include_dirs=[SRC_DIR])
+
+
+if __name__ == "__main__":
+    ffibuilder.compile(verbose=True)
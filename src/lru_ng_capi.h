@@ -0,0 +1,130 @@
+#ifndef LRU_NG_CAPI_H
+#define LRU_NG_CAPI_H
+#include "Python.h"
+/*
+ * C API of the lru_ng module, for use by other extension modules.
+ *
+ * The module exports a table of function pointers as the PyCapsule
+ * "lru_ng._C_API". Include this header in the consuming extension and call
+ * LRUNG_ImportCAPI() once (typically in its module init function) before
+ * using the macro LRUNG_CAPI:
+ *
+ *     if (LRUNG_ImportCAPI(1) == -1) {
+ *         return NULL;
+ *     }
+ *     ...
+ *     status = LRUNG_CAPI->lookup_known_hash(lru, key, hash, &value);
+ *
+ * The functions are equivalent to the methods of LRUDict, but take the hash of
+ * the key from the caller, and report missing keys by return value instead of
+ * raising KeyError. A hash of -1 means "not known": it is then computed as
+ * usual. All functions must be called with the GIL held, and "lru" must be an
+ * LRUDict instance (this is checked).
+ *
+ * Newer versions of the table only append members, so a consumer built
+ * against version N works with any module exporting version >= N.
+ */
+
+
+#define LRUNG_CAPI_NAME     "lru_ng._C_API"
+#define LRUNG_CAPI_VERSION  3
+
+
+/* Native eviction hook; see set_evict_hook below. Return 0, or nonzero with
+ * exception set. */
+typedef int (*LRUNG_EvictHook)(void *ctx, PyObject *key, PyObject *value,
+                               int reason);
+
+
+/* Reasons for eviction passed to the hook. */
+/* The size bound was exceeded by an insertion or by shrinking. */
+#define LRUNG_EVICT_SIZE    0
+
+
+typedef struct _LRUNG_CAPI {
+    /* Version of this table, i.e. the number of its last member group. */
+    unsigned int version;
+    /* The LRUDict type object. */
+    PyTypeObject *LRUDict_Type;
+
+    /* Version 1 */
+    /* Look up key. Return 1 and write a new reference to the value into
+     * *value if found (a hit), 0 and write NULL if not (a miss), or -1 with
+     * exception set on error. */
+    int (*lookup_known_hash)(PyObject *lru, PyObject *key, Py_hash_t hash,
+                             PyObject **value);
+    /* Insert or replace, like lru[key] = value. Return 0 on success, or -1
+     * with exception set. */
+    int (*insert_known_hash)(PyObject *lru, PyObject *key, Py_hash_t hash,
+                             PyObject *value);
+    /* Remove key, like lru.pop(key). Return 1 and write a new reference to the
+     * removed value into *value if found, 0 and write NULL if not, or -1 with
+     * exception set. */
+    int (*pop)(PyObject *lru, PyObject *key, Py_hash_t hash, PyObject **value);
+    /* Look up n keys in one go. hashes may be NULL, or an array of n hashes
+     * (each possibly -1). For each key, write to values[i] a new reference to
+     * the value or NULL. Return the number of hits, or -1 with exception set
+     * (in which case all of values[] are NULL). */
+    Py_ssize_t (*get_many)(PyObject *lru, Py_ssize_t n, PyObject *const *keys,
+                           const Py_hash_t *hashes, PyObject **values);
+    /* Write the hit and miss counters, as returned by get_stats(). Return 0,
+     * or -1 with exception set.
+     * Deprecated: use stats64 (version 3). Where unsigned long is 32-bit wide,
+     * the counters saturate at ULONG_MAX. */
+    int (*stats)(PyObject *lru, unsigned long *hits, unsigned long *misses);
+
+    /* Version 2 */
+    /* Set the native eviction hook, replacing any previous one, or remove it
+     * if fn is NULL. For each evicted item, fn(ctx, key, value, reason) is
+     * called with borrowed references, before the Python-level callback (if
+     * any) and under the same conditions: outside the critical section, with
+     * the GIL held, and possibly from a different method call than the one
+     * that caused the eviction. Items dropped by the "drop" overflow policy
+     * skip the callback but not the hook. The LRUDict may be accessed from
+     * the hook.
+     * An exception raised by the hook is reported as unraisable and
+     * suppressed, except for the kinds that are also passed on from the
+     * callback (e.g. MemoryError).
+     *
+     * ctx_free (may be NULL) is called with ctx once the hook is replaced or
+     * removed, or the LRUDict is deallocated, and no purge is using it any
+     * more. Return 0 on success, or -1 with exception set, in which case the
+     * previous hook stays and ctx_free is not called. */
+    int (*set_evict_hook)(PyObject *lru, LRUNG_EvictHook fn, void *ctx,
+                          void (*ctx_free)(void *ctx));
+
+    /* Version 3 */
+    /* Like stats, but with the full 64-bit counters. */
+    int (*stats64)(PyObject *lru, uint64_t *hits, uint64_t *misses);
+} LRUNG_CAPI_t;
+
+
+#ifndef LRU_NG_MODULE
+/* For the consumer of the API. */
+static LRUNG_CAPI_t *LRUNG_CAPI_ptr = NULL;
+#define LRUNG_CAPI  (LRUNG_CAPI_ptr)
+
+
+/* Import the table, requiring at least the given version. Return 0 on success,
+ * or -1 with exception set. */
+static inline int
+LRUNG_ImportCAPI(unsigned int min_version)
+{
+    LRUNG_CAPI_t *api;
+
+    if ((api = (LRUNG_CAPI_t *)PyCapsule_Import(LRUNG_CAPI_NAME, 0)) == NULL) {
+        return -1;
+    }
+    if (api->version < min_version) {
+        PyErr_Format(PyExc_ImportError,
+                     "lru_ng C API version %u is older than required (%u)",
+                     api->version, min_version);
+        return -1;
+    }
+    LRUNG_CAPI_ptr = api;
+    return 0;
+}
+#endif /* LRU_NG_MODULE */
+
+
+#endif /* LRU_NG_CAPI_H */
@@ -5,6 +5,13 @@
 #include "lrudict_pq.h"
 #include "lrudict_exctype.h"
 #include "lrudict_statstype.h"
+#include "lrudict_shm.h"
+#include "lrudict_sim.h"
+#define LRU_NG_MODULE
+#include "lru_ng_capi.h"
+#if LRUNG_EVICT_SIZE != LRUPQ_EVICT_SIZE
+#error "eviction reasons out of sync between C API and purge queue"
+#endif
 #ifdef __GNUC__
 __attribute__((malloc))
 extern PyObject * _PyObject_New(PyTypeObject *);
@@ -15,6 +22,7 @@ extern void * PyMem_Malloc(size_t);
 
 #include "tinyset.c"
 static TinySet *lru_safe_types;
+PyObject *LRUDictExc_BusyErr;
 
 
 /*
@@ -55,7 +63,7 @@ node_repr(Node *self)
 }
 
 
-static PyTypeObject NodeType = {
+PyTypeObject NodeType = {
     PyVarObject_HEAD_INIT(NULL, 0)
     .tp_name = "lru_ng._Node",
     .tp_basicsize = sizeof(Node),
@@ -68,21 +76,17 @@ static PyTypeObject NodeType = {
 };
 
 
-/* Return new ref to newly created node initialized with payload, or NULL
- * in case of failure to create node at all. */
-static inline Node *
-node_getnewfrom(const NodePayload *restrict payload)
-{
-    Node *n;
-
-    if ((n = PyObject_New(Node, &NodeType)) != NULL) {
-        Py_INCREF(payload->key);
-        Py_INCREF(payload->value);
-        /* Note: direct copy of struct via (indirect) assignment. */
-        n->pl = *payload;
-    }
-    return n;
-}
+PyTypeObject TimedNodeType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "lru_ng._TimedNode",
+    .tp_basicsize = sizeof(TimedNode),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor)node_dealloc,
+    .tp_repr = (reprfunc)node_repr,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "linked-list node with access times for internal use",
+    .tp_base = &NodeType,
+};
 
 
 /* LRUDict internal critical section macros. These sections must be entered
@@ -92,6 +96,7 @@ node_getnewfrom(const NodePayload *restrict payload)
 do {                                        \
     if ((self)->detect_conflict && (self)->internal_busy) \
     {  \
+        LRU_PROBE1(busy, (self));   \
         PyErr_SetString(LRUDictExc_BusyErr, \
                 "attempted entry into LRUDict critical section while busy");\
         return (failresult);    \
@@ -105,13 +110,113 @@ do {                            \
     (self)->internal_busy = 0;  \
 } while (0)
 
+/* Number of items staged in the purge queue and not yet claimed. */
+#define LRU_STAGED(self)    \
+    ((self)->purge_queue->sinfo.tail - (self)->purge_queue->sinfo.head)
+
+
 #define PURGE_MAYBE_FAIL(self)  \
     (unlikely(lru_purge_staging_impl((self), NO_FORCE_PURGE) == -2))
 
 
-/* Linked-list data-structure implementations internal to LRUDict */
-#define FIRST_NODE(s)        ((s)->root->next)
-#define LAST_NODE(s)         ((s)->root->prev)
+/* Guard for methods that would modify a frozen LRUDict. */
+#define LRU_FAIL_IF_FROZEN(self, failresult)    \
+do {                                            \
+    if (unlikely((self)->frozen)) {             \
+        PyErr_SetString(PyExc_TypeError,        \
+                "LRUDict instance is frozen and cannot be modified");\
+        return (failresult);                    \
+    }                                           \
+} while (0)
+
+
+/* Read-only methods only need the critical section if the instance may still
+ * be modified. A frozen instance skips it so as not to write into self. */
+#define LRU_ENTER_CRIT_RO(self, failresult)     \
+do {                                            \
+    if (!(self)->frozen) {                      \
+        LRU_ENTER_CRIT((self), (failresult));   \
+    }                                           \
+} while (0)
+
+
+#define LRU_LEAVE_CRIT_RO(self) \
+do {                            \
+    if (!(self)->frozen) {      \
+        LRU_LEAVE_CRIT(self);   \
+    }                           \
+} while (0)
+
+
+/* Record an access if the trace recorder is on (see lrudict_trace.h). */
+#ifdef LRUTRACE_AVAILABLE
+#define LRU_TRACE(self, op, kh, hit)                            \
+do {                                                            \
+    if (unlikely((self)->trace != NULL)) {                      \
+        lrutrace_record((self)->trace, (op), (kh), (hit));      \
+    }                                                           \
+} while (0)
+#else
+#define LRU_TRACE(self, op, kh, hit)    ((void)0)
+#endif
+
+
+/* Count an access in the hot-key tracker, if on (see lrudict_hot.h), and
+ * release the keys it dropped once outside of the critical section. */
+#define LRU_HOT_COUNT(self, key, kh)                    \
+do {                                                    \
+    if (unlikely((self)->hot != NULL)) {                \
+        lruhot_update((self)->hot, (key), (kh));        \
+    }                                                   \
+} while (0)
+
+
+#define LRU_HOT_FLUSH(self)                             \
+do {                                                    \
+    if (unlikely((self)->hot != NULL)) {                \
+        lruhot_flush((self)->hot);                      \
+    }                                                   \
+} while (0)
+
+
+/* New node for payload, timed if the ages of evicted items are tracked. */
+#define LRU_NODE_NEW(self, payload)                             \
+    (unlikely((self)->age != NULL) ?                            \
+     timednode_getnewfrom((payload), lrulat_now()) :            \
+     node_getnewfrom(payload))
+
+
+/* Note an access to node n, if timed. */
+#define LRU_AGE_TOUCH(self, n)                                  \
+do {                                                            \
+    if (unlikely((self)->age != NULL) && IS_TIMED_NODE(n)) {    \
+        ((TimedNode *)(n))->t_access = lrulat_now();            \
+    }                                                           \
+} while (0)
+
+
+/* Time an operation if the latency recorder is on (see lrudict_lat.h). The
+ * start time is 0 if not, and the recorder may be turned off by code run
+ * during the operation. */
+#define LRU_LAT_START(self)                             \
+    (unlikely((self)->lat != NULL) ? lrulat_now() : 0)
+
+
+#define LRU_LAT_STOP(self, op, t0)                      \
+do {                                                    \
+    if (unlikely((t0) != 0) && (self)->lat != NULL) {   \
+        lrulat_record((self)->lat, (op), (t0));         \
+    }                                                   \
+} while (0)
+
+
+/* Linked-list data-structure implementations internal to LRUDict. The list
+ * primitives are shared with the C core (lrung_core.h) and operate on the link
+ * member of Node (see NODE_OF in lrudict.h). */
+#define FIRST_NODE(s)        NODE_OF((s)->root->link.next)
+#define LAST_NODE(s)         NODE_OF((s)->root->link.prev)
+#define NEXT_NODE(n)         NODE_OF((n)->link.next)
+#define PREV_NODE(n)         NODE_OF((n)->link.prev)
 #define IS_VALID_NODE_IN(s, n)  ((n) != (s)->root)
 
 
@@ -121,13 +226,9 @@ static inline void
 lru_detach_node(const Node *restrict node)
 {
     /* These two may point to the same thing but never "node" itself */
-    Node *n_next = node->next;
-    Node *n_prev = node->prev;
-    assert(n_next != node);
-    assert(n_prev != node);
-
-    n_next->prev = n_prev;
-    n_prev->next = n_next;
+    assert(node->link.next != &node->link);
+    assert(node->link.prev != &node->link);
+    lrung_link_detach(&node->link);
 }
 
 
@@ -136,14 +237,9 @@ lru_detach_node(const Node *restrict node)
 static inline void
 lru_attach_node_after(Node *restrict origin, Node *restrict node)
 {
-    Node *o_next = origin->next;  /* this thing may be the same as origin */
     assert(node != origin);
-    assert(node != o_next);
-
-    o_next->prev = node;
-    node->next = o_next;
-    node->prev = origin;
-    origin->next = node;
+    assert(&node->link != origin->link.next);
+    lrung_link_attach_after(&origin->link, &node->link);
 }
 
 
@@ -153,11 +249,7 @@ lru_attach_node_after(Node *restrict origin, Node *restrict node)
 static inline void
 lru_promote_node(const LRUDict *self, Node *node)
 {
-    if (node == FIRST_NODE(self)) {
-        return;
-    }
-    lru_detach_node(node);
-    lru_attach_node_after(self->root, node);
+    lrung_link_promote(&self->root->link, &node->link);
 }
 
 
@@ -178,6 +270,9 @@ lrupq_push(LRUDict_pq *q, Node *restrict n)
 {
     if (PyList_Append(q->lst, (PyObject *restrict)n) == 0) {
         q->sinfo.tail++;
+        if (q->sinfo.tail - q->sinfo.head > q->peak_len) {
+            q->peak_len = q->sinfo.tail - q->sinfo.head;
+        }
         return 0;
     }
     else {
@@ -186,11 +281,148 @@ lrupq_push(LRUDict_pq *q, Node *restrict n)
 }
 
 
+/* Append the nodes in the list seg to the queue in one piece, and take over
+ * seg itself if the queue is empty and idle. */
+static inline int
+lrupq_push_list(LRUDict_pq *q, PyObject *seg)
+{
+    Py_ssize_t m = PyList_GET_SIZE(seg);
+
+    if (q->n_active == 0 && PyList_GET_SIZE(q->lst) == 0) {
+        Py_INCREF(seg);
+        Py_SETREF(q->lst, seg);
+    }
+    else if (PyList_SetSlice(q->lst, PY_SSIZE_T_MAX, PY_SSIZE_T_MAX,
+                             seg) != 0) {
+        return -1;
+    }
+    q->sinfo.tail += m;
+    if (q->sinfo.tail - q->sinfo.head > q->peak_len) {
+        q->peak_len = q->sinfo.tail - q->sinfo.head;
+    }
+    return 0;
+}
+
+
+/* Record the eviction of n with the recorders in effect. */
+static inline void
+lru_record_eviction(LRUDict *self, const Node *n)
+{
+    if (unlikely(self->age != NULL) && IS_TIMED_NODE(n)) {
+        uint64_t now = lrulat_now();
+
+        lrulat_add(&self->age->since_insert,
+                   now - ((const TimedNode *)n)->t_insert);
+        lrulat_add(&self->age->since_access,
+                   now - ((const TimedNode *)n)->t_access);
+    }
+    LRU_TRACE(self, LRUTRACE_EVICT, n->pl.key_hash, 1);
+}
+
+
+/* Whether evicting n goes through the purge queue: releasing it may run
+ * arbitrary code, or the callback or hook is to be told of it. */
+static inline _Bool
+lru_evict_staged(const LRUDict *self, const Node *n)
+{
+    return (self->callback || self->purge_queue->hook ||
+            (lru_decref_unsafe(n->pl.key) | lru_decref_unsafe(n->pl.value)));
+}
+
+
+/* Number of the m evictions about to be staged that may go to the purge queue
+ * under max_staged; the others are dropped. Under the "purge" policy, the
+ * queue is purged at the end of the operation that fills it, and before an
+ * operation that finds it full (see lru_make_room()), so that the evictions
+ * only overflow it if a purge cannot begin. Under "raise", they all may go,
+ * for the operations that would overflow the queue refuse to begin. */
+static inline Py_ssize_t
+lru_stage_quota(LRUDict *self, Py_ssize_t m)
+{
+    LRUDict_pq *q = self->purge_queue;
+    Py_ssize_t room;
+
+    if (likely(q->max_staged == 0) ||
+        (room = q->max_staged - LRU_STAGED(self)) > m)
+    {
+        return m;
+    }
+    switch (q->overflow) {
+    case LRUPQ_OVERFLOW_PURGE:
+        q->purge_due = 1;
+        break;
+    case LRUPQ_OVERFLOW_RAISE:
+        return m;
+    }
+    return room > 0 ? room : 0;
+}
+
+
+/* Under the "raise" policy, check whether evicting the last k items would
+ * stage more than max_staged. If so, raise LRUDictBusyError and return 1. */
+static int
+lru_overflow_refused(LRUDict *self, Py_ssize_t k)
+{
+    LRUDict_pq *q = self->purge_queue;
+    Py_ssize_t room;
+
+    if (likely(q->max_staged == 0) || q->overflow != LRUPQ_OVERFLOW_RAISE) {
+        return 0;
+    }
+    room = q->max_staged - LRU_STAGED(self);
+    if (room >= k) {
+        return 0;
+    }
+    if (room < 0) {
+        room = 0;
+    }
+    if (self->callback == NULL && q->hook == NULL) {
+        /* Only those that would be staged count. */
+        Node *cur = LAST_NODE(self);
+        Py_ssize_t m = 0;
+
+        for (Py_ssize_t i = 0; i < k && m <= room; i++) {
+            m += lru_evict_staged(self, cur);
+            cur = PREV_NODE(cur);
+        }
+        if (m <= room) {
+            return 0;
+        }
+    }
+    PyErr_SetString(LRUDictExc_BusyErr, "purge queue is full");
+    return 1;
+}
+
+
+/* Release the evicted node n, for which there is no room in the purge queue,
+ * without the callback: at once by the caller if that is safe and there is no
+ * hook, or else by the purge right after the critical section, which is not
+ * held up by the suspension of purging and calls the hook. */
+static inline void
+lru_drop_eviction(LRUDict *self, Node *n)
+{
+    LRUDict_pq *q = self->purge_queue;
+
+    self->xstats.evictions_dropped++;
+    if (q->hook != NULL ||
+        (lru_decref_unsafe(n->pl.key) | lru_decref_unsafe(n->pl.value)))
+    {
+        if (q->dropped == NULL && (q->dropped = PyList_New(0)) == NULL) {
+            PyErr_Clear();
+        }
+        else if (PyList_Append(q->dropped, (PyObject *)n) != 0) {
+            PyErr_Clear();
+        }
+    }
+}
+
+
 /* Can only be called while there's actually a node to delete (evict) */
 static void
 lru_delete_last_impl(LRUDict *self)
 {
     Node *n = LAST_NODE(self);
+    uint64_t t0 = LRU_LAT_START(self);
     assert(IS_VALID_NODE_IN(self, n));
 
     /* Transfer the node to purge queue.
@@ -201,21 +433,35 @@ lru_delete_last_impl(LRUDict *self)
     Py_INCREF(n);
     if (_PyDict_DelItem_KnownHash(self->dict, n->pl.key, n->pl.key_hash) == 0)
     {
+        _Bool staged = 0;
+
         /* detach; n is never root because the only item cannot be evicted. */
         lru_detach_node(n);
-        /* The list will increase the refcount to the node if successful */
-        if (self->callback ||
-            (lru_decref_unsafe(n->pl.key) | lru_decref_unsafe(n->pl.value)))
-        {
-            if (lrupq_push(self->purge_queue, n) == 0) {
-                self->_pb = 1;
+        lru_record_eviction(self, n);
+        if (lru_evict_staged(self, n)) {
+            if (likely(lru_stage_quota(self, 1) == 1)) {
+                /* The list will increase the refcount to the node if
+                 * successful */
+                staged = lrupq_push(self->purge_queue, n) == 0;
+            }
+            else {
+                lru_drop_eviction(self, n);
             }
         }
+        if (staged) {
+            self->_pb = 1;
+            self->xstats.evictions_staged++;
+        }
+        else {
+            self->xstats.evictions_direct++;
+        }
+        LRU_PROBE3(evict, self, n->pl.key_hash, LRU_STAGED(self));
     }
     /* This DECREF in the case when the list append isn't succesful (a rare
      * condition) is the last resort, but in normal condition it simply mean
      * the reference is transfered to the list. */
     Py_DECREF(n);
+    LRU_LAT_STOP(self, LRULAT_EVICT, t0);
 }
 
 
@@ -223,18 +469,37 @@ lru_delete_last_impl(LRUDict *self)
 static inline Py_ssize_t
 lru_purge_staging_impl(LRUDict *self, purge_mode_t opt)
 {
+    LRUDict_pq *q = self->purge_queue;
     Py_ssize_t res;
+    uint64_t t0;
 
-    if (self->purge_suspended && opt != FORCE_PURGE) {
+    if (unlikely(q->dropped != NULL) && lrupq_release_dropped(q) == -2) {
+        return -2;
+    }
+
+    if (self->purge_suspended && opt != FORCE_PURGE && !q->purge_due) {
         return 0;
     }
+    q->purge_due = 0;
 
     if (self->_pb == 0) {
         return 0;
     }
 
-    res = lrupq_purge(self->purge_queue, self->callback);
-    if (res != 0) {
+    self->xstats.purges++;
+    t0 = LRU_LAT_START(self);
+    LRU_PROBE2(purge_start, self, LRU_STAGED(self));
+    /* Only an automatic purge is on a budget. */
+    if (opt == FORCE_PURGE) {
+        res = lrupq_purge(q, self->callback, 0, 0);
+    }
+    else {
+        res = lrupq_purge(q, self->callback, q->budget_items, q->budget_ns);
+    }
+    LRU_PROBE2(purge_end, self, res);
+    LRU_LAT_STOP(self, LRULAT_PURGE, t0);
+    /* What the budget leaves over is for the next purge. */
+    if (res != 0 && LRU_STAGED(self) == 0) {
         self->_pb = 0;
     }
 
@@ -242,6 +507,25 @@ lru_purge_staging_impl(LRUDict *self, purge_mode_t opt)
 }
 
 
+/* Under the "purge" policy, purge the queue, even if purging is suspended,
+ * before an operation that would find it full at max_staged, so that the
+ * evictions of the operation are staged rather than dropped. Return -1 if the
+ * purge fails, or 0. */
+static inline int
+lru_make_room(LRUDict *self)
+{
+    LRUDict_pq *q = self->purge_queue;
+
+    if (likely(q->max_staged == 0) || q->overflow != LRUPQ_OVERFLOW_PURGE ||
+        LRU_STAGED(self) < q->max_staged)
+    {
+        return 0;
+    }
+    q->purge_due = 1;
+    return PURGE_MAYBE_FAIL(self) ? -1 : 0;
+}
+
+
 /* Querying length information (Python __len__ or len() function) */
 static inline Py_ssize_t
 lru_length_impl(const LRUDict *self)
@@ -250,6 +534,96 @@ lru_length_impl(const LRUDict *self)
 }
 
 
+/* Default reservation, if less than the size */
+#define LRU_RESERVE_DEFAULT     1024
+/* CPython presizes a dict for no more items than this, and for fewer if asked
+ * for more. */
+#define LRU_PRESIZE_MAX         87381
+
+
+/* Automatic compaction: when the length (or the reservation) drops below
+ * 1/LRU_COMPACT_RATIO of dict_peak, if dict_peak is at least LRU_COMPACT_MIN
+ * and the length at most LRU_COMPACT_AUTO_MAX (which bounds the pause). */
+#define LRU_COMPACT_RATIO       4
+#define LRU_COMPACT_MIN         4096
+#define LRU_COMPACT_AUTO_MAX    (1 << 16)
+
+
+/* Number of items to size a new dict holding len items for: the reservation,
+ * up to the capacity, if larger. */
+static inline Py_ssize_t
+lru_dict_target(const LRUDict *self, Py_ssize_t len)
+{
+    Py_ssize_t r = Py_MIN(self->reserve, self->capacity);
+
+    return Py_MAX(len, r);
+}
+
+
+/* New dict presized for the target; see lru_dict_target(). */
+static inline PyObject *
+lru_dict_new(Py_ssize_t target)
+{
+    return _PyDict_NewPresized(Py_MIN(target, LRU_PRESIZE_MAX));
+}
+
+
+/* Replace the dict by a new one just large enough for its items, or for the
+ * reservation, since a dict never shrinks its table on deletion. The new dict
+ * takes the keys and nodes of the old one, so releasing the latter drops no
+ * last reference. */
+static int
+lru_compact_impl(LRUDict *self)
+{
+    Py_ssize_t target = lru_dict_target(self, lru_length_impl(self));
+    Py_ssize_t pos = 0;
+    PyObject *d, *key, *n;
+
+    if ((d = lru_dict_new(target)) == NULL) {
+        return -1;
+    }
+    while (PyDict_Next(self->dict, &pos, &key, &n)) {
+        if (_PyDict_SetItem_KnownHash(d, key, n,
+                                      ((Node *)n)->pl.key_hash) != 0) {
+            Py_DECREF(d);
+            return -1;
+        }
+    }
+    Py_SETREF(self->dict, d);
+    self->dict_peak = target;
+    return 0;
+}
+
+
+/* Note that the length has dropped from "from" by explicit deletions, and
+ * compact the dict if it has become mostly empty. */
+static inline void
+lru_note_shrink(LRUDict *self, Py_ssize_t from)
+{
+    Py_ssize_t len = lru_length_impl(self);
+
+    if (from > self->dict_peak) {
+        self->dict_peak = from;
+    }
+    if (unlikely(len < self->dict_peak / LRU_COMPACT_RATIO) &&
+        self->dict_peak >= LRU_COMPACT_MIN && len <= LRU_COMPACT_AUTO_MAX &&
+        lru_dict_target(self, len) < self->dict_peak / LRU_COMPACT_RATIO &&
+        lru_compact_impl(self) != 0)
+    {
+        /* Only an optimization */
+        PyErr_Clear();
+    }
+}
+
+
+static inline void
+lru_count_deletion(LRUDict *self)
+{
+    self->xstats.deletions++;
+    lru_note_shrink(self, lru_length_impl(self) + 1);
+}
+
+
 static Py_ssize_t
 LRU_length(LRUDict *self)
 {
@@ -272,13 +646,181 @@ LRU_get_size_legacy(LRUDict *self, PyObject *Py_UNUSED(ignored))
 }
 
 
+/* Shrinking by at least this many items takes the bulk path. */
+#define LRU_SHRINK_BULK_MIN     64
+
+
+/* Evict the k least-recently used items at once: cut them off the end of the
+ * list in one piece, and either delete their keys from the dict or, if they
+ * are the majority, replace the dict by a presized one of the survivors.
+ * Instead of being released one by one, the evicted nodes are left in
+ * *garbage (the old dict, or a list of them) for the caller to release
+ * outside the critical section, as clear() does. If there is a callback or a
+ * hook, the list of them also goes to the purge queue in one piece. If timed,
+ * the evictions are recorded as that many samples of their mean duration.
+ *
+ * Return 0, or -1 with exception set, in which case some of the items may
+ * have been evicted. */
+static int
+lru_shrink_bulk(LRUDict *self, Py_ssize_t k, PyObject **garbage)
+{
+    LRUDict_pq *q = self->purge_queue;
+    const _Bool staged = self->callback != NULL || q->hook != NULL;
+    const Py_ssize_t n = lru_length_impl(self) - k;
+    PyObject *seg = NULL;
+    PyObject *exc_type = NULL, *exc_value, *tb;
+    Node *cur;
+    Py_ssize_t i, m = 0;
+    uint64_t t0 = LRU_LAT_START(self);
+
+    if ((staged || k <= n) && (seg = PyList_New(k)) == NULL) {
+        return -1;
+    }
+
+    if (k > n) {
+        PyObject *survivors = lru_dict_new(lru_dict_target(self, n));
+
+        if (survivors == NULL) {
+            Py_XDECREF(seg);
+            return -1;
+        }
+        for (cur = FIRST_NODE(self), i = 0; i < n; cur = NEXT_NODE(cur), i++) {
+            if (_PyDict_SetItem_KnownHash(survivors, cur->pl.key,
+                                          (PyObject *)cur,
+                                          cur->pl.key_hash) != 0)
+            {
+                Py_DECREF(survivors);
+                Py_XDECREF(seg);
+                return -1;
+            }
+        }
+        *garbage = self->dict;
+        self->dict = survivors;
+        self->dict_peak = lru_dict_target(self, n);
+        for (cur = LAST_NODE(self), i = 0; i < k; cur = PREV_NODE(cur), i++) {
+            lru_record_eviction(self, cur);
+            if (seg != NULL) {
+                Py_INCREF(cur);
+                PyList_SET_ITEM(seg, i, (PyObject *)cur);
+            }
+            /* If staged, the probes fire once the queue has taken them. */
+            if (!staged) {
+                LRU_PROBE3(evict, self, cur->pl.key_hash, LRU_STAGED(self));
+            }
+        }
+    }
+    else {
+        for (cur = LAST_NODE(self), i = 0; i < k; cur = PREV_NODE(cur), i++) {
+            /* The list keeps the node alive. */
+            Py_INCREF(cur);
+            PyList_SET_ITEM(seg, i, (PyObject *)cur);
+            if (_PyDict_DelItem_KnownHash(self->dict, cur->pl.key,
+                                          cur->pl.key_hash) != 0)
+            {
+                PyErr_Fetch(&exc_type, &exc_value, &tb);
+                /* The items so far are evicted nonetheless. */
+                PyList_SET_ITEM(seg, i, NULL);
+                Py_DECREF(cur);
+                if (PyList_SetSlice(seg, i, k, NULL) != 0) {
+                    PyErr_Clear();
+                }
+                break;
+            }
+            lru_record_eviction(self, cur);
+            if (!staged) {
+                LRU_PROBE3(evict, self, cur->pl.key_hash, LRU_STAGED(self));
+            }
+        }
+        *garbage = seg;
+        seg = NULL;
+        if (exc_type == NULL) {
+            lru_note_shrink(self, n + k);
+        }
+    }
+    if (i > 0) {
+        /* cur is the first survivor. */
+        lrung_link_truncate(&self->root->link, cur->link.next);
+        if (staged) {
+            PyObject *all = seg != NULL ? seg : *garbage;
+            Py_ssize_t quota = lru_stage_quota(self, i);
+
+            if (quota == i) {
+                m = lrupq_push_list(q, all) == 0 ? i : 0;
+            }
+            else if (quota > 0) {
+                PyObject *part = PyList_GetSlice(all, 0, quota);
+
+                if (part != NULL && lrupq_push_list(q, part) == 0) {
+                    m = quota;
+                }
+                Py_XDECREF(part);
+            }
+            if (m < quota) {
+                /* Fall back to one at a time. */
+                PyErr_Clear();
+                for (; m < quota; m++) {
+                    if (lrupq_push(q, (Node *)PyList_GET_ITEM(all, m)) != 0) {
+                        PyErr_Clear();
+                        break;
+                    }
+                }
+            }
+            /* Those beyond the quota, or that could not be pushed, are
+             * dropped, and released with the garbage unless the hook is yet
+             * to see them. */
+            for (Py_ssize_t j = m; j < i; j++) {
+                lru_drop_eviction(self, (Node *)PyList_GET_ITEM(all, j));
+            }
+            for (Py_ssize_t j = 0; j < i; j++) {
+                LRU_PROBE3(evict, self,
+                           ((Node *)PyList_GET_ITEM(all, j))->pl.key_hash,
+                           LRU_STAGED(self));
+            }
+        }
+        if (m > 0) {
+            self->_pb = 1;
+            self->xstats.evictions_staged += (uint64_t)m;
+        }
+        self->xstats.evictions_direct += (uint64_t)(i - m);
+        if (unlikely(t0 != 0) && self->lat != NULL) {
+            lrulat_record_n(self->lat, LRULAT_EVICT, t0, (uint64_t)i);
+        }
+    }
+    /* With the old dict as the garbage, the nodes outlive seg. */
+    Py_XDECREF(seg);
+    if (exc_type != NULL) {
+        PyErr_Restore(exc_type, exc_value, tb);
+        return -1;
+    }
+    return 0;
+}
+
+
 static inline int
-lru_set_size_impl(LRUDict *self, Py_ssize_t n)
+lru_set_size_impl(LRUDict *self, Py_ssize_t n, PyObject **garbage)
 {
     if (n > 0) {
+        Py_ssize_t k = lru_length_impl(self) - n;
+        const _Bool bulk = k >= LRU_SHRINK_BULK_MIN;
+
+        /* In bulk, only the callback or the hook stages the evictions. */
+        if (k > 0 &&
+            (!bulk || self->callback || self->purge_queue->hook) &&
+            lru_overflow_refused(self, k))
+        {
+            return -1;
+        }
         self->capacity = n;
-        for (Py_ssize_t i = lru_length_impl(self) - n; i > 0; i--) {
-            lru_delete_last_impl(self);
+        if (bulk) {
+            return lru_shrink_bulk(self, k, garbage);
+        }
+        if (k > 0) {
+            /* An eviction on insertion leaves the length at the capacity, so
+             * only a reduced capacity may bring it down for compaction. */
+            for (Py_ssize_t i = 0; i < k; i++) {
+                lru_delete_last_impl(self);
+            }
+            lru_note_shrink(self, n + k);
         }
         return 0;
     }
@@ -289,11 +831,50 @@ lru_set_size_impl(LRUDict *self, Py_ssize_t n)
 }
 
 
+/* Set the size to n, and purge. Under the "purge" policy, if the callback or
+ * the hook is to see the evictions, they are made in steps of at most the room
+ * left in the purge queue, which is purged after each, so that it is kept
+ * within max_staged. Return 0, or -1 with exception set. */
+static int
+lru_resize(LRUDict *self, Py_ssize_t n)
+{
+    LRUDict_pq *q = self->purge_queue;
+    Py_ssize_t step;
+    int status;
+
+    do {
+        PyObject *garbage = NULL;
+
+        step = n;
+        if (unlikely(q->max_staged > 0) &&
+            q->overflow == LRUPQ_OVERFLOW_PURGE &&
+            (self->callback || q->hook) && n > 0)
+        {
+            Py_ssize_t room = q->max_staged - LRU_STAGED(self);
+
+            if (room > 0 && lru_length_impl(self) - n > room) {
+                step = lru_length_impl(self) - room;
+            }
+        }
+        /* Setting new size may trigger eviction, must protect */
+        LRU_ENTER_CRIT(self, -1);
+        status = lru_set_size_impl(self, step, &garbage);
+        LRU_LEAVE_CRIT(self);
+        Py_XDECREF(garbage);
+
+        if (PURGE_MAYBE_FAIL(self)) {
+            return -1;
+        }
+    } while (status == 0 && step != n);
+
+    return status;
+}
+
+
 /* Descriptor setter function for size */
 static int
 LRU_size_setter(LRUDict *self, PyObject *value, void *Py_UNUSED(closure))
 {
-    int status;
     Py_ssize_t newsize;
 
     if (value == NULL) {
@@ -310,16 +891,8 @@ LRU_size_setter(LRUDict *self, PyObject *value, void *Py_UNUSED(closure))
         return -1;      /* this also checks for overflow */
     }
 
-    /* Setting new size may trigger eviction, must protect */
-    LRU_ENTER_CRIT(self, -1);
-    status = lru_set_size_impl(self, newsize);
-    LRU_LEAVE_CRIT(self);
-
-    if (PURGE_MAYBE_FAIL(self)) {
-        return -1;
-    }
-
-    return status;
+    LRU_FAIL_IF_FROZEN(self, -1);
+    return lru_resize(self, newsize);
 }
 
 
@@ -327,21 +900,12 @@ static PyObject *
 LRU_set_size_legacy(LRUDict *self, PyObject *args)
 {
     Py_ssize_t newsize;
-    int status;
 
     if (!PyArg_ParseTuple(args, "n:set_size", &newsize)) {
         return NULL;
     }
-    /* Setting new size may trigger eviction, must protect */
-    LRU_ENTER_CRIT(self, NULL);
-    status = lru_set_size_impl(self, newsize);
-    LRU_LEAVE_CRIT(self);
-
-    if (PURGE_MAYBE_FAIL(self)) {
-        return NULL;
-    }
-
-    if (status == -1) {
+    LRU_FAIL_IF_FROZEN(self, NULL);
+    if (lru_resize(self, newsize) == -1) {
         return NULL;
     }
     Py_RETURN_NONE;
@@ -394,6 +958,7 @@ LRU_callback_setter(LRUDict *self, PyObject *value, void *Py_UNUSED(closure))
 {
     int status;
 
+    LRU_FAIL_IF_FROZEN(self, -1);
     LRU_ENTER_CRIT(self, -1);
     status = lru_set_callback_impl(self, value);
     LRU_LEAVE_CRIT(self);
@@ -412,6 +977,7 @@ LRU_set_callback_legacy(LRUDict *self, PyObject *args)
         return NULL;
     }
 
+    LRU_FAIL_IF_FROZEN(self, NULL);
     LRU_ENTER_CRIT(self, NULL);
     status = lru_set_callback_impl(self, value);
     LRU_LEAVE_CRIT(self);
@@ -427,7 +993,11 @@ LRU_set_callback_legacy(LRUDict *self, PyObject *args)
 static int
 lru_contains_impl(LRUDict *self, PyObject *key)
 {
-    return PyDict_Contains(self->dict, key);
+    int res = PyDict_Contains(self->dict, key);
+
+    /* Failed lookups (-1) count as false. */
+    self->contains_stats[res > 0]++;
+    return res;
 }
 
 
@@ -452,83 +1022,114 @@ lru_hit_impl(LRUDict *self, Node *node)
 {
     lru_promote_node(self, node);
     self->hits++;
+    LRU_AGE_TOUCH(self, node);
     Py_INCREF(node->pl.value);
     return node->pl.value;
 }
 
 
-/* Optimized hash getter code-path that uses the memoized hash for ASCII
- * strings. See CPython: Objects/dictobject.c
- * This does more work for non-ASCII-strings but no more than what Python dict
- * does. There's a real advantage for string keys. */
-static inline Py_hash_t
-get_hash(PyObject *k)
+/* Counterpart of lru_hit_impl for a frozen LRUDict: no promotion, and the hit
+ * is tallied in the separate per-process block. */
+static inline PyObject *
+lru_frozen_hit_impl(LRUDict *self, Node *node)
 {
-    Py_hash_t hash;
-
-    if (!PyUnicode_CheckExact(k) || (hash = ((PyASCIIObject *)k)->hash) == -1)
-    {
-        hash = PyObject_Hash(k);
-    }
-    return hash;
+    self->frozen_stats->hits++;
+    Py_INCREF(node->pl.value);
+    return node->pl.value;
 }
 
 
-static inline Py_ssize_t
-direct_lookup(PyObject *restrict d, PyObject *restrict key, Py_hash_t kh,
-              Node **restrict node_ref)
+/* Always write to output parameter "value" new reference or NULL. The key hash
+ * kh must have been computed already. */
+static inline int
+lru_subscript_kh_impl(LRUDict *self, PyObject *key, Py_hash_t kh,
+                      PyObject **value)
 {
-    PyDictObject *mp = (PyDictObject *)d;
-#if PY_VERSION_HEX >= 0x03070000
-    return (mp->ma_keys->dk_lookup)(mp, key, kh, (PyObject **)node_ref);
-#else
-    PyObject **vaddr;
+    Node *n;
     Py_ssize_t index;
-    index = (mp->ma_keys->dk_lookup)(mp, key, kh, &vaddr, NULL);
-    if (index >= 0 && vaddr) {
-        *node_ref = (Node *)(*vaddr);
+    uint64_t t0 = LRU_LAT_START(self);
+
+    index = direct_lookup(self->dict, key, kh, &n);
+
+    if (unlikely(index == DKIX_ERROR)) {
+        *value = NULL;
+        return -1;
+    }
+
+    if (index < 0) {
+        self->misses++;
+        LRU_PROBE2(miss, self, kh);
+        *value = NULL;
     }
     else {
-        *node_ref = NULL;
+        /* The "overt" dict is never a split table, hence index >= 0 implies
+         * that n != NULL, hence can be dereferenced. */
+        assert(n != NULL);
+        LRU_PROBE2(hit, self, kh);
+        *value = lru_hit_impl(self, n);
     }
-    return index;
-#endif
+    LRU_HOT_COUNT(self, key, kh);
+    LRU_TRACE(self, LRUTRACE_GET, kh, index >= 0);
+    LRU_LAT_STOP(self, LRULAT_GET, t0);
+    return 0;
 }
 
 
-/* Always write to output parameter "value" borrowed reference or NULL. */
 static inline int
 lru_subscript_impl(LRUDict *self, PyObject *key, PyObject **value)
 {
-    Node *n;
     Py_hash_t kh;
-    Py_ssize_t index;
 
     if (unlikely((kh = get_hash(key)) == -1)) {
-        goto fail;
+        *value = NULL;
+        return -1;
     }
+    return lru_subscript_kh_impl(self, key, kh, value);
+}
+
+
+/* Lookup in a frozen LRUDict. Same output-parameter convention as
+ * lru_subscript_kh_impl, but nothing shared by self (the nodes, their links,
+ * the dict, or self) is written to. */
+static inline int
+lru_frozen_subscript_kh_impl(LRUDict *self, PyObject *key, Py_hash_t kh,
+                             PyObject **value)
+{
+    Node *n;
+    Py_ssize_t index;
 
     index = direct_lookup(self->dict, key, kh, &n);
 
     if (unlikely(index == DKIX_ERROR)) {
-        goto fail;
+        *value = NULL;
+        return -1;
     }
 
     if (index < 0) {
-        self->misses++;
+        self->frozen_stats->misses++;
+        LRU_PROBE2(miss, self, kh);
         *value = NULL;
     }
     else {
-        /* The "overt" dict is never a split table, hence index >= 0 implies
-         * that n != NULL, hence can be dereferenced. */
         assert(n != NULL);
-        *value = lru_hit_impl(self, n);
+        LRU_PROBE2(hit, self, kh);
+        *value = lru_frozen_hit_impl(self, n);
     }
+    LRU_TRACE(self, LRUTRACE_GET, kh, index >= 0);
     return 0;
+}
 
-fail:
-    *value = NULL;
-    return -1;
+
+static inline int
+lru_frozen_subscript_impl(LRUDict *self, PyObject *key, PyObject **value)
+{
+    Py_hash_t kh;
+
+    if (unlikely((kh = get_hash(key)) == -1)) {
+        *value = NULL;
+        return -1;
+    }
+    return lru_frozen_subscript_kh_impl(self, key, kh, value);
 }
 
 
@@ -538,10 +1139,16 @@ LRU_subscript(LRUDict *self, PyObject *key)
     PyObject *value;
     int status;
 
-    /* Subscripting changes the order of nodes, must protect. */
-    LRU_ENTER_CRIT(self, NULL);
-    status = lru_subscript_impl(self, key, &value);
-    LRU_LEAVE_CRIT(self);
+    if (unlikely(self->frozen)) {
+        status = lru_frozen_subscript_impl(self, key, &value);
+    }
+    else {
+        /* Subscripting changes the order of nodes, must protect. */
+        LRU_ENTER_CRIT(self, NULL);
+        status = lru_subscript_impl(self, key, &value);
+        LRU_LEAVE_CRIT(self);
+        LRU_HOT_FLUSH(self);
+    }
 
     if (status == 0 && value == NULL) {
         _PyErr_SetKeyError(key);
@@ -575,6 +1182,7 @@ lru_popnode_impl(LRUDict *self, PyObject *key, Py_hash_t kh, Node **node_ref)
     }
 
     if (index < 0) {
+        LRU_TRACE(self, LRUTRACE_DEL, kh, 0);
         _PyErr_SetKeyError(key);
         return -1;
     }
@@ -586,6 +1194,8 @@ lru_popnode_impl(LRUDict *self, PyObject *key, Py_hash_t kh, Node **node_ref)
         /* If dict item-deletion succeed, detach from queue and keep this ref
          * for the output parameter. */
         lru_detach_node(*node_ref);
+        lru_count_deletion(self);
+        LRU_TRACE(self, LRUTRACE_DEL, kh, 1);
     }
     else {
         /* If dict item-deletion fail, rewind the INCREF so there's no net
@@ -603,12 +1213,22 @@ lru_insert_new_node_impl(LRUDict *self, Node *restrict node)
 {
     int res;
 
+    if (unlikely(self->purge_queue->max_staged > 0) &&
+        lru_length_impl(self) >= self->capacity &&
+        lru_overflow_refused(self, 1))
+    {
+        return -1;
+    }
+
     res = _PyDict_SetItem_KnownHash(self->dict,
                                     node->pl.key,
                                     (PyObject *restrict)node,
                                     node->pl.key_hash);
     if (res == 0) {
         lru_attach_node_after(self->root, node);
+        self->xstats.inserts++;
+        LRU_PROBE3(insert, self, node->pl.key_hash, lru_length_impl(self));
+        LRU_TRACE(self, LRUTRACE_SET, node->pl.key_hash, 0);
     }
 
     if (lru_length_impl(self) > self->capacity) {
@@ -650,13 +1270,14 @@ lru_push_impl(LRUDict *self, const NodePayload *restrict payload,
         }
 
         /* inserting new key */
-        if (unlikely((n = node_getnewfrom(payload)) == NULL)) {
+        if (unlikely((n = LRU_NODE_NEW(self, payload)) == NULL)) {
             return -1;
         }
 
         res = lru_insert_new_node_impl(self, n);
         if (res == 0) {
             *oldvalue_ref = NULL;
+            LRU_HOT_COUNT(self, payload->key, payload->key_hash);
         }
         /* No matter the dict SetItem succeed or not, our ref is now useless.
          * Notice that the DECREF will not trigger deallocation of key or
@@ -677,18 +1298,58 @@ lru_push_impl(LRUDict *self, const NodePayload *restrict payload,
         n->pl.value = payload->value;
         /* Promote node to first. */
         lru_promote_node(self, n);
+        LRU_AGE_TOUCH(self, n);
+        self->xstats.replacements++;
+        LRU_HOT_COUNT(self, payload->key, payload->key_hash);
+        LRU_TRACE(self, LRUTRACE_SET, payload->key_hash, 1);
         res = 0;
     }
     return res;
 }
 
 
+/* Insert or replace the value for key with precomputed hash kh, then purge.
+ * Return error status. */
+static inline int
+lru_setitem_impl(LRUDict *self, PyObject *key, Py_hash_t kh, PyObject *value)
+{
+    int res;
+    PyObject *old_value;
+    NodePayload pl = {key, value, kh};
+    uint64_t t0 = LRU_LAT_START(self);
+
+    if (lru_make_room(self) != 0) {
+        return -1;
+    }
+    LRU_ENTER_CRIT(self, -1);
+    res = lru_push_impl(self, &pl, &old_value);
+    LRU_LEAVE_CRIT(self);
+    LRU_LAT_STOP(self, LRULAT_SET, t0);
+    LRU_HOT_FLUSH(self);
+    if (res == 0) {
+        if (old_value == NULL) {
+            /* Inserted value */
+            if (PURGE_MAYBE_FAIL(self)) {
+                res = -1;
+            }
+        }
+        else {
+            /* Replaced old_value */
+            Py_DECREF(old_value);
+        }
+    }  /* test whether push result "meaningful"; fall through if not */
+    return res;
+}
+
+
 static int
 LRU_ass_sub(LRUDict *self, PyObject *key, PyObject *value)
 {
     int res;
     Py_hash_t kh;
 
+    LRU_FAIL_IF_FROZEN(self, -1);
+
     if (unlikely((kh = get_hash(key)) == -1)) {
         return -1;
     }
@@ -709,25 +1370,7 @@ LRU_ass_sub(LRUDict *self, PyObject *key, PyObject *value)
     }
     else {
         /* insertion or replacement */
-        PyObject *old_value;
-        NodePayload pl = {key, value, kh};
-
-        LRU_ENTER_CRIT(self, -1);
-        res = lru_push_impl(self, &pl, &old_value);
-        LRU_LEAVE_CRIT(self);
-        if (res == 0) {
-            if (old_value == NULL) {
-                /* Inserted value */
-                if (PURGE_MAYBE_FAIL(self)) {
-                    res = -1;
-                }
-            }
-            else {
-                /* Replaced old_value */
-                Py_DECREF(old_value);
-            }
-        }  /* test whether push result "meaningful"; fall through if not */
-        return res;
+        return lru_setitem_impl(self, key, kh, value);
     }
 }
 
@@ -769,7 +1412,7 @@ lru_list_ftl(const LRUDict *self, lru_node_reader_func fcn)
 
         if ((obj = fcn(cur)) != NULL) {
             PyList_SET_ITEM(v, i++, obj);
-            cur = cur->next;
+            cur = NEXT_NODE(cur);
         }
         else {
             goto fail;
@@ -800,9 +1443,9 @@ LRU_keys(LRUDict *self, PyObject *Py_UNUSED(ignored))
 {
     PyObject *result;
 
-    LRU_ENTER_CRIT(self, NULL);
+    LRU_ENTER_CRIT_RO(self, NULL);
     result = lru_list_ftl(self, lru_node_key);
-    LRU_LEAVE_CRIT(self);
+    LRU_LEAVE_CRIT_RO(self);
     return result;
 }
 
@@ -823,9 +1466,9 @@ LRU_values(LRUDict *self, PyObject *Py_UNUSED(ignored))
 {
     PyObject *result;
 
-    LRU_ENTER_CRIT(self, NULL);
+    LRU_ENTER_CRIT_RO(self, NULL);
     result = lru_list_ftl(self, lru_node_value);
-    LRU_LEAVE_CRIT(self);
+    LRU_LEAVE_CRIT_RO(self);
     return result;
 }
 
@@ -849,9 +1492,9 @@ LRU_items(LRUDict *self, PyObject *Py_UNUSED(ignored))
 {
     PyObject *result;
 
-    LRU_ENTER_CRIT(self, NULL);
+    LRU_ENTER_CRIT_RO(self, NULL);
     result = lru_list_ftl(self, lru_tuplify_node);
-    LRU_LEAVE_CRIT(self);
+    LRU_LEAVE_CRIT_RO(self);
     return result;
 }
 
@@ -871,10 +1514,16 @@ LRU_get(LRUDict *self, PyObject *args)
     assert(key != NULL);
     assert(default_obj != NULL);
 
-    /* Subscripting changes the order of nodes, must protect. */
-    LRU_ENTER_CRIT(self, NULL);
-    status = lru_subscript_impl(self, key, &result);
-    LRU_LEAVE_CRIT(self);
+    if (unlikely(self->frozen)) {
+        status = lru_frozen_subscript_impl(self, key, &result);
+    }
+    else {
+        /* Subscripting changes the order of nodes, must protect. */
+        LRU_ENTER_CRIT(self, NULL);
+        status = lru_subscript_impl(self, key, &result);
+        LRU_LEAVE_CRIT(self);
+        LRU_HOT_FLUSH(self);
+    }
 
     if (status == 0) {
         return result ? result : (Py_INCREF(default_obj), default_obj);
@@ -887,6 +1536,22 @@ LRU_get(LRUDict *self, PyObject *args)
 }
 
 
+/* Whether the purge queue, bounded by max_staged, is to be purged before going
+ * on with a long operation: a purge is due, the queue is full and purging is
+ * not suspended, or n nodes have been dropped pending release. */
+static inline _Bool
+lru_staging_pressed(const LRUDict *self, size_t n)
+{
+    const LRUDict_pq *q = self->purge_queue;
+
+    return (q->max_staged > 0 &&
+            (q->purge_due ||
+             (!self->purge_suspended && LRU_STAGED(self) >= q->max_staged) ||
+             (q->dropped != NULL &&
+              (size_t)PyList_GET_SIZE(q->dropped) >= n)));
+}
+
+
 typedef struct _LRUUpdateBuf {
     PyObject **const restrict buf;
     const size_t len;
@@ -929,6 +1594,11 @@ lru_update_fill_buffer(LRUDict *self, PyObject *src,
                  * is not NULL */
                 i++;
             }
+
+            if (unlikely(lru_staging_pressed(self, updbuf->len))) {
+                /* Leave the pass early to purge. */
+                break;
+            }
         }
         else {
             /* src exhausted */
@@ -958,8 +1628,13 @@ lru_update_with(LRUDict *self, PyObject *other, update_buf_t *restrict updbuf)
     do {
         int status;
 
+        if (lru_make_room(self) != 0) {
+            fail = 1;
+            break;
+        }
         if (self->detect_conflict && self->internal_busy)
         {
+            LRU_PROBE1(busy, self);
             PyErr_SetString(LRUDictExc_BusyErr,
                             "attempted entry into LRUDict critical section"
                             " while busy");
@@ -984,6 +1659,15 @@ lru_update_with(LRUDict *self, PyObject *other, update_buf_t *restrict updbuf)
         for (size_t j = 0; j < updbuf->n_written; j++) {
             Py_DECREF(updbuf->buf[j]);
         }
+        LRU_HOT_FLUSH(self);
+
+        /* Keep the purge queue within max_staged. */
+        if (!leave && lru_staging_pressed(self, updbuf->len) &&
+            PURGE_MAYBE_FAIL(self))
+        {
+            fail = 1;
+            break;
+        }
     } while (!leave);
 
     return fail;
@@ -1001,12 +1685,12 @@ lru_update_with(LRUDict *self, PyObject *other, update_buf_t *restrict updbuf)
  * as large a buffer, because each existing value could have been subject to
  * replacement.
  *
- * XXX: Idea for improvement with memory use: the purge (eviction) list could
- * grow as big as the difference (their_length - our_capacity). This will make
- * eviction more time-efficent but potentially very memory-consuming. We could
- * also purge as we leave each pass, but that won't help much because a huge
- * source will not fill the replacement buffer as it pushes a huge amount of
- * elements to the list.
+ * The purge (eviction) list could grow as big as the difference
+ * (their_length - our_capacity), since a huge source will not fill the
+ * replacement buffer as it pushes a huge amount of elements to the list. This
+ * is time-efficient but potentially very memory-consuming. Unless max_staged
+ * is set, in which case a pass also ends once the list is to be purged, and
+ * it is purged before the next.
  */
 #define LRU_BATCH_MAX   64
 static PyObject *
@@ -1024,6 +1708,9 @@ LRU_update(LRUDict *self, PyObject *args, PyObject *kwargs)
         return NULL;
     }
 
+    LRU_FAIL_IF_FROZEN(self, NULL);
+
+    uint64_t t0 = LRU_LAT_START(self);
     update_buf_t updbuf = {
         .len = LRU_BATCH_MAX,
         .buf = PyMem_Malloc(LRU_BATCH_MAX * sizeof(PyObject *)),
@@ -1053,6 +1740,7 @@ cleanup:
     if (PURGE_MAYBE_FAIL(self)) {
         res = NULL;
     }
+    LRU_LAT_STOP(self, LRULAT_UPDATE, t0);
     Py_XINCREF(res);
     return res;
 }
@@ -1080,6 +1768,21 @@ LRU_setdefault(LRUDict *self, PyObject *args)
         return NULL;
     }
 
+    if (unlikely(self->frozen)) {
+        /* Only a hit is possible; inserting is not. */
+        index = direct_lookup(self->dict, key, kh, &ret_node);
+        if (ret_node != NULL) {
+            return lru_frozen_hit_impl(self, ret_node);
+        }
+        if (unlikely(index == DKIX_ERROR)) {
+            return NULL;
+        }
+        LRU_FAIL_IF_FROZEN(self, NULL);
+    }
+
+    if (lru_make_room(self) != 0) {
+        return NULL;
+    }
     LRU_ENTER_CRIT(self, NULL);
     /* Try borrowing a ref by key */
     index = direct_lookup(self->dict, key, kh, &ret_node);
@@ -1093,7 +1796,7 @@ LRU_setdefault(LRUDict *self, PyObject *args)
         int status;
         NodePayload pl = {key, default_obj, kh};
         /* key not in, this is not a miss, pack default_obj and insert */
-        if (unlikely((ret_node = node_getnewfrom(&pl)) == NULL)) {
+        if (unlikely((ret_node = LRU_NODE_NEW(self, &pl)) == NULL)) {
             LRU_LEAVE_CRIT(self);
             return NULL;
         }
@@ -1133,20 +1836,25 @@ LRU_pop(LRUDict *self, PyObject *args)
     PyObject *default_obj = NULL;
     PyObject *result;
     Node *ret_node;
+    Py_hash_t kh;
 
     if (!PyArg_ParseTuple(args, "O|O:pop", &key, &default_obj)) {
         return NULL;
     }
 
+    LRU_FAIL_IF_FROZEN(self, NULL);
+
+    /* Hash outside the critical section, since it may run Python code. */
+    if (unlikely((kh = get_hash(key)) == -1)) {
+        return NULL;
+    }
+
     /* Assignment method, must protect */
     LRU_ENTER_CRIT(self, NULL);
     /* Trying to access the item by key. */
-    ret_node = (Node *)_PyDict_Pop(self->dict, key, NULL);
-
-    if (ret_node) {
-        /* ret_node != NULL, delete it, unbox, and return value */
+    if (lru_popnode_impl(self, key, kh, &ret_node) == 0) {
+        /* ret_node has been deleted and detached; unbox, and return value */
         /* lru_hit_impl will do a promotion; don't use it. */
-        lru_detach_node(ret_node);
         Py_INCREF(ret_node->pl.value);
         result = ret_node->pl.value;
         self->hits++;
@@ -1155,7 +1863,7 @@ LRU_pop(LRUDict *self, PyObject *args)
 
         Py_DECREF(ret_node);
     }
-    else {    /* ret_node == NULL, i.e. key missing */
+    else {    /* key missing, or error in the lookup */
         self->misses++;
         if (default_obj != NULL) {      /* default_obj given */
             PyErr_Clear();
@@ -1183,6 +1891,8 @@ LRU_popitem(LRUDict *self, PyObject *args)
         return NULL;
     }
 
+    LRU_FAIL_IF_FROZEN(self, NULL);
+
     /* Assignment method, must protect */
     LRU_ENTER_CRIT(self, NULL);
 
@@ -1202,6 +1912,8 @@ LRU_popitem(LRUDict *self, PyObject *args)
                                       node->pl.key, node->pl.key_hash) == 0)
         {
             lru_detach_node(node);
+            lru_count_deletion(self);
+            LRU_TRACE(self, LRUTRACE_DEL, node->pl.key_hash, 1);
         }
         else { /* Somehow fails to delete from dict. */
             /* item_to_pop is now useless and must be destroyed */
@@ -1225,20 +1937,85 @@ LRU_popitem(LRUDict *self, PyObject *args)
 static PyObject *
 LRU_clear(LRUDict *self, PyObject *Py_UNUSED(ignored))
 {
+    PyObject *old_dict = NULL;
+    PyObject *new_dict;
+
+    LRU_FAIL_IF_FROZEN(self, NULL);
+    /* Keep the reservation with a new dict, if one can be had. */
+    if ((new_dict = lru_dict_new(lru_dict_target(self, 0))) == NULL) {
+        PyErr_Clear();
+    }
     /* Write into almost everything in self */
     LRU_ENTER_CRIT(self, NULL);
     /* Optimization hack: just let nodes go out of lifecycle by PyDict_Clear()
-     * (out of critical section; for fear of triggering the __del__ of objects
-     * referenced by nodes in turn), and let dealloc handle them. We can re-set
-     * the root's prev/next links and don't have to delink one by one. */
+     * or with the old dict (out of critical section; for fear of triggering
+     * the __del__ of objects referenced by nodes in turn), and let dealloc
+     * handle them. We can re-set the root's prev/next links and don't have to
+     * delink one by one. */
     assert(self->root != NULL);
-    FIRST_NODE(self) = LAST_NODE(self) = self->root;
-    self->misses = 0;
-    self->hits = 0;
+    lrung_link_init(&self->root->link);
+    if (new_dict != NULL) {
+        old_dict = self->dict;
+        self->dict = new_dict;
+        self->dict_peak = lru_dict_target(self, 0);
+    }
+    else {
+        self->dict_peak = 0;
+    }
+    self->xstats.misses_cleared = self->misses;
+    self->xstats.hits_cleared = self->hits;
+    LRU_LEAVE_CRIT(self);
+
+    if (old_dict != NULL) {
+        Py_DECREF(old_dict);
+    }
+    else {
+        PyDict_Clear(self->dict);   /* no return value (void) */
+    }
+
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+LRU_compact(LRUDict *self, PyObject *Py_UNUSED(ignored))
+{
+    int status;
+
+    LRU_FAIL_IF_FROZEN(self, NULL);
+    LRU_ENTER_CRIT(self, NULL);
+    status = lru_compact_impl(self);
     LRU_LEAVE_CRIT(self);
+    if (status != 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
 
-    PyDict_Clear(self->dict);   /* no return value (void) */
 
+static PyObject *
+LRU_reserve(LRUDict *self, PyObject *arg)
+{
+    Py_ssize_t n;
+    int status = 0;
+
+    if ((n = PyLong_AsSsize_t(arg)) == -1 && PyErr_Occurred()) {
+        return NULL;
+    }
+    if (n < 0) {
+        PyErr_SetString(PyExc_ValueError, "n must not be negative");
+        return NULL;
+    }
+    LRU_FAIL_IF_FROZEN(self, NULL);
+    LRU_ENTER_CRIT(self, NULL);
+    self->reserve = n;
+    if (lru_dict_target(self, lru_length_impl(self)) > self->dict_peak) {
+        status = lru_compact_impl(self);
+    }
+    LRU_LEAVE_CRIT(self);
+    if (status != 0) {
+        return NULL;
+    }
     Py_RETURN_NONE;
 }
 
@@ -1289,79 +2066,621 @@ LRU_to_dict(LRUDict *self, PyObject *Py_UNUSED(ignored))
         return NULL;
     }
 
-    LRU_ENTER_CRIT(self, NULL);
+    LRU_ENTER_CRIT_RO(self, NULL);
     while (IS_VALID_NODE_IN(self, n)) {
         int status = _PyDict_SetItem_KnownHash(dst,
                                                n->pl.key,
                                                n->pl.value,
                                                n->pl.key_hash);
         if (unlikely(status == -1)) {
-            LRU_LEAVE_CRIT(self);
+            LRU_LEAVE_CRIT_RO(self);
             Py_DECREF(dst);
             return NULL;
         }
-        n = n->prev;
+        n = PREV_NODE(n);
     }
-    LRU_LEAVE_CRIT(self);
+    LRU_LEAVE_CRIT_RO(self);
     return dst;
 }
 
 
 /* Hit/miss information */
+static inline uint64_t
+lru_hits(const LRUDict *self)
+{
+    return self->frozen ? self->frozen_stats->hits : self->hits;
+}
+
+
+static inline uint64_t
+lru_misses(const LRUDict *self)
+{
+    return self->frozen ? self->frozen_stats->misses : self->misses;
+}
+
+
+/* New LRUDictStats-like object of n items, with the struct-sequence type
+ * seqtype or, where that is broken, as a plain tuple. */
+static inline PyObject *
+lru_seq_new(PyTypeObject *seqtype, Py_ssize_t n)
+{
 #ifdef LRUDICT_STRUCT_SEQUENCE_NOT_BROKEN
-static PyObject *
-LRU_get_stats(LRUDict *self, PyObject *Py_UNUSED(ignored))
+    (void)n;
+    return PyStructSequence_New(seqtype);
+#else
+    (void)seqtype;
+    return PyTuple_New(n);
+#endif
+}
+
+
+#ifdef LRUDICT_STRUCT_SEQUENCE_NOT_BROKEN
+#define LRU_SEQ_SET(seq, i, v)  PyStructSequence_SetItem((seq), (i), (v))
+#else
+#define LRU_SEQ_SET(seq, i, v)  PyTuple_SET_ITEM((seq), (i), (v))
+#endif
+
+
+/* Fill the items of res from start on with n counters. */
+static int
+lru_seq_fill(PyObject *res, Py_ssize_t start, const uint64_t *counters,
+             Py_ssize_t n)
 {
-    PyObject *n;
-    PyObject *res = PyStructSequence_New(LRUDictStatsType);
-    if (res == NULL) {
-        goto fail;
-    }
+    Py_ssize_t i;
 
-    if ((n = PyLong_FromUnsignedLong(self->hits)) != NULL) {
-        PyStructSequence_SetItem(res, 0, n);
-    }
-    else {
-        goto fail;
+    for (i = 0; i < n; i++) {
+        PyObject *v = PyLong_FromUnsignedLongLong(counters[i]);
+
+        if (v == NULL) {
+            return -1;
+        }
+        LRU_SEQ_SET(res, start + i, v);
     }
+    return 0;
+}
+
+
+/* Build an LRUDictStats-like object from n counters. */
+static PyObject *
+lru_stats_new(PyTypeObject *seqtype, const uint64_t *counters, Py_ssize_t n)
+{
+    PyObject *res;
 
-    if ((n = PyLong_FromUnsignedLong(self->misses)) != NULL) {
-        PyStructSequence_SetItem(res, 1, n);
+    if ((res = lru_seq_new(seqtype, n)) == NULL) {
+        return NULL;
     }
-    else {
-        goto fail;
+    if (lru_seq_fill(res, 0, counters, n) != 0) {
+        Py_DECREF(res);
+        return NULL;
     }
-
     return res;
-
-fail:
-    Py_XDECREF(res);
-    return NULL;
 }
-#else /* LRUDICT_STRUCT_SEQUENCE_NOT_BROKEN */
+
+
 static PyObject *
 LRU_get_stats(LRUDict *self, PyObject *Py_UNUSED(ignored))
 {
-    return Py_BuildValue("(kk)", self->hits, self->misses);
+    uint64_t counters[2];
+
+    counters[0] = lru_hits(self) - self->xstats.hits_cleared;
+    counters[1] = lru_misses(self) - self->xstats.misses_cleared;
+    return lru_stats_new(LRUDictStatsType, counters, 2);
 }
-#endif /* LRUDICT_STRUCT_SEQUENCE_NOT_BROKEN */
 
 
-/* "Manual" purge once */
 static PyObject *
-LRU_purge(LRUDict *self, PyObject *Py_UNUSED(ignored))
+LRU_get_ext_stats(LRUDict *self, PyObject *Py_UNUSED(ignored))
+{
+    const LRUExtStats *x = &self->xstats;
+    const LRUDict_pq *q = self->purge_queue;
+    /* In the order of LRUDict_ext_stats_fields */
+    uint64_t counters[LRUDICT_EXT_STATS_N] = {
+        lru_hits(self),
+        lru_misses(self),
+        self->contains_stats[1],
+        self->contains_stats[0],
+        x->inserts,
+        x->replacements,
+        x->deletions,
+        x->evictions_staged + x->evictions_direct,
+        x->evictions_staged,
+        x->evictions_direct,
+        x->purges,
+        q->n_calls,
+        q->n_call_errors,
+        x->evictions_dropped,
+        (uint64_t)q->peak_len,
+    };
+
+    return lru_stats_new(LRUDictExtStatsType, counters, LRUDICT_EXT_STATS_N);
+}
+
+
+static PyObject *
+LRU_reset_stats(LRUDict *self, PyObject *Py_UNUSED(ignored))
 {
-    self->_pb = 1;
-    Py_ssize_t status = lru_purge_staging_impl(self, FORCE_PURGE);
-    return unlikely(status == -2) ? NULL : PyLong_FromSsize_t(status);
+    LRUDict_pq *q = self->purge_queue;
+
+    self->hits = self->misses = 0;
+    if (self->frozen) {
+        self->frozen_stats->hits = self->frozen_stats->misses = 0;
+    }
+    self->contains_stats[0] = self->contains_stats[1] = 0;
+    memset(&self->xstats, 0, sizeof(self->xstats));
+    q->n_calls = q->n_call_errors = 0;
+    q->peak_len = q->sinfo.tail - q->sinfo.head;
+    Py_RETURN_NONE;
 }
 
 
-#define MAP_BITFIELD(field, prop)                   \
-static PyObject *                                   \
-LRU_##prop##_getter(LRUDict *self, void *Py_UNUSED(closure))   \
-{if (self->field) {Py_RETURN_TRUE;} else {Py_RETURN_FALSE;}}   \
-static int                                          \
+/* Memory accounting. Sizes are those of the objects proper, as reported by
+ * sys.getsizeof(), not including the overhead of the allocator. */
+typedef struct {
+    size_t object;      /* the LRUDict */
+    size_t dict;        /* internal dict */
+    size_t nodes;       /* in the dict, and the root */
+    size_t purge_queue; /* with the staged nodes */
+    size_t tracking;    /* frozen counters, trace, hot keys, timing */
+} lru_memusage_t;
+
+
+/* Fill mu. Runs no Python code. Return -1 with exception set on failure. */
+static int
+lru_memusage_impl(LRUDict *self, lru_memusage_t *mu)
+{
+    const LRUDict_pq *q = self->purge_queue;
+    const Node *cur;
+    size_t size;
+
+    mu->object = (size_t)Py_TYPE(self)->tp_basicsize;
+    if ((size = _PySys_GetSizeOf(self->dict)) == (size_t)-1) {
+        return -1;
+    }
+    mu->dict = size;
+
+    /* The node type tells the size, as nodes may be timed. */
+    mu->nodes = sizeof(Node);
+    for (cur = FIRST_NODE(self); IS_VALID_NODE_IN(self, cur);
+         cur = NEXT_NODE(cur)) {
+        mu->nodes += (size_t)Py_TYPE(cur)->tp_basicsize;
+    }
+
+    if ((size = _PySys_GetSizeOf(q->lst)) == (size_t)-1) {
+        return -1;
+    }
+    mu->purge_queue = sizeof(LRUDict_pq) + size;
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(q->lst); i++) {
+        mu->purge_queue +=
+            (size_t)Py_TYPE(PyList_GET_ITEM(q->lst, i))->tp_basicsize;
+    }
+
+    mu->tracking = 0;
+    if (self->frozen_stats != NULL) {
+        mu->tracking += sizeof(LRUFrozenStats);
+    }
+#ifdef LRUTRACE_AVAILABLE
+    if (self->trace != NULL) {
+        mu->tracking += sizeof(LRUTrace) +
+                        (self->trace->mask + 1) * sizeof(lrutrace_rec);
+    }
+#endif
+    if (self->hot != NULL) {
+        mu->tracking += lruhot_sizeof(self->hot);
+    }
+    if (self->lat != NULL) {
+        mu->tracking += sizeof(LRULat);
+    }
+    if (self->age != NULL) {
+        mu->tracking += sizeof(LRUAge);
+    }
+    return 0;
+}
+
+
+static PyObject *
+LRU_sizeof(LRUDict *self, PyObject *Py_UNUSED(ignored))
+{
+    lru_memusage_t mu;
+
+    if (lru_memusage_impl(self, &mu) != 0) {
+        return NULL;
+    }
+    return PyLong_FromSize_t(mu.object + mu.dict + mu.nodes +
+                             mu.purge_queue + mu.tracking);
+}
+
+
+/* Add sys.getsizeof() of the key and value of node n to *keys and *values.
+ * May run Python code. */
+static int
+lru_memusage_node_deep(PyObject *n, size_t *keys, size_t *values)
+{
+    size_t k, v;
+
+    Py_INCREF(n);
+    k = _PySys_GetSizeOf(((Node *)n)->pl.key);
+    v = k == (size_t)-1 ? k : _PySys_GetSizeOf(((Node *)n)->pl.value);
+    Py_DECREF(n);
+    if (v == (size_t)-1) {
+        return -1;
+    }
+    *keys += k;
+    *values += v;
+    return 0;
+}
+
+
+static PyObject *
+LRU_memory_usage(LRUDict *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"deep", NULL};
+    int deep = 0;
+    lru_memusage_t mu;
+    size_t keys = 0, values = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|$p:memory_usage", kwlist,
+                                     &deep)) {
+        return NULL;
+    }
+    if (lru_memusage_impl(self, &mu) != 0) {
+        return NULL;
+    }
+    if (deep) {
+        /* The sizes are taken in a critical section, as __sizeof__ may be
+         * Python code. Even if that modifies self anyway, the dict and the
+         * list are traversed safely. */
+        PyObject *lst = self->purge_queue->lst;
+        PyObject *key, *n;
+        Py_ssize_t pos = 0;
+        int fail = 0;
+
+        LRU_ENTER_CRIT_RO(self, NULL);
+        while (!fail && PyDict_Next(self->dict, &pos, &key, &n)) {
+            fail = lru_memusage_node_deep(n, &keys, &values);
+        }
+        Py_INCREF(lst);
+        for (pos = 0; !fail && pos < PyList_GET_SIZE(lst); pos++) {
+            fail = lru_memusage_node_deep(PyList_GET_ITEM(lst, pos), &keys,
+                                          &values);
+        }
+        Py_DECREF(lst);
+        LRU_LEAVE_CRIT_RO(self);
+        if (fail) {
+            return NULL;
+        }
+    }
+    return Py_BuildValue(deep ? "{snsnsnsnsnsnsn}" : "{snsnsnsnsn}",
+                         "object", (Py_ssize_t)mu.object,
+                         "dict", (Py_ssize_t)mu.dict,
+                         "nodes", (Py_ssize_t)mu.nodes,
+                         "purge_queue", (Py_ssize_t)mu.purge_queue,
+                         "tracking", (Py_ssize_t)mu.tracking,
+                         "keys", (Py_ssize_t)keys,
+                         "values", (Py_ssize_t)values);
+}
+
+
+/* "Manual" purge once */
+static PyObject *
+LRU_purge(LRUDict *self, PyObject *Py_UNUSED(ignored))
+{
+    self->_pb = 1;
+    Py_ssize_t status = lru_purge_staging_impl(self, FORCE_PURGE);
+    return unlikely(status == -2) ? NULL : PyLong_FromSsize_t(status);
+}
+
+
+/* Immortalization is only meaningful where CPython has immortal objects
+ * (PEP 683) stored in the refcount field itself. */
+#if (PY_VERSION_HEX >= 0x030C0000) && (PY_VERSION_HEX < 0x030E0000) && \
+    defined(_Py_IMMORTAL_REFCNT) && !defined(Py_GIL_DISABLED)
+#define LRU_CAN_IMMORTALIZE 1
+static inline void
+lru_immortalize(PyObject *obj)
+{
+    obj->ob_refcnt = _Py_IMMORTAL_REFCNT;
+}
+#else
+#define LRU_CAN_IMMORTALIZE 0
+#endif
+
+
+/* Make self read-only. Pending evictions are purged first so that nothing is
+ * left for a later purge to write into. After that, lookups no longer promote
+ * nodes or enter the critical section, and hits/misses are counted in a newly
+ * allocated block. If requested (and possible), self and everything a lookup
+ * may INCREF are made immortal, so that reading from a forked child does not
+ * write to the pages shared with the parent. Immortal objects are never
+ * deallocated, so this leaks them together with the frozen_stats block; it is
+ * therefore not the default. */
+static PyObject *
+LRU_freeze(LRUDict *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"immortalize", NULL};
+    int immortalize = 0;
+    LRUFrozenStats *fstats;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|p:freeze", kwlist,
+                                     &immortalize))
+    {
+        return NULL;
+    }
+
+    if (self->frozen) {
+        Py_RETURN_NONE;
+    }
+
+    self->_pb = 1;
+    if (lru_purge_staging_impl(self, FORCE_PURGE) == -2) {
+        return NULL;
+    }
+
+    LRU_ENTER_CRIT(self, NULL);
+    if ((fstats = PyMem_RawMalloc(sizeof(LRUFrozenStats))) == NULL) {
+        LRU_LEAVE_CRIT(self);
+        return PyErr_NoMemory();
+    }
+    fstats->hits = self->hits;
+    fstats->misses = self->misses;
+    fstats->contains[0] = self->xstats.contains[0];
+    fstats->contains[1] = self->xstats.contains[1];
+    self->frozen_stats = fstats;
+    self->contains_stats = fstats->contains;
+    self->frozen = 1;
+#if LRU_CAN_IMMORTALIZE
+    if (immortalize) {
+        for (Node *n = FIRST_NODE(self); IS_VALID_NODE_IN(self, n);
+             n = NEXT_NODE(n))
+        {
+            lru_immortalize(n->pl.key);
+            lru_immortalize(n->pl.value);
+        }
+        lru_immortalize((PyObject *)self);
+    }
+#endif
+    LRU_LEAVE_CRIT(self);
+
+    Py_RETURN_NONE;
+}
+
+
+/* Start (or restart) tracking the k hottest keys, or stop if k is 0. */
+static PyObject *
+LRU_track_hot_keys(LRUDict *self, PyObject *arg)
+{
+    Py_ssize_t k = PyLong_AsSsize_t(arg);
+    LRUHot *old = self->hot, *hot = NULL;
+
+    if (k == -1 && PyErr_Occurred()) {
+        return NULL;
+    }
+    if (k != 0 && (hot = lruhot_new(k)) == NULL) {
+        return NULL;
+    }
+    /* Releasing the old keys may run arbitrary code. */
+    self->hot = hot;
+    if (old != NULL) {
+        lruhot_free(old);
+    }
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+LRU_top_keys(LRUDict *self, PyObject *args)
+{
+    Py_ssize_t n = -1;
+
+    if (!PyArg_ParseTuple(args, "|n:top_keys", &n)) {
+        return NULL;
+    }
+    if (self->hot == NULL) {
+        return PyList_New(0);
+    }
+    return lruhot_top(self->hot, n);
+}
+
+
+static void
+lru_lat_set(LRUDict *self, LRULat *lat)
+{
+    LRULat *old = self->lat;
+
+    self->lat = lat;
+    if (self->purge_queue != NULL) {
+        self->purge_queue->lat = lat;
+    }
+    if (old != NULL) {
+        lrulat_free(old);
+    }
+}
+
+
+/* Start (or restart, with empty histograms) timing operations, or stop. */
+static PyObject *
+LRU_track_latency(LRUDict *self, PyObject *arg)
+{
+    int enable = PyObject_IsTrue(arg);
+    LRULat *lat = NULL;
+
+    if (enable == -1) {
+        return NULL;
+    }
+    if (enable && (lat = lrulat_new()) == NULL) {
+        return NULL;
+    }
+    lru_lat_set(self, lat);
+    Py_RETURN_NONE;
+}
+
+
+/* lrulat_summary(), with the default percentiles if NULL. */
+static PyObject *
+lru_hist_summary(const LRULatHist *h, PyObject *percentiles)
+{
+    PyObject *res;
+
+    if (percentiles != NULL) {
+        return lrulat_summary(h, percentiles);
+    }
+    if ((percentiles = Py_BuildValue("(iiid)", 50, 90, 99, 99.9)) == NULL) {
+        return NULL;
+    }
+    res = lrulat_summary(h, percentiles);
+    Py_DECREF(percentiles);
+    return res;
+}
+
+
+/* Start (or restart) tracking the ages of evicted items, or stop. */
+static PyObject *
+LRU_track_eviction_age(LRUDict *self, PyObject *arg)
+{
+    int enable = PyObject_IsTrue(arg);
+    LRUAge *age = NULL;
+
+    if (enable == -1) {
+        return NULL;
+    }
+    if (enable && (age = PyMem_Calloc(1, sizeof(LRUAge))) == NULL) {
+        return PyErr_NoMemory();
+    }
+    PyMem_Free(self->age);
+    self->age = age;
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+LRU_eviction_age_histogram(LRUDict *self, PyObject *args)
+{
+    PyObject *since, *percentiles = NULL;
+    int access;
+
+    if (!PyArg_ParseTuple(args, "U|O:eviction_age_histogram", &since,
+                          &percentiles)) {
+        return NULL;
+    }
+    if (PyUnicode_CompareWithASCIIString(since, "access") == 0) {
+        access = 1;
+    }
+    else if (PyUnicode_CompareWithASCIIString(since, "insert") == 0) {
+        access = 0;
+    }
+    else {
+        PyErr_Format(PyExc_ValueError,
+                     "since must be 'insert' or 'access', not %R", since);
+        return NULL;
+    }
+    if (self->age == NULL) {
+        Py_RETURN_NONE;
+    }
+    return lru_hist_summary(access ? &self->age->since_access :
+                            &self->age->since_insert, percentiles);
+}
+
+
+static PyObject *
+LRU_latency_histogram(LRUDict *self, PyObject *args)
+{
+    PyObject *name, *percentiles = NULL;
+    int op;
+
+    if (!PyArg_ParseTuple(args, "O|O:latency_histogram", &name,
+                          &percentiles)) {
+        return NULL;
+    }
+    if ((op = lrulat_op_from_name(name)) == -1) {
+        return NULL;
+    }
+    if (self->lat == NULL) {
+        Py_RETURN_NONE;
+    }
+    return lru_hist_summary(self->lat->hist + op, percentiles);
+}
+
+
+#ifdef LRUTRACE_AVAILABLE
+static PyObject *
+LRU_start_trace(LRUDict *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"path", "sample", "buffer_size", NULL};
+    PyObject *path;
+    double sample = 1.0;
+    Py_ssize_t buffer_size = 65536;
+    LRUTrace *tr;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|dn:start_trace", kwlist,
+                                     &path, &sample, &buffer_size))
+    {
+        return NULL;
+    }
+    if (self->trace != NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "trace already started");
+        return NULL;
+    }
+    if ((tr = lrutrace_start(path, buffer_size, sample)) == NULL) {
+        return NULL;
+    }
+    /* Opening the file may have let another thread start a trace too. */
+    if (self->trace != NULL) {
+        uint64_t written, dropped;
+
+        lrutrace_stop(tr, &written, &dropped);
+        PyErr_SetString(PyExc_RuntimeError, "trace already started");
+        return NULL;
+    }
+    self->trace = tr;
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+LRU_stop_trace(LRUDict *self, PyObject *Py_UNUSED(ignored))
+{
+    LRUTrace *tr = self->trace;
+    uint64_t written, dropped;
+
+    if (tr == NULL) {
+        Py_RETURN_NONE;
+    }
+    /* Detach first: the GIL is released while the thread finishes. */
+    self->trace = NULL;
+    if (lrutrace_stop(tr, &written, &dropped) == -1) {
+        return NULL;
+    }
+    return Py_BuildValue("(KK)", (unsigned long long)written,
+                         (unsigned long long)dropped);
+}
+#endif /* LRUTRACE_AVAILABLE */
+
+
+static PyObject *
+LRU_frozen_getter(LRUDict *self, void *Py_UNUSED(closure))
+{
+    if (self->frozen) {
+        Py_RETURN_TRUE;
+    }
+    Py_RETURN_FALSE;
+}
+
+
+static PyObject *
+LRU_name_getter(LRUDict *self, void *Py_UNUSED(closure))
+{
+    if (self->name == NULL) {
+        Py_RETURN_NONE;
+    }
+    Py_INCREF(self->name);
+    return self->name;
+}
+
+
+#define MAP_BITFIELD(field, prop)                   \
+static PyObject *                                   \
+LRU_##prop##_getter(LRUDict *self, void *Py_UNUSED(closure))   \
+{if (self->field) {Py_RETURN_TRUE;} else {Py_RETURN_FALSE;}}   \
+static int                                          \
 LRU_##prop##_setter(LRUDict *self, PyObject *value, void *Py_UNUSED(closure))\
 {   int v;                                      \
     if (value == NULL) {                        \
@@ -1390,54 +2709,192 @@ LRU__purge_queue_size_getter(LRUDict *self, void *Py_UNUSED(closure))
     if (self->purge_queue) {
         len = self->purge_queue->sinfo.tail;
     }
-    return PyLong_FromSsize_t(len);
+    return PyLong_FromSsize_t(len);
+}
+
+
+static PyObject *
+LRU__max_pending_callbacks_getter(LRUDict *self, void *Py_UNUSED(closure))
+{
+    if (self->purge_queue) {
+        unsigned long ires = (unsigned long)(self->purge_queue->n_max);
+        return PyLong_FromUnsignedLong(ires);
+    }
+    else {
+        PyErr_SetString(PyExc_MemoryError, "purge queue pointer is NULL");
+        return NULL;
+    }
+}
+
+
+static int
+LRU__max_pending_callbacks_setter(LRUDict *self, PyObject *value,
+                                  void *Py_UNUSED(closure))
+{
+    if (value == NULL) {
+        PyErr_SetString(PyExc_AttributeError,
+                        "can't delete _max_pending_callbacks");
+        return -1;
+    }
+
+    if (self->purge_queue == NULL) {
+        PyErr_SetString(PyExc_MemoryError, "purge queue pointer is NULL");
+        return -1;
+    }
+
+    Py_ssize_t ires = PyLong_AsSsize_t(value);
+
+    if (PyErr_Occurred()) {
+        return -1;
+    }
+
+    if (ires < 1 || ires > (Py_ssize_t)USHRT_MAX) {
+        PyErr_Format(PyExc_ValueError,
+                     "value must be between 1 and %u", USHRT_MAX);
+        return -1;
+    }
+    else {
+        self->purge_queue->n_max = (unsigned short)ires;
+        return 0;
+    }
+}
+
+
+/* Convert the value of a bound property called name, a positive integer or
+ * None (for which *res is 0). Return 0, or -1 with exception set. */
+static int
+lru_bound_converter(PyObject *value, const char *name, Py_ssize_t *res)
+{
+    Py_ssize_t n;
+
+    if (value == NULL) {
+        PyErr_Format(PyExc_AttributeError, "can't delete %s", name);
+        return -1;
+    }
+    if (value == Py_None) {
+        *res = 0;
+        return 0;
+    }
+    if (!PyLong_Check(value)) {
+        PyErr_Format(PyExc_TypeError, "%s must be an integer or None", name);
+        return -1;
+    }
+    n = PyLong_AsSsize_t(value);
+    if (n == -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    if (n < 1) {
+        PyErr_Format(PyExc_ValueError, "%s must be positive", name);
+        return -1;
+    }
+    *res = n;
+    return 0;
+}
+
+
+static inline PyObject *
+lru_bound_getter(Py_ssize_t n)
+{
+    if (n == 0) {
+        Py_RETURN_NONE;
+    }
+    return PyLong_FromSsize_t(n);
+}
+
+
+/* Bound on the purge queue and the policy for overflowing it */
+static PyObject *
+LRU_max_staged_getter(LRUDict *self, void *Py_UNUSED(closure))
+{
+    return lru_bound_getter(self->purge_queue->max_staged);
+}
+
+
+static int
+LRU_max_staged_setter(LRUDict *self, PyObject *value,
+                      void *Py_UNUSED(closure))
+{
+    return lru_bound_converter(value, "max_staged",
+                               &self->purge_queue->max_staged);
+}
+
+
+/* Budget of an automatic purge */
+static PyObject *
+LRU_purge_budget_getter(LRUDict *self, void *Py_UNUSED(closure))
+{
+    return lru_bound_getter(self->purge_queue->budget_items);
+}
+
+
+static int
+LRU_purge_budget_setter(LRUDict *self, PyObject *value,
+                        void *Py_UNUSED(closure))
+{
+    return lru_bound_converter(value, "purge_budget",
+                               &self->purge_queue->budget_items);
+}
+
+
+static PyObject *
+LRU_purge_budget_us_getter(LRUDict *self, void *Py_UNUSED(closure))
+{
+    return lru_bound_getter(
+            (Py_ssize_t)(self->purge_queue->budget_ns / 1000));
+}
+
+
+static int
+LRU_purge_budget_us_setter(LRUDict *self, PyObject *value,
+                           void *Py_UNUSED(closure))
+{
+    Py_ssize_t us;
+
+    if (lru_bound_converter(value, "purge_budget_us", &us) == -1) {
+        return -1;
+    }
+    if (us > PY_SSIZE_T_MAX / 1000) {
+        us = PY_SSIZE_T_MAX / 1000;
+    }
+    self->purge_queue->budget_ns = (uint64_t)us * 1000;
+    return 0;
 }
 
 
+/* Indexed by LRUPQ_OVERFLOW_* */
+static const char *const lru_overflow_names[] = {"purge", "drop", "raise"};
+
+
 static PyObject *
-LRU__max_pending_callbacks_getter(LRUDict *self, void *Py_UNUSED(closure))
+LRU_overflow_getter(LRUDict *self, void *Py_UNUSED(closure))
 {
-    if (self->purge_queue) {
-        unsigned long ires = (unsigned long)(self->purge_queue->n_max);
-        return PyLong_FromUnsignedLong(ires);
-    }
-    else {
-        PyErr_SetString(PyExc_MemoryError, "purge queue pointer is NULL");
-        return NULL;
-    }
+    return PyUnicode_FromString(
+            lru_overflow_names[self->purge_queue->overflow]);
 }
 
 
 static int
-LRU__max_pending_callbacks_setter(LRUDict *self, PyObject *value,
-                                  void *Py_UNUSED(closure))
+LRU_overflow_setter(LRUDict *self, PyObject *value, void *Py_UNUSED(closure))
 {
     if (value == NULL) {
-        PyErr_SetString(PyExc_AttributeError,
-                        "can't delete _max_pending_callbacks");
-        return -1;
-    }
-
-    if (self->purge_queue == NULL) {
-        PyErr_SetString(PyExc_MemoryError, "purge queue pointer is NULL");
-        return -1;
-    }
-
-    Py_ssize_t ires = PyLong_AsSsize_t(value);
-
-    if (PyErr_Occurred()) {
+        PyErr_SetString(PyExc_AttributeError, "can't delete overflow");
         return -1;
     }
-
-    if (ires < 1 || ires > (Py_ssize_t)USHRT_MAX) {
-        PyErr_Format(PyExc_ValueError,
-                     "value must be between 1 and %u", USHRT_MAX);
+    if (!PyUnicode_Check(value)) {
+        PyErr_SetString(PyExc_TypeError, "overflow must be a str");
         return -1;
     }
-    else {
-        self->purge_queue->n_max = (unsigned short)ires;
-        return 0;
+    for (unsigned char i = 0; i < Py_ARRAY_LENGTH(lru_overflow_names); i++) {
+        if (PyUnicode_CompareWithASCIIString(value,
+                                             lru_overflow_names[i]) == 0)
+        {
+            self->purge_queue->overflow = i;
+            return 0;
+        }
     }
+    PyErr_SetString(PyExc_ValueError,
+                    "overflow must be 'purge', 'drop', or 'raise'");
+    return -1;
 }
 
 
@@ -1486,10 +2943,28 @@ static PyMethodDef LRU_methods[] = {
         PyDoc_STR("get_size(self, /)\n--\n\n-> int\nReturn the size (capacity) of the LRUDict.\n*Deprecated:* Access the ``size`` attribute instead.")},
     {"clear",
         (PyCFunction)LRU_clear, METH_NOARGS,
-        PyDoc_STR("clear(self, /)\n--\n\n-> None\nClear the contents in the LRUDict and reset its hit/miss counters. The callback will not be called.")},
+        PyDoc_STR("clear(self, /)\n--\n\n-> None\nClear the contents in the LRUDict and reset its hit/miss counters as reported by get_stats(). The callback will not be called.")},
     {"get_stats",
         (PyCFunction)LRU_get_stats, METH_NOARGS,
-        PyDoc_STR("get_stats(self, /)\n--\n\n-> Tuple[int, int]\nReturn a tuple of (hits, misses).\nNotice that hits/misses are represented as C ``unsigned long`` internally and may overflow.")},
+        PyDoc_STR("get_stats(self, /)\n--\n\n-> Tuple[int, int]\nReturn a tuple of (hits, misses) since the last clear() or reset_stats().")},
+    {"get_ext_stats",
+        (PyCFunction)LRU_get_ext_stats, METH_NOARGS,
+        PyDoc_STR("get_ext_stats(self, /)\n--\n\n-> LRUDictExtStats\nReturn a named tuple of operational counters since the creation of the LRUDict or the last reset_stats(): hits, misses, contains_true, contains_false, inserts, replacements, deletions, evictions, evictions_staged, evictions_direct, purges, callbacks, callback_errors, evictions_dropped, and purge_queue_peak.\nThe counters are not reset by clear().")},
+    {"__sizeof__",
+        (PyCFunction)LRU_sizeof, METH_NOARGS,
+        PyDoc_STR("__sizeof__(self, /)\n--\n\n-> int\nReturn the size of the LRUDict in bytes, including its internal dict, nodes, purge queue, and tracking data, but not the keys and values.")},
+    {"memory_usage",
+        (PyCFunction)(void(*)(void))LRU_memory_usage, METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("memory_usage(self, *, deep=False)\n--\n\n-> Dict[str, int]\nReturn the sizes in bytes of the parts of the LRUDict, as a dict with the keys \"object\", \"dict\", \"nodes\", \"purge_queue\", and \"tracking\". They add up to self.__sizeof__(), to which sys.getsizeof() adds the garbage collector's header.\nIf deep is True, also include \"keys\" and \"values\", the sums of sys.getsizeof() of the keys and values of the items, including the evicted ones in the purge queue.")},
+    {"compact",
+        (PyCFunction)LRU_compact, METH_NOARGS,
+        PyDoc_STR("compact(self, /)\n--\n\n-> None\nRebuild the internal dict at the size of its contents (or of the reservation, if larger), releasing the memory left over by deletions.\nThis is done automatically when the length falls below a quarter of the largest length since the dict was last built, for up to 65536 items.")},
+    {"reserve",
+        (PyCFunction)LRU_reserve, METH_O,
+        PyDoc_STR("reserve(self, n, /)\n--\n\n-> None\nPresize the internal dict for n items (up to the size), so that filling the LRUDict up to n items does not resize it. The reservation is kept by clear() and compact(). CPython presizes a dict for at most 87381 items, beyond which the dict grows as usual.")},
+    {"reset_stats",
+        (PyCFunction)LRU_reset_stats, METH_NOARGS,
+        PyDoc_STR("reset_stats(self, /)\n--\n\n-> None\nReset all the counters reported by get_stats() and get_ext_stats(). The peak length of the purge queue is reset to the current length.")},
     {"peek_first_item",
         (PyCFunction)LRU_peek_first_item, METH_NOARGS,
         PyDoc_STR("peek_first_item(self, /)\n--\n\n-> Tuple[Object, Object]\nReturn the MRU item as tuple (key, value) without changing the key order.")},
@@ -1505,6 +2980,35 @@ static PyMethodDef LRU_methods[] = {
     {"set_callback",
         (PyCFunction)LRU_set_callback_legacy, METH_VARARGS,
         PyDoc_STR("set_callback(self, callback, /)\n--\n\n-> None\nSet a callback to call when an item is evicted.\nThe callaback has the type Callable[[Object, Object], Any], i.e.,\n    callaback(key, value)\nRaise TypeError if callback is not a callable object that is not None. Setting callback to None disables the callback mechanism.\n*Deprecated:* Assign to the ``callback`` property instead.")},
+    {"freeze",
+        (PyCFunction)(void(*)(void))LRU_freeze, METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("freeze(self, /, immortalize=False)\n--\n\n-> None\nMake the LRUDict read-only.\nPending evictions are purged first. Afterwards, lookups neither change the recent-use order nor write into the LRUDict, and methods that would modify it raise TypeError. Hits and misses continue to be counted in a separate block. On CPython 3.12 and 3.13, if immortalize is True, the LRUDict and its keys and values are also made immortal. They are then never deallocated: their memory, and that of the block of counters, is leaked for the rest of the process.\nFreezing is irreversible.")},
+    {"track_hot_keys",
+        (PyCFunction)LRU_track_hot_keys, METH_O,
+        PyDoc_STR("track_hot_keys(self, k, /)\n--\n\n-> None\nStart counting the accesses to the k most frequently used keys, or stop if k is 0. Any previous counts are discarded.\nLookups and assignments are counted with the Space-Saving algorithm, which needs memory for k keys only; see top_keys().")},
+    {"top_keys",
+        (PyCFunction)LRU_top_keys, METH_VARARGS,
+        PyDoc_STR("top_keys(self, n=-1, /)\n--\n\n-> List[Tuple[Object, int, int]]\nReturn a list of up to n (or all, if negative) tuples (key, count, error) of the tracked keys, in descending order of count. The true number of accesses to the key lies between count - error and count. Any key accessed more than (total accesses) / k times is in the list.\nReturn an empty list if keys are not being tracked.")},
+    {"track_latency",
+        (PyCFunction)LRU_track_latency, METH_O,
+        PyDoc_STR("track_latency(self, enable, /)\n--\n\n-> None\nStart timing the operations \"get\", \"set\", \"update\", \"evict\", \"purge\", and \"callback\" if enable is true, or stop if false. Any previous histograms are discarded.\nSee latency_histogram().")},
+    {"latency_histogram",
+        (PyCFunction)LRU_latency_histogram, METH_VARARGS,
+        PyDoc_STR("latency_histogram(self, op, percentiles=(50, 90, 99, 99.9), /)\n--\n\n-> Optional[Dict]\nReturn the histogram of durations of the operation op, in nanoseconds, as a dict with the keys \"count\", \"total\", \"max\", \"buckets\" (list of (low, high, count) tuples of the non-empty buckets, each covering the range [low, high)), and \"percentiles\" (mapping each of the given percentiles to a duration).\nReturn None if operations are not being timed.")},
+    {"track_eviction_age",
+        (PyCFunction)LRU_track_eviction_age, METH_O,
+        PyDoc_STR("track_eviction_age(self, enable, /)\n--\n\n-> None\nStart recording the times of insertion and last access of the items inserted from now on, and the ages of those evicted, if enable is true; or stop if false. Any previous histograms are discarded.\nSee eviction_age_histogram().")},
+    {"eviction_age_histogram",
+        (PyCFunction)LRU_eviction_age_histogram, METH_VARARGS,
+        PyDoc_STR("eviction_age_histogram(self, since, percentiles=(50, 90, 99, 99.9), /)\n--\n\n-> Optional[Dict]\nReturn the histogram of the ages of the evicted items, in nanoseconds since their insertion if since is \"insert\", or since their last access if \"access\". The dict is as returned by latency_histogram().\nReturn None if the ages are not being tracked.")},
+#ifdef LRUTRACE_AVAILABLE
+    {"start_trace",
+        (PyCFunction)(void(*)(void))LRU_start_trace, METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("start_trace(self, path, sample=1.0, buffer_size=65536)\n--\n\n-> None\nStart recording accesses to the binary file at path, which is overwritten.\nEach lookup, insertion or replacement, deletion, and eviction is recorded with the key's hash, whether the key was found, and the time. Records go to a buffer of buffer_size records, which a background thread writes to the file; if the buffer is full, records are dropped. Only keys whose hash falls in a fraction sample of the hash space are recorded. Read the file with lru_ng.read_trace().\nRaise RuntimeError if a trace is already being recorded.")},
+    {"stop_trace",
+        (PyCFunction)LRU_stop_trace, METH_NOARGS,
+        PyDoc_STR("stop_trace(self, /)\n--\n\n-> Optional[Tuple[int, int]]\nStop recording, write the remaining records, and close the file.\nReturn a tuple of the numbers of records written and dropped, or None if no trace was being recorded.")},
+#endif
     {"purge",
         (PyCFunction)LRU_purge, METH_NOARGS,
         PyDoc_STR("purge(self, /)\n--\n\n-> int\nReturn the number of items purged.\nManually purge the evicted items in the eviction queue for once. During the purge, more items may have been added to the eviction queue by another thread.")},
@@ -1524,6 +3028,36 @@ static PyGetSetDef LRU_descriptors[] = {
         (setter)LRU_callback_setter,
         PyDoc_STR("Callback object with the signature\n    callback(key, value)\nIf set to a callable, the (key, value) pair will be passed to it after evicted from the LRUDict. If set to None, disable the callback mechanism. Setting it to a non-callable object that is not None raises TypeError."),
         NULL},
+    {"frozen",
+        (getter)LRU_frozen_getter,
+        NULL,
+        PyDoc_STR("Boolean value indicating whether the LRUDict has been frozen by the freeze() method."),
+        NULL},
+    {"name",
+        (getter)LRU_name_getter,
+        NULL,
+        PyDoc_STR("Name given at construction (a str), or None. It identifies the LRUDict in the snapshots returned by lru_ng.instances()."),
+        NULL},
+    {"max_staged",
+        (getter)LRU_max_staged_getter,
+        (setter)LRU_max_staged_setter,
+        PyDoc_STR("Maximal number of evicted items staged in the purge queue, or None (the default) for no bound. What happens to the evictions beyond it is decided by the overflow property."),
+        NULL},
+    {"overflow",
+        (getter)LRU_overflow_getter,
+        (setter)LRU_overflow_setter,
+        PyDoc_STR("Policy for the evictions beyond max_staged: 'purge' (the default) to stage them anyway and purge at the end of the method call, even while purging is suspended; 'drop' to release them without the callback; or 'raise' to refuse the method call with LRUDictBusyError."),
+        NULL},
+    {"purge_budget",
+        (getter)LRU_purge_budget_getter,
+        (setter)LRU_purge_budget_setter,
+        PyDoc_STR("Maximal number of evicted items handed to the callback by an automatic purge (at the end of a method call), or None (the default) for no bound. The rest is left in the purge queue for the purges to come, or for purge(), which is not bounded."),
+        NULL},
+    {"purge_budget_us",
+        (getter)LRU_purge_budget_us_getter,
+        (setter)LRU_purge_budget_us_setter,
+        PyDoc_STR("Time in microseconds after which an automatic purge stops handing evicted items to the callback, or None (the default) for no bound. At least one item is handed on each time. The rest is left as with purge_budget."),
+        NULL},
     {"_max_pending_callbacks",
         (getter)LRU__max_pending_callbacks_getter,
         (setter)LRU__max_pending_callbacks_setter,
@@ -1645,36 +3179,91 @@ LRU_repr(LRUDict *self)
 
 
 /* __init__ */
+/* Registry of live LRUDict objects for lru_ng.instances(). It holds no
+ * references: an object is linked in by a successful __init__() and unlinked
+ * by tp_clear before its resources are released. It is process-wide rather
+ * than module state, because LRUDictType is a static type shared by every
+ * (sub)interpreter that imports the module, and is only touched under the
+ * GIL. */
+static lrung_link lru_registry = {&lru_registry, &lru_registry};
+
+
+static void
+lru_register(LRUDict *self)
+{
+    if (self->registry.next == NULL) {
+        lrung_link_attach_after(&lru_registry, &self->registry);
+    }
+}
+
+
+static void
+lru_unregister(LRUDict *self)
+{
+    if (self->registry.next != NULL) {
+        lrung_link_detach(&self->registry);
+        self->registry.next = self->registry.prev = NULL;
+    }
+}
+
+
 static int
 LRU_init(LRUDict *self, PyObject *args, PyObject *kwds)
 {
     Py_ssize_t initial_size = 0;
-    static char *kwlist[] = {"size", "callback", NULL};
+    static char *kwlist[] = {"size", "callback", "name", "reserve", NULL};
     PyObject *callback = Py_None;
+    PyObject *name = Py_None;
+    PyObject *reserve_obj = Py_None;
+    Py_ssize_t reserve;
 
+    LRU_FAIL_IF_FROZEN(self, -1);
     self->internal_busy = 0;
 
-    /* Allocate resoures */
-    if ((self->dict = PyDict_New()) == NULL) {
-        PyErr_SetString(PyExc_MemoryError, "internal dict allocation failure");
+    if (!PyArg_ParseTupleAndKeywords(args, kwds,
+                                     "n|O$OO:__init__",
+                                     kwlist, &initial_size, &callback, &name,
+                                     &reserve_obj))
+    {
+        return -1;
+    }
+    if (initial_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be positive");
+        return -1;
+    }
+    if (name != Py_None && !PyUnicode_Check(name)) {
+        PyErr_Format(PyExc_TypeError, "name must be str or None, not %.200s",
+                     Py_TYPE(name)->tp_name);
+        return -1;
+    }
+    if (reserve_obj == Py_None) {
+        reserve = Py_MIN(initial_size, LRU_RESERVE_DEFAULT);
+    }
+    else if ((reserve = PyLong_AsSsize_t(reserve_obj)) == -1 &&
+             PyErr_Occurred())
+    {
+        return -1;
+    }
+    if (reserve < 0) {
+        PyErr_SetString(PyExc_ValueError, "reserve must not be negative");
         return -1;
     }
+    self->reserve = reserve;
 
-    if ((self->purge_queue = lrupq_new()) == NULL) {
+    /* Allocate resoures */
+    if ((self->dict = lru_dict_new(Py_MIN(reserve, initial_size))) == NULL) {
         return -1;
     }
 
-    /* Modify own structure member values */
-    if (!PyArg_ParseTupleAndKeywords(args, kwds,
-                                     "n|O:__init__",
-                                     kwlist, &initial_size, &callback))
-    {
+    if ((self->purge_queue = lrupq_new()) == NULL) {
         return -1;
     }
 
-    if (lru_set_size_impl(self, initial_size) == -1) {
+    /* The dict is new, and nothing is evicted. */
+    if (lru_set_size_impl(self, initial_size, NULL) == -1) {
         return -1;
     }
+    self->dict_peak = lru_dict_target(self, 0);
 
     if (lru_set_callback_impl(self, callback) == -1) {
         return -1;
@@ -1691,14 +3280,21 @@ LRU_init(LRUDict *self, PyObject *args, PyObject *kwds)
         self->root = NULL;
         return -1;
     }
-    root_node->next = root_node->prev = root_node;
+    lrung_link_init(&root_node->link);
     self->root = root_node;
 
     self->hits = 0;
     self->misses = 0;
+    memset(&self->xstats, 0, sizeof(self->xstats));
+    self->contains_stats = self->xstats.contains;
     self->purge_suspended = 0;
     self->detect_conflict = 1;
+    self->frozen = 0;
+    self->frozen_stats = NULL;
     self->_pb = 0;
+    Py_INCREF(name);
+    Py_XSETREF(self->name, name);
+    lru_register(self);
     return 0;
 }
 
@@ -1710,9 +3306,11 @@ LRU_fini(LRUDict *self)
     PyObject *exc_type, *exc_value, *traceback;
     PyErr_Fetch(&exc_type, &exc_value, &traceback);
 
-    /* One last chance to honour any callback. */
+    /* One last chance to honour any callback, if __init__() got so far. */
     self->_pb = 1;
-    if (lru_purge_staging_impl(self, FORCE_PURGE) == -2) {
+    if (self->purge_queue != NULL &&
+        lru_purge_staging_impl(self, FORCE_PURGE) == -2)
+    {
         PyErr_WriteUnraisable((PyObject *)self);
     }
 
@@ -1741,7 +3339,10 @@ LRU_traverse(LRUDict *self, visitproc visit, void *arg)
     Node *restrict cur;
     Py_ssize_t pos = 0;
 
-    while(PyDict_Next(self->dict, &pos, &key, (PyObject **restrict)&cur)) {
+    /* A collection may happen before __init__() has made the dict, or after
+     * tp_clear has released it. */
+    while (self->dict != NULL &&
+           PyDict_Next(self->dict, &pos, &key, (PyObject **restrict)&cur)) {
         Py_VISIT(key);
         if (cur->pl.key != key) {
             Py_VISIT(cur->pl.key);
@@ -1760,9 +3361,26 @@ LRU_traverse(LRUDict *self, visitproc visit, void *arg)
         }
     }
 
+    if (self->purge_queue && self->purge_queue->dropped) {
+        Py_ssize_t len = PyList_GET_SIZE(self->purge_queue->dropped);
+        for (pos = 0; pos < len; pos++) {
+            cur = (Node *restrict)PyList_GET_ITEM(self->purge_queue->dropped,
+                                                  pos);
+            Py_VISIT(cur->pl.key);
+            Py_VISIT(cur->pl.value);
+        }
+    }
+
     if (self->callback) {
         Py_VISIT(self->callback);
     }
+
+    if (self->hot) {
+        for (uint32_t i = 0; i < self->hot->n; i++) {
+            Py_VISIT(self->hot->entry[i].key);
+        }
+        Py_VISIT(self->hot->retired);
+    }
     return 0;
 }
 
@@ -1772,6 +3390,8 @@ LRU_traverse(LRUDict *self, visitproc visit, void *arg)
 static int
 LRU_tp_clear(LRUDict *self)
 {
+    lru_unregister(self);
+
     /* Release storage (and all nodes in it) */
     if (self->dict) {
         self->internal_busy = 0;
@@ -1780,6 +3400,11 @@ LRU_tp_clear(LRUDict *self)
         Py_CLEAR(self->dict);
     }
 
+    if (self->lat) {
+        /* A purge still in progress must not see it. */
+        lru_lat_set(self, NULL);
+    }
+
     if (self->purge_queue) {
         /* Release purge queue */
         if (lrupq_free(self->purge_queue) == -1) {
@@ -1799,6 +3424,17 @@ LRU_tp_clear(LRUDict *self)
 
     /* Dispose of reference to callback if any. */
     Py_CLEAR(self->callback);
+
+    if (self->hot) {
+        LRUHot *hot = self->hot;
+
+        self->hot = NULL;
+        lruhot_free(hot);
+    }
+
+    PyMem_Free(self->age);
+    self->age = NULL;
+    Py_CLEAR(self->name);
     return 0;
 }
 
@@ -1814,8 +3450,20 @@ LRU_dealloc(LRUDict *self)
 
     PyObject_GC_UnTrack((PyObject *)self);
 
+#ifdef LRUTRACE_AVAILABLE
+    if (self->trace != NULL) {
+        uint64_t written, dropped;
+        LRUTrace *tr = self->trace;
+
+        self->trace = NULL;
+        if (lrutrace_stop(tr, &written, &dropped) == -1) {
+            PyErr_WriteUnraisable((PyObject *)self);
+        }
+    }
+#endif
     LRU_tp_clear(self);
     Py_CLEAR(self->root);
+    PyMem_RawFree(self->frozen_stats);
     Py_TYPE(self)->tp_free((PyObject *)self);
 }
 
@@ -1861,6 +3509,230 @@ static PyTypeObject LRUDictType = {
 };
 
 
+/* C API exported as capsule; see lru_ng_capi.h */
+#define LRU_CAPI_CHECK(obj, failresult)                             \
+do {                                                                \
+    if (unlikely(!PyObject_TypeCheck((obj), &LRUDictType))) {       \
+        PyErr_Format(PyExc_TypeError, "expected LRUDict, got %s",   \
+                     Py_TYPE(obj)->tp_name);                        \
+        return (failresult);                                        \
+    }                                                               \
+} while (0)
+
+
+static inline Py_hash_t
+lru_capi_hash(PyObject *key, Py_hash_t hash)
+{
+    return hash == -1 ? get_hash(key) : hash;
+}
+
+
+static int
+lru_capi_lookup_known_hash(PyObject *lru, PyObject *key, Py_hash_t hash,
+                           PyObject **value)
+{
+    LRUDict *self = (LRUDict *)lru;
+    int status;
+
+    *value = NULL;
+    LRU_CAPI_CHECK(lru, -1);
+    if (unlikely((hash = lru_capi_hash(key, hash)) == -1)) {
+        return -1;
+    }
+
+    if (unlikely(self->frozen)) {
+        status = lru_frozen_subscript_kh_impl(self, key, hash, value);
+    }
+    else {
+        LRU_ENTER_CRIT(self, -1);
+        status = lru_subscript_kh_impl(self, key, hash, value);
+        LRU_LEAVE_CRIT(self);
+        LRU_HOT_FLUSH(self);
+    }
+    return status == 0 ? (*value != NULL) : -1;
+}
+
+
+static int
+lru_capi_insert_known_hash(PyObject *lru, PyObject *key, Py_hash_t hash,
+                           PyObject *value)
+{
+    LRUDict *self = (LRUDict *)lru;
+
+    LRU_CAPI_CHECK(lru, -1);
+    LRU_FAIL_IF_FROZEN(self, -1);
+    if (unlikely((hash = lru_capi_hash(key, hash)) == -1)) {
+        return -1;
+    }
+    return lru_setitem_impl(self, key, hash, value);
+}
+
+
+static int
+lru_capi_pop(PyObject *lru, PyObject *key, Py_hash_t hash, PyObject **value)
+{
+    LRUDict *self = (LRUDict *)lru;
+    Py_ssize_t index;
+    Node *n;
+    int res;
+
+    *value = NULL;
+    LRU_CAPI_CHECK(lru, -1);
+    LRU_FAIL_IF_FROZEN(self, -1);
+    if (unlikely((hash = lru_capi_hash(key, hash)) == -1)) {
+        return -1;
+    }
+
+    LRU_ENTER_CRIT(self, -1);
+    index = direct_lookup(self->dict, key, hash, &n);
+    if (index < 0) {
+        if (index != DKIX_ERROR) {
+            self->misses++;
+        }
+        LRU_LEAVE_CRIT(self);
+        return index == DKIX_ERROR ? -1 : 0;
+    }
+    /* Like lru_popnode_impl, less the KeyError. */
+    Py_INCREF(n);
+    if ((res = _PyDict_DelItem_KnownHash(self->dict, key, hash)) == 0) {
+        lru_detach_node(n);
+        lru_count_deletion(self);
+        Py_INCREF(n->pl.value);
+        *value = n->pl.value;
+        self->hits++;
+    }
+    LRU_LEAVE_CRIT(self);
+
+    Py_DECREF(n);
+    return res == 0 ? 1 : -1;
+}
+
+
+static Py_ssize_t
+lru_capi_get_many(PyObject *lru, Py_ssize_t n, PyObject *const *keys,
+                  const Py_hash_t *hashes, PyObject **values)
+{
+    LRUDict *self = (LRUDict *)lru;
+    Py_hash_t stackbuf[LRU_BATCH_MAX];
+    Py_hash_t *kh = stackbuf;
+    Py_ssize_t i;
+    Py_ssize_t n_hits = 0;
+    int status = 0;
+
+    for (i = 0; i < n; i++) {
+        values[i] = NULL;
+    }
+    LRU_CAPI_CHECK(lru, -1);
+
+    /* Hash everything first, because hashing may run arbitrary code that
+     * must not be run inside the critical section. */
+    if (n > LRU_BATCH_MAX && (kh = PyMem_New(Py_hash_t, n)) == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        kh[i] = lru_capi_hash(keys[i], hashes ? hashes[i] : -1);
+        if (unlikely(kh[i] == -1)) {
+            goto done;
+        }
+    }
+
+    if (unlikely(self->frozen)) {
+        for (i = 0; i < n && status == 0; i++) {
+            status = lru_frozen_subscript_kh_impl(self, keys[i], kh[i],
+                                                  values + i);
+            n_hits += (values[i] != NULL);
+        }
+    }
+    else {
+        /* As LRU_ENTER_CRIT, but the buffer must be freed on failure. */
+        if (self->detect_conflict && self->internal_busy) {
+            LRU_PROBE1(busy, self);
+            PyErr_SetString(LRUDictExc_BusyErr,
+                "attempted entry into LRUDict critical section while busy");
+            goto done;
+        }
+        self->internal_busy = 1;
+        for (i = 0; i < n && status == 0; i++) {
+            status = lru_subscript_kh_impl(self, keys[i], kh[i], values + i);
+            n_hits += (values[i] != NULL);
+        }
+        LRU_LEAVE_CRIT(self);
+        LRU_HOT_FLUSH(self);
+    }
+
+    if (status == 0) {
+        if (kh != stackbuf) {
+            PyMem_Free(kh);
+        }
+        return n_hits;
+    }
+
+done:
+    for (i = 0; i < n; i++) {
+        Py_CLEAR(values[i]);
+    }
+    if (kh != stackbuf) {
+        PyMem_Free(kh);
+    }
+    return -1;
+}
+
+
+static int
+lru_capi_stats(PyObject *lru, unsigned long *hits, unsigned long *misses)
+{
+    LRUDict *self = (LRUDict *)lru;
+
+    uint64_t h, m;
+
+    LRU_CAPI_CHECK(lru, -1);
+    h = lru_hits(self) - self->xstats.hits_cleared;
+    m = lru_misses(self) - self->xstats.misses_cleared;
+    /* Saturate rather than wrap where unsigned long is 32-bit wide. */
+    *hits = h > ULONG_MAX ? ULONG_MAX : (unsigned long)h;
+    *misses = m > ULONG_MAX ? ULONG_MAX : (unsigned long)m;
+    return 0;
+}
+
+
+static int
+lru_capi_stats64(PyObject *lru, uint64_t *hits, uint64_t *misses)
+{
+    LRUDict *self = (LRUDict *)lru;
+
+    LRU_CAPI_CHECK(lru, -1);
+    *hits = lru_hits(self) - self->xstats.hits_cleared;
+    *misses = lru_misses(self) - self->xstats.misses_cleared;
+    return 0;
+}
+
+
+static int
+lru_capi_set_evict_hook(PyObject *lru, LRUNG_EvictHook fn, void *ctx,
+                        void (*ctx_free)(void *))
+{
+    LRUDict *self = (LRUDict *)lru;
+
+    LRU_CAPI_CHECK(lru, -1);
+    LRU_FAIL_IF_FROZEN(self, -1);
+    return lrupq_set_hook(self->purge_queue, fn, ctx, ctx_free);
+}
+
+
+static LRUNG_CAPI_t lru_capi = {
+    .version = LRUNG_CAPI_VERSION,
+    .LRUDict_Type = &LRUDictType,
+    .lookup_known_hash = lru_capi_lookup_known_hash,
+    .insert_known_hash = lru_capi_insert_known_hash,
+    .pop = lru_capi_pop,
+    .get_many = lru_capi_get_many,
+    .stats = lru_capi_stats,
+    .set_evict_hook = lru_capi_set_evict_hook,
+    .stats64 = lru_capi_stats64,
+};
+
+
 static void
 lru_ng_module_free_safe_types(void *mself)
 {
@@ -1872,11 +3744,97 @@ lru_ng_module_free_safe_types(void *mself)
 }
 
 
+/* Raw numbers of a snapshot, in the order of LRUDict_info_fields after the
+ * name. */
+typedef struct {
+    PyObject *name;
+    uint64_t counters[LRUDICT_INFO_N - 1];
+} lru_info_t;
+
+
+static PyObject *
+lru_instances(PyObject *Py_UNUSED(module), PyObject *Py_UNUSED(ignored))
+{
+    lrung_link *l;
+    lru_info_t *info;
+    PyObject *res;
+    Py_ssize_t n = 0, i;
+
+    for (l = lru_registry.next; l != &lru_registry; l = l->next) {
+        n++;
+    }
+    if ((info = PyMem_New(lru_info_t, n ? (size_t)n : 1)) == NULL) {
+        return PyErr_NoMemory();
+    }
+    /* Copy everything first: making Python objects may start the GC, which
+     * could free an LRUDict and unlink it under our feet. */
+    i = 0;
+    for (l = lru_registry.next; l != &lru_registry; l = l->next, i++) {
+        const LRUDict *self = LRUNG_CONTAINER_OF(l, LRUDict, registry);
+        const LRUExtStats *x = &self->xstats;
+
+        info[i].name = self->name;
+        Py_INCREF(info[i].name);
+        info[i].counters[0] = (uint64_t)self->capacity;
+        info[i].counters[1] = (uint64_t)PyDict_GET_SIZE(self->dict);
+        info[i].counters[2] = lru_hits(self);
+        info[i].counters[3] = lru_misses(self);
+        info[i].counters[4] = x->evictions_staged + x->evictions_direct;
+        info[i].counters[5] = (uint64_t)LRU_STAGED(self);
+    }
+
+    res = PyList_New(n);
+    for (i = 0; i < n; i++) {
+        PyObject *item;
+
+        if (res == NULL ||
+            (item = lru_seq_new(LRUDictInfoType, LRUDICT_INFO_N)) == NULL)
+        {
+            Py_CLEAR(res);
+            Py_DECREF(info[i].name);
+            continue;
+        }
+        /* Steals the name. */
+        LRU_SEQ_SET(item, 0, info[i].name);
+        PyList_SET_ITEM(res, i, item);
+        if (lru_seq_fill(item, 1, info[i].counters,
+                         LRUDICT_INFO_N - 1) != 0)
+        {
+            Py_CLEAR(res);
+        }
+    }
+    PyMem_Free(info);
+    return res;
+}
+
+
 /* Module structure */
+static PyMethodDef lru_module_methods[] = {
+    {"simulate",
+        (PyCFunction)(void(*)(void))lrusim_simulate,
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("simulate(trace, capacities, policies=('lru',))\n--\n\n-> Dict[str, List[float]]\nReplay a trace of keys or key hashes through models of the cache policies ('lru', 'clock', 'slru', 'arc', or 'tinylfu') at each of the capacities, and return the hit ratios, by policy, in the order of the capacities.")},
+    {"make_trace",
+        (PyCFunction)(void(*)(void))lrusim_make_trace,
+        METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("make_trace(kind, length, universe, alpha=1.0, seed=0)\n--\n\n-> array\nGenerate a synthetic trace of integer keys of the given kind ('zipf', 'scan', or 'loop') over universe keys, for simulate().")},
+    {"instances",
+        (PyCFunction)lru_instances, METH_NOARGS,
+        PyDoc_STR("instances()\n--\n\n-> List[LRUDictInfo]\nReturn snapshots of the live LRUDict objects, as named tuples of (name, size, len, hits, misses, evictions, purge_queue_len). The counters are cumulative like those of get_ext_stats(). Taking a snapshot does not lock or touch any LRUDict.")},
+#ifdef LRUTRACE_AVAILABLE
+    {"read_trace",
+        (PyCFunction)lrutrace_read, METH_O,
+        PyDoc_STR("read_trace(path, /)\n--\n\n-> Tuple[array, array, array, array]\nRead a trace file written by LRUDict.start_trace().\nReturn four arrays of equal length, one item per record: the operations (TRACE_GET, TRACE_SET, TRACE_DEL, or TRACE_EVICT; typecode 'B'), the key hashes ('q'), the hit flags ('B'), and the times in nanoseconds since the start of the trace ('Q'). For TRACE_SET, the hit flag tells a replacement from an insertion.")},
+#endif
+    {NULL, NULL, 0, NULL},              /* sentinel */
+};
+
+
 static struct PyModuleDef moduledef = {
     PyModuleDef_HEAD_INIT,
     .m_name = "lru_ng",
     .m_doc = lru_doc,
+    .m_methods = lru_module_methods,
     .m_size = -1,
     .m_free = lru_ng_module_free_safe_types,
 };
@@ -1886,7 +3844,7 @@ static PyObject *
 moduleinit(void)
 {
     PyObject *m;
-    PyTypeObject *st_list[] = {&_PyNone_Type, &PyUnicode_Type, &PyLong_Type,
+    PyTypeObject *st_list[] = {Py_TYPE(Py_None), &PyUnicode_Type, &PyLong_Type,
                                &PyBytes_Type, &PyByteArray_Type,
                                &PyBool_Type, &PyFloat_Type, &PyComplex_Type};
     lru_safe_types = ts_create((const void *const *)st_list,
@@ -1898,12 +3856,17 @@ moduleinit(void)
     }
 
     /* Pull in the types */
-    if (PyType_Ready(&NodeType) < 0) {
+    if (PyType_Ready(&NodeType) < 0 || PyType_Ready(&TimedNodeType) < 0) {
         return NULL;
     }
     if (PyType_Ready(&LRUDictType) < 0) {
         return NULL;
     }
+#ifdef LRUSHM_AVAILABLE
+    if (PyType_Ready(&SharedLRUCacheType) < 0) {
+        return NULL;
+    }
+#endif
     /* Create new exception */
     LRUDictExc_BusyErr = PyErr_NewExceptionWithDoc(
             "lru_ng.LRUDictBusyError",
@@ -1920,6 +3883,14 @@ moduleinit(void)
     if (LRUDictStatsType == NULL) {
         return NULL;
     }
+    LRUDictExtStatsType = PyStructSequence_NewType(&LRUDict_ext_stats_desc);
+    if (LRUDictExtStatsType == NULL) {
+        return NULL;
+    }
+    LRUDictInfoType = PyStructSequence_NewType(&LRUDict_info_desc);
+    if (LRUDictInfoType == NULL) {
+        return NULL;
+    }
 #endif
 
     /* Create module object */
@@ -1938,6 +3909,40 @@ moduleinit(void)
         Py_DECREF(m);
         m = NULL;
     }
+    else {
+        PyObject *capsule = PyCapsule_New((void *)&lru_capi, LRUNG_CAPI_NAME,
+                                          NULL);
+        if (capsule == NULL ||
+            PyModule_AddObject(m, "_C_API", capsule) < 0)
+        {
+            Py_XDECREF(capsule);
+            Py_DECREF(m);
+            m = NULL;
+        }
+    }
+#ifdef LRUTRACE_AVAILABLE
+    if (m != NULL &&
+        (PyModule_AddIntConstant(m, "TRACE_GET", LRUTRACE_GET) < 0 ||
+         PyModule_AddIntConstant(m, "TRACE_SET", LRUTRACE_SET) < 0 ||
+         PyModule_AddIntConstant(m, "TRACE_DEL", LRUTRACE_DEL) < 0 ||
+         PyModule_AddIntConstant(m, "TRACE_EVICT", LRUTRACE_EVICT) < 0))
+    {
+        Py_DECREF(m);
+        m = NULL;
+    }
+#endif
+#ifdef LRUSHM_AVAILABLE
+    if (m != NULL) {
+        Py_INCREF(&SharedLRUCacheType);
+        if (PyModule_AddObject(m, "SharedLRUCache",
+                               (PyObject *)(&SharedLRUCacheType)) < 0)
+        {
+            Py_DECREF(&SharedLRUCacheType);
+            Py_DECREF(m);
+            m = NULL;
+        }
+    }
+#endif
 
     return m;
 }
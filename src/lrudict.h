@@ -4,6 +4,11 @@
 #define PY_SSIZE_T_CLEAN
 #include "Python.h"
 #include "lrudict_pq.h"
+#include "lrung_core.h"
+#include "lrudict_trace.h"
+#include "lrudict_hot.h"
+#include "lrudict_lat.h"
+#include "lrudict_probes.h"
 
 #if (defined __GNUC__) || (defined __clang__) || (defined __INTEL_COMPILER)
 #define likely(p)     __builtin_expect(!!(p), 1)
@@ -38,31 +43,94 @@ typedef struct _NodePayload {
 
 typedef struct _Node {
     PyObject_HEAD
-    struct _Node *next;
-    struct _Node *prev;
+    lrung_link link;
     NodePayload pl;
 } Node;
 
 
+/* Defined in lrudict.c. */
+extern PyTypeObject NodeType;
+#define NODE_OF(l)           LRUNG_CONTAINER_OF((l), Node, link)
+
+
+/* Node with the times (from lrulat_now()) of insertion and last access, made
+ * by an LRUDict that tracks the ages of evicted items. Its type is a subtype
+ * of NodeType; nodes made before the tracking started remain plain. */
+typedef struct _TimedNode {
+    Node node;
+    uint64_t t_insert;
+    uint64_t t_access;
+} TimedNode;
+
+
+extern PyTypeObject TimedNodeType;
+#define IS_TIMED_NODE(n)    (Py_TYPE(n) == &TimedNodeType)
+
+
+/* Hit/miss counters of a frozen LRUDict. They live in a block of their own,
+ * allocated at freezing time, so that a lookup in a forked child only dirties
+ * this block instead of the pages shared with the parent. */
+typedef struct _LRUFrozenStats {
+    uint64_t misses;
+    uint64_t hits;
+    uint64_t contains[2];
+} LRUFrozenStats;
+
+
+/* Operational counters beyond hits and misses, reported by get_ext_stats().
+ * Unlike the hits and misses reported by get_stats(), they are cleared only by
+ * reset_stats(); clear() merely notes the hits and misses at the time. Each
+ * counter is incremented on a branch that is taken anyway. */
+typedef struct _LRUExtStats {
+    uint64_t inserts;
+    uint64_t replacements;
+    uint64_t deletions;         /* explicit: del, pop() and popitem() */
+    uint64_t evictions_staged;  /* to the purge queue */
+    uint64_t evictions_direct;  /* deallocated at once */
+    uint64_t evictions_dropped; /* of those, not staged for lack of room */
+    uint64_t purges;            /* passes over a non-empty purge queue */
+    uint64_t contains[2];       /* "in" tests, false and true */
+    uint64_t hits_cleared;      /* hits and misses at the last clear() */
+    uint64_t misses_cleared;
+} LRUExtStats;
+
+
 /* Implementation of LRUDict object */
 /* Object structure */
 typedef struct _LRUDict {
     PyObject_HEAD
     PyObject *dict;
     Node *root;
-    unsigned long misses;
-    unsigned long hits;
+    uint64_t misses;
+    uint64_t hits;
+    uint64_t *contains_stats;   /* xstats.contains, or frozen_stats's */
     Py_ssize_t capacity;
+    Py_ssize_t dict_peak;       /* largest length the dict's table has held
+                                   or been presized for */
+    Py_ssize_t reserve;         /* length to presize the dict for */
     PyObject *callback;
     LRUDict_pq *purge_queue;
+    LRUFrozenStats *frozen_stats;
+    LRUTrace *trace;            /* NULL unless recording */
+    LRUHot *hot;                /* NULL unless tracking hot keys */
+    LRULat *lat;                /* NULL unless timing operations */
+    LRUAge *age;                /* NULL unless tracking eviction ages */
+    PyObject *name;             /* str or None, for lru_ng.instances() */
+    lrung_link registry;        /* in the list of live instances */
+    LRUExtStats xstats;
     _Bool _pb;
     _Bool detect_conflict:1;
     _Bool internal_busy:1;
     _Bool purge_suspended:1;
+    _Bool frozen:1;
 } LRUDict;
 
 
 /* Forward declarations */
+#if PY_VERSION_HEX < 0x030B0000
+/* Until 3.10, the lookup routine of a dict is a function pointer in its keys
+ * object, and calling it directly borrows the value while hashing only once.
+ * The struct is private, so redeclare its head. */
 #if PY_VERSION_HEX >= 0x03070000
 typedef Py_ssize_t (*dict_lookup_func)
 (PyDictObject *mp, PyObject *key, Py_hash_t hash, PyObject **value_addr);
@@ -81,8 +149,24 @@ struct _dictkeysobject {
     Py_ssize_t dk_nentries;
     char dk_indices[];
 };
+#define LRU_HAVE_DK_LOOKUP 1
+#endif
+
+
+#if PY_VERSION_HEX >= 0x030D0000
+/* Moved to the internal headers in 3.13, but still exported. */
+PyAPI_FUNC(int) _PyDict_SetItem_KnownHash(PyObject *mp, PyObject *key,
+                                          PyObject *item, Py_hash_t hash);
+PyAPI_FUNC(int) _PyDict_DelItem_KnownHash(PyObject *mp, PyObject *key,
+                                          Py_hash_t hash);
+PyAPI_FUNC(void) _PyErr_SetKeyError(PyObject *);
+PyAPI_FUNC(size_t) _PySys_GetSizeOf(PyObject *);
+#endif
 
 
+#ifndef DKIX_EMPTY
+#define DKIX_EMPTY ((Py_ssize_t)(-1))
+#endif
 #ifndef DKIX_ERROR
 #define DKIX_ERROR ((Py_ssize_t)(-3))
 #endif
@@ -93,4 +177,88 @@ struct _dictkeysobject {
 #endif
 
 
+/* Return new ref to newly created node initialized with payload, or NULL
+ * in case of failure to create node at all. */
+static inline Node *
+node_getnewfrom(const NodePayload *restrict payload)
+{
+    Node *n;
+
+    if ((n = PyObject_New(Node, &NodeType)) != NULL) {
+        Py_INCREF(payload->key);
+        Py_INCREF(payload->value);
+        /* Note: direct copy of struct via (indirect) assignment. */
+        n->pl = *payload;
+    }
+    return n;
+}
+
+
+/* As node_getnewfrom, but a TimedNode inserted and accessed at time t. */
+static inline Node *
+timednode_getnewfrom(const NodePayload *restrict payload, uint64_t t)
+{
+    TimedNode *n;
+
+    if ((n = PyObject_New(TimedNode, &TimedNodeType)) != NULL) {
+        Py_INCREF(payload->key);
+        Py_INCREF(payload->value);
+        n->node.pl = *payload;
+        n->t_insert = n->t_access = t;
+    }
+    return (Node *)n;
+}
+
+
+/* Optimized hash getter code-path that uses the memoized hash for ASCII
+ * strings. See CPython: Objects/dictobject.c
+ * This does more work for non-ASCII-strings but no more than what Python dict
+ * does. There's a real advantage for string keys. */
+static inline Py_hash_t
+get_hash(PyObject *k)
+{
+    Py_hash_t hash;
+
+    if (!PyUnicode_CheckExact(k) || (hash = ((PyASCIIObject *)k)->hash) == -1)
+    {
+        hash = PyObject_Hash(k);
+    }
+    return hash;
+}
+
+
+/* Look up key with precomputed hash kh in the dict d, writing to node_ref the
+ * borrowed Node or NULL. Return a non-negative number if found, DKIX_EMPTY if
+ * not, or DKIX_ERROR with exception set. */
+static inline Py_ssize_t
+direct_lookup(PyObject *restrict d, PyObject *restrict key, Py_hash_t kh,
+              Node **restrict node_ref)
+{
+#ifdef LRU_HAVE_DK_LOOKUP
+    PyDictObject *mp = (PyDictObject *)d;
+#if PY_VERSION_HEX >= 0x03070000
+    return (mp->ma_keys->dk_lookup)(mp, key, kh, (PyObject **)node_ref);
+#else
+    PyObject **vaddr;
+    Py_ssize_t index;
+    index = (mp->ma_keys->dk_lookup)(mp, key, kh, &vaddr, NULL);
+    if (index >= 0 && vaddr) {
+        *node_ref = (Node *)(*vaddr);
+    }
+    else {
+        *node_ref = NULL;
+    }
+    return index;
+#endif
+#else
+    /* 3.11+: dk_lookup is gone, but this still hashes only once and borrows.
+     * A NULL result is ambiguous, but the error check is only needed then. */
+    if ((*node_ref = (Node *)_PyDict_GetItem_KnownHash(d, key, kh)) != NULL) {
+        return 0;
+    }
+    return unlikely(PyErr_Occurred() != NULL) ? DKIX_ERROR : DKIX_EMPTY;
+#endif
+}
+
+
 #endif
@@ -2,7 +2,8 @@
 #define LRUDICT_EXCTYPE_H
 
 
-static PyObject *LRUDictExc_BusyErr;
+/* Defined in lrudict.c. */
+extern PyObject *LRUDictExc_BusyErr;
 
 
 #endif /* LRUDICT_EXCTYPE_H */
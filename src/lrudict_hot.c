@@ -0,0 +1,338 @@
+#define PY_SSIZE_T_CLEAN
+#include "Python.h"
+#include "lrudict_hot.h"
+
+
+#define LRUHOT_GOLDEN   UINT64_C(0x9E3779B97F4A7C15)
+
+
+LRUHot *
+lruhot_new(Py_ssize_t k)
+{
+    LRUHot *hot;
+    uint32_t size = 4;
+    int bits = 2;
+    int32_t i;
+
+    if (k <= 0 || k > (1 << 24)) {
+        PyErr_SetString(PyExc_ValueError, "k must be between 1 and 2**24");
+        return NULL;
+    }
+    while (size < (uint32_t)k * 2) {
+        size <<= 1;
+        bits++;
+    }
+    if ((hot = PyMem_Malloc(sizeof(LRUHot))) == NULL) {
+        return (LRUHot *)PyErr_NoMemory();
+    }
+    hot->entry = PyMem_New(lruhot_entry, (size_t)k);
+    hot->bucket = PyMem_New(lruhot_bucket, (size_t)k);
+    hot->table = PyMem_New(int32_t, size);
+    hot->retired = PyList_New(0);
+    if (hot->entry == NULL || hot->bucket == NULL || hot->table == NULL ||
+        hot->retired == NULL) {
+        PyMem_Free(hot->entry);
+        PyMem_Free(hot->bucket);
+        PyMem_Free(hot->table);
+        Py_XDECREF(hot->retired);
+        PyMem_Free(hot);
+        return (LRUHot *)(PyErr_Occurred() ? NULL : PyErr_NoMemory());
+    }
+    memset(hot->table, 0xff, size * sizeof(int32_t));
+    /* At most one bucket per counter. */
+    for (i = 0; i < (int32_t)k; i++) {
+        hot->bucket[i].head = -1;
+        hot->bucket[i].next = i + 1 < (int32_t)k ? i + 1 : -1;
+    }
+    hot->k = (uint32_t)k;
+    hot->n = 0;
+    hot->min_bucket = -1;
+    hot->free_bucket = 0;
+    hot->table_mask = size - 1;
+    hot->table_shift = 64 - bits;
+    return hot;
+}
+
+
+void
+lruhot_free(LRUHot *hot)
+{
+    uint32_t i;
+
+    for (i = 0; i < hot->n; i++) {
+        Py_DECREF(hot->entry[i].key);
+    }
+    PyMem_Free(hot->entry);
+    PyMem_Free(hot->bucket);
+    PyMem_Free(hot->table);
+    Py_DECREF(hot->retired);
+    PyMem_Free(hot);
+}
+
+
+static inline uint32_t
+lruhot_home(const LRUHot *hot, Py_hash_t kh)
+{
+    return (uint32_t)(((uint64_t)kh * LRUHOT_GOLDEN) >> hot->table_shift);
+}
+
+
+/* Slot of kh in the table, or of the empty slot where it would go. */
+static inline uint32_t
+lruhot_find(const LRUHot *hot, Py_hash_t kh)
+{
+    uint32_t i = lruhot_home(hot, kh);
+    int32_t e;
+
+    while ((e = hot->table[i]) >= 0 && hot->entry[e].hash != kh) {
+        i = (i + 1) & hot->table_mask;
+    }
+    return i;
+}
+
+
+/* Empty slot i by backward-shift deletion. */
+static void
+lruhot_table_del(LRUHot *hot, uint32_t i)
+{
+    uint32_t j = i;
+
+    for (;;) {
+        uint32_t home;
+        int32_t e;
+
+        j = (j + 1) & hot->table_mask;
+        if ((e = hot->table[j]) < 0) {
+            break;
+        }
+        home = lruhot_home(hot, hot->entry[e].hash);
+        if (((j - home) & hot->table_mask) >= ((j - i) & hot->table_mask)) {
+            hot->table[i] = e;
+            i = j;
+        }
+    }
+    hot->table[i] = -1;
+}
+
+
+static inline void
+lruhot_link(LRUHot *hot, int32_t e, int32_t b)
+{
+    int32_t next = hot->bucket[b].head;
+
+    hot->entry[e].bucket = b;
+    hot->entry[e].prev = -1;
+    hot->entry[e].next = next;
+    if (next >= 0) {
+        hot->entry[next].prev = e;
+    }
+    hot->bucket[b].head = e;
+}
+
+
+static inline void
+lruhot_unlink(LRUHot *hot, int32_t e)
+{
+    int32_t prev = hot->entry[e].prev;
+    int32_t next = hot->entry[e].next;
+
+    if (prev >= 0) {
+        hot->entry[prev].next = next;
+    }
+    else {
+        hot->bucket[hot->entry[e].bucket].head = next;
+    }
+    if (next >= 0) {
+        hot->entry[next].prev = prev;
+    }
+}
+
+
+/* Take a free bucket for count and put it after the bucket "after", or first
+ * if after is -1. */
+static int32_t
+lruhot_bucket_new(LRUHot *hot, uint64_t count, int32_t after)
+{
+    int32_t b = hot->free_bucket;
+    int32_t next;
+
+    hot->free_bucket = hot->bucket[b].next;
+    if (after >= 0) {
+        next = hot->bucket[after].next;
+        hot->bucket[after].next = b;
+    }
+    else {
+        next = hot->min_bucket;
+        hot->min_bucket = b;
+    }
+    if (next >= 0) {
+        hot->bucket[next].prev = b;
+    }
+    hot->bucket[b].count = count;
+    hot->bucket[b].head = -1;
+    hot->bucket[b].prev = after;
+    hot->bucket[b].next = next;
+    return b;
+}
+
+
+static void
+lruhot_bucket_free(LRUHot *hot, int32_t b)
+{
+    int32_t prev = hot->bucket[b].prev;
+    int32_t next = hot->bucket[b].next;
+
+    if (prev >= 0) {
+        hot->bucket[prev].next = next;
+    }
+    else {
+        hot->min_bucket = next;
+    }
+    if (next >= 0) {
+        hot->bucket[next].prev = prev;
+    }
+    hot->bucket[b].next = hot->free_bucket;
+    hot->free_bucket = b;
+}
+
+
+/* Move counter e to the bucket of the next count. */
+static void
+lruhot_increment(LRUHot *hot, int32_t e)
+{
+    int32_t b = hot->entry[e].bucket;
+    int32_t nb = hot->bucket[b].next;
+    uint64_t count = hot->bucket[b].count + 1;
+
+    lruhot_unlink(hot, e);
+    if (nb >= 0 && hot->bucket[nb].count == count) {
+        lruhot_link(hot, e, nb);
+        if (hot->bucket[b].head < 0) {
+            lruhot_bucket_free(hot, b);
+        }
+    }
+    else if (hot->bucket[b].head < 0) {
+        /* e was alone; the bucket moves up with it. */
+        hot->bucket[b].count = count;
+        lruhot_link(hot, e, b);
+    }
+    else {
+        lruhot_link(hot, e, lruhot_bucket_new(hot, count, b));
+    }
+}
+
+
+static void
+lruhot_retire(LRUHot *hot, PyObject *key)
+{
+    /* If the append fails, the DECREF below may run arbitrary code; this is
+     * the last resort. */
+    if (Py_REFCNT(key) == 1 && PyList_Append(hot->retired, key) != 0) {
+        PyErr_Clear();
+    }
+    Py_DECREF(key);
+}
+
+
+void
+lruhot_update(LRUHot *hot, PyObject *key, Py_hash_t kh)
+{
+    uint32_t slot = lruhot_find(hot, kh);
+    int32_t e = hot->table[slot];
+    PyObject *old_key;
+
+    if (e >= 0) {
+        lruhot_increment(hot, e);
+        return;
+    }
+    Py_INCREF(key);
+    if (hot->n < hot->k) {
+        int32_t b = hot->min_bucket;
+
+        if (b < 0 || hot->bucket[b].count != 1) {
+            b = lruhot_bucket_new(hot, 1, -1);
+        }
+        e = (int32_t)hot->n++;
+        hot->entry[e].key = key;
+        hot->entry[e].hash = kh;
+        hot->entry[e].error = 0;
+        hot->table[slot] = e;
+        lruhot_link(hot, e, b);
+        return;
+    }
+    /* Take over a counter with the least count. */
+    e = hot->bucket[hot->min_bucket].head;
+    old_key = hot->entry[e].key;
+    lruhot_table_del(hot, lruhot_find(hot, hot->entry[e].hash));
+    hot->table[lruhot_find(hot, kh)] = e;
+    hot->entry[e].key = key;
+    hot->entry[e].hash = kh;
+    hot->entry[e].error = hot->bucket[hot->min_bucket].count;
+    lruhot_increment(hot, e);
+    lruhot_retire(hot, old_key);
+}
+
+
+void
+lruhot_flush(LRUHot *hot)
+{
+    PyObject *retired = hot->retired;
+
+    if (PyList_GET_SIZE(retired) == 0) {
+        return;
+    }
+    /* hot may be freed by the time the keys are gone. */
+    Py_INCREF(retired);
+    if (PyList_SetSlice(retired, 0, PyList_GET_SIZE(retired), NULL) != 0) {
+        PyErr_WriteUnraisable(retired);
+        PyErr_Clear();
+    }
+    Py_DECREF(retired);
+}
+
+
+size_t
+lruhot_sizeof(const LRUHot *hot)
+{
+    return sizeof(LRUHot) +
+           hot->k * (sizeof(lruhot_entry) + sizeof(lruhot_bucket)) +
+           (hot->table_mask + 1) * sizeof(int32_t) +
+           (size_t)Py_SIZE(hot->retired) * sizeof(PyObject *);
+}
+
+
+PyObject *
+lruhot_top(const LRUHot *hot, Py_ssize_t n)
+{
+    PyObject *result;
+    Py_ssize_t i;
+    int32_t b, e;
+
+    if (n < 0 || n > (Py_ssize_t)hot->n) {
+        n = (Py_ssize_t)hot->n;
+    }
+    if ((result = PyList_New(n)) == NULL) {
+        return NULL;
+    }
+    /* The buckets are in ascending order; fill the list from the back and
+     * skip the least counters that don't fit. */
+    i = (Py_ssize_t)hot->n;
+    for (b = hot->min_bucket; b >= 0 && i > 0; b = hot->bucket[b].next) {
+        for (e = hot->bucket[b].head; e >= 0 && i > 0; e = hot->entry[e].next) {
+            PyObject *item;
+
+            if (--i >= n) {
+                continue;
+            }
+            item = Py_BuildValue("(OKK)", hot->entry[e].key,
+                                 (unsigned long long)hot->bucket[b].count,
+                                 (unsigned long long)hot->entry[e].error);
+            if (item == NULL) {
+                Py_DECREF(result);
+                return NULL;
+            }
+            PyList_SET_ITEM(result, i, item);
+        }
+    }
+    return result;
+}
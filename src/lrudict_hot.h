@@ -0,0 +1,82 @@
+#ifndef LRUDICT_HOT_H
+#define LRUDICT_HOT_H
+#include "Python.h"
+#include <stdint.h>
+/* Hot-key tracker of LRUDict: the Space-Saving algorithm (Metwally et al.,
+ * 2005) over key hashes, with a fixed number k of counters. A tracked key that
+ * is accessed has its counter incremented. An untracked one takes over the
+ * counter with the least count, say c, and starts from c + 1 with an error
+ * bound of c. Any key accessed more than (number of accesses) / k times is
+ * tracked, and its true count lies in [count - error, count].
+ *
+ * The counters are kept in the "Stream-Summary" structure of the paper: a
+ * list of buckets in ascending order of count, each holding the list of
+ * counters sharing that count. Together with an open-addressing table from
+ * hash to counter, an access costs a probe and a few pointer updates, and
+ * never moves the counters. */
+
+
+typedef struct {
+    PyObject *key;      /* strong reference */
+    Py_hash_t hash;
+    uint64_t error;
+    int32_t bucket;
+    int32_t prev;       /* counters in the same bucket */
+    int32_t next;
+} lruhot_entry;
+
+
+typedef struct {
+    uint64_t count;
+    int32_t head;       /* first counter, or -1 if the bucket is free */
+    int32_t prev;       /* neighbouring buckets by count */
+    int32_t next;
+} lruhot_bucket;
+
+
+typedef struct _LRUHot {
+    lruhot_entry *entry;
+    lruhot_bucket *bucket;
+    int32_t *table;     /* counter index, or -1 if the slot is empty */
+    uint32_t k;         /* number of counters */
+    uint32_t n;         /* counters in use */
+    int32_t min_bucket; /* bucket with the least count, or -1 */
+    int32_t free_bucket;
+    uint32_t table_mask;
+    int table_shift;
+    /* Keys of replaced counters, whose deallocation could run arbitrary code,
+     * are kept here until lruhot_flush() is called outside of the critical
+     * section. */
+    PyObject *retired;
+} LRUHot;
+
+
+/* Allocate a tracker of k counters. Return NULL with exception set on
+ * failure. */
+LRUHot *lruhot_new(Py_ssize_t k);
+
+
+/* Release the keys and free hot. May run arbitrary code. */
+void lruhot_free(LRUHot *hot);
+
+
+/* Count an access to key with hash kh. Must be called with the GIL held. Runs
+ * no Python code. */
+void lruhot_update(LRUHot *hot, PyObject *key, Py_hash_t kh);
+
+
+/* Release the retired keys. May run arbitrary code, including code that frees
+ * hot. */
+void lruhot_flush(LRUHot *hot);
+
+
+/* Bytes allocated for hot, not counting the keys. */
+size_t lruhot_sizeof(const LRUHot *hot);
+
+
+/* List of (key, count, error) tuples of the top n counters by count, in
+ * descending order, or all if n < 0. */
+PyObject *lruhot_top(const LRUHot *hot, Py_ssize_t n);
+
+
+#endif /* LRUDICT_HOT_H */
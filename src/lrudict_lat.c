@@ -0,0 +1,222 @@
+#define PY_SSIZE_T_CLEAN
+#include "Python.h"
+#include <math.h>
+#include "lrudict_lat.h"
+
+
+static const char *const lrulat_names[LRULAT_NOPS] = {
+    "get", "set", "update", "evict", "purge", "callback",
+};
+
+
+LRULat *
+lrulat_new(void)
+{
+    LRULat *lat = PyMem_Calloc(1, sizeof(LRULat));
+
+    return lat ? lat : (LRULat *)PyErr_NoMemory();
+}
+
+
+void
+lrulat_free(LRULat *lat)
+{
+    PyMem_Free(lat);
+}
+
+
+int
+lrulat_op_from_name(PyObject *name)
+{
+    if (PyUnicode_Check(name)) {
+        for (int op = 0; op < LRULAT_NOPS; op++) {
+            if (PyUnicode_CompareWithASCIIString(name,
+                                                 lrulat_names[op]) == 0) {
+                return op;
+            }
+        }
+    }
+    PyErr_Format(PyExc_ValueError,
+                 "unknown operation %R, expected one of 'get', 'set', "
+                 "'update', 'evict', 'purge', or 'callback'", name);
+    return -1;
+}
+
+
+/* Range [*low, *high) of bucket i. */
+static void
+lrulat_bounds(unsigned int i, uint64_t *low, uint64_t *high)
+{
+    if (i < (1u << LRULAT_SUB_BITS)) {
+        *low = i;
+        *high = i + 1;
+    }
+    else {
+        int shift = (int)(i >> LRULAT_SUB_BITS) - 1;
+        uint64_t m = i & ((1u << LRULAT_SUB_BITS) - 1);
+
+        *low = ((UINT64_C(1) << LRULAT_SUB_BITS) + m) << shift;
+        *high = *low + (UINT64_C(1) << shift);
+    }
+}
+
+
+/* Value at percentile p: the highest value in the bucket of the sample of
+ * that rank, but no more than the maximum seen. */
+static uint64_t
+lrulat_percentile(const LRULatHist *h, double p)
+{
+    uint64_t rank = (uint64_t)ceil(p / 100.0 * (double)h->count);
+    uint64_t seen = 0;
+    uint64_t low, high;
+
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (unsigned int i = 0; i < LRULAT_NBUCKETS; i++) {
+        if ((seen += h->bucket[i]) >= rank) {
+            lrulat_bounds(i, &low, &high);
+            return high - 1 < h->max ? high - 1 : h->max;
+        }
+    }
+    return h->max;
+}
+
+
+static int
+lrulat_set_u64(PyObject *d, const char *key, uint64_t v)
+{
+    PyObject *o = PyLong_FromUnsignedLongLong((unsigned long long)v);
+    int res;
+
+    if (o == NULL) {
+        return -1;
+    }
+    res = PyDict_SetItemString(d, key, o);
+    Py_DECREF(o);
+    return res;
+}
+
+
+static PyObject *
+lrulat_buckets(const LRULatHist *h)
+{
+    PyObject *lst = PyList_New(0);
+
+    if (lst == NULL) {
+        return NULL;
+    }
+    for (unsigned int i = 0; i < LRULAT_NBUCKETS; i++) {
+        uint64_t low, high;
+        PyObject *item;
+
+        if (h->bucket[i] == 0) {
+            continue;
+        }
+        lrulat_bounds(i, &low, &high);
+        item = Py_BuildValue("(KKK)", (unsigned long long)low,
+                             (unsigned long long)high,
+                             (unsigned long long)h->bucket[i]);
+        if (item == NULL || PyList_Append(lst, item) != 0) {
+            Py_XDECREF(item);
+            Py_DECREF(lst);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return lst;
+}
+
+
+static PyObject *
+lrulat_percentiles(const LRULatHist *h, PyObject *percentiles)
+{
+    PyObject *seq, *res;
+
+    seq = PySequence_Fast(percentiles, "percentiles must be a sequence");
+    if (seq == NULL) {
+        return NULL;
+    }
+    if ((res = PyDict_New()) == NULL) {
+        goto fail;
+    }
+    for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+        PyObject *p = PySequence_Fast_GET_ITEM(seq, i);
+        double pv = PyFloat_AsDouble(p);
+        PyObject *v;
+        int status;
+
+        if (pv == -1.0 && PyErr_Occurred()) {
+            goto fail;
+        }
+        if (!(pv >= 0.0 && pv <= 100.0)) {
+            PyErr_SetString(PyExc_ValueError,
+                            "percentiles must be between 0 and 100");
+            goto fail;
+        }
+        if (h->count == 0) {
+            v = Py_None;
+            Py_INCREF(v);
+        }
+        else {
+            v = PyLong_FromUnsignedLongLong(
+                    (unsigned long long)lrulat_percentile(h, pv));
+            if (v == NULL) {
+                goto fail;
+            }
+        }
+        status = PyDict_SetItem(res, p, v);
+        Py_DECREF(v);
+        if (status != 0) {
+            goto fail;
+        }
+    }
+    Py_DECREF(seq);
+    return res;
+fail:
+    Py_DECREF(seq);
+    Py_XDECREF(res);
+    return NULL;
+}
+
+
+PyObject *
+lrulat_summary(const LRULatHist *hist, PyObject *percentiles)
+{
+    /* Copy first: the conversions below may run Python code that records into
+     * hist, or frees it. */
+    LRULatHist *h = PyMem_Malloc(sizeof(LRULatHist));
+    PyObject *res = NULL, *o;
+
+    if (h == NULL) {
+        return PyErr_NoMemory();
+    }
+    *h = *hist;
+    if ((res = PyDict_New()) == NULL ||
+        lrulat_set_u64(res, "count", h->count) != 0 ||
+        lrulat_set_u64(res, "total", h->total) != 0 ||
+        lrulat_set_u64(res, "max", h->max) != 0)
+    {
+        goto fail;
+    }
+    if ((o = lrulat_buckets(h)) == NULL ||
+        PyDict_SetItemString(res, "buckets", o) != 0)
+    {
+        Py_XDECREF(o);
+        goto fail;
+    }
+    Py_DECREF(o);
+    if ((o = lrulat_percentiles(h, percentiles)) == NULL ||
+        PyDict_SetItemString(res, "percentiles", o) != 0)
+    {
+        Py_XDECREF(o);
+        goto fail;
+    }
+    Py_DECREF(o);
+    PyMem_Free(h);
+    return res;
+fail:
+    Py_XDECREF(res);
+    PyMem_Free(h);
+    return NULL;
+}
@@ -0,0 +1,165 @@
+#ifndef LRUDICT_LAT_H
+#define LRUDICT_LAT_H
+#include "Python.h"
+#include <stdint.h>
+/* Latency recorder of LRUDict: per-operation histograms of durations in
+ * nanoseconds, with log-linear buckets in the manner of HdrHistogram. Values
+ * below 2**LRULAT_SUB_BITS ns have a bucket each; above that, every power of
+ * two is split into 2**LRULAT_SUB_BITS buckets of equal width, so that the
+ * relative error of a bucket is at most 1/16. Durations from
+ * 2**LRULAT_MAX_BITS ns (about 52 days) up share the last bucket.
+ *
+ * The same histograms hold the ages of evicted items (LRUAge). */
+
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+
+#define LRULAT_SUB_BITS     4
+#define LRULAT_MAX_BITS     52
+#define LRULAT_NBUCKETS     ((LRULAT_MAX_BITS - LRULAT_SUB_BITS + 1) << \
+                             LRULAT_SUB_BITS)
+
+
+/* Operations timed. */
+typedef enum {
+    LRULAT_GET = 0,         /* lookup by __getitem__() or get() */
+    LRULAT_SET = 1,         /* __setitem__(), not including the purge */
+    LRULAT_UPDATE = 2,      /* update(), including the purge */
+    LRULAT_EVICT = 3,       /* eviction of one item into the purge queue */
+    LRULAT_PURGE = 4,       /* purge of the staged items */
+    LRULAT_CALLBACK = 5,    /* callback and native hook for one item */
+    LRULAT_NOPS
+} lrulat_op;
+
+
+typedef struct {
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint64_t bucket[LRULAT_NBUCKETS];
+} LRULatHist;
+
+
+typedef struct _LRULat {
+    LRULatHist hist[LRULAT_NOPS];
+} LRULat;
+
+
+/* Ages of the evicted items that were timed since insertion. */
+typedef struct _LRUAge {
+    LRULatHist since_insert;
+    LRULatHist since_access;
+} LRUAge;
+
+
+/* Monotonic time in ns. Never returns 0, which the callers reserve for "not
+ * timed". */
+static inline uint64_t
+lrulat_now(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER t;
+
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&t);
+    return ((uint64_t)(t.QuadPart / freq.QuadPart) * UINT64_C(1000000000) +
+            (uint64_t)(t.QuadPart % freq.QuadPart) * UINT64_C(1000000000) /
+            (uint64_t)freq.QuadPart) | 1;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * UINT64_C(1000000000) +
+            (uint64_t)ts.tv_nsec) | 1;
+#endif
+}
+
+
+static inline unsigned int
+lrulat_index(uint64_t v)
+{
+    int e;
+
+    if (v < (UINT64_C(1) << LRULAT_SUB_BITS)) {
+        return (unsigned int)v;
+    }
+    if (v >= (UINT64_C(1) << LRULAT_MAX_BITS)) {
+        return LRULAT_NBUCKETS - 1;
+    }
+#if (defined __GNUC__) || (defined __clang__)
+    e = 63 - __builtin_clzll(v);
+#else
+    for (e = LRULAT_SUB_BITS; (v >> (e + 1)) != 0; e++) {
+        ;
+    }
+#endif
+    return (unsigned int)(((e - LRULAT_SUB_BITS + 1) << LRULAT_SUB_BITS) +
+                          ((v >> (e - LRULAT_SUB_BITS)) &
+                           ((1u << LRULAT_SUB_BITS) - 1)));
+}
+
+
+static inline void
+lrulat_add(LRULatHist *h, uint64_t d)
+{
+    h->count++;
+    h->total += d;
+    if (d > h->max) {
+        h->max = d;
+    }
+    h->bucket[lrulat_index(d)]++;
+}
+
+
+/* Record the time elapsed since t0 (from lrulat_now()) for op. */
+static inline void
+lrulat_record(LRULat *lat, lrulat_op op, uint64_t t0)
+{
+    lrulat_add(lat->hist + op, lrulat_now() - t0);
+}
+
+
+/* Record the time elapsed since t0 for n operations done together, as n
+ * samples of the mean. */
+static inline void
+lrulat_record_n(LRULat *lat, lrulat_op op, uint64_t t0, uint64_t n)
+{
+    LRULatHist *h = lat->hist + op;
+    uint64_t d = lrulat_now() - t0;
+    uint64_t mean = d / n;
+
+    h->count += n;
+    h->total += d;
+    if (mean > h->max) {
+        h->max = mean;
+    }
+    h->bucket[lrulat_index(mean)] += n;
+}
+
+
+/* Allocate a zeroed recorder. Return NULL with exception set on failure. */
+LRULat *lrulat_new(void);
+
+
+void lrulat_free(LRULat *lat);
+
+
+/* Operation code for name ("get", "set", ...), or -1 with ValueError set. */
+int lrulat_op_from_name(PyObject *name);
+
+
+/* Summary of h as a dict; see the documentation of
+ * LRUDict.latency_histogram(). percentiles is a sequence of numbers in
+ * [0, 100]. */
+PyObject *lrulat_summary(const LRULatHist *h, PyObject *percentiles);
+
+
+#endif /* LRUDICT_LAT_H */
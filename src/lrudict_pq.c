@@ -34,13 +34,60 @@ lrupq_new(void)
     }
 
     q->lst = new_list;
+    q->hook = NULL;
+    q->lat = NULL;
     q->sinfo.head = q->sinfo.tail = 0;
     q->n_max = LRUPQ_N_MAX_DEFAULT;
     q->n_active = 0;
+    q->n_calls = q->n_call_errors = 0;
+    q->peak_len = 0;
+    q->max_staged = 0;
+    q->budget_items = 0;
+    q->budget_ns = 0;
+    q->overflow = LRUPQ_OVERFLOW_PURGE;
+    q->purge_due = 0;
+    q->dropped = NULL;
     return q;
 }
 
 
+static inline void
+lrupq_hook_decref(LRUDict_hook *hook)
+{
+    if (hook != NULL && --hook->refcnt == 0) {
+        if (hook->ctx_free != NULL) {
+            hook->ctx_free(hook->ctx);
+        }
+        PyMem_Free(hook);
+    }
+}
+
+
+/* Replace the eviction hook, or remove it if fn is NULL. Return 0 on success,
+ * or -1 with exception set. On failure, ctx is not taken over. */
+int
+lrupq_set_hook(LRUDict_pq *q, lrupq_hook_func fn, void *ctx,
+               void (*ctx_free)(void *))
+{
+    LRUDict_hook *hook = NULL;
+    LRUDict_hook *old = q->hook;
+
+    if (fn != NULL) {
+        if ((hook = PyMem_Malloc(sizeof(LRUDict_hook))) == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        hook->fn = fn;
+        hook->ctx = ctx;
+        hook->ctx_free = ctx_free;
+        hook->refcnt = 1;
+    }
+    q->hook = hook;
+    lrupq_hook_decref(old);
+    return 0;
+}
+
+
 /* DECREF the underlying list and free the memory space of the purge-queue
  * struct. Return 0 on success or -1 on error (typically because somehow a
  * callback cannot leave the purging procedure). On error, the underlying
@@ -55,6 +102,8 @@ lrupq_free(LRUDict_pq *q)
     }
     else {
         Py_CLEAR(q->lst);
+        Py_CLEAR(q->dropped);
+        lrupq_hook_decref(q->hook);
         PyMem_Free(q);
         return 0;
     }
@@ -78,16 +127,91 @@ lrupq_err_bad(PyObject *exc)
 }
 
 
-/* Execute the purge with callback (optional, can be NULL).
+/* Handle the failure (NULL or nonzero return) of a callback or hook, which is
+ * represented by obj (may be NULL) in the message. Return 1 if the exception
+ * must be passed on to Python, or 0 if it has been suppressed (or if none is
+ * set, which a sufficiently bad callback may fail to do). */
+static inline _Bool
+lrupq_call_failed(PyObject *obj)
+{
+    PyObject *exc = PyErr_Occurred();
+
+    if (exc) {
+        if (lrupq_err_bad(exc)) {
+            /* External exception that needs the attention of interpreter: do
+             * not suppress. */
+            return 1;
+        }
+        else {
+            /* Exception ignored. */
+            PyErr_WriteUnraisable(obj);
+            PyErr_Clear();
+        }
+    }
+    return 0;
+}
+
+
+/* Release the nodes in q->dropped, calling the hook (if any) but not the
+ * callback for each. Return 0, or -2 if an error from the hook must be passed
+ * on to Python, in which case the rest are released without it. */
+Py_ssize_t
+lrupq_release_dropped(LRUDict_pq *q)
+{
+    PyObject *dropped = q->dropped;
+    LRUDict_hook *hook = q->hook;
+    PyObject *exc_type = NULL, *exc_value, *tb;
+
+    q->dropped = NULL;
+    if (hook != NULL) {
+        hook->refcnt++;
+        for (Py_ssize_t i = 0; i < PyList_GET_SIZE(dropped); i++) {
+            Node *n = (Node *)PyList_GET_ITEM(dropped, i);
+
+            if (hook->fn(hook->ctx, n->pl.key, n->pl.value,
+                         LRUPQ_EVICT_SIZE) != 0 &&
+                lrupq_call_failed(NULL))
+            {
+                PyErr_Fetch(&exc_type, &exc_value, &tb);
+                break;
+            }
+        }
+        lrupq_hook_decref(hook);
+    }
+    Py_DECREF(dropped);
+    if (exc_type != NULL) {
+        PyErr_Restore(exc_type, exc_value, tb);
+        return -2;
+    }
+    return 0;
+}
+
+
+/* Record the time taken by the callback and hook for one item, if timed. The
+ * recorder may have gone in the meantime. */
+#define LRUPQ_LAT_STOP(q, t0)                                   \
+do {                                                            \
+    if (unlikely((t0) != 0) && (q)->lat != NULL) {              \
+        lrulat_record((q)->lat, LRULAT_CALLBACK, (t0));         \
+    }                                                           \
+} while (0)
+
+
+/* Execute the purge with callback (optional, can be NULL) and the native hook
+ * of q (if any; it is called first), over at most max_items items, and for
+ * about max_ns nanoseconds at most (either is unbounded if 0). The items left
+ * over stay in the queue for the next purge.
  * Return the number of items actually dislodged from the head of the queue,
  * or -1 in the case of "swallowed" error, or -2 in the case of unrecoverable
  * error that should request the attention of Python (thinking of this as an
  * escape hatch). */
 Py_ssize_t
-lrupq_purge(LRUDict_pq *q, PyObject *callback)
+lrupq_purge(LRUDict_pq *q, PyObject *callback, Py_ssize_t max_items,
+            uint64_t max_ns)
 {
     Py_ssize_t res;
     struct _pq_sinfo batch;
+    uint64_t deadline = 0;
 
     /* Load status quo */
     batch = q->sinfo;
@@ -108,18 +232,48 @@ lrupq_purge(LRUDict_pq *q, PyObject *callback)
         return 0;
     }
 
-    /* Claim up to current tail. */
-    q->sinfo.head = batch.tail;
+    if (max_items > 0 && batch.tail - batch.head > max_items) {
+        batch.tail = batch.head + max_items;
+    }
+
+    /* Claim up to current tail, or as far as the budget goes. Against a
+     * deadline, claim one at a time instead, so that the rest stays in the
+     * queue as the time is up. */
+    if (max_ns != 0 && (callback != NULL || q->hook != NULL)) {
+        deadline = lrulat_now() + max_ns;
+    }
+    else {
+        q->sinfo.head = batch.tail;
+    }
 
-    if (callback != NULL) {
+    if (callback != NULL || q->hook != NULL) {
         _Bool fail = 0;
+        LRUDict_hook *hook = q->hook;
+
         q->n_active++;
         Py_INCREF(q->lst);
-        Py_INCREF(callback);
+        Py_XINCREF(callback);
+        if (hook != NULL) {
+            hook->refcnt++;
+        }
 
-        for (Py_ssize_t i = batch.head; i < batch.tail; i++) {
+        for (Py_ssize_t k = 0, i = batch.head; k < batch.tail - batch.head;
+             k++, i++)
+        {
             Node *n;
             PyObject *cres;
+            uint64_t t0;
+
+            if (deadline != 0) {
+                /* The first is claimed regardless, for progress. A purge
+                 * started by the callback may have claimed the rest. */
+                if ((k > 0 && lrulat_now() >= deadline) ||
+                    q->sinfo.head == q->sinfo.tail)
+                {
+                    break;
+                }
+                i = q->sinfo.head++;
+            }
             /* Borrow reference from list. */
             n = (Node *)PyList_GetItem(q->lst, i);
 
@@ -128,39 +282,44 @@ lrupq_purge(LRUDict_pq *q, PyObject *callback)
                 continue;
             }
 
+            t0 = unlikely(q->lat != NULL) ? lrulat_now() : 0;
+            if (hook != NULL &&
+                hook->fn(hook->ctx, n->pl.key, n->pl.value,
+                         LRUPQ_EVICT_SIZE) != 0 &&
+                lrupq_call_failed(NULL))
+            {
+                /* Abandon, leave loop, and signal our intent to go all the
+                 * way back to Python. */
+                fail = 1;
+                break;
+            }
+
+            if (callback == NULL) {
+                LRUPQ_LAT_STOP(q, t0);
+                continue;
+            }
+
+            q->n_calls++;
             cres = PyObject_CallFunctionObjArgs(callback,
                                                 n->pl.key, n->pl.value,
                                                 NULL);
+            LRUPQ_LAT_STOP(q, t0);
             if (cres != NULL) {
                 /* Discard return value of callback. */
                 Py_DECREF(cres);
                 continue;
             }
 
-            /* This block is executed if callback returns NULL. A sufficiently
-             * bad callback may fail to set (or swallow) exception, so we check
-             * explicitly. */
-            {
-                PyObject *exc = PyErr_Occurred();
-                if (exc) {
-                    if (lrupq_err_bad(exc)) {
-                        /* External exception that needs the attention of
-                         * interpreter: do not suppress. Instead, abandon,
-                         * leave loop, and signal our intent to go all the way
-                         * back to Python. */
-                        fail = 1;
-                        break;
-                    }
-                    else {
-                        /* Exception ignored. */
-                        PyErr_WriteUnraisable(callback);
-                        PyErr_Clear();
-                    }
-                }
+            /* This block is executed if callback returns NULL. */
+            q->n_call_errors++;
+            if (lrupq_call_failed(callback)) {
+                fail = 1;
+                break;
             }
         }  /* end of "for item in batch" loop */
 
-        Py_DECREF(callback);
+        lrupq_hook_decref(hook);
+        Py_XDECREF(callback);
         Py_DECREF(q->lst);
         q->n_active--;
         if (fail) {
@@ -17,16 +17,63 @@ struct _pq_sinfo {
 };
 
 
+/* Native eviction hook, set from C through the C API (see lru_ng_capi.h).
+ * Refcounted, so that replacing it during a purge does not pull it from under
+ * the purge in progress; ctx_free(ctx) is called as the last ref is dropped. */
+typedef int (*lrupq_hook_func)(void *ctx, PyObject *key, PyObject *value,
+                               int reason);
+
+
+typedef struct _LRUDict_hook {
+    lrupq_hook_func fn;
+    void *ctx;
+    void (*ctx_free)(void *ctx);
+    Py_ssize_t refcnt;
+} LRUDict_hook;
+
+
+/* Reasons passed to the hook. */
+#define LRUPQ_EVICT_SIZE    0
+
+
 typedef struct _LRUDict_pq {
     struct _pq_sinfo sinfo;
     PyObject *lst;
+    LRUDict_hook *hook;
+    /* Latency recorder of the owning LRUDict, which times the callbacks if
+     * not NULL (see lrudict_lat.h). */
+    struct _LRULat *lat;
     unsigned short n_active;
     unsigned short n_max;
+    /* Bound on the number of staged items (0 if unbounded), and what to do
+     * with evictions beyond it; see LRUDict.max_staged. */
+    Py_ssize_t max_staged;
+    unsigned char overflow;
+    /* Budget of an automatic purge, in items and in ns (0 if unbounded); see
+     * LRUDict.purge_budget. */
+    Py_ssize_t budget_items;
+    uint64_t budget_ns;
+    /* Purge due at the end of the operation, even if suspended. */
+    _Bool purge_due;
+    /* Nodes evicted beyond the bound that cannot be released inside the
+     * critical section, or are yet to be passed to the hook, to be released
+     * without the callback right after it (by update() every LRU_BATCH_MAX
+     * of them); NULL if none. */
+    PyObject *dropped;
+    /* Statistics, reported by LRUDict.get_ext_stats() */
+    uint64_t n_calls;           /* of the callback */
+    uint64_t n_call_errors;
+    Py_ssize_t peak_len;
 } LRUDict_pq;
 
 /* Hard-coded default n_max. */
 #define LRUPQ_N_MAX_DEFAULT 8192
 
+/* Overflow policies, in the order of their names for LRUDict.overflow. */
+#define LRUPQ_OVERFLOW_PURGE    0
+#define LRUPQ_OVERFLOW_DROP     1
+#define LRUPQ_OVERFLOW_RAISE    2
+
 LRUDict_pq *
 lrupq_new(void);
 
@@ -34,6 +81,14 @@ int
 lrupq_free(LRUDict_pq *q);
 
 Py_ssize_t
-lrupq_purge(LRUDict_pq *q, PyObject *callback);
+lrupq_purge(LRUDict_pq *q, PyObject *callback, Py_ssize_t max_items,
+            uint64_t max_ns);
+
+Py_ssize_t
+lrupq_release_dropped(LRUDict_pq *q);
+
+int
+lrupq_set_hook(LRUDict_pq *q, lrupq_hook_func fn, void *ctx,
+               void (*ctx_free)(void *));
 
 #endif
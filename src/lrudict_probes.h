@@ -0,0 +1,41 @@
+#ifndef LRUDICT_PROBES_H
+#define LRUDICT_PROBES_H
+/* USDT (user-level statically defined tracing) probes of LRUDict, under the
+ * provider "lru_ng", for bpftrace, perf, or SystemTap. They are compiled in
+ * where the <sys/sdt.h> header of SystemTap is found, unless LRUNG_NO_USDT is
+ * defined. A probe is then a nop in the code and a note in the ELF section
+ * .note.stapsdt; attaching a tracer patches the nop. The arguments are
+ * values already at hand, and are not evaluated into memory.
+ *
+ *  hit(self, key_hash)         lookup found the key
+ *  miss(self, key_hash)        lookup did not
+ *  insert(self, key_hash, len) new key, before any eviction
+ *  evict(self, key_hash, queue_len)
+ *                              queue_len: items staged in the purge queue
+ *  purge_start(self, queue_len)
+ *  purge_end(self, result)     return value of lrupq_purge()
+ *  busy(self)                  LRUDictBusyError is about to be raised */
+
+
+#ifndef LRUNG_NO_USDT
+#ifdef __has_include
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define LRU_USDT_AVAILABLE 1
+#endif
+#endif
+#endif
+
+
+#ifdef LRU_USDT_AVAILABLE
+#define LRU_PROBE1(name, a)         DTRACE_PROBE1(lru_ng, name, a)
+#define LRU_PROBE2(name, a, b)      DTRACE_PROBE2(lru_ng, name, a, b)
+#define LRU_PROBE3(name, a, b, c)   DTRACE_PROBE3(lru_ng, name, a, b, c)
+#else
+#define LRU_PROBE1(name, a)         ((void)0)
+#define LRU_PROBE2(name, a, b)      ((void)0)
+#define LRU_PROBE3(name, a, b, c)   ((void)0)
+#endif
+
+
+#endif /* LRUDICT_PROBES_H */
@@ -0,0 +1,1717 @@
+#define PY_SSIZE_T_CLEAN
+#include "Python.h"
+#include "lrudict.h"    /* For likely/unlikely */
+#include "lrudict_shm.h"
+
+#ifdef LRUSHM_AVAILABLE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/*
+ * SharedLRUCache: an LRU cache of bytes keys and bytes values stored in a
+ * POSIX shared-memory object (on Linux, a file under /dev/shm). Every process
+ * that opens the object by name maps the same memory, so they see (and share
+ * the capacity of) one cache.
+ *
+ * Nothing in the mapping is a pointer, because the mapping lands at different
+ * addresses in different processes. Links are byte offsets from the start of
+ * the mapping, and offset 0 (where the header lives) doubles as "null".
+ *
+ * Layout of the mapping:
+ *
+ *  [header | hash-bucket array | slab pages ...]
+ *
+ * The slab allocator works like memcached's. The pages are handed out on
+ * demand to size classes, each of which cuts its pages into chunks of one
+ * fixed size. An item (header + key + value) occupies one chunk of the
+ * smallest class that fits.
+ *
+ * Each item is on two doubly-linked recency lists: a global one, which gives
+ * the MRU-to-LRU order seen by keys() and friends, and one for its own size
+ * class. When a class has no free chunk and no page is left, the least
+ * recently used item of that class is evicted to make room, because only an
+ * item of that class can free a chunk of the right size. That alone would
+ * leave the pages wherever the early traffic put them, and a class that got
+ * none could never store anything, so as memcached's slab rebalancer does,
+ * a page is moved between classes when the class in need is starved: the
+ * page holding the globally least recently used item is emptied (evicting
+ * all its items) and recut for the class in need. Items carry a logical
+ * timestamp of their last use, which tells how starved a class is.
+ *
+ * All access to the mapping happens under one process-shared mutex in the
+ * header. Where supported, the mutex is robust: if a process dies while
+ * holding it, the next locker takes it over, and because the data may have
+ * been left half-modified, the cache is emptied.
+ *
+ * Hashing uses 64-bit FNV-1a rather than Python's hash(), since the latter is
+ * randomized per process (see PYTHONHASHSEED).
+ */
+
+
+#define SHM_MAGIC       UINT64_C(0x314853474e55524c)    /* "LRUNGSH1" */
+#define SHM_VERSION     2U
+#define SHM_MAX_CLASSES 48
+#define SHM_MIN_CHUNK   96
+#define SHM_MIN_PAGE    4096
+#define SHM_MAX_PAGE    (1024 * 1024)
+#define SHM_ALIGN       64
+/* A page is moved to a class when the globally LRU item has gone unused this
+ * many times longer than the class's own LRU item. */
+#define SHM_MOVE_RATIO  2
+/* Number of 1-ms waits for another process to finish creating the cache. */
+#define SHM_ATTACH_TRIES    2000
+
+#if defined(__linux__) || defined(__FreeBSD__)
+#define SHM_ROBUST 1
+#endif
+
+
+typedef uint64_t shm_off;
+
+
+typedef struct _shm_class {
+    uint64_t chunk_size;
+    shm_off free_head;  /* singly linked through hnext */
+    shm_off head;       /* MRU of this class */
+    shm_off tail;       /* LRU of this class */
+} shm_class;
+
+
+typedef struct _shm_header {
+    uint64_t magic;     /* written last when the cache is created */
+    uint32_t version;
+    uint32_t n_classes;
+    uint64_t total_size;
+    uint64_t page_size;
+    uint64_t bucket_mask;
+    shm_off buckets;
+    shm_off pages;
+    uint64_t n_pages;
+    uint64_t n_pages_used;
+    shm_off head;       /* MRU of all items */
+    shm_off tail;       /* LRU of all items */
+    uint64_t n_items;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t clock;     /* logical time, advanced by each use of an item */
+    pthread_mutex_t lock;
+    shm_class classes[SHM_MAX_CLASSES];
+} shm_header;
+
+
+typedef struct _shm_item {
+    shm_off hnext;      /* next in hash chain, or in class free list */
+    shm_off prev;       /* global list, towards MRU */
+    shm_off next;       /* global list, towards LRU */
+    shm_off cprev;      /* class list, towards MRU */
+    shm_off cnext;      /* class list, towards LRU */
+    uint64_t hash;
+    uint64_t stamp;     /* clock at the last use */
+    uint32_t klen;
+    uint32_t vlen;
+    uint32_t cls;       /* also set in free chunks: the class owns the page */
+    uint32_t live;      /* 0 in a free chunk */
+    char data[];        /* key bytes immediately followed by value bytes */
+} shm_item;
+
+
+/* Python object: a handle to one mapping of the cache. */
+typedef struct _SharedLRUCache {
+    PyObject_HEAD
+    shm_header *hdr;    /* NULL once closed */
+    shm_header *map;    /* NULL once unmapped, which may come later */
+    size_t map_size;
+    Py_ssize_t busy;    /* threads waiting for the lock without the GIL */
+    PyObject *name;
+} SharedLRUCache;
+
+
+#define SHM_ITEM(hdr, off)  ((shm_item *)((char *)(hdr) + (off)))
+#define SHM_BUCKETS(hdr)    ((shm_off *)((char *)(hdr) + (hdr)->buckets))
+#define SHM_ITEM_KEY(it)    ((it)->data)
+#define SHM_ITEM_VALUE(it)  ((it)->data + (it)->klen)
+
+
+static inline uint64_t
+shm_hash(const char *s, size_t n)
+{
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)s[i];
+        h *= UINT64_C(0x100000001b3);
+    }
+    return h;
+}
+
+
+static inline uint64_t
+shm_round_up(uint64_t n, uint64_t align)
+{
+    return (n + align - 1) / align * align;
+}
+
+
+/* Recency-list primitives, one set for the global list (prev/next) and one
+ * for the class lists (cprev/cnext). */
+#define SHM_LIST_OPS(name, PREV, NEXT)                                      \
+static inline void                                                          \
+shm_##name##_unlink(shm_header *hdr, shm_off *head, shm_off *tail,          \
+                    shm_item *it)                                           \
+{                                                                           \
+    if (it->PREV) {                                                         \
+        SHM_ITEM(hdr, it->PREV)->NEXT = it->NEXT;                           \
+    }                                                                       \
+    else {                                                                  \
+        *head = it->NEXT;                                                   \
+    }                                                                       \
+    if (it->NEXT) {                                                         \
+        SHM_ITEM(hdr, it->NEXT)->PREV = it->PREV;                           \
+    }                                                                       \
+    else {                                                                  \
+        *tail = it->PREV;                                                   \
+    }                                                                       \
+}                                                                           \
+                                                                            \
+static inline void                                                          \
+shm_##name##_push(shm_header *hdr, shm_off *head, shm_off *tail,            \
+                  shm_item *it, shm_off off)                                \
+{                                                                           \
+    it->PREV = 0;                                                           \
+    it->NEXT = *head;                                                       \
+    if (*head) {                                                            \
+        SHM_ITEM(hdr, *head)->PREV = off;                                   \
+    }                                                                       \
+    else {                                                                  \
+        *tail = off;                                                        \
+    }                                                                       \
+    *head = off;                                                            \
+}
+
+SHM_LIST_OPS(glist, prev, next)
+SHM_LIST_OPS(clist, cprev, cnext)
+
+
+/* Move item to the MRU end of both lists. */
+static inline void
+shm_promote(shm_header *hdr, shm_item *it, shm_off off)
+{
+    shm_class *cl = hdr->classes + it->cls;
+
+    it->stamp = ++hdr->clock;
+    if (hdr->head != off) {
+        shm_glist_unlink(hdr, &hdr->head, &hdr->tail, it);
+        shm_glist_push(hdr, &hdr->head, &hdr->tail, it, off);
+    }
+    if (cl->head != off) {
+        shm_clist_unlink(hdr, &cl->head, &cl->tail, it);
+        shm_clist_push(hdr, &cl->head, &cl->tail, it, off);
+    }
+}
+
+
+/* Find item by key. If found, return its offset and write to *link_ref the
+ * location of the hash-chain link pointing to it; otherwise return 0. */
+static shm_off
+shm_find(shm_header *hdr, const char *key, uint32_t klen, uint64_t h,
+         shm_off **link_ref)
+{
+    shm_off *link = SHM_BUCKETS(hdr) + (h & hdr->bucket_mask);
+
+    while (*link) {
+        shm_item *it = SHM_ITEM(hdr, *link);
+        if (it->hash == h && it->klen == klen &&
+            memcmp(SHM_ITEM_KEY(it), key, klen) == 0)
+        {
+            *link_ref = link;
+            return *link;
+        }
+        link = &it->hnext;
+    }
+    return 0;
+}
+
+
+/* Locate the hash-chain link pointing to a live item. */
+static shm_off *
+shm_find_link(shm_header *hdr, shm_off off)
+{
+    shm_off *link = SHM_BUCKETS(hdr) +
+                    (SHM_ITEM(hdr, off)->hash & hdr->bucket_mask);
+
+    while (*link != off) {
+        assert(*link != 0);
+        link = &SHM_ITEM(hdr, *link)->hnext;
+    }
+    return link;
+}
+
+
+/* Unlink item from the hash chain and both lists, and free its chunk. */
+static void
+shm_remove(shm_header *hdr, shm_off *link, shm_off off)
+{
+    shm_item *it = SHM_ITEM(hdr, off);
+    shm_class *cl = hdr->classes + it->cls;
+
+    *link = it->hnext;
+    shm_glist_unlink(hdr, &hdr->head, &hdr->tail, it);
+    shm_clist_unlink(hdr, &cl->head, &cl->tail, it);
+    hdr->n_items--;
+
+    it->live = 0;
+    it->hnext = cl->free_head;
+    cl->free_head = off;
+}
+
+
+/* Smallest class whose chunks can hold need bytes, or -1. */
+static int
+shm_class_for(const shm_header *hdr, uint64_t need)
+{
+    uint32_t lo = 0;
+    uint32_t hi = hdr->n_classes;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (hdr->classes[mid].chunk_size < need) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo < hdr->n_classes ? (int)lo : -1;
+}
+
+
+/* Cut the page into free chunks of class c. */
+static void
+shm_carve(shm_header *hdr, shm_off page, int c)
+{
+    shm_class *cl = hdr->classes + c;
+    uint64_t n = hdr->page_size / cl->chunk_size;
+
+    while (n-- > 0) {
+        shm_off off = page + n * cl->chunk_size;
+        shm_item *it = SHM_ITEM(hdr, off);
+        it->cls = (uint32_t)c;
+        it->live = 0;
+        it->hnext = cl->free_head;
+        cl->free_head = off;
+    }
+}
+
+
+/* Choose the page to move to class c, which has no free chunk and no fresh
+ * page to take. Return 0 if the class should evict its own LRU item
+ * instead. */
+static shm_off
+shm_victim_page(shm_header *hdr, int c)
+{
+    const shm_class *cl = hdr->classes + c;
+    shm_off off = hdr->tail;
+
+    if (off == 0) {
+        /* No item at all: the pages are free chunks of other classes. */
+        for (uint32_t i = 0; i < hdr->n_classes && off == 0; i++) {
+            off = hdr->classes[i].free_head;
+        }
+        if (off == 0) {
+            return 0;
+        }
+    }
+    else if (SHM_ITEM(hdr, off)->cls == (uint32_t)c) {
+        return 0;
+    }
+    else if (cl->tail &&
+             hdr->clock - SHM_ITEM(hdr, off)->stamp <=
+             SHM_MOVE_RATIO * (hdr->clock - SHM_ITEM(hdr, cl->tail)->stamp))
+    {
+        return 0;
+    }
+    return hdr->pages + (off - hdr->pages) / hdr->page_size * hdr->page_size;
+}
+
+
+/* Empty the page, evicting its items, and recut it for class c. */
+static void
+shm_move_page(shm_header *hdr, shm_off page, int c)
+{
+    shm_class *owner = hdr->classes + SHM_ITEM(hdr, page)->cls;
+    uint64_t size = owner->chunk_size;
+    shm_off *link;
+
+    for (shm_off off = page; off + size <= page + hdr->page_size;
+         off += size)
+    {
+        if (SHM_ITEM(hdr, off)->live) {
+            shm_remove(hdr, shm_find_link(hdr, off), off);
+            hdr->evictions++;
+        }
+    }
+    /* All the page's chunks are free by now; drop them from the old
+     * owner's free list. */
+    link = &owner->free_head;
+    while (*link) {
+        if (*link >= page && *link < page + hdr->page_size) {
+            *link = SHM_ITEM(hdr, *link)->hnext;
+        }
+        else {
+            link = &SHM_ITEM(hdr, *link)->hnext;
+        }
+    }
+    shm_carve(hdr, page, c);
+}
+
+
+/* Get a free chunk of class c, taking a fresh page, moving a page from
+ * another class or evicting the class's LRU item if needed. Return 0 if none
+ * is possible. */
+static shm_off
+shm_alloc(shm_header *hdr, int c)
+{
+    shm_class *cl = hdr->classes + c;
+    shm_off off;
+
+    if (cl->free_head == 0) {
+        shm_off page;
+        if (hdr->n_pages_used < hdr->n_pages) {
+            shm_carve(hdr, hdr->pages + hdr->n_pages_used * hdr->page_size,
+                      c);
+            hdr->n_pages_used++;
+        }
+        else if ((page = shm_victim_page(hdr, c)) != 0) {
+            shm_move_page(hdr, page, c);
+        }
+        else if (cl->tail) {
+            off = cl->tail;
+            shm_remove(hdr, shm_find_link(hdr, off), off);
+            hdr->evictions++;
+        }
+        else {
+            return 0;
+        }
+    }
+
+    off = cl->free_head;
+    cl->free_head = SHM_ITEM(hdr, off)->hnext;
+    return off;
+}
+
+
+/* Insert or replace. Return 0 on success, -1 if there's no room for an item
+ * of this class, or -2 if the item is larger than the largest class. */
+static int
+shm_set(shm_header *hdr, const char *key, uint32_t klen,
+        const char *value, uint32_t vlen, uint64_t h)
+{
+    shm_off *link;
+    shm_off off, new_off;
+    shm_item *it;
+    int c = shm_class_for(hdr, sizeof(shm_item) + (uint64_t)klen + vlen);
+
+    if (c < 0) {
+        return -2;
+    }
+
+    if ((off = shm_find(hdr, key, klen, h, &link)) != 0) {
+        it = SHM_ITEM(hdr, off);
+        if (it->cls == (uint32_t)c) {
+            /* Fits the same chunk: overwrite in place. */
+            memcpy(SHM_ITEM_VALUE(it), value, vlen);
+            it->vlen = vlen;
+            shm_promote(hdr, it, off);
+            return 0;
+        }
+    }
+
+    /* Allocate before dropping the old item, which stays if this fails. */
+    if ((new_off = shm_alloc(hdr, c)) == 0) {
+        return -1;
+    }
+    /* The allocation may have evicted it already. */
+    if (off != 0 && (off = shm_find(hdr, key, klen, h, &link)) != 0) {
+        shm_remove(hdr, link, off);
+    }
+    off = new_off;
+
+    it = SHM_ITEM(hdr, off);
+    it->hash = h;
+    it->stamp = ++hdr->clock;
+    it->klen = klen;
+    it->vlen = vlen;
+    it->cls = (uint32_t)c;
+    it->live = 1;
+    memcpy(SHM_ITEM_KEY(it), key, klen);
+    memcpy(SHM_ITEM_VALUE(it), value, vlen);
+
+    link = SHM_BUCKETS(hdr) + (h & hdr->bucket_mask);
+    it->hnext = *link;
+    *link = off;
+    shm_glist_push(hdr, &hdr->head, &hdr->tail, it, off);
+    shm_clist_push(hdr, &hdr->classes[c].head, &hdr->classes[c].tail, it, off);
+    hdr->n_items++;
+    return 0;
+}
+
+
+/* Compute the geometry for a mapping of the given size into hdr (which need
+ * not be mapped memory). Return -1 if the size is too small to be useful. */
+static int
+shm_geometry(shm_header *hdr, uint64_t size)
+{
+    uint64_t page_size = SHM_MIN_PAGE;
+    uint64_t n_buckets = 64;
+    uint64_t chunk = SHM_MIN_CHUNK;
+    uint32_t n_classes = 0;
+
+    while (page_size < SHM_MAX_PAGE && page_size * 32 <= size) {
+        page_size *= 2;
+    }
+    /* Assume roughly 256 bytes per item on average. */
+    while (n_buckets * 256 < size) {
+        n_buckets *= 2;
+    }
+
+    memset(hdr, 0, sizeof(shm_header));
+    hdr->version = SHM_VERSION;
+    hdr->total_size = size;
+    hdr->page_size = page_size;
+    hdr->bucket_mask = n_buckets - 1;
+    hdr->buckets = shm_round_up(sizeof(shm_header), SHM_ALIGN);
+    hdr->pages = shm_round_up(hdr->buckets + n_buckets * sizeof(shm_off),
+                              SHM_ALIGN);
+    if (hdr->pages + page_size > size) {
+        return -1;
+    }
+    hdr->n_pages = (size - hdr->pages) / page_size;
+
+    /* Chunk sizes grow by a factor of about 1.25 up to one full page. */
+    while (chunk < page_size && n_classes < SHM_MAX_CLASSES - 1) {
+        hdr->classes[n_classes++].chunk_size = chunk;
+        chunk = shm_round_up(chunk + chunk / 4, 8);
+    }
+    hdr->classes[n_classes++].chunk_size = page_size;
+    hdr->n_classes = n_classes;
+    return 0;
+}
+
+
+/* Drop all items, keeping the geometry and the lock. */
+static void
+shm_reset(shm_header *hdr)
+{
+    memset(SHM_BUCKETS(hdr), 0, (hdr->bucket_mask + 1) * sizeof(shm_off));
+    for (uint32_t i = 0; i < hdr->n_classes; i++) {
+        shm_class *cl = hdr->classes + i;
+        cl->free_head = cl->head = cl->tail = 0;
+    }
+    hdr->n_pages_used = 0;
+    hdr->head = hdr->tail = 0;
+    hdr->n_items = 0;
+    hdr->hits = hdr->misses = hdr->evictions = 0;
+    hdr->clock = 0;
+}
+
+
+static int
+shm_init_lock(shm_header *hdr)
+{
+    pthread_mutexattr_t attr;
+    int rc;
+
+    if ((rc = pthread_mutexattr_init(&attr)) != 0) {
+        return rc;
+    }
+    rc = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef SHM_ROBUST
+    if (rc == 0) {
+        rc = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    }
+#endif
+    if (rc == 0) {
+        rc = pthread_mutex_init(&hdr->lock, &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+    return rc;
+}
+
+
+static inline void
+shm_publish_magic(shm_header *hdr)
+{
+#ifdef __GNUC__
+    __atomic_store_n(&hdr->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+#else
+    *(volatile uint64_t *)&hdr->magic = SHM_MAGIC;
+#endif
+}
+
+
+static inline uint64_t
+shm_read_magic(shm_header *hdr)
+{
+#ifdef __GNUC__
+    return __atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE);
+#else
+    return *(volatile uint64_t *)&hdr->magic;
+#endif
+}
+
+
+static void
+shm_sleep_ms(void)
+{
+    struct timespec ts = {0, 1000000L};
+
+    Py_BEGIN_ALLOW_THREADS
+    nanosleep(&ts, NULL);
+    Py_END_ALLOW_THREADS
+}
+
+
+/* Python-facing part */
+#define SHM_CHECK_OPEN(self, failresult)    \
+do {                                        \
+    if (unlikely((self)->hdr == NULL)) {    \
+        PyErr_SetString(PyExc_ValueError,   \
+                "operation on closed SharedLRUCache");  \
+        return (failresult);                \
+    }                                       \
+} while (0)
+
+
+/* Acquire the shared lock. The GIL is only released if the lock is contended,
+ * and it is never released while the lock is held, so that two threads of the
+ * same process cannot deadlock on the pair. For the same reason nothing that
+ * can run Python code happens under the lock. That includes creating a
+ * GC-tracked object such as a tuple, a list or an exception, since this may
+ * start a collection and hence run finalizers; only the (untracked) bytes
+ * objects and raw copies of the items are made there. */
+static void shm_unmap(SharedLRUCache *self);
+
+static int
+shm_lock(SharedLRUCache *self)
+{
+    shm_header *hdr = self->hdr;
+    int rc;
+
+    SHM_CHECK_OPEN(self, -1);
+
+    if ((rc = pthread_mutex_trylock(&hdr->lock)) == EBUSY) {
+        /* Another thread may close the handle meanwhile; the count keeps the
+         * memory mapped until this one is done with it. */
+        self->busy++;
+        Py_BEGIN_ALLOW_THREADS
+        rc = pthread_mutex_lock(&hdr->lock);
+        Py_END_ALLOW_THREADS
+        self->busy--;
+    }
+#ifdef SHM_ROBUST
+    if (rc == EOWNERDEAD) {
+        /* The last owner died in the middle of its work; start over. */
+        shm_reset(hdr);
+        if ((rc = pthread_mutex_consistent(&hdr->lock)) != 0) {
+            pthread_mutex_unlock(&hdr->lock);
+        }
+    }
+#endif
+    if (unlikely(self->hdr == NULL)) {
+        /* Closed while waiting; finish the deferred unmapping. */
+        if (rc == 0) {
+            pthread_mutex_unlock(&hdr->lock);
+        }
+        shm_unmap(self);
+        SHM_CHECK_OPEN(self, -1);
+    }
+    if (rc != 0) {
+        errno = rc;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    return 0;
+}
+
+
+static inline void
+shm_unlock(SharedLRUCache *self)
+{
+    pthread_mutex_unlock(&self->hdr->lock);
+}
+
+
+/* Borrow the buffer of a bytes object, checking its type and length. */
+static int
+shm_get_bytes(PyObject *obj, const char *what, const char **buf,
+              uint32_t *len)
+{
+    Py_ssize_t n;
+
+    if (!PyBytes_Check(obj)) {
+        PyErr_Format(PyExc_TypeError, "SharedLRUCache %s must be bytes, not %s",
+                     what, Py_TYPE(obj)->tp_name);
+        return -1;
+    }
+    n = PyBytes_GET_SIZE(obj);
+    if ((uint64_t)n > UINT32_MAX) {
+        PyErr_Format(PyExc_ValueError, "SharedLRUCache %s too large", what);
+        return -1;
+    }
+    *buf = PyBytes_AS_STRING(obj);
+    *len = (uint32_t)n;
+    return 0;
+}
+
+
+static inline PyObject *
+shm_item_value(const shm_item *it)
+{
+    return PyBytes_FromStringAndSize(SHM_ITEM_VALUE(it), it->vlen);
+}
+
+
+static inline PyObject *
+shm_item_key(const shm_item *it)
+{
+    return PyBytes_FromStringAndSize(SHM_ITEM_KEY(it), it->klen);
+}
+
+
+/* Pack key and value into a tuple, stealing the references. Return NULL if
+ * either is NULL, with the exception left as set. */
+static PyObject *
+shm_pair_steal(PyObject *key, PyObject *value)
+{
+    PyObject *item = NULL;
+
+    if (key && value) {
+        item = PyTuple_Pack(2, key, value);
+    }
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+    return item;
+}
+
+
+/* Look up key. On a hit, promote it and write a new reference to a copy of
+ * the value into *value; on a miss write NULL. If pop is true, also remove
+ * the item on a hit. Return -1 on error. */
+static int
+shm_lookup_impl(SharedLRUCache *self, PyObject *key, PyObject **value,
+                _Bool pop)
+{
+    const char *k;
+    uint32_t klen;
+    uint64_t h;
+    shm_off *link;
+    shm_off off;
+
+    *value = NULL;
+    if (shm_get_bytes(key, "key", &k, &klen) == -1) {
+        return -1;
+    }
+    h = shm_hash(k, klen);
+
+    if (shm_lock(self) == -1) {
+        return -1;
+    }
+    if ((off = shm_find(self->hdr, k, klen, h, &link)) != 0) {
+        shm_item *it = SHM_ITEM(self->hdr, off);
+        if ((*value = shm_item_value(it)) != NULL) {
+            self->hdr->hits++;
+            if (pop) {
+                shm_remove(self->hdr, link, off);
+            }
+            else {
+                shm_promote(self->hdr, it, off);
+            }
+        }
+    }
+    else {
+        self->hdr->misses++;
+    }
+    shm_unlock(self);
+
+    return (off != 0 && *value == NULL) ? -1 : 0;
+}
+
+
+/* Set the exception for a failed shm_set(). */
+static void
+shm_set_error(int res, uint32_t klen, uint32_t vlen)
+{
+    if (res == -2) {
+        PyErr_Format(PyExc_ValueError,
+                     "item of %zd bytes exceeds the maximal item size of"
+                     " SharedLRUCache",
+                     (Py_ssize_t)klen + (Py_ssize_t)vlen);
+    }
+    else {
+        PyErr_SetString(PyExc_MemoryError,
+                        "no room in SharedLRUCache for an item of this size");
+    }
+}
+
+
+static int
+shm_store_impl(SharedLRUCache *self, PyObject *key, PyObject *value)
+{
+    const char *k, *v;
+    uint32_t klen, vlen;
+    int res;
+
+    if (shm_get_bytes(key, "key", &k, &klen) == -1 ||
+        shm_get_bytes(value, "value", &v, &vlen) == -1)
+    {
+        return -1;
+    }
+
+    if (shm_lock(self) == -1) {
+        return -1;
+    }
+    res = shm_set(self->hdr, k, klen, v, vlen, shm_hash(k, klen));
+    shm_unlock(self);
+
+    if (res != 0) {
+        shm_set_error(res, klen, vlen);
+    }
+    return res == 0 ? 0 : -1;
+}
+
+
+static Py_ssize_t
+SHM_length(SharedLRUCache *self)
+{
+    Py_ssize_t n;
+
+    if (shm_lock(self) == -1) {
+        return -1;
+    }
+    n = (Py_ssize_t)self->hdr->n_items;
+    shm_unlock(self);
+    return n;
+}
+
+
+static PyObject *
+SHM_subscript(SharedLRUCache *self, PyObject *key)
+{
+    PyObject *value;
+
+    if (shm_lookup_impl(self, key, &value, 0) == 0 && value == NULL) {
+        _PyErr_SetKeyError(key);
+    }
+    return value;
+}
+
+
+static int
+SHM_ass_sub(SharedLRUCache *self, PyObject *key, PyObject *value)
+{
+    const char *k;
+    uint32_t klen;
+    uint64_t h;
+    shm_off *link;
+    shm_off off;
+
+    if (value != NULL) {
+        return shm_store_impl(self, key, value);
+    }
+
+    if (shm_get_bytes(key, "key", &k, &klen) == -1) {
+        return -1;
+    }
+    h = shm_hash(k, klen);
+    if (shm_lock(self) == -1) {
+        return -1;
+    }
+    if ((off = shm_find(self->hdr, k, klen, h, &link)) != 0) {
+        shm_remove(self->hdr, link, off);
+    }
+    shm_unlock(self);
+
+    if (off == 0) {
+        _PyErr_SetKeyError(key);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+SHM_contains(SharedLRUCache *self, PyObject *key)
+{
+    const char *k;
+    uint32_t klen;
+    uint64_t h;
+    shm_off *link;
+    shm_off off;
+
+    if (shm_get_bytes(key, "key", &k, &klen) == -1) {
+        return -1;
+    }
+    h = shm_hash(k, klen);
+    if (shm_lock(self) == -1) {
+        return -1;
+    }
+    off = shm_find(self->hdr, k, klen, h, &link);
+    shm_unlock(self);
+    return off != 0;
+}
+
+
+static PyObject *
+SHM_contains_method(SharedLRUCache *self, PyObject *key)
+{
+    switch (SHM_contains(self, key))
+    {
+        case 0: Py_RETURN_FALSE;
+        case 1: Py_RETURN_TRUE;
+        default: return NULL;
+    }
+}
+
+
+static PySequenceMethods SHM_as_sequence = {
+    .sq_contains = (objobjproc)SHM_contains,
+};
+
+
+static PyMappingMethods SHM_as_mapping = {
+    .mp_length = (lenfunc)SHM_length,
+    .mp_subscript = (binaryfunc)SHM_subscript,
+    .mp_ass_subscript = (objobjargproc)SHM_ass_sub,
+};
+
+
+/* A copy of all the items, taken under the lock, from which the Python
+ * objects are built once it is released. */
+typedef struct _shm_snapshot {
+    Py_ssize_t n;
+    uint32_t *lens;     /* klen and vlen of each item, in MRU-to-LRU order */
+    char *data;         /* each key followed by its value, in the same order */
+} shm_snapshot;
+
+
+static int
+shm_snapshot_take(SharedLRUCache *self, shm_snapshot *snap)
+{
+    shm_header *hdr;
+    size_t total = 0;
+    shm_off off;
+    char *p;
+    uint32_t *lp;
+
+    snap->lens = NULL;
+    snap->data = NULL;
+    if (shm_lock(self) == -1) {
+        return -1;
+    }
+    hdr = self->hdr;
+    for (off = hdr->head; off; off = SHM_ITEM(hdr, off)->next) {
+        total += (size_t)SHM_ITEM(hdr, off)->klen + SHM_ITEM(hdr, off)->vlen;
+    }
+    snap->n = (Py_ssize_t)hdr->n_items;
+    snap->lens = PyMem_Malloc(2 * (size_t)snap->n * sizeof(uint32_t) + 1);
+    snap->data = PyMem_Malloc(total + 1);
+    if (snap->lens == NULL || snap->data == NULL) {
+        shm_unlock(self);
+        PyMem_Free(snap->lens);
+        PyMem_Free(snap->data);
+        PyErr_NoMemory();
+        return -1;
+    }
+    p = snap->data;
+    lp = snap->lens;
+    for (off = hdr->head; off; off = SHM_ITEM(hdr, off)->next) {
+        const shm_item *it = SHM_ITEM(hdr, off);
+        *lp++ = it->klen;
+        *lp++ = it->vlen;
+        memcpy(p, it->data, (size_t)it->klen + it->vlen);
+        p += (size_t)it->klen + it->vlen;
+    }
+    shm_unlock(self);
+    return 0;
+}
+
+
+static inline void
+shm_snapshot_release(shm_snapshot *snap)
+{
+    PyMem_Free(snap->lens);
+    PyMem_Free(snap->data);
+}
+
+
+typedef PyObject * (*shm_item_reader_func)(const char *, uint32_t,
+                                           const char *, uint32_t);
+
+
+static PyObject *
+shm_read_key(const char *key, uint32_t klen,
+             const char *Py_UNUSED(value), uint32_t Py_UNUSED(vlen))
+{
+    return PyBytes_FromStringAndSize(key, klen);
+}
+
+
+static PyObject *
+shm_read_value(const char *Py_UNUSED(key), uint32_t Py_UNUSED(klen),
+               const char *value, uint32_t vlen)
+{
+    return PyBytes_FromStringAndSize(value, vlen);
+}
+
+
+static PyObject *
+shm_read_pair(const char *key, uint32_t klen, const char *value, uint32_t vlen)
+{
+    return Py_BuildValue("(y#y#)", key, (Py_ssize_t)klen,
+                         value, (Py_ssize_t)vlen);
+}
+
+
+/* Create list from the items in MRU-to-LRU order. */
+static PyObject *
+shm_list_ftl(SharedLRUCache *self, shm_item_reader_func fcn)
+{
+    shm_snapshot snap;
+    PyObject *v;
+    const char *p;
+
+    if (shm_snapshot_take(self, &snap) == -1) {
+        return NULL;
+    }
+    if ((v = PyList_New(snap.n)) == NULL) {
+        goto done;
+    }
+    p = snap.data;
+    for (Py_ssize_t i = 0; i < snap.n; i++) {
+        uint32_t klen = snap.lens[2 * i], vlen = snap.lens[2 * i + 1];
+        PyObject *obj;
+        if ((obj = fcn(p, klen, p + klen, vlen)) == NULL) {
+            Py_CLEAR(v);
+            goto done;
+        }
+        PyList_SET_ITEM(v, i, obj);
+        p += (size_t)klen + vlen;
+    }
+done:
+    shm_snapshot_release(&snap);
+    return v;
+}
+
+
+static PyObject *
+SHM_keys(SharedLRUCache *self, PyObject *Py_UNUSED(ignored))
+{
+    return shm_list_ftl(self, shm_read_key);
+}
+
+
+static PyObject *
+SHM_values(SharedLRUCache *self, PyObject *Py_UNUSED(ignored))
+{
+    return shm_list_ftl(self, shm_read_value);
+}
+
+
+static PyObject *
+SHM_items(SharedLRUCache *self, PyObject *Py_UNUSED(ignored))
+{
+    return shm_list_ftl(self, shm_read_pair);
+}
+
+
+static PyObject *
+SHM_get(SharedLRUCache *self, PyObject *args)
+{
+    PyObject *key;
+    PyObject *default_obj = Py_None;
+    PyObject *result;
+
+    if (!PyArg_ParseTuple(args, "O|O:get", &key, &default_obj)) {
+        return NULL;
+    }
+    if (shm_lookup_impl(self, key, &result, 0) == -1) {
+        return NULL;
+    }
+    return result ? result : (Py_INCREF(default_obj), default_obj);
+}
+
+
+static PyObject *
+SHM_setdefault(SharedLRUCache *self, PyObject *args)
+{
+    PyObject *key;
+    PyObject *default_obj = Py_None;
+    const char *k, *v;
+    uint32_t klen, vlen;
+    uint64_t h;
+    shm_off *link;
+    shm_off off;
+    PyObject *res;
+    int status = 0;
+
+    if (!PyArg_ParseTuple(args, "O|O:setdefault", &key, &default_obj)) {
+        return NULL;
+    }
+    if (shm_get_bytes(key, "key", &k, &klen) == -1 ||
+        shm_get_bytes(default_obj, "value", &v, &vlen) == -1)
+    {
+        return NULL;
+    }
+    h = shm_hash(k, klen);
+
+    if (shm_lock(self) == -1) {
+        return NULL;
+    }
+    if ((off = shm_find(self->hdr, k, klen, h, &link)) != 0) {
+        shm_item *it = SHM_ITEM(self->hdr, off);
+        if ((res = shm_item_value(it)) != NULL) {
+            self->hdr->hits++;
+            shm_promote(self->hdr, it, off);
+        }
+    }
+    else {
+        status = shm_set(self->hdr, k, klen, v, vlen, h);
+        res = default_obj;
+        Py_INCREF(res);
+    }
+    shm_unlock(self);
+
+    if (status != 0) {
+        Py_DECREF(res);
+        shm_set_error(status, klen, vlen);
+        return NULL;
+    }
+    return res;
+}
+
+
+static PyObject *
+SHM_pop(SharedLRUCache *self, PyObject *args)
+{
+    PyObject *key;
+    PyObject *default_obj = NULL;
+    PyObject *result;
+
+    if (!PyArg_ParseTuple(args, "O|O:pop", &key, &default_obj)) {
+        return NULL;
+    }
+    if (shm_lookup_impl(self, key, &result, 1) == -1) {
+        return NULL;
+    }
+    if (result == NULL) {
+        if (default_obj == NULL) {
+            _PyErr_SetKeyError(key);
+        }
+        else {
+            Py_INCREF(default_obj);
+            result = default_obj;
+        }
+    }
+    return result;
+}
+
+
+static PyObject *
+SHM_popitem(SharedLRUCache *self, PyObject *args)
+{
+    int pop_least_recent = 0;
+    PyObject *key = NULL, *value = NULL;
+    shm_off off;
+
+    if (!PyArg_ParseTuple(args, "|p:popitem", &pop_least_recent)) {
+        return NULL;
+    }
+    if (shm_lock(self) == -1) {
+        return NULL;
+    }
+    off = pop_least_recent ? self->hdr->tail : self->hdr->head;
+    if (off) {
+        const shm_item *it = SHM_ITEM(self->hdr, off);
+        key = shm_item_key(it);
+        value = shm_item_value(it);
+        if (key && value) {
+            shm_remove(self->hdr, shm_find_link(self->hdr, off), off);
+        }
+    }
+    shm_unlock(self);
+
+    if (off == 0) {
+        PyErr_SetString(PyExc_KeyError,
+                        "popitem(): SharedLRUCache instance is empty");
+    }
+    return shm_pair_steal(key, value);
+}
+
+
+static PyObject *
+shm_peek_impl(SharedLRUCache *self, _Bool last, const char *msg)
+{
+    PyObject *key = NULL, *value = NULL;
+    shm_off off;
+
+    if (shm_lock(self) == -1) {
+        return NULL;
+    }
+    off = last ? self->hdr->tail : self->hdr->head;
+    if (off) {
+        key = shm_item_key(SHM_ITEM(self->hdr, off));
+        value = shm_item_value(SHM_ITEM(self->hdr, off));
+    }
+    shm_unlock(self);
+
+    if (off == 0) {
+        PyErr_Format(PyExc_KeyError, "%s: SharedLRUCache instance is empty",
+                     msg);
+    }
+    return shm_pair_steal(key, value);
+}
+
+
+static PyObject *
+SHM_peek_first_item(SharedLRUCache *self, PyObject *Py_UNUSED(ignored))
+{
+    return shm_peek_impl(self, 0, "peek_first_item()");
+}
+
+
+static PyObject *
+SHM_peek_last_item(SharedLRUCache *self, PyObject *Py_UNUSED(ignored))
+{
+    return shm_peek_impl(self, 1, "peek_last_item()");
+}
+
+
+static int
+shm_update_with(SharedLRUCache *self, PyObject *src)
+{
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+
+    while (PyDict_Next(src, &pos, &key, &value)) {
+        if (shm_store_impl(self, key, value) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+static PyObject *
+SHM_update(SharedLRUCache *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *other = NULL;
+
+    if (!PyArg_ParseTuple(args,
+                          "|O!;update() takes at most one positional-only"
+                          " parameter, which must be a dict",
+                          &PyDict_Type, &other))
+    {
+        return NULL;
+    }
+    if (other != NULL && shm_update_with(self, other) == -1) {
+        return NULL;
+    }
+    if (kwargs != NULL && shm_update_with(self, kwargs) == -1) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+SHM_to_dict(SharedLRUCache *self, PyObject *Py_UNUSED(ignored))
+{
+    shm_snapshot snap;
+    PyObject *dst;
+    const char *p;
+
+    if (shm_snapshot_take(self, &snap) == -1) {
+        return NULL;
+    }
+    if ((dst = PyDict_New()) == NULL) {
+        goto done;
+    }
+    /* Walk the copy backwards, from its end. */
+    p = snap.data;
+    for (Py_ssize_t i = 0; i < snap.n; i++) {
+        p += (size_t)snap.lens[2 * i] + snap.lens[2 * i + 1];
+    }
+    for (Py_ssize_t i = snap.n - 1; i >= 0; i--) {
+        uint32_t klen = snap.lens[2 * i], vlen = snap.lens[2 * i + 1];
+        PyObject *k, *v;
+        int status;
+        p -= (size_t)klen + vlen;
+        k = PyBytes_FromStringAndSize(p, klen);
+        v = PyBytes_FromStringAndSize(p + klen, vlen);
+        status = (k && v) ? PyDict_SetItem(dst, k, v) : -1;
+        Py_XDECREF(k);
+        Py_XDECREF(v);
+        if (unlikely(status == -1)) {
+            Py_CLEAR(dst);
+            goto done;
+        }
+    }
+done:
+    shm_snapshot_release(&snap);
+    return dst;
+}
+
+
+static PyObject *
+SHM_clear(SharedLRUCache *self, PyObject *Py_UNUSED(ignored))
+{
+    if (shm_lock(self) == -1) {
+        return NULL;
+    }
+    shm_reset(self->hdr);
+    shm_unlock(self);
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+SHM_get_stats(SharedLRUCache *self, PyObject *Py_UNUSED(ignored))
+{
+    unsigned long long hits, misses;
+
+    if (shm_lock(self) == -1) {
+        return NULL;
+    }
+    hits = self->hdr->hits;
+    misses = self->hdr->misses;
+    shm_unlock(self);
+    return Py_BuildValue("(KK)", hits, misses);
+}
+
+
+/* Close the handle. The memory is unmapped at once unless a thread is waiting
+ * for the lock in it, in which case the last such thread unmaps it. */
+static void
+shm_unmap(SharedLRUCache *self)
+{
+    self->hdr = NULL;
+    if (self->map != NULL && self->busy == 0) {
+        munmap(self->map, self->map_size);
+        self->map = NULL;
+    }
+}
+
+
+static PyObject *
+SHM_close(SharedLRUCache *self, PyObject *Py_UNUSED(ignored))
+{
+    shm_unmap(self);
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+SHM_unlink(SharedLRUCache *self, PyObject *Py_UNUSED(ignored))
+{
+    const char *cname;
+
+    if ((cname = PyUnicode_AsUTF8(self->name)) == NULL) {
+        return NULL;
+    }
+    if (shm_unlink(cname) == -1) {
+        return PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError,
+                                                    self->name);
+    }
+    Py_RETURN_NONE;
+}
+
+
+#ifdef SHM_ROBUST
+/* For testing recovery: a process calling this and then exiting dies while
+ * holding the lock. */
+static PyObject *
+SHM_acquire_lock(SharedLRUCache *self, PyObject *Py_UNUSED(ignored))
+{
+    if (shm_lock(self) == -1) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+#endif
+
+
+static PyObject *
+SHM_enter(SharedLRUCache *self, PyObject *Py_UNUSED(ignored))
+{
+    SHM_CHECK_OPEN(self, NULL);
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+
+static PyObject *
+SHM_exit(SharedLRUCache *self, PyObject *Py_UNUSED(args))
+{
+    shm_unmap(self);
+    Py_RETURN_NONE;
+}
+
+
+static PyMethodDef SHM_methods[] = {
+    {"__contains__",
+        (PyCFunction)SHM_contains_method, METH_O | METH_COEXIST,
+        PyDoc_STR("__contains__(self, key, /)\n--\n\n-> Bool\nCheck if key is in the cache.")},
+    {"__getitem__",
+        (PyCFunction)SHM_subscript, METH_O | METH_COEXIST,
+        PyDoc_STR("__getitem__(self, key, /)\n--\n\nReturn the value associated with key or raise KeyError if key is not found.")},
+    {"keys",
+        (PyCFunction)SHM_keys, METH_NOARGS,
+        PyDoc_STR("keys(self, /)\n--\n\n-> List[bytes]\nReturn a list of the keys in MRU order.")},
+    {"values",
+        (PyCFunction)SHM_values, METH_NOARGS,
+        PyDoc_STR("values(self, /)\n--\n\n-> List[bytes]\nReturn a list of values in MRU order.")},
+    {"items",
+        (PyCFunction)SHM_items, METH_NOARGS,
+        PyDoc_STR("items(self, /)\n--\n\n-> List[Tuple[bytes, bytes]]\nReturn a list of (key, value) pairs in MRU order.")},
+    {"get",
+        (PyCFunction)SHM_get, METH_VARARGS,
+        PyDoc_STR("get(self, key, default=None, /)\n--\n\n-> Object\nReturn the value for key if key is in the cache; otherwise return default.")},
+    {"setdefault",
+        (PyCFunction)SHM_setdefault, METH_VARARGS,
+        PyDoc_STR("setdefault(self, key, default, /)\n--\n\n-> bytes\nIf key is not in the cache, insert key with the value default.\n\nReturn the value associated with key if key is in the cache; otherwise return default.")},
+    {"pop",
+        (PyCFunction)SHM_pop, METH_VARARGS,
+        PyDoc_STR("pop(self, key[, default]) -> Object\nRemove the specific key and return its value.\n\nIf key is not in the cache, return default if it is present as an argument, but raise KeyError if default is not present.")},
+    {"popitem",
+        (PyCFunction)SHM_popitem, METH_VARARGS,
+        PyDoc_STR("popitem(least_recent=False, /)\n--\n\n-> Tuple[bytes, bytes]\nRemove and return a (key, value) pair, the most-recently used one by default or the least-recently used one if least_recent is True.")},
+    {"clear",
+        (PyCFunction)SHM_clear, METH_NOARGS,
+        PyDoc_STR("clear(self, /)\n--\n\n-> None\nRemove all items and reset the hit/miss counters, for every process using the cache.")},
+    {"get_stats",
+        (PyCFunction)SHM_get_stats, METH_NOARGS,
+        PyDoc_STR("get_stats(self, /)\n--\n\n-> Tuple[int, int]\nReturn a tuple of (hits, misses) summed over every process using the cache.")},
+    {"peek_first_item",
+        (PyCFunction)SHM_peek_first_item, METH_NOARGS,
+        PyDoc_STR("peek_first_item(self, /)\n--\n\n-> Tuple[bytes, bytes]\nReturn the MRU item as tuple (key, value) without changing the key order.")},
+    {"peek_last_item",
+        (PyCFunction)SHM_peek_last_item, METH_NOARGS,
+        PyDoc_STR("peek_last_item(self, /)\n--\n\n-> Tuple[bytes, bytes]\nReturn the LRU item as tuple (key, value) without changing the key order.")},
+    {"update",
+        (PyCFunction)(void(*)(void))SHM_update, METH_VARARGS | METH_KEYWORDS,
+        PyDoc_STR("update(self, other={}, /, **kwargs)\n--\n\n-> None\nUpdate the cache using the key-value pairs from the dictionary \"other\".")},
+    {"to_dict",
+        (PyCFunction)SHM_to_dict, METH_NOARGS,
+        PyDoc_STR("to_dict(self, /)\n--\n\n-> Dict[bytes, bytes]\nReturn new dictionary as a copy of self's entries, in LRU-to-MRU order.")},
+    {"close",
+        (PyCFunction)SHM_close, METH_NOARGS,
+        PyDoc_STR("close(self, /)\n--\n\n-> None\nUnmap the shared memory from this process. The cache itself, and other processes' access to it, are not affected.")},
+    {"unlink",
+        (PyCFunction)SHM_unlink, METH_NOARGS,
+        PyDoc_STR("unlink(self, /)\n--\n\n-> None\nRemove the name of the shared-memory object. It is destroyed once every process has closed it.")},
+#ifdef SHM_ROBUST
+    {"_acquire_lock",
+        (PyCFunction)SHM_acquire_lock, METH_NOARGS, NULL},
+#endif
+    {"__enter__",
+        (PyCFunction)SHM_enter, METH_NOARGS, NULL},
+    {"__exit__",
+        (PyCFunction)SHM_exit, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL},              /* sentinel */
+};
+
+
+static PyObject *
+SHM_size_getter(SharedLRUCache *self, void *Py_UNUSED(closure))
+{
+    SHM_CHECK_OPEN(self, NULL);
+    return PyLong_FromUnsignedLongLong(self->hdr->total_size);
+}
+
+
+static PyObject *
+SHM_max_item_size_getter(SharedLRUCache *self, void *Py_UNUSED(closure))
+{
+    SHM_CHECK_OPEN(self, NULL);
+    return PyLong_FromUnsignedLongLong(self->hdr->page_size -
+                                       sizeof(shm_item));
+}
+
+
+static PyObject *
+SHM_name_getter(SharedLRUCache *self, void *Py_UNUSED(closure))
+{
+    Py_INCREF(self->name);
+    return self->name;
+}
+
+
+static PyObject *
+SHM_closed_getter(SharedLRUCache *self, void *Py_UNUSED(closure))
+{
+    if (self->hdr == NULL) {
+        Py_RETURN_TRUE;
+    }
+    Py_RETURN_FALSE;
+}
+
+
+static PyGetSetDef SHM_descriptors[] = {
+    {"size",
+        (getter)SHM_size_getter, NULL,
+        PyDoc_STR("Size of the shared-memory object in bytes."),
+        NULL},
+    {"max_item_size",
+        (getter)SHM_max_item_size_getter, NULL,
+        PyDoc_STR("Maximal combined length in bytes of a key and its value."),
+        NULL},
+    {"name",
+        (getter)SHM_name_getter, NULL,
+        PyDoc_STR("Name of the shared-memory object."),
+        NULL},
+    {"closed",
+        (getter)SHM_closed_getter, NULL,
+        PyDoc_STR("Whether close() has been called."),
+        NULL},
+    {NULL, NULL, NULL, NULL, NULL},     /* sentinel */
+};
+
+
+static PyObject *
+SHM_repr(SharedLRUCache *self)
+{
+    return PyUnicode_FromFormat("<SharedLRUCache(%R, %llu)%s object at %p>",
+                                self->name,
+                                self->hdr ? (unsigned long long)
+                                            self->hdr->total_size : 0ULL,
+                                self->hdr ? "" : " (closed)",
+                                self);
+}
+
+
+/* Open (and if needed and size_bytes > 0, create) the object by name and map
+ * it. Return -1 with exception set on failure. */
+/* Check that an attached header describes the layout its creator would have
+ * computed for a mapping of this size, so that no offset derived from it can
+ * point outside the mapping. */
+static int
+shm_check_geometry(const shm_header *hdr, uint64_t size)
+{
+    shm_header geom;
+
+    if (hdr->version != SHM_VERSION || hdr->total_size != size ||
+        shm_geometry(&geom, size) == -1)
+    {
+        return -1;
+    }
+    if (hdr->page_size != geom.page_size ||
+        hdr->bucket_mask != geom.bucket_mask ||
+        hdr->buckets != geom.buckets || hdr->pages != geom.pages ||
+        hdr->n_pages != geom.n_pages || hdr->n_pages_used > hdr->n_pages ||
+        hdr->n_classes != geom.n_classes)
+    {
+        return -1;
+    }
+    for (uint32_t i = 0; i < geom.n_classes; i++) {
+        if (hdr->classes[i].chunk_size != geom.classes[i].chunk_size) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+static int
+shm_open_map(SharedLRUCache *self, const char *cname, Py_ssize_t size_bytes)
+{
+    shm_header geom;
+    struct stat st;
+    shm_header *base = MAP_FAILED;
+    _Bool created = 0;
+    int fd = -1;
+    int tries;
+
+    if (size_bytes > 0) {
+        if (shm_geometry(&geom, (uint64_t)size_bytes) == -1) {
+            PyErr_SetString(PyExc_ValueError, "size_bytes is too small");
+            return -1;
+        }
+        fd = shm_open(cname, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            created = 1;
+            if (ftruncate(fd, (off_t)size_bytes) == -1) {
+                goto oserror;
+            }
+        }
+        else if (errno != EEXIST) {
+            goto oserror;
+        }
+    }
+
+    if (!created) {
+        if ((fd = shm_open(cname, O_RDWR, 0)) == -1) {
+            goto oserror;
+        }
+        /* The creator may not have set the size yet. */
+        for (tries = 0; ; tries++) {
+            if (fstat(fd, &st) == -1) {
+                goto oserror;
+            }
+            if (st.st_size > 0 || tries >= SHM_ATTACH_TRIES) {
+                break;
+            }
+            shm_sleep_ms();
+        }
+        if ((uint64_t)st.st_size < sizeof(shm_header)) {
+            PyErr_SetString(PyExc_ValueError,
+                            "shared-memory object is not a SharedLRUCache");
+            goto error;
+        }
+        size_bytes = (Py_ssize_t)st.st_size;
+    }
+
+    base = mmap(NULL, (size_t)size_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+    if (base == MAP_FAILED) {
+        goto oserror;
+    }
+    close(fd);
+    fd = -1;
+    /* Not published in self until usable: waiting for the creator below
+     * releases the GIL. */
+    self->map_size = (size_t)size_bytes;
+
+    if (created) {
+        int rc;
+        memcpy(base, &geom, sizeof(shm_header));
+        shm_reset(base);
+        if ((rc = shm_init_lock(base)) != 0) {
+            errno = rc;
+            goto oserror;
+        }
+        shm_publish_magic(base);
+        self->hdr = self->map = base;
+        return 0;
+    }
+
+    for (tries = 0; shm_read_magic(base) != SHM_MAGIC; tries++) {
+        if (tries >= SHM_ATTACH_TRIES) {
+            PyErr_SetString(PyExc_ValueError,
+                            "shared-memory object is not a SharedLRUCache");
+            goto error;
+        }
+        shm_sleep_ms();
+    }
+    if (shm_check_geometry(base, (uint64_t)size_bytes) == -1) {
+        PyErr_SetString(PyExc_ValueError,
+                        "shared-memory object has an incompatible layout");
+        goto error;
+    }
+    self->hdr = self->map = base;
+    return 0;
+
+oserror:
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, cname);
+error:
+    /* Leave no half-made object behind to fail every later open. */
+    if (created) {
+        shm_unlink(cname);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (base != MAP_FAILED) {
+        munmap(base, (size_t)size_bytes);
+    }
+    return -1;
+}
+
+
+static int
+SHM_init(SharedLRUCache *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"name", "size_bytes", NULL};
+    PyObject *name;
+    Py_ssize_t size_bytes = 0;
+    const char *cname;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "U|n:SharedLRUCache", kwlist,
+                                     &name, &size_bytes))
+    {
+        return -1;
+    }
+    if (size_bytes < 0) {
+        PyErr_SetString(PyExc_ValueError, "size_bytes must not be negative");
+        return -1;
+    }
+
+    if (self->busy > 0) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "cannot reinitialize a SharedLRUCache in use");
+        return -1;
+    }
+    shm_unmap(self);
+    Py_CLEAR(self->name);
+    /* POSIX names begin with a slash. */
+    if (PyUnicode_GetLength(name) > 0 && PyUnicode_READ_CHAR(name, 0) == '/') {
+        Py_INCREF(name);
+        self->name = name;
+    }
+    else if ((self->name = PyUnicode_FromFormat("/%U", name)) == NULL) {
+        return -1;
+    }
+    if ((cname = PyUnicode_AsUTF8(self->name)) == NULL) {
+        return -1;
+    }
+
+    return shm_open_map(self, cname, size_bytes);
+}
+
+
+static void
+SHM_dealloc(SharedLRUCache *self)
+{
+    shm_unmap(self);
+    Py_CLEAR(self->name);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+PyDoc_STRVAR(shm_doc,
+"SharedLRUCache(name, size_bytes=0) -> LRU cache of bytes keys and values in\n"
+"shared memory\n\n"
+"Open the POSIX shared-memory object called ``name``, creating it with\n"
+"``size_bytes`` bytes if it does not exist yet and ``size_bytes`` is positive.\n"
+"All processes opening the same name share one cache, which evicts the\n"
+"least-recently used items of a similar size when it runs out of room.\n"
+"Keys and values must be ``bytes``; values are copied out on retrieval.\n\n"
+"The object persists until unlink() is called and every process has closed\n"
+"it, even after the processes have exited.");
+
+
+PyTypeObject SharedLRUCacheType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "lru_ng.SharedLRUCache",
+    .tp_basicsize = sizeof(SharedLRUCache),
+    .tp_dealloc = (destructor)SHM_dealloc,
+    .tp_repr = (reprfunc)SHM_repr,
+    .tp_as_sequence = &SHM_as_sequence,
+    .tp_as_mapping = &SHM_as_mapping,
+    .tp_hash = PyObject_HashNotImplemented,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = shm_doc,
+    .tp_methods = SHM_methods,
+    .tp_getset = SHM_descriptors,
+    .tp_init = (initproc)SHM_init,
+    .tp_new = PyType_GenericNew,
+};
+
+
+#endif /* LRUSHM_AVAILABLE */
@@ -0,0 +1,24 @@
+#ifndef LRUDICT_SHM_H
+#define LRUDICT_SHM_H
+#include "Python.h"
+/* LRU cache for bytes keys and values living in a POSIX shared-memory object,
+ * usable concurrently by unrelated processes that open it by name. */
+
+
+#if defined(HAVE_UNISTD_H) && defined(HAVE_PTHREAD_H)
+#include <unistd.h>
+#if defined(_POSIX_SHARED_MEMORY_OBJECTS) && \
+    (_POSIX_SHARED_MEMORY_OBJECTS > 0) && \
+    defined(_POSIX_THREAD_PROCESS_SHARED) && \
+    (_POSIX_THREAD_PROCESS_SHARED > 0)
+#define LRUSHM_AVAILABLE 1
+#endif
+#endif
+
+
+#ifdef LRUSHM_AVAILABLE
+extern PyTypeObject SharedLRUCacheType;
+#endif
+
+
+#endif /* LRUDICT_SHM_H */
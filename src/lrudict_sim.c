@@ -0,0 +1,1092 @@
+#define PY_SSIZE_T_CLEAN
+#include "Python.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lrudict_sim.h"
+
+
+/*
+ * The simulator works on a private copy, or a locked buffer, of the trace, and
+ * runs without the GIL. Each policy is a function that replays the whole trace
+ * at one capacity and returns the number of hits, or -1 if out of memory.
+ *
+ * LRU is the exception: it has the inclusion property (the content of a
+ * smaller LRU cache is always a subset of a larger one), so one pass computes
+ * the stack distance of each access (Mattson et al., 1970), that is, the
+ * number of distinct keys used since the previous access of the same key. The
+ * access hits in every cache at least that large. The distance is counted with
+ * a Fenwick tree over the positions in the trace, where only the latest access
+ * of each key is marked, in O(log n) per access.
+ *
+ * The other policies are kept to their textbook forms, with the parameters
+ * used by common implementations:
+ *
+ * - CLOCK: one reference bit per slot, set on hits and cleared by the hand.
+ * - SLRU: a probationary and a protected LRU segment, the latter with 80% of
+ *   the capacity; hits in probation are promoted, and the LRU end of the
+ *   protected segment is demoted back when it overflows.
+ * - ARC: Megiddo and Modha (2003), with ghost lists of evicted keys.
+ * - W-TinyLFU: Einziger et al. (2017), with an LRU window of 1% of the
+ *   capacity in front of an SLRU main cache. A key leaving the window replaces
+ *   the next victim of the main cache only if it has been seen more often, as
+ *   estimated by a count-min sketch of 4-bit counters halved every 10 x
+ *   capacity accesses. There is no doorkeeper.
+ */
+
+
+#define SIM_GOLDEN  UINT64_C(0x9E3779B97F4A7C15)
+
+
+/* Hash map from key hash to a non-negative value, with linear probing and
+ * backward-shift deletion. It grows as needed. */
+typedef struct {
+    int64_t *keys;
+    int64_t *vals;      /* -1 if the slot is empty */
+    uint64_t mask;
+    uint64_t used;
+    int shift;
+} simmap;
+
+
+static int
+simmap_alloc(simmap *m, int bits)
+{
+    uint64_t size = UINT64_C(1) << bits;
+
+    m->keys = malloc(size * sizeof(int64_t));
+    m->vals = malloc(size * sizeof(int64_t));
+    if (m->keys == NULL || m->vals == NULL) {
+        free(m->keys);
+        free(m->vals);
+        return -1;
+    }
+    memset(m->vals, 0xff, size * sizeof(int64_t));
+    m->mask = size - 1;
+    m->used = 0;
+    m->shift = 64 - bits;
+    return 0;
+}
+
+
+/* Room for n entries without growing. */
+static int
+simmap_init(simmap *m, int64_t n)
+{
+    int bits = 4;
+
+    while ((UINT64_C(1) << bits) < (uint64_t)n * 2) {
+        bits++;
+    }
+    return simmap_alloc(m, bits);
+}
+
+
+static void
+simmap_fini(simmap *m)
+{
+    free(m->keys);
+    free(m->vals);
+}
+
+
+static inline uint64_t
+simmap_find(const simmap *m, int64_t key)
+{
+    uint64_t i = ((uint64_t)key * SIM_GOLDEN) >> m->shift;
+
+    while (m->vals[i] >= 0 && m->keys[i] != key) {
+        i = (i + 1) & m->mask;
+    }
+    return i;
+}
+
+
+static inline int64_t
+simmap_get(const simmap *m, int64_t key)
+{
+    return m->vals[simmap_find(m, key)];
+}
+
+
+static int
+simmap_put(simmap *m, int64_t key, int64_t val)
+{
+    uint64_t i = simmap_find(m, key);
+
+    if (m->vals[i] < 0) {
+        if (++m->used * 2 > m->mask + 1) {
+            simmap old = *m;
+            uint64_t j;
+
+            if (simmap_alloc(m, 64 - old.shift + 1) < 0) {
+                *m = old;
+                return -1;
+            }
+            for (j = 0; j <= old.mask; j++) {
+                if (old.vals[j] >= 0) {
+                    uint64_t k = simmap_find(m, old.keys[j]);
+
+                    m->keys[k] = old.keys[j];
+                    m->vals[k] = old.vals[j];
+                }
+            }
+            m->used = old.used;
+            simmap_fini(&old);
+            i = simmap_find(m, key);
+        }
+        m->keys[i] = key;
+    }
+    m->vals[i] = val;
+    return 0;
+}
+
+
+static void
+simmap_del(simmap *m, int64_t key)
+{
+    uint64_t i = simmap_find(m, key), j = i;
+
+    if (m->vals[i] < 0) {
+        return;
+    }
+    for (;;) {
+        uint64_t home;
+
+        j = (j + 1) & m->mask;
+        if (m->vals[j] < 0) {
+            break;
+        }
+        home = ((uint64_t)m->keys[j] * SIM_GOLDEN) >> m->shift;
+        /* The entry at j may fill the hole at i unless its home is
+         * cyclically in (i, j]. */
+        if (((j - home) & m->mask) >= ((j - i) & m->mask)) {
+            m->keys[i] = m->keys[j];
+            m->vals[i] = m->vals[j];
+            i = j;
+        }
+    }
+    m->vals[i] = -1;
+    m->used--;
+}
+
+
+/* A pool of nodes on up to SIM_NLISTS doubly linked lists, with the head at
+ * the MRU end, and a map from keys to nodes. */
+#define SIM_NLISTS  4
+
+
+typedef struct {
+    int32_t head, tail;
+    int64_t size;
+} simlist;
+
+
+typedef struct {
+    int64_t *key;
+    int32_t *prev, *next;
+    uint8_t *where;     /* list the node is on */
+    int32_t free;       /* free nodes, chained by next */
+    simmap map;
+    simlist lists[SIM_NLISTS];
+} simcache;
+
+
+static int
+simcache_init(simcache *c, int64_t nodes)
+{
+    int32_t i;
+    int k;
+
+    c->key = malloc((size_t)nodes * sizeof(int64_t));
+    c->prev = malloc((size_t)nodes * sizeof(int32_t));
+    c->next = malloc((size_t)nodes * sizeof(int32_t));
+    c->where = malloc((size_t)nodes);
+    if (c->key == NULL || c->prev == NULL || c->next == NULL ||
+        c->where == NULL || simmap_init(&c->map, nodes) < 0)
+    {
+        free(c->key);
+        free(c->prev);
+        free(c->next);
+        free(c->where);
+        return -1;
+    }
+    for (i = 0; i < nodes; i++) {
+        c->next[i] = i + 1 < nodes ? i + 1 : -1;
+    }
+    c->free = 0;
+    for (k = 0; k < SIM_NLISTS; k++) {
+        c->lists[k].head = c->lists[k].tail = -1;
+        c->lists[k].size = 0;
+    }
+    return 0;
+}
+
+
+static void
+simcache_fini(simcache *c)
+{
+    free(c->key);
+    free(c->prev);
+    free(c->next);
+    free(c->where);
+    simmap_fini(&c->map);
+}
+
+
+static inline void
+simcache_push(simcache *c, int32_t i, int list)
+{
+    simlist *l = c->lists + list;
+
+    c->prev[i] = -1;
+    c->next[i] = l->head;
+    if (l->head >= 0) {
+        c->prev[l->head] = i;
+    }
+    else {
+        l->tail = i;
+    }
+    l->head = i;
+    l->size++;
+    c->where[i] = (uint8_t)list;
+}
+
+
+static inline void
+simcache_unlink(simcache *c, int32_t i)
+{
+    simlist *l = c->lists + c->where[i];
+
+    if (c->prev[i] >= 0) {
+        c->next[c->prev[i]] = c->next[i];
+    }
+    else {
+        l->head = c->next[i];
+    }
+    if (c->next[i] >= 0) {
+        c->prev[c->next[i]] = c->prev[i];
+    }
+    else {
+        l->tail = c->prev[i];
+    }
+    l->size--;
+}
+
+
+static inline int32_t
+simcache_lookup(const simcache *c, int64_t key)
+{
+    return (int32_t)simmap_get(&c->map, key);
+}
+
+
+/* Move node i to the MRU end of list. */
+static inline void
+simcache_move(simcache *c, int32_t i, int list)
+{
+    simcache_unlink(c, i);
+    simcache_push(c, i, list);
+}
+
+
+static void
+simcache_remove(simcache *c, int32_t i)
+{
+    simcache_unlink(c, i);
+    simmap_del(&c->map, c->key[i]);
+    c->next[i] = c->free;
+    c->free = i;
+}
+
+
+/* Add key at the MRU end of list. The pool must not be exhausted. Return the
+ * node, or -1 if out of memory. */
+static int32_t
+simcache_insert(simcache *c, int64_t key, int list)
+{
+    int32_t i = c->free;
+
+    if (simmap_put(&c->map, key, i) < 0) {
+        return -1;
+    }
+    c->free = c->next[i];
+    c->key[i] = key;
+    simcache_push(c, i, list);
+    return i;
+}
+
+
+/* SLRU segments, shared by SLRU and the main cache of W-TinyLFU. */
+static inline void
+slru_hit(simcache *c, int32_t i, int prob, int prot, int64_t prot_cap)
+{
+    simcache_move(c, i, prot);
+    if (c->lists[prot].size > prot_cap) {
+        simcache_move(c, c->lists[prot].tail, prob);
+    }
+}
+
+
+static inline int32_t
+slru_victim(const simcache *c, int prob, int prot)
+{
+    return (c->lists[prob].size > 0 ? c->lists[prob].tail :
+                                      c->lists[prot].tail);
+}
+
+
+static int64_t
+sim_clock(const int64_t *trace, int64_t n, int64_t cap)
+{
+    int64_t *keys = malloc((size_t)cap * sizeof(int64_t));
+    uint8_t *ref = malloc((size_t)cap);
+    int64_t t, used = 0, hand = 0, hits = 0;
+    simmap m;
+
+    if (keys == NULL || ref == NULL || simmap_init(&m, cap) < 0) {
+        free(keys);
+        free(ref);
+        return -1;
+    }
+    for (t = 0; t < n; t++) {
+        int64_t s = simmap_get(&m, trace[t]);
+
+        if (s >= 0) {
+            ref[s] = 1;
+            hits++;
+            continue;
+        }
+        if (used < cap) {
+            s = used++;
+        }
+        else {
+            while (ref[hand]) {
+                ref[hand] = 0;
+                hand = hand + 1 < cap ? hand + 1 : 0;
+            }
+            s = hand;
+            hand = hand + 1 < cap ? hand + 1 : 0;
+            simmap_del(&m, keys[s]);
+        }
+        keys[s] = trace[t];
+        ref[s] = 0;
+        if (simmap_put(&m, trace[t], s) < 0) {
+            hits = -1;
+            break;
+        }
+    }
+    simmap_fini(&m);
+    free(keys);
+    free(ref);
+    return hits;
+}
+
+
+enum { SLRU_PROB, SLRU_PROT };
+
+
+static int64_t
+sim_slru(const int64_t *trace, int64_t n, int64_t cap)
+{
+    int64_t t, hits = 0, prot_cap = cap * 4 / 5;
+    simcache c;
+
+    if (simcache_init(&c, cap) < 0) {
+        return -1;
+    }
+    for (t = 0; t < n; t++) {
+        int32_t i = simcache_lookup(&c, trace[t]);
+
+        if (i >= 0) {
+            slru_hit(&c, i, SLRU_PROB, SLRU_PROT, prot_cap);
+            hits++;
+            continue;
+        }
+        if (c.lists[SLRU_PROB].size + c.lists[SLRU_PROT].size >= cap) {
+            simcache_remove(&c, slru_victim(&c, SLRU_PROB, SLRU_PROT));
+        }
+        if (simcache_insert(&c, trace[t], SLRU_PROB) < 0) {
+            hits = -1;
+            break;
+        }
+    }
+    simcache_fini(&c);
+    return hits;
+}
+
+
+enum { ARC_T1, ARC_T2, ARC_B1, ARC_B2 };
+
+
+/* Make room in T1 + T2 by moving its LRU entry to the ghost lists. */
+static void
+arc_replace(simcache *c, int in_b2, int64_t p)
+{
+    int64_t t1 = c->lists[ARC_T1].size;
+
+    if (t1 > 0 && ((in_b2 && t1 == p) || t1 > p ||
+                   c->lists[ARC_T2].size == 0))
+    {
+        simcache_move(c, c->lists[ARC_T1].tail, ARC_B1);
+    }
+    else if (c->lists[ARC_T2].size > 0) {
+        simcache_move(c, c->lists[ARC_T2].tail, ARC_B2);
+    }
+}
+
+
+static int64_t
+sim_arc(const int64_t *trace, int64_t n, int64_t cap)
+{
+    simlist *l;
+    int64_t t, hits = 0, p = 0;
+    simcache c;
+
+    if (simcache_init(&c, cap * 2) < 0) {
+        return -1;
+    }
+    l = c.lists;
+    for (t = 0; t < n; t++) {
+        int32_t i = simcache_lookup(&c, trace[t]);
+        int64_t d;
+
+        if (i >= 0) {
+            switch (c.where[i]) {
+            case ARC_T1:
+            case ARC_T2:
+                hits++;
+                break;
+            case ARC_B1:
+                d = l[ARC_B2].size / l[ARC_B1].size;
+                p += d > 1 ? d : 1;
+                p = p < cap ? p : cap;
+                arc_replace(&c, 0, p);
+                break;
+            default:
+                d = l[ARC_B1].size / l[ARC_B2].size;
+                p -= d > 1 ? d : 1;
+                p = p > 0 ? p : 0;
+                arc_replace(&c, 1, p);
+                break;
+            }
+            simcache_move(&c, i, ARC_T2);
+            continue;
+        }
+        if (l[ARC_T1].size + l[ARC_B1].size == cap) {
+            if (l[ARC_T1].size < cap) {
+                simcache_remove(&c, l[ARC_B1].tail);
+                arc_replace(&c, 0, p);
+            }
+            else {
+                simcache_remove(&c, l[ARC_T1].tail);
+            }
+        }
+        else if (l[ARC_T1].size + l[ARC_T2].size + l[ARC_B1].size +
+                 l[ARC_B2].size >= cap)
+        {
+            if (l[ARC_T1].size + l[ARC_T2].size + l[ARC_B1].size +
+                l[ARC_B2].size == cap * 2)
+            {
+                simcache_remove(&c, l[ARC_B2].tail);
+            }
+            arc_replace(&c, 0, p);
+        }
+        if (simcache_insert(&c, trace[t], ARC_T1) < 0) {
+            hits = -1;
+            break;
+        }
+    }
+    simcache_fini(&c);
+    return hits;
+}
+
+
+/* Count-min sketch of W-TinyLFU, 4 rows of saturating 4-bit counters (held in
+ * bytes for simplicity). */
+typedef struct {
+    uint8_t *tab;
+    uint64_t width_mask;
+    int shift;
+    int64_t ops, period;
+} simsketch;
+
+
+static const uint64_t sketch_seeds[4] = {
+    UINT64_C(0x9E3779B97F4A7C15), UINT64_C(0xC2B2AE3D27D4EB4F),
+    UINT64_C(0x165667B19E3779F9), UINT64_C(0xD6E8FEB86659FD93),
+};
+
+
+static int
+sketch_init(simsketch *s, int64_t cap)
+{
+    int bits = 4;
+
+    while ((INT64_C(1) << bits) < cap) {
+        bits++;
+    }
+    if ((s->tab = calloc((size_t)4 << bits, 1)) == NULL) {
+        return -1;
+    }
+    s->width_mask = (UINT64_C(1) << bits) - 1;
+    s->shift = 64 - bits;
+    s->ops = 0;
+    s->period = cap * 10;
+    return 0;
+}
+
+
+static inline uint8_t *
+sketch_counter(const simsketch *s, int64_t key, int row)
+{
+    return (s->tab + ((uint64_t)row << (64 - s->shift)) +
+            (((uint64_t)key * sketch_seeds[row]) >> s->shift));
+}
+
+
+static void
+sketch_inc(simsketch *s, int64_t key)
+{
+    int r;
+
+    for (r = 0; r < 4; r++) {
+        uint8_t *ctr = sketch_counter(s, key, r);
+
+        if (*ctr < 15) {
+            (*ctr)++;
+        }
+    }
+    if (++s->ops >= s->period) {
+        uint64_t j;
+
+        for (j = 0; j < 4 * (s->width_mask + 1); j++) {
+            s->tab[j] >>= 1;
+        }
+        s->ops /= 2;
+    }
+}
+
+
+static unsigned
+sketch_freq(const simsketch *s, int64_t key)
+{
+    unsigned f = 15;
+    int r;
+
+    for (r = 0; r < 4; r++) {
+        uint8_t ctr = *sketch_counter(s, key, r);
+
+        f = ctr < f ? ctr : f;
+    }
+    return f;
+}
+
+
+enum { TLFU_WIN, TLFU_PROB, TLFU_PROT };
+
+
+static int64_t
+sim_tinylfu(const int64_t *trace, int64_t n, int64_t cap)
+{
+    int64_t win_cap = cap / 100 > 0 ? cap / 100 : 1;
+    int64_t main_cap = cap - win_cap, prot_cap = main_cap * 4 / 5;
+    int64_t t, hits = 0;
+    simcache c;
+    simsketch s;
+
+    if (sketch_init(&s, cap) < 0) {
+        return -1;
+    }
+    if (simcache_init(&c, cap + 1) < 0) {
+        free(s.tab);
+        return -1;
+    }
+    for (t = 0; t < n; t++) {
+        int32_t i = simcache_lookup(&c, trace[t]), cand, victim;
+
+        sketch_inc(&s, trace[t]);
+        if (i >= 0) {
+            if (c.where[i] == TLFU_WIN) {
+                simcache_move(&c, i, TLFU_WIN);
+            }
+            else {
+                slru_hit(&c, i, TLFU_PROB, TLFU_PROT, prot_cap);
+            }
+            hits++;
+            continue;
+        }
+        if (simcache_insert(&c, trace[t], TLFU_WIN) < 0) {
+            hits = -1;
+            break;
+        }
+        if (c.lists[TLFU_WIN].size <= win_cap) {
+            continue;
+        }
+        cand = c.lists[TLFU_WIN].tail;
+        if (c.lists[TLFU_PROB].size + c.lists[TLFU_PROT].size < main_cap) {
+            simcache_move(&c, cand, TLFU_PROB);
+            continue;
+        }
+        victim = slru_victim(&c, TLFU_PROB, TLFU_PROT);
+        if (victim >= 0 &&
+            sketch_freq(&s, c.key[cand]) > sketch_freq(&s, c.key[victim]))
+        {
+            simcache_remove(&c, victim);
+            simcache_move(&c, cand, TLFU_PROB);
+        }
+        else {
+            simcache_remove(&c, cand);
+        }
+    }
+    simcache_fini(&c);
+    free(s.tab);
+    return hits;
+}
+
+
+/* LRU at all capacities: hist[d] is the number of accesses at stack distance
+ * d, for 1 <= d <= max_cap. Return -1 if out of memory. */
+static int
+sim_lru_hist(const int64_t *trace, int64_t n, int64_t max_cap, int64_t *hist)
+{
+    int32_t *tree = calloc((size_t)n + 1, sizeof(int32_t));
+    int64_t t, j;
+    simmap m;
+    int ret = 0;
+
+    if (tree == NULL || simmap_init(&m, 0) < 0) {
+        free(tree);
+        return -1;
+    }
+    for (t = 0; t < n; t++) {
+        /* Position of access t in the tree is t + 1. */
+        int64_t prev = simmap_get(&m, trace[t]);
+
+        if (prev >= 0) {
+            int64_t d = 1;
+
+            /* Marks in positions prev + 2 .. t */
+            for (j = t; j > 0; j -= j & -j) {
+                d += tree[j];
+            }
+            for (j = prev + 1; j > 0; j -= j & -j) {
+                d -= tree[j];
+            }
+            if (d <= max_cap) {
+                hist[d]++;
+            }
+            for (j = prev + 1; j <= n; j += j & -j) {
+                tree[j]--;
+            }
+        }
+        for (j = t + 1; j <= n; j += j & -j) {
+            tree[j]++;
+        }
+        if (simmap_put(&m, trace[t], t) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+    simmap_fini(&m);
+    free(tree);
+    return ret;
+}
+
+
+typedef int64_t (*sim_func)(const int64_t *, int64_t, int64_t);
+
+
+static const struct {
+    const char *name;
+    sim_func func;      /* NULL for LRU, done by sim_lru_hist() */
+} sim_policies[] = {
+    {"lru", NULL},
+    {"clock", sim_clock},
+    {"slru", sim_slru},
+    {"arc", sim_arc},
+    {"tinylfu", sim_tinylfu},
+    {NULL, NULL},
+};
+
+
+/* Get the trace as an array of n key hashes. If it is a C-contiguous buffer of
+ * native 64-bit integers, it is used in place and view is filled in;
+ * otherwise, the hashes of the items of the iterable are copied into memory
+ * that the caller must free, and view->obj is set to NULL. */
+static int64_t *
+sim_load_trace(PyObject *trace, Py_buffer *view, Py_ssize_t *n)
+{
+    PyObject *it, *item;
+    int64_t *keys = NULL;
+    Py_ssize_t size = 0, alloc = 0;
+
+    if (PyObject_CheckBuffer(trace) &&
+        PyObject_GetBuffer(trace, view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) == 0)
+    {
+        const char *fmt = view->format;
+
+        if (*fmt == '@' || *fmt == '=') {
+            fmt++;
+        }
+        if (view->itemsize == 8 && fmt[0] != '\0' && fmt[1] == '\0' &&
+            strchr("qQlL", fmt[0]) != NULL)
+        {
+            *n = view->len / 8;
+            return view->buf;
+        }
+        PyBuffer_Release(view);
+    }
+    PyErr_Clear();
+    view->obj = NULL;
+
+    if ((it = PyObject_GetIter(trace)) == NULL) {
+        return NULL;
+    }
+    while ((item = PyIter_Next(it)) != NULL) {
+        Py_hash_t h = PyObject_Hash(item);
+
+        Py_DECREF(item);
+        if (h == -1) {
+            goto fail;
+        }
+        if (size == alloc) {
+            int64_t *newkeys;
+
+            alloc = alloc ? alloc * 2 : 1024;
+            newkeys = PyMem_Realloc(keys, (size_t)alloc * sizeof(int64_t));
+            if (newkeys == NULL) {
+                PyErr_NoMemory();
+                goto fail;
+            }
+            keys = newkeys;
+        }
+        keys[size++] = (int64_t)h;
+    }
+    if (PyErr_Occurred()) {
+        goto fail;
+    }
+    Py_DECREF(it);
+    *n = size;
+    if (keys == NULL) {
+        keys = PyMem_Malloc(1);
+        if (keys == NULL) {
+            PyErr_NoMemory();
+        }
+    }
+    return keys;
+
+fail:
+    Py_DECREF(it);
+    PyMem_Free(keys);
+    return NULL;
+}
+
+
+PyObject *
+lrusim_simulate(PyObject *Py_UNUSED(module), PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"trace", "capacities", "policies", NULL};
+    PyObject *trace, *capacities, *policies = NULL;
+    PyObject *cap_seq = NULL, *pol_seq = NULL, *result = NULL;
+    Py_buffer view = {0};
+    int64_t *keys = NULL, *caps = NULL, *hits = NULL, *hist = NULL;
+    int *pols = NULL;
+    Py_ssize_t n, ncap = 0, npol = 0, i, j;
+    int64_t max_cap = 0;
+    int nomem = 0, want_lru = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|O:simulate", kwlist,
+                                     &trace, &capacities, &policies))
+    {
+        return NULL;
+    }
+
+    if ((cap_seq = PySequence_Fast(capacities,
+                                   "capacities must be iterable")) == NULL)
+    {
+        goto done;
+    }
+    ncap = PySequence_Fast_GET_SIZE(cap_seq);
+    if (policies == NULL) {
+        pol_seq = Py_BuildValue("(s)", "lru");
+    }
+    else if (PyUnicode_Check(policies)) {
+        pol_seq = PyTuple_Pack(1, policies);
+    }
+    else {
+        pol_seq = PySequence_Fast(policies, "policies must be iterable");
+    }
+    if (pol_seq == NULL) {
+        goto done;
+    }
+    npol = PySequence_Fast_GET_SIZE(pol_seq);
+
+    caps = PyMem_Calloc((size_t)ncap + 1, sizeof(int64_t));
+    pols = PyMem_Calloc((size_t)npol + 1, sizeof(int));
+    hits = PyMem_Calloc((size_t)(ncap * npol) + 1, sizeof(int64_t));
+    if (caps == NULL || pols == NULL || hits == NULL) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (i = 0; i < ncap; i++) {
+        caps[i] = PyLong_AsSsize_t(PySequence_Fast_GET_ITEM(cap_seq, i));
+        if (caps[i] == -1 && PyErr_Occurred()) {
+            goto done;
+        }
+        if (caps[i] <= 0) {
+            PyErr_SetString(PyExc_ValueError, "capacities must be positive");
+            goto done;
+        }
+    }
+    for (i = 0; i < npol; i++) {
+        PyObject *name = PySequence_Fast_GET_ITEM(pol_seq, i);
+
+        if (!PyUnicode_Check(name)) {
+            PyErr_SetString(PyExc_TypeError, "policy names must be str");
+            goto done;
+        }
+        for (j = 0; sim_policies[j].name != NULL; j++) {
+            if (PyUnicode_CompareWithASCIIString(name,
+                                                 sim_policies[j].name) == 0)
+            {
+                break;
+            }
+        }
+        if (sim_policies[j].name == NULL) {
+            PyErr_Format(PyExc_ValueError, "unknown policy %R", name);
+            goto done;
+        }
+        pols[i] = (int)j;
+        want_lru |= sim_policies[j].func == NULL;
+    }
+
+    if ((keys = sim_load_trace(trace, &view, &n)) == NULL) {
+        goto done;
+    }
+    /* Node indices are int32_t, and no cache holds more keys than the trace
+     * has accesses. */
+    if (n > (INT32_MAX - 1) / 2) {
+        PyErr_SetString(PyExc_OverflowError, "trace too long");
+        goto done;
+    }
+    for (i = 0; i < ncap; i++) {
+        caps[i] = caps[i] < n ? caps[i] : n;
+        max_cap = caps[i] > max_cap ? caps[i] : max_cap;
+    }
+    if (want_lru &&
+        (hist = PyMem_Calloc((size_t)max_cap + 1, sizeof(int64_t))) == NULL)
+    {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    if (want_lru && n > 0) {
+        nomem = sim_lru_hist(keys, n, max_cap, hist) < 0;
+        for (i = 1; i <= max_cap; i++) {
+            hist[i] += hist[i - 1];
+        }
+    }
+    for (i = 0; i < npol && !nomem; i++) {
+        sim_func func = sim_policies[pols[i]].func;
+
+        for (j = 0; j < ncap && !nomem; j++) {
+            int64_t *h = hits + i * ncap + j;
+
+            if (func == NULL) {
+                *h = hist[caps[j]];
+            }
+            else if (n > 0) {
+                nomem = (*h = func(keys, n, caps[j])) < 0;
+            }
+        }
+    }
+    Py_END_ALLOW_THREADS
+    if (nomem) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    if ((result = PyDict_New()) == NULL) {
+        goto done;
+    }
+    for (i = 0; i < npol; i++) {
+        PyObject *ratios = PyList_New(ncap);
+
+        if (ratios == NULL ||
+            PyDict_SetItem(result, PySequence_Fast_GET_ITEM(pol_seq, i),
+                           ratios) < 0)
+        {
+            Py_XDECREF(ratios);
+            Py_CLEAR(result);
+            goto done;
+        }
+        Py_DECREF(ratios);
+        for (j = 0; j < ncap; j++) {
+            PyObject *r = PyFloat_FromDouble(
+                n > 0 ? (double)hits[i * ncap + j] / (double)n : 0.0);
+
+            if (r == NULL) {
+                Py_CLEAR(result);
+                goto done;
+            }
+            PyList_SET_ITEM(ratios, j, r);
+        }
+    }
+
+done:
+    if (view.obj != NULL) {
+        PyBuffer_Release(&view);
+    }
+    else {
+        PyMem_Free(keys);
+    }
+    PyMem_Free(caps);
+    PyMem_Free(pols);
+    PyMem_Free(hits);
+    PyMem_Free(hist);
+    Py_XDECREF(cap_seq);
+    Py_XDECREF(pol_seq);
+    return result;
+}
+
+
+/* SplitMix64 */
+static inline uint64_t
+sim_rand(uint64_t *state)
+{
+    uint64_t z = (*state += SIM_GOLDEN);
+
+    z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+
+/* Draw from the cumulative distribution cdf of size universe. */
+static inline int64_t
+sim_zipf(const double *cdf, int64_t universe, uint64_t *state)
+{
+    double u = (double)(sim_rand(state) >> 11) * 0x1.0p-53;
+    int64_t lo = 0, hi = universe - 1;
+
+    while (lo < hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+
+        if (cdf[mid] > u) {
+            hi = mid;
+        }
+        else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+
+PyObject *
+lrusim_make_trace(PyObject *Py_UNUSED(module), PyObject *args,
+                  PyObject *kwds)
+{
+    static char *kwlist[] = {"kind", "length", "universe", "alpha", "seed",
+                             NULL};
+    const char *kind;
+    Py_ssize_t length, universe, t;
+    double alpha = 1.0;
+    unsigned long long seed = 0;
+    PyObject *data, *array_mod, *array_type, *result;
+    int64_t *out;
+    double *cdf = NULL;
+    uint64_t state;
+    int zipf;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "snn|dK:make_trace", kwlist,
+                                     &kind, &length, &universe, &alpha,
+                                     &seed))
+    {
+        return NULL;
+    }
+    if (strcmp(kind, "loop") == 0) {
+        zipf = 0;
+    }
+    else if (strcmp(kind, "zipf") == 0 || strcmp(kind, "scan") == 0) {
+        zipf = 1;
+    }
+    else {
+        PyErr_Format(PyExc_ValueError, "unknown trace kind '%s'", kind);
+        return NULL;
+    }
+    if (length < 0 || universe <= 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "length must be non-negative and universe positive");
+        return NULL;
+    }
+    if (!(alpha >= 0.0 && alpha <= 100.0)) {
+        PyErr_SetString(PyExc_ValueError, "alpha must be in [0, 100]");
+        return NULL;
+    }
+    if (length > PY_SSIZE_T_MAX / 8) {
+        return PyErr_NoMemory();
+    }
+    if (zipf &&
+        (cdf = PyMem_Malloc((size_t)universe * sizeof(double))) == NULL)
+    {
+        return PyErr_NoMemory();
+    }
+    if ((data = PyBytes_FromStringAndSize(NULL, length * 8)) == NULL) {
+        PyMem_Free(cdf);
+        return NULL;
+    }
+    out = (int64_t *)PyBytes_AS_STRING(data);
+    state = seed;
+
+    Py_BEGIN_ALLOW_THREADS
+    if (zipf) {
+        double sum = 0.0;
+
+        for (t = 0; t < universe; t++) {
+            cdf[t] = (sum += pow((double)(t + 1), -alpha));
+        }
+        for (t = 0; t < universe; t++) {
+            cdf[t] /= sum;
+        }
+    }
+    if (strcmp(kind, "loop") == 0) {
+        for (t = 0; t < length; t++) {
+            out[t] = t % universe;
+        }
+    }
+    else if (strcmp(kind, "zipf") == 0) {
+        for (t = 0; t < length; t++) {
+            out[t] = sim_zipf(cdf, universe, &state);
+        }
+    }
+    else {
+        /* Every fourth block of universe accesses is a scan of new keys. */
+        int64_t fresh = universe;
+
+        for (t = 0; t < length; t++) {
+            out[t] = ((t / universe) % 4 == 3 ? fresh++ :
+                      sim_zipf(cdf, universe, &state));
+        }
+    }
+    Py_END_ALLOW_THREADS
+    PyMem_Free(cdf);
+
+    if ((array_mod = PyImport_ImportModule("array")) == NULL) {
+        Py_DECREF(data);
+        return NULL;
+    }
+    array_type = PyObject_GetAttrString(array_mod, "array");
+    Py_DECREF(array_mod);
+    if (array_type == NULL) {
+        Py_DECREF(data);
+        return NULL;
+    }
+    result = PyObject_CallFunction(array_type, "sO", "q", data);
+    Py_DECREF(array_type);
+    Py_DECREF(data);
+    return result;
+}
@@ -0,0 +1,18 @@
+#ifndef LRUDICT_SIM_H
+#define LRUDICT_SIM_H
+#include "Python.h"
+/* Offline cache-policy simulator: replays a trace of key hashes through native
+ * models of LRU, CLOCK, SLRU, ARC, and W-TinyLFU, and synthetic traces to feed
+ * it with. */
+
+
+/* Implementation of lru_ng.simulate(trace, capacities, policies=("lru",)). */
+PyObject *lrusim_simulate(PyObject *module, PyObject *args, PyObject *kwds);
+
+
+/* Implementation of
+ * lru_ng.make_trace(kind, length, universe, alpha=1.0, seed=0). */
+PyObject *lrusim_make_trace(PyObject *module, PyObject *args, PyObject *kwds);
+
+
+#endif /* LRUDICT_SIM_H */
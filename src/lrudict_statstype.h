@@ -27,11 +27,76 @@ static PyStructSequence_Desc LRUDict_stats_desc = {
 
 
 static PyTypeObject *LRUDictStatsType;
+
+
+static PyStructSequence_Field LRUDict_ext_stats_fields[] = {
+    {"hits", PyDoc_STR("Number of hits")},
+    {"misses", PyDoc_STR("Number of misses")},
+    {"contains_true", PyDoc_STR("Number of \"in\" tests that were true")},
+    {"contains_false", PyDoc_STR("Number of \"in\" tests that were false")},
+    {"inserts", PyDoc_STR("Number of new keys inserted")},
+    {"replacements", PyDoc_STR("Number of values replaced for existing keys")},
+    {"deletions", PyDoc_STR("Number of keys deleted by del, pop(), or "
+                            "popitem()")},
+    {"evictions", PyDoc_STR("Number of keys evicted for capacity")},
+    {"evictions_staged", PyDoc_STR("Number of evictions through the purge "
+                                   "queue")},
+    {"evictions_direct", PyDoc_STR("Number of evictions deallocated at "
+                                   "once")},
+    {"purges", PyDoc_STR("Number of passes over a non-empty purge queue")},
+    {"callbacks", PyDoc_STR("Number of calls to the callback")},
+    {"callback_errors", PyDoc_STR("Number of callback calls that raised")},
+    {"evictions_dropped", PyDoc_STR("Number of evictions not staged for "
+                                    "lack of room in the purge queue")},
+    {"purge_queue_peak", PyDoc_STR("Largest length of the purge queue")},
+    {NULL, NULL},
+};
+
+
+static PyStructSequence_Desc LRUDict_ext_stats_desc = {
+    .name = "lru_ng.LRUDictExtStats",
+    .doc = PyDoc_STR("Operational statistics for LRUDict object"),
+    .fields = LRUDict_ext_stats_fields,
+    .n_in_sequence = 15,
+};
+
+
+static PyTypeObject *LRUDictExtStatsType;
+
+
+static PyStructSequence_Field LRUDict_info_fields[] = {
+    {"name", PyDoc_STR("Name given at construction, or None")},
+    {"size", PyDoc_STR("Size (capacity)")},
+    {"len", PyDoc_STR("Number of items")},
+    {"hits", PyDoc_STR("Number of hits")},
+    {"misses", PyDoc_STR("Number of misses")},
+    {"evictions", PyDoc_STR("Number of keys evicted for capacity")},
+    {"purge_queue_len", PyDoc_STR("Number of evicted items awaiting purge")},
+    {NULL, NULL},
+};
+
+
+static PyStructSequence_Desc LRUDict_info_desc = {
+    .name = "lru_ng.LRUDictInfo",
+    .doc = PyDoc_STR("Snapshot of a live LRUDict object"),
+    .fields = LRUDict_info_fields,
+    .n_in_sequence = 7,
+};
+
+
+static PyTypeObject *LRUDictInfoType;
 #else	/* version check */
 #ifdef LRUDICT_STRUCT_SEQUENCE_NOT_BROKEN
 #undef LRUDICT_STRUCT_SEQUENCE_NOT_BROKEN
 #endif
+#define LRUDictStatsType        NULL
+#define LRUDictExtStatsType     NULL
+#define LRUDictInfoType         NULL
 #endif	/* version check */
 
 
+#define LRUDICT_EXT_STATS_N     15
+#define LRUDICT_INFO_N          7
+
+
 #endif /* LRUDICT_STATSTYPE_H */
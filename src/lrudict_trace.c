@@ -0,0 +1,371 @@
+#define PY_SSIZE_T_CLEAN
+#include "Python.h"
+#include "lrudict_trace.h"
+
+#ifdef LRUTRACE_AVAILABLE
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+
+/*
+ * The ring buffer has one producer, the thread that holds the GIL while it
+ * calls an LRUDict method, and one consumer, the flush thread, which never
+ * takes the GIL. Each side writes only its own index (head or tail) and reads
+ * the other's with acquire semantics, so no lock is taken on the recording
+ * path.
+ *
+ * The flush thread wakes up every LRUTRACE_FLUSH_MS milliseconds, or when
+ * asked to stop, and writes whatever is between tail and head to the file with
+ * write(2). Without stdio buffering, a forked child cannot write the parent's
+ * data again. The child does not have the thread, though, and its records are
+ * dropped once the buffer fills up.
+ */
+
+
+#define LRUTRACE_FLUSH_MS   10
+
+
+struct _LRUTraceThread {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pid_t pid;
+    int fd;
+    int stop;           /* protected by mutex */
+    int error;          /* errno of the first failed write, or 0 */
+    uint64_t written;
+};
+
+
+static int
+lrutrace_write_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+
+static void
+lrutrace_drain(LRUTrace *tr)
+{
+    LRUTraceThread *th = tr->thread;
+    uint64_t h = __atomic_load_n(&tr->head, __ATOMIC_ACQUIRE);
+    uint64_t t = tr->tail;
+
+    while (t != h) {
+        uint64_t i = t & tr->mask;
+        uint64_t n = h - t;
+
+        if (n > tr->mask + 1 - i) {
+            n = tr->mask + 1 - i;   /* up to the end of buf */
+        }
+        if (th->error == 0) {
+            th->error = lrutrace_write_all(th->fd, tr->buf + i,
+                                           n * sizeof(lrutrace_rec));
+            if (th->error == 0) {
+                th->written += n;
+            }
+        }
+        t += n;
+        __atomic_store_n(&tr->tail, t, __ATOMIC_RELEASE);
+    }
+}
+
+
+static void *
+lrutrace_flush_main(void *arg)
+{
+    LRUTrace *tr = arg;
+    LRUTraceThread *th = tr->thread;
+
+    pthread_mutex_lock(&th->mutex);
+    for (;;) {
+        int stop = th->stop;
+        struct timespec deadline;
+
+        pthread_mutex_unlock(&th->mutex);
+        lrutrace_drain(tr);
+        if (stop) {
+            break;
+        }
+        pthread_mutex_lock(&th->mutex);
+        if (!th->stop) {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += LRUTRACE_FLUSH_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&th->cond, &th->mutex, &deadline);
+        }
+    }
+    return NULL;
+}
+
+
+static void
+lrutrace_free(LRUTrace *tr)
+{
+    if (tr != NULL) {
+        PyMem_RawFree(tr->thread);
+        PyMem_RawFree(tr->buf);
+        PyMem_RawFree(tr);
+    }
+}
+
+
+LRUTrace *
+lrutrace_start(PyObject *path, Py_ssize_t capacity, double sample)
+{
+    PyObject *path_bytes = NULL;
+    LRUTrace *tr;
+    LRUTraceThread *th;
+    lrutrace_header hdr;
+    struct timespec ts;
+    uint64_t n = 2;
+    int err;
+
+    if (!(sample > 0.0 && sample <= 1.0)) {
+        PyErr_SetString(PyExc_ValueError, "sample must be in (0, 1]");
+        return NULL;
+    }
+    if (capacity < 2) {
+        PyErr_SetString(PyExc_ValueError, "buffer_size must be at least 2");
+        return NULL;
+    }
+    while (n < (uint64_t)capacity) {
+        n <<= 1;
+    }
+
+    tr = PyMem_RawCalloc(1, sizeof(LRUTrace));
+    if (tr == NULL ||
+        (tr->buf = PyMem_RawMalloc(n * sizeof(lrutrace_rec))) == NULL ||
+        (tr->thread = PyMem_RawCalloc(1, sizeof(LRUTraceThread))) == NULL)
+    {
+        lrutrace_free(tr);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    th = tr->thread;
+    tr->mask = n - 1;
+    /* The product of the hash and the odd constant in lrutrace_record() is
+     * uniform over 64 bits, so comparing it with threshold takes a fraction
+     * sample of the hashes. */
+    tr->sample_threshold = (sample >= 1.0 ? UINT64_MAX
+                            : (uint64_t)ldexp(sample, 64));
+
+    if (!PyUnicode_FSConverter(path, &path_bytes)) {
+        lrutrace_free(tr);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    th->fd = open(PyBytes_AS_STRING(path_bytes),
+                  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    Py_END_ALLOW_THREADS
+    if (th->fd < 0) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        Py_DECREF(path_bytes);
+        lrutrace_free(tr);
+        return NULL;
+    }
+    Py_DECREF(path_bytes);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, LRUTRACE_MAGIC, sizeof(hdr.magic));
+    hdr.byteorder = LRUTRACE_BYTEORDER;
+    hdr.rec_size = (uint32_t)sizeof(lrutrace_rec);
+    hdr.sample_threshold = tr->sample_threshold;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    hdr.start_time = ((uint64_t)ts.tv_sec * UINT64_C(1000000000) +
+                      (uint64_t)ts.tv_nsec);
+    tr->t0 = lrutrace_now();
+    if ((err = lrutrace_write_all(th->fd, &hdr, sizeof(hdr))) != 0) {
+        close(th->fd);
+        lrutrace_free(tr);
+        errno = err;
+        return (LRUTrace *)PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError,
+                                                                path);
+    }
+
+    th->pid = getpid();
+    pthread_mutex_init(&th->mutex, NULL);
+    pthread_cond_init(&th->cond, NULL);
+    if ((err = pthread_create(&th->thread, NULL, lrutrace_flush_main, tr))
+        != 0)
+    {
+        pthread_cond_destroy(&th->cond);
+        pthread_mutex_destroy(&th->mutex);
+        close(th->fd);
+        lrutrace_free(tr);
+        errno = err;
+        return (LRUTrace *)PyErr_SetFromErrno(PyExc_OSError);
+    }
+    return tr;
+}
+
+
+int
+lrutrace_stop(LRUTrace *tr, uint64_t *written, uint64_t *dropped)
+{
+    LRUTraceThread *th = tr->thread;
+    int err;
+
+    if (th->pid != getpid()) {
+        /* Forked child: there is no thread to stop, and the mutex may have
+         * been held by it at the time of fork(). Discard the records. */
+        *written = 0;
+        *dropped = tr->dropped + (tr->head - tr->tail);
+        close(th->fd);
+        lrutrace_free(tr);
+        return 0;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&th->mutex);
+    th->stop = 1;
+    pthread_cond_signal(&th->cond);
+    pthread_mutex_unlock(&th->mutex);
+    pthread_join(th->thread, NULL);
+    if (close(th->fd) != 0 && th->error == 0) {
+        th->error = errno;
+    }
+    Py_END_ALLOW_THREADS
+    pthread_cond_destroy(&th->cond);
+    pthread_mutex_destroy(&th->mutex);
+
+    *written = th->written;
+    *dropped = tr->dropped;
+    err = th->error;
+    lrutrace_free(tr);
+    if (err != 0) {
+        errno = err;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    return 0;
+}
+
+
+PyObject *
+lrutrace_read(PyObject *Py_UNUSED(module), PyObject *path)
+{
+    PyObject *path_bytes = NULL;
+    PyObject *array_mod, *array_type = NULL, *result = NULL;
+    PyObject *ops = NULL, *hashes = NULL, *hits = NULL, *times = NULL;
+    lrutrace_header hdr;
+    FILE *fp;
+    Py_ssize_t n, i;
+
+    if (!PyUnicode_FSConverter(path, &path_bytes)) {
+        return NULL;
+    }
+    fp = fopen(PyBytes_AS_STRING(path_bytes), "rb");
+    Py_DECREF(path_bytes);
+    if (fp == NULL) {
+        return PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        memcmp(hdr.magic, LRUTRACE_MAGIC, sizeof(hdr.magic)) != 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "not an LRUDict trace file");
+        goto done;
+    }
+    if (hdr.byteorder != LRUTRACE_BYTEORDER ||
+        hdr.rec_size != sizeof(lrutrace_rec))
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "trace file written on an incompatible platform");
+        goto done;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        goto done;
+    }
+    /* A partial record at the end (e.g. if the writer was killed) is left
+     * out. */
+    n = (Py_ssize_t)((ftell(fp) - (long)sizeof(hdr)) /
+                     (long)sizeof(lrutrace_rec));
+    if (n < 0 || fseek(fp, (long)sizeof(hdr), SEEK_SET) != 0) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        goto done;
+    }
+
+    ops = PyBytes_FromStringAndSize(NULL, n);
+    hits = PyBytes_FromStringAndSize(NULL, n);
+    hashes = PyBytes_FromStringAndSize(NULL, n * (Py_ssize_t)sizeof(int64_t));
+    times = PyBytes_FromStringAndSize(NULL, n * (Py_ssize_t)sizeof(uint64_t));
+    if (ops == NULL || hits == NULL || hashes == NULL || times == NULL) {
+        goto done;
+    }
+    for (i = 0; i < n; i++) {
+        lrutrace_rec rec;
+
+        if (fread(&rec, sizeof(rec), 1, fp) != 1) {
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+            goto done;
+        }
+        PyBytes_AS_STRING(ops)[i] = (char)((rec.t_op >> 1) & 3);
+        PyBytes_AS_STRING(hits)[i] = (char)(rec.t_op & 1);
+        ((int64_t *)PyBytes_AS_STRING(hashes))[i] = rec.key_hash;
+        ((uint64_t *)PyBytes_AS_STRING(times))[i] = rec.t_op >> 3;
+    }
+
+    if ((array_mod = PyImport_ImportModule("array")) == NULL) {
+        goto done;
+    }
+    array_type = PyObject_GetAttrString(array_mod, "array");
+    Py_DECREF(array_mod);
+    if (array_type == NULL) {
+        goto done;
+    }
+    {
+        static const char *const typecodes[4] = {"B", "q", "B", "Q"};
+        PyObject *data[4] = {ops, hashes, hits, times};
+
+        ops = hashes = hits = times = NULL;
+        result = PyTuple_New(4);
+        for (i = 0; i < 4; i++) {
+            PyObject *item = NULL;
+
+            if (result != NULL) {
+                item = PyObject_CallFunction(array_type, "sO", typecodes[i],
+                                             data[i]);
+            }
+            Py_DECREF(data[i]);
+            if (item == NULL) {
+                Py_CLEAR(result);
+            }
+            else {
+                PyTuple_SET_ITEM(result, i, item);
+            }
+        }
+    }
+
+done:
+    fclose(fp);
+    Py_XDECREF(array_type);
+    Py_XDECREF(ops);
+    Py_XDECREF(hashes);
+    Py_XDECREF(hits);
+    Py_XDECREF(times);
+    return result;
+}
+
+
+#endif /* LRUTRACE_AVAILABLE */
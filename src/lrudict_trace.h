@@ -0,0 +1,124 @@
+#ifndef LRUDICT_TRACE_H
+#define LRUDICT_TRACE_H
+#include "Python.h"
+#include <stdint.h>
+/* Access-trace recorder of LRUDict: records of (operation, key hash, hit,
+ * time) go to a per-instance ring buffer, which a background thread writes to
+ * a binary file. */
+
+
+#if defined(HAVE_UNISTD_H) && defined(HAVE_PTHREAD_H) && \
+    (defined(__GNUC__) || defined(__clang__))
+#include <time.h>
+#include <unistd.h>
+#if defined(_POSIX_TIMERS) && (_POSIX_TIMERS > 0) && \
+    defined(_POSIX_MONOTONIC_CLOCK)
+#define LRUTRACE_AVAILABLE 1
+#endif
+#endif
+
+
+/* Operations recorded. The meaning of the hit flag depends on it: */
+typedef enum {
+    LRUTRACE_GET = 0,   /* lookup; found */
+    LRUTRACE_SET = 1,   /* insert (0) or replace (1) */
+    LRUTRACE_DEL = 2,   /* deletion; found */
+    LRUTRACE_EVICT = 3, /* eviction; always 1 */
+} lrutrace_op;
+
+
+/* One record, as written to the file in native byte order. The time, in
+ * nanoseconds since the start of the trace, shares a word with the operation
+ * and the hit flag: t_op = time << 3 | op << 1 | hit. */
+typedef struct {
+    uint64_t t_op;
+    int64_t key_hash;
+} lrutrace_rec;
+
+
+/* File header, followed by the records. */
+#define LRUTRACE_MAGIC      "LRUNGTR1"
+#define LRUTRACE_BYTEORDER  UINT32_C(0x01020304)
+typedef struct {
+    char magic[8];
+    uint32_t byteorder;         /* LRUTRACE_BYTEORDER as written */
+    uint32_t rec_size;          /* sizeof(lrutrace_rec) */
+    uint64_t sample_threshold;  /* see lrutrace_record() */
+    uint64_t start_time;        /* wall-clock time of the start, in ns */
+} lrutrace_header;
+
+
+#ifdef LRUTRACE_AVAILABLE
+typedef struct _LRUTraceThread LRUTraceThread;
+
+
+typedef struct _LRUTrace {
+    lrutrace_rec *buf;
+    uint64_t mask;              /* number of records in buf, minus 1 */
+    uint64_t head;              /* written by the recording thread */
+    uint64_t tail;              /* written by the flush thread */
+    uint64_t sample_threshold;
+    uint64_t t0;
+    uint64_t dropped;           /* because buf was full */
+    LRUTraceThread *thread;
+} LRUTrace;
+
+
+static inline uint64_t
+lrutrace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+
+/* Append a record. Must be called with the GIL held. Keys are sampled by
+ * hash: a key is either always or never recorded, so that the reuse of a
+ * sampled key is seen in full. If the buffer is full, the record is dropped
+ * rather than waiting for the flush thread. */
+static inline void
+lrutrace_record(LRUTrace *tr, lrutrace_op op, Py_hash_t kh, int hit)
+{
+    uint64_t h, t;
+    lrutrace_rec *rec;
+
+    if ((uint64_t)kh * UINT64_C(0x9E3779B97F4A7C15) > tr->sample_threshold) {
+        return;
+    }
+    h = tr->head;
+    t = __atomic_load_n(&tr->tail, __ATOMIC_ACQUIRE);
+    if (h - t > tr->mask) {
+        tr->dropped++;
+        return;
+    }
+    rec = tr->buf + (h & tr->mask);
+    rec->t_op = ((lrutrace_now() - tr->t0) << 3) | ((uint64_t)op << 1) |
+                (hit != 0);
+    rec->key_hash = (int64_t)kh;
+    __atomic_store_n(&tr->head, h + 1, __ATOMIC_RELEASE);
+}
+
+
+/* Open path for writing and start the flush thread. The buffer holds at least
+ * capacity records, and a fraction sample (in (0, 1]) of the keys is recorded.
+ * Return NULL with exception set on failure. */
+LRUTrace *lrutrace_start(PyObject *path, Py_ssize_t capacity, double sample);
+
+
+/* Flush the remaining records, stop the thread, close the file, and free tr.
+ * Write to the output parameters the numbers of records written and dropped.
+ * Return -1 with OSError set if writing failed. Must be called with the GIL
+ * held, which is released while waiting for the thread. */
+int lrutrace_stop(LRUTrace *tr, uint64_t *written, uint64_t *dropped);
+
+
+/* Implementation of lru_ng.read_trace(path). */
+PyObject *lrutrace_read(PyObject *module, PyObject *path);
+#else
+typedef struct _LRUTrace LRUTrace;
+#endif
+
+
+#endif /* LRUDICT_TRACE_H */
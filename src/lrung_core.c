@@ -0,0 +1,450 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lrung_core.h"
+
+
+/*
+ * An entry lives in the recency list through its link and in one hash chain
+ * through hnext. Staged (evicted but not yet purged) entries are on a
+ * singly-linked FIFO through hnext as well, since they are no longer in the
+ * table.
+ */
+typedef struct _lrung_entry {
+    lrung_link link;
+    struct _lrung_entry *hnext;
+    uint64_t hash;
+    void *key;
+    void *value;
+} lrung_entry;
+
+
+struct _lrung_cache {
+    lrung_link root;
+    lrung_entry **buckets;
+    size_t mask;            /* number of buckets - 1 */
+    size_t len;
+    size_t capacity;
+    lrung_entry *staged_head;
+    lrung_entry **staged_tail;
+    size_t n_staged;
+    lrung_stats stats;
+    lrung_ops ops;
+    int purge_suspended;
+    int purging;
+};
+
+
+#define ENTRY_OF(l)     LRUNG_CONTAINER_OF((l), lrung_entry, link)
+#define MIN_BUCKETS     8
+
+
+static inline void
+lrung_retain(const lrung_cache *c, void *obj)
+{
+    if (c->ops.retain) {
+        c->ops.retain(obj, c->ops.ud);
+    }
+}
+
+
+static inline void
+lrung_release(const lrung_cache *c, void *obj)
+{
+    if (c->ops.release) {
+        c->ops.release(obj, c->ops.ud);
+    }
+}
+
+
+/* Return the link pointing to the entry for key, i.e. the bucket or the hnext
+ * of the previous entry in the chain; *link is NULL if not found. */
+static inline lrung_entry **
+lrung_find(const lrung_cache *c, const void *key, uint64_t h)
+{
+    lrung_entry **link = c->buckets + (h & c->mask);
+
+    while (*link) {
+        lrung_entry *e = *link;
+        if (e->hash == h &&
+            (e->key == key || c->ops.equal(e->key, key, c->ops.ud)))
+        {
+            break;
+        }
+        link = &e->hnext;
+    }
+    return link;
+}
+
+
+/* Double the number of buckets. Failure is harmless (chains just grow). */
+static void
+lrung_grow(lrung_cache *c)
+{
+    size_t n = (c->mask + 1) * 2;
+    lrung_entry **nb = calloc(n, sizeof(lrung_entry *));
+
+    if (nb == NULL) {
+        return;
+    }
+    for (size_t i = 0; i <= c->mask; i++) {
+        lrung_entry *e = c->buckets[i];
+        while (e) {
+            lrung_entry *next = e->hnext;
+            lrung_entry **b = nb + (e->hash & (n - 1));
+            e->hnext = *b;
+            *b = e;
+            e = next;
+        }
+    }
+    free(c->buckets);
+    c->buckets = nb;
+    c->mask = n - 1;
+}
+
+
+/* Unlink the entry at *link from the table and the list. */
+static inline lrung_entry *
+lrung_unlink(lrung_cache *c, lrung_entry **link)
+{
+    lrung_entry *e = *link;
+
+    *link = e->hnext;
+    lrung_link_detach(&e->link);
+    c->len--;
+    return e;
+}
+
+
+/* Evict the LRU entry to the staging FIFO. */
+static void
+lrung_evict_last(lrung_cache *c)
+{
+    lrung_entry *e = ENTRY_OF(c->root.prev);
+    lrung_entry **link = lrung_find(c, e->key, e->hash);
+
+    lrung_unlink(c, link);
+    e->hnext = NULL;
+    *c->staged_tail = e;
+    c->staged_tail = &e->hnext;
+    c->n_staged++;
+    c->stats.evictions++;
+}
+
+
+static inline void
+lrung_maybe_purge(lrung_cache *c)
+{
+    if (!c->purge_suspended) {
+        lrung_purge(c);
+    }
+}
+
+
+lrung_cache *
+lrung_new(size_t capacity, const lrung_ops *ops)
+{
+    lrung_cache *c;
+
+    if (capacity == 0 || ops == NULL || ops->hash == NULL ||
+        ops->equal == NULL)
+    {
+        return NULL;
+    }
+    if ((c = calloc(1, sizeof(lrung_cache))) == NULL) {
+        return NULL;
+    }
+    if ((c->buckets = calloc(MIN_BUCKETS, sizeof(lrung_entry *))) == NULL) {
+        free(c);
+        return NULL;
+    }
+    c->mask = MIN_BUCKETS - 1;
+    c->capacity = capacity;
+    c->ops = *ops;
+    c->staged_tail = &c->staged_head;
+    lrung_link_init(&c->root);
+    return c;
+}
+
+
+void
+lrung_free(lrung_cache *c)
+{
+    if (c == NULL) {
+        return;
+    }
+    lrung_purge(c);
+    lrung_clear(c);
+    free(c->buckets);
+    free(c);
+}
+
+
+int
+lrung_get(lrung_cache *c, const void *key, void **value)
+{
+    lrung_entry *e = *lrung_find(c, key, c->ops.hash(key, c->ops.ud));
+
+    if (e == NULL) {
+        c->stats.misses++;
+        return 0;
+    }
+    c->stats.hits++;
+    lrung_link_promote(&c->root, &e->link);
+    if (value) {
+        *value = e->value;
+    }
+    return 1;
+}
+
+
+int
+lrung_peek(const lrung_cache *c, const void *key, void **value)
+{
+    lrung_entry *e = *lrung_find(c, key, c->ops.hash(key, c->ops.ud));
+
+    if (e == NULL) {
+        return 0;
+    }
+    if (value) {
+        *value = e->value;
+    }
+    return 1;
+}
+
+
+int
+lrung_set(lrung_cache *c, void *key, void *value)
+{
+    uint64_t h = c->ops.hash(key, c->ops.ud);
+    lrung_entry **link = lrung_find(c, key, h);
+    lrung_entry *e = *link;
+
+    if (e != NULL) {
+        /* Replace the value; release the old one after the switch. */
+        void *old = e->value;
+        lrung_retain(c, value);
+        e->value = value;
+        lrung_link_promote(&c->root, &e->link);
+        lrung_release(c, old);
+        return 0;
+    }
+
+    if ((e = malloc(sizeof(lrung_entry))) == NULL) {
+        return -1;
+    }
+    lrung_retain(c, key);
+    lrung_retain(c, value);
+    e->hash = h;
+    e->key = key;
+    e->value = value;
+    e->hnext = NULL;
+    *link = e;
+    lrung_link_attach_after(&c->root, &e->link);
+    c->len++;
+
+    if (c->len > c->capacity) {
+        lrung_evict_last(c);
+    }
+    if (c->len > c->mask + 1) {
+        lrung_grow(c);
+    }
+    lrung_maybe_purge(c);
+    return 0;
+}
+
+
+int
+lrung_pop(lrung_cache *c, const void *key, void **key_out, void **value_out)
+{
+    lrung_entry **link = lrung_find(c, key, c->ops.hash(key, c->ops.ud));
+    lrung_entry *e;
+
+    if (*link == NULL) {
+        return 0;
+    }
+    e = lrung_unlink(c, link);
+    if (key_out) {
+        *key_out = e->key;
+    }
+    else {
+        lrung_release(c, e->key);
+    }
+    if (value_out) {
+        *value_out = e->value;
+    }
+    else {
+        lrung_release(c, e->value);
+    }
+    free(e);
+    return 1;
+}
+
+
+void
+lrung_clear(lrung_cache *c)
+{
+    lrung_link *l = c->root.next;
+
+    /* Detach everything first so that release() sees an empty cache. */
+    memset(c->buckets, 0, (c->mask + 1) * sizeof(lrung_entry *));
+    lrung_link_init(&c->root);
+    c->len = 0;
+    c->stats.hits = c->stats.misses = 0;
+
+    while (l != &c->root) {
+        lrung_entry *e = ENTRY_OF(l);
+        l = l->next;
+        lrung_release(c, e->key);
+        lrung_release(c, e->value);
+        free(e);
+    }
+}
+
+
+int
+lrung_resize(lrung_cache *c, size_t capacity)
+{
+    if (capacity == 0) {
+        return -1;
+    }
+    c->capacity = capacity;
+    while (c->len > capacity) {
+        lrung_evict_last(c);
+    }
+    lrung_maybe_purge(c);
+    return 0;
+}
+
+
+size_t
+lrung_len(const lrung_cache *c)
+{
+    return c->len;
+}
+
+
+size_t
+lrung_capacity(const lrung_cache *c)
+{
+    return c->capacity;
+}
+
+
+void
+lrung_get_stats(const lrung_cache *c, lrung_stats *stats)
+{
+    *stats = c->stats;
+}
+
+
+/* Remove and return the head of the staging FIFO, or NULL. */
+static inline lrung_entry *
+lrung_unstage(lrung_cache *c)
+{
+    lrung_entry *e = c->staged_head;
+
+    if (e != NULL) {
+        if ((c->staged_head = e->hnext) == NULL) {
+            c->staged_tail = &c->staged_head;
+        }
+        c->n_staged--;
+    }
+    return e;
+}
+
+
+size_t
+lrung_purge(lrung_cache *c)
+{
+    size_t n = 0;
+    lrung_entry *e;
+
+    /* A purge called from within evicted() or release() leaves the work to
+     * the outer one, which keeps going until the FIFO is empty. */
+    if (c->purging) {
+        return 0;
+    }
+    c->purging = 1;
+    while ((e = lrung_unstage(c)) != NULL) {
+        if (c->ops.evicted) {
+            c->ops.evicted(e->key, e->value, c->ops.ud);
+        }
+        lrung_release(c, e->key);
+        lrung_release(c, e->value);
+        free(e);
+        n++;
+    }
+    c->purging = 0;
+    return n;
+}
+
+
+void
+lrung_suspend_purge(lrung_cache *c, int suspend)
+{
+    c->purge_suspended = suspend;
+}
+
+
+size_t
+lrung_staged(const lrung_cache *c)
+{
+    return c->n_staged;
+}
+
+
+int
+lrung_take_staged(lrung_cache *c, void **key, void **value)
+{
+    lrung_entry *e = lrung_unstage(c);
+
+    if (e == NULL) {
+        return 0;
+    }
+    *key = e->key;
+    *value = e->value;
+    free(e);
+    return 1;
+}
+
+
+const void *
+lrung_iter_next(const lrung_cache *c, const void *it, void **key,
+                void **value)
+{
+    const lrung_link *l = it ? ((const lrung_link *)it)->next : c->root.next;
+    const lrung_entry *e;
+
+    if (l == &c->root) {
+        return NULL;
+    }
+    e = ENTRY_OF(l);
+    if (key) {
+        *key = e->key;
+    }
+    if (value) {
+        *value = e->value;
+    }
+    return l;
+}
+
+
+const void *
+lrung_iter_prev(const lrung_cache *c, const void *it, void **key,
+                void **value)
+{
+    const lrung_link *l = it ? ((const lrung_link *)it)->prev : c->root.prev;
+    const lrung_entry *e;
+
+    if (l == &c->root) {
+        return NULL;
+    }
+    e = ENTRY_OF(l);
+    if (key) {
+        *key = e->key;
+    }
+    if (value) {
+        *value = e->value;
+    }
+    return l;
+}
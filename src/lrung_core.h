@@ -0,0 +1,203 @@
+#ifndef LRUNG_CORE_H
+#define LRUNG_CORE_H
+/*
+ * lrung core: the LRU machinery of lru_ng in plain C, without Python.
+ *
+ * It has two layers:
+ *
+ * - Intrusive circular doubly-linked list primitives (lrung_link), which are
+ *   also what the LRUDict Python type uses to keep its recency order.
+ *
+ * - A self-contained LRU cache (lrung_cache) with its own chained hash table.
+ *   Keys and values are opaque pointers; hashing, comparison, reference
+ *   keeping, and eviction notification are supplied by the user as function
+ *   pointers (lrung_ops).
+ *
+ * Eviction is staged as in LRUDict: an entry pushed out by lrung_set() or
+ * lrung_resize() is unlinked from the cache right away, but the "evicted" and
+ * "release" operations on it are deferred to lrung_purge(), which is called
+ * at the end of those functions unless purging is suspended. By then the cache
+ * is consistent, so these operations may call back into the cache.
+ *
+ * The cache is not thread-safe: callers must serialize access.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Intrusive list. A list is represented by a root link, which is not an item,
+ * and wraps around, so that an empty list has root->next == root->prev ==
+ * root. */
+typedef struct _lrung_link {
+    struct _lrung_link *next;
+    struct _lrung_link *prev;
+} lrung_link;
+
+
+#define LRUNG_CONTAINER_OF(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+
+static inline void
+lrung_link_init(lrung_link *root)
+{
+    root->next = root->prev = root;
+}
+
+
+/* Detach link, which must be a member but not root. After detach the link's
+ * pointers contain garbage. */
+static inline void
+lrung_link_detach(const lrung_link *link)
+{
+    lrung_link *l_next = link->next;
+    lrung_link *l_prev = link->prev;
+
+    l_next->prev = l_prev;
+    l_prev->next = l_next;
+}
+
+
+/* Attach link, which must not be a member, right after origin. */
+static inline void
+lrung_link_attach_after(lrung_link *origin, lrung_link *link)
+{
+    lrung_link *o_next = origin->next;  /* may be the same as origin */
+
+    o_next->prev = link;
+    link->next = o_next;
+    link->prev = origin;
+    origin->next = link;
+}
+
+
+/* Detach the links from first, which must be a member but not root, to the
+ * end of the list in one piece. Their own pointers are left as they were. */
+static inline void
+lrung_link_truncate(lrung_link *root, const lrung_link *first)
+{
+    lrung_link *l_prev = first->prev;
+
+    l_prev->next = root;
+    root->prev = l_prev;
+}
+
+
+/* Move link, which must be a member, to the front. */
+static inline void
+lrung_link_promote(lrung_link *root, lrung_link *link)
+{
+    if (link == root->next) {
+        return;
+    }
+    lrung_link_detach(link);
+    lrung_link_attach_after(root, link);
+}
+
+
+/* Operations on keys and values supplied by the user. All but hash and equal
+ * may be NULL. ud is passed to each of them. */
+typedef struct _lrung_ops {
+    uint64_t (*hash)(const void *key, void *ud);
+    /* Return nonzero if equal. */
+    int (*equal)(const void *a, const void *b, void *ud);
+    /* Called on a key or value when the cache starts holding it. */
+    void (*retain)(void *obj, void *ud);
+    /* Called on a key or value when the cache stops holding it, unless it is
+     * handed back to the caller (lrung_pop). */
+    void (*release)(void *obj, void *ud);
+    /* Called with an evicted pair before it is released. */
+    void (*evicted)(void *key, void *value, void *ud);
+    void *ud;
+} lrung_ops;
+
+
+typedef struct _lrung_cache lrung_cache;
+
+
+typedef struct _lrung_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} lrung_stats;
+
+
+/* Return a new cache bounded to capacity (> 0) items, or NULL if out of memory
+ * or capacity is 0. ops is copied. */
+lrung_cache *
+lrung_new(size_t capacity, const lrung_ops *ops);
+
+/* Release all entries (without "evicted") and free the cache. */
+void
+lrung_free(lrung_cache *c);
+
+/* Look up key. On a hit, write the value to *value (if not NULL), make the
+ * entry most recent, and return 1. On a miss, return 0. */
+int
+lrung_get(lrung_cache *c, const void *key, void **value);
+
+/* Look up key without changing the order or the statistics. */
+int
+lrung_peek(const lrung_cache *c, const void *key, void **value);
+
+/* Insert or replace. Return 0, or -1 if out of memory (nothing changed). */
+int
+lrung_set(lrung_cache *c, void *key, void *value);
+
+/* Remove key. If found, hand over the stored key and value (without release)
+ * to *key_out and *value_out (where not NULL; otherwise they are released)
+ * and return 1; return 0 if not found. */
+int
+lrung_pop(lrung_cache *c, const void *key, void **key_out, void **value_out);
+
+/* Release all entries (without "evicted"). */
+void
+lrung_clear(lrung_cache *c);
+
+/* Change the capacity (> 0), evicting as needed. Return 0, or -1 if capacity
+ * is 0. */
+int
+lrung_resize(lrung_cache *c, size_t capacity);
+
+size_t
+lrung_len(const lrung_cache *c);
+
+size_t
+lrung_capacity(const lrung_cache *c);
+
+void
+lrung_get_stats(const lrung_cache *c, lrung_stats *stats);
+
+/* Run "evicted" and "release" on the staged evictions. Return the number of
+ * them. Entries evicted while this runs are handled in the same call. */
+size_t
+lrung_purge(lrung_cache *c);
+
+/* While suspended, staged evictions accumulate until lrung_purge() is called
+ * explicitly. */
+void
+lrung_suspend_purge(lrung_cache *c, int suspend);
+
+size_t
+lrung_staged(const lrung_cache *c);
+
+/* Take the oldest staged eviction out of the cache without running "evicted"
+ * or "release" on it; ownership of key and value passes to the caller. Return
+ * 1, or 0 if there is none. This is an alternative to lrung_purge() for
+ * callers that handle evictions themselves. */
+int
+lrung_take_staged(lrung_cache *c, void **key, void **value);
+
+/* Iterate in MRU-to-LRU order. Start with it = NULL; each call writes the
+ * next pair and returns the iterator to pass next, or NULL when done. The
+ * cache must not be modified during the iteration. */
+const void *
+lrung_iter_next(const lrung_cache *c, const void *it, void **key,
+                void **value);
+
+/* Same as lrung_iter_next, but in LRU-to-MRU order. */
+const void *
+lrung_iter_prev(const lrung_cache *c, const void *it, void **key,
+                void **value);
+
+#endif /* LRUNG_CORE_H */
@@ -0,0 +1,225 @@
+/* Test extension for the C API of lru_ng, compiled by test_capi.py. It wraps
+ * each function in the API table as a Python function of the same name. */
+#define PY_SSIZE_T_CLEAN
+#include "Python.h"
+#include "lru_ng_capi.h"
+
+
+/* Return the status and value as a tuple (status, value-or-None). */
+static PyObject *
+status_value_tuple(int status, PyObject *value)
+{
+    PyObject *res;
+
+    if (status == -1) {
+        return NULL;
+    }
+    res = Py_BuildValue("(iO)", status, value ? value : Py_None);
+    Py_XDECREF(value);
+    return res;
+}
+
+
+static PyObject *
+capi_lookup(PyObject *Py_UNUSED(mod), PyObject *args)
+{
+    PyObject *lru, *key, *value;
+    Py_hash_t hash = -1;
+    int status;
+
+    if (!PyArg_ParseTuple(args, "OO|n", &lru, &key, &hash)) {
+        return NULL;
+    }
+    status = LRUNG_CAPI->lookup_known_hash(lru, key, hash, &value);
+    return status_value_tuple(status, value);
+}
+
+
+static PyObject *
+capi_insert(PyObject *Py_UNUSED(mod), PyObject *args)
+{
+    PyObject *lru, *key, *value;
+    Py_hash_t hash = -1;
+
+    if (!PyArg_ParseTuple(args, "OOO|n", &lru, &key, &value, &hash)) {
+        return NULL;
+    }
+    if (LRUNG_CAPI->insert_known_hash(lru, key, hash, value) == -1) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+capi_pop(PyObject *Py_UNUSED(mod), PyObject *args)
+{
+    PyObject *lru, *key, *value;
+    Py_hash_t hash = -1;
+    int status;
+
+    if (!PyArg_ParseTuple(args, "OO|n", &lru, &key, &hash)) {
+        return NULL;
+    }
+    status = LRUNG_CAPI->pop(lru, key, hash, &value);
+    return status_value_tuple(status, value);
+}
+
+
+/* get_many(lru, keys) -> (n_hits, [value-or-None, ...]) */
+static PyObject *
+capi_get_many(PyObject *Py_UNUSED(mod), PyObject *args)
+{
+    PyObject *lru, *keys, *lst;
+    PyObject **values;
+    Py_ssize_t n, i, n_hits;
+
+    if (!PyArg_ParseTuple(args, "OO!", &lru, &PyTuple_Type, &keys)) {
+        return NULL;
+    }
+    n = PyTuple_GET_SIZE(keys);
+    if ((values = PyMem_New(PyObject *, n + 1)) == NULL) {
+        return PyErr_NoMemory();
+    }
+    n_hits = LRUNG_CAPI->get_many(lru, n, &PyTuple_GET_ITEM(keys, 0), NULL,
+                                  values);
+    if (n_hits == -1) {
+        PyMem_Free(values);
+        return NULL;
+    }
+    if ((lst = PyList_New(n)) != NULL) {
+        for (i = 0; i < n; i++) {
+            PyObject *v = values[i] ? values[i] : (Py_INCREF(Py_None), Py_None);
+            PyList_SET_ITEM(lst, i, v);
+        }
+    }
+    else {
+        for (i = 0; i < n; i++) {
+            Py_XDECREF(values[i]);
+        }
+    }
+    PyMem_Free(values);
+    return lst ? Py_BuildValue("(nN)", n_hits, lst) : NULL;
+}
+
+
+static PyObject *
+capi_stats(PyObject *Py_UNUSED(mod), PyObject *lru)
+{
+    unsigned long hits, misses;
+
+    if (LRUNG_CAPI->stats(lru, &hits, &misses) == -1) {
+        return NULL;
+    }
+    return Py_BuildValue("(kk)", hits, misses);
+}
+
+
+static PyObject *
+capi_stats64(PyObject *Py_UNUSED(mod), PyObject *lru)
+{
+    uint64_t hits, misses;
+
+    if (LRUNG_CAPI->stats64(lru, &hits, &misses) == -1) {
+        return NULL;
+    }
+    return Py_BuildValue("(KK)", (unsigned long long)hits,
+                         (unsigned long long)misses);
+}
+
+
+/* Hook appending (key, value, reason) to the list passed as ctx. */
+static int
+recording_hook(void *ctx, PyObject *key, PyObject *value, int reason)
+{
+    PyObject *t = Py_BuildValue("(OOi)", key, value, reason);
+    int res = t ? PyList_Append((PyObject *)ctx, t) : -1;
+    Py_XDECREF(t);
+    return res;
+}
+
+
+static void
+recording_hook_free(void *ctx)
+{
+    Py_DECREF((PyObject *)ctx);
+}
+
+
+static int
+failing_hook(void *Py_UNUSED(ctx), PyObject *key,
+             PyObject *Py_UNUSED(value), int Py_UNUSED(reason))
+{
+    PyErr_SetObject(PyExc_ValueError, key);
+    return -1;
+}
+
+
+/* set_hook(lru, lst) records into lst; set_hook(lru, None) removes the hook;
+ * set_hook(lru, True) sets a hook that raises ValueError(key). */
+static PyObject *
+capi_set_hook(PyObject *Py_UNUSED(mod), PyObject *args)
+{
+    PyObject *lru, *arg;
+    int status;
+
+    if (!PyArg_ParseTuple(args, "OO", &lru, &arg)) {
+        return NULL;
+    }
+    if (arg == Py_None) {
+        status = LRUNG_CAPI->set_evict_hook(lru, NULL, NULL, NULL);
+    }
+    else if (arg == Py_True) {
+        status = LRUNG_CAPI->set_evict_hook(lru, failing_hook, NULL, NULL);
+    }
+    else {
+        Py_INCREF(arg);
+        status = LRUNG_CAPI->set_evict_hook(lru, recording_hook, arg,
+                                            recording_hook_free);
+        if (status == -1) {
+            Py_DECREF(arg);
+        }
+    }
+    if (status == -1) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+capi_version(PyObject *Py_UNUSED(mod), PyObject *Py_UNUSED(ignored))
+{
+    return PyLong_FromUnsignedLong(LRUNG_CAPI->version);
+}
+
+
+static PyMethodDef capi_methods[] = {
+    {"lookup", (PyCFunction)capi_lookup, METH_VARARGS, NULL},
+    {"insert", (PyCFunction)capi_insert, METH_VARARGS, NULL},
+    {"pop", (PyCFunction)capi_pop, METH_VARARGS, NULL},
+    {"get_many", (PyCFunction)capi_get_many, METH_VARARGS, NULL},
+    {"stats", (PyCFunction)capi_stats, METH_O, NULL},
+    {"stats64", (PyCFunction)capi_stats64, METH_O, NULL},
+    {"set_hook", (PyCFunction)capi_set_hook, METH_VARARGS, NULL},
+    {"version", (PyCFunction)capi_version, METH_NOARGS, NULL},
+    {NULL, NULL, 0, NULL},
+};
+
+
+static struct PyModuleDef capi_moduledef = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "capi_test_ext",
+    .m_size = -1,
+    .m_methods = capi_methods,
+};
+
+
+PyMODINIT_FUNC
+PyInit_capi_test_ext(void)
+{
+    if (LRUNG_ImportCAPI(3) == -1) {
+        return NULL;
+    }
+    return PyModule_Create(&capi_moduledef);
+}
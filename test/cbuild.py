@@ -0,0 +1,55 @@
+"""Helpers for tests that compile C code on the fly with the compiler that
+built the interpreter."""
+import importlib.util
+import os
+import shlex
+import subprocess
+import sysconfig
+import pytest
+
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(os.path.dirname(HERE), "src")
+
+
+def _run_compiler(cmd, name):
+    try:
+        proc = subprocess.run(cmd, stdout=subprocess.PIPE,
+                              stderr=subprocess.STDOUT)
+    except OSError as exc:
+        pytest.skip("compiler not available: %s" % exc)
+    if proc.returncode != 0:
+        pytest.fail("failed to build %s:\n%s"
+                    % (name, proc.stdout.decode(errors="replace")))
+
+
+def build_ext(name, sources, dest_dir, extra_args=()):
+    """Compile and link the C sources into an extension module in dest_dir,
+    then import it. Skip the test if there's no compiler."""
+    ldshared = sysconfig.get_config_var("LDSHARED")
+    suffix = sysconfig.get_config_var("EXT_SUFFIX")
+    if not ldshared or not suffix or os.name != "posix":
+        pytest.skip("don't know how to build extensions here")
+    target = os.path.join(str(dest_dir), name + suffix)
+    cmd = (shlex.split(ldshared) +
+           shlex.split(sysconfig.get_config_var("CCSHARED") or "") +
+           ["-I", sysconfig.get_paths()["include"], "-I", SRC_DIR] +
+           list(sources) + ["-o", target] + list(extra_args))
+    _run_compiler(cmd, name)
+    spec = importlib.util.spec_from_file_location(name, target)
+    mod = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(mod)
+    return mod
+
+
+def build_exe(name, sources, dest_dir, extra_args=()):
+    """Compile and link the C sources (not using Python) into an executable in
+    dest_dir, and return its path. Skip the test if there's no compiler."""
+    cc = sysconfig.get_config_var("CC")
+    if not cc or os.name != "posix":
+        pytest.skip("don't know how to build executables here")
+    target = os.path.join(str(dest_dir), name)
+    cmd = (shlex.split(cc) + ["-I", SRC_DIR] + list(sources) +
+           ["-o", target] + list(extra_args))
+    _run_compiler(cmd, name)
+    return target
@@ -0,0 +1,211 @@
+"""Testing the C API exported as capsule, through a test extension compiled on
+the fly."""
+import os
+import sys
+import pytest
+import lru_ng
+from lru_ng import LRUDict
+from cbuild import HERE, build_ext
+
+
+pytestmark = pytest.mark.skipif(not hasattr(lru_ng, "_C_API"),
+                                reason="C API not available")
+
+
+@pytest.fixture(scope="module")
+def capi(tmp_path_factory):
+    return build_ext("capi_test_ext", [os.path.join(HERE, "capi_test_ext.c")],
+                     tmp_path_factory.mktemp("capi"))
+
+
+@pytest.fixture
+def r():
+    r = LRUDict(3)
+    for i in range(3):
+        r[i] = str(i)
+    return r
+
+
+def test_version(capi):
+    assert capi.version() >= 3
+
+
+def test_lookup(capi, r):
+    assert capi.lookup(r, 0) == (1, "0")
+    assert capi.lookup(r, 5) == (0, None)
+    assert capi.lookup(r, 1, hash(1)) == (1, "1")
+    assert r.keys() == [1, 0, 2]
+    assert capi.stats(r) == (2, 1) == tuple(r.get_stats())
+    assert capi.stats64(r) == (2, 1)
+
+
+def test_lookup_wrong_hash(capi, r):
+    # A wrong hash is the caller's fault, and just misses.
+    assert capi.lookup(r, 1, hash(1) + 1) == (0, None)
+
+
+def test_insert(capi, r):
+    capi.insert(r, "a", "A", hash("a"))
+    assert r["a"] == "A"
+    assert 0 not in r
+    capi.insert(r, "a", "B")
+    assert r["a"] == "B"
+    assert len(r) == 3
+
+
+def test_insert_runs_callback(capi):
+    evicted = []
+    r = LRUDict(1, lambda k, v: evicted.append(k))
+    capi.insert(r, 0, 0)
+    capi.insert(r, 1, 1)
+    assert evicted == [0]
+
+
+def test_pop(capi, r):
+    assert capi.pop(r, 1) == (1, "1")
+    assert capi.pop(r, 1) == (0, None)
+    assert 1 not in r
+    assert capi.stats(r) == (1, 1)
+
+
+def test_get_many(capi, r):
+    n, values = capi.get_many(r, (0, 5, 2))
+    assert n == 2
+    assert values == ["0", None, "2"]
+    assert r.keys()[:2] == [2, 0]
+    assert capi.get_many(r, ()) == (0, [])
+    keys = tuple(range(100))
+    n, values = capi.get_many(r, keys)
+    assert n == 3
+    assert values[3:] == [None] * 97
+
+
+def test_get_many_unhashable(capi, r):
+    with pytest.raises(TypeError):
+        capi.get_many(r, (0, [], 1))
+    assert r.get_stats() == (0, 0)
+
+
+def test_frozen(capi, r):
+    r.freeze(immortalize=False)
+    assert capi.lookup(r, 0) == (1, "0")
+    assert capi.get_many(r, (0, 1, 9))[0] == 2
+    assert capi.stats(r) == (3, 1)
+    with pytest.raises(TypeError):
+        capi.insert(r, 5, 5)
+    with pytest.raises(TypeError):
+        capi.pop(r, 0)
+
+
+def test_type_check(capi):
+    for f in (capi.lookup, capi.pop):
+        with pytest.raises(TypeError):
+            f({}, 0)
+    with pytest.raises(TypeError):
+        capi.stats({})
+    with pytest.raises(TypeError):
+        capi.stats64({})
+
+
+def test_hook(capi):
+    log = []
+    r = LRUDict(2, lambda k, v: log.append(("callback", k)))
+    capi.set_hook(r, log)
+    for i in range(4):
+        r[i] = str(i)
+    # The hook comes before the callback.
+    assert log == [(0, "0", 0), ("callback", 0), (1, "1", 0), ("callback", 1)]
+    del log[:]
+    r.size = 1
+    assert log == [(2, "2", 0), ("callback", 2)]
+
+
+def test_hook_staged_without_callback(capi):
+    # Safe-typed items are normally dropped on the spot when there's no
+    # callback; with a hook they must be staged for it.
+    log = []
+    r = LRUDict(1)
+    capi.set_hook(r, log)
+    r[0] = 0
+    r[1] = 1
+    assert log == [(0, 0, 0)]
+
+
+def test_hook_deferred_with_purge(capi):
+    r = LRUDict(1)
+    log = []
+    capi.set_hook(r, log)
+    r._suspend_purge = True
+    r[0] = 0
+    r[1] = 1
+    assert log == []
+    r.purge()
+    assert log == [(0, 0, 0)]
+
+
+def test_hook_on_drop(capi):
+    # Dropping skips the callback, but the hook must still see each item.
+    evicted, log = [], []
+    r = LRUDict(10, lambda k, v: evicted.append(k))
+    r.max_staged = 5
+    r.overflow = "drop"
+    r._suspend_purge = True
+    capi.set_hook(r, log)
+    for i in range(30):
+        r[i] = i
+    assert r.get_ext_stats().evictions_dropped == 15
+    assert sorted(k for k, v, reason in log) == list(range(5, 20))
+    r.purge()
+    assert evicted == list(range(5))
+    assert sorted(k for k, v, reason in log) == list(range(20))
+    del log[:]
+    r.size = 1
+    r.purge()
+    assert sorted(k for k, v, reason in log) == list(range(20, 29))
+    # Likewise in bulk
+    r.size = 200
+    for i in range(200):
+        r[i] = i
+    del log[:]
+    r.size = 1
+    r.purge()
+    assert sorted(k for k, v, reason in log) == list(range(199))
+
+
+def test_hook_replace_and_remove(capi):
+    first, second = [], []
+    r = LRUDict(1)
+    capi.set_hook(r, first)
+    r[0] = 0
+    r[1] = 1
+    capi.set_hook(r, second)
+    r[2] = 2
+    capi.set_hook(r, None)
+    r[3] = 3
+    assert first == [(0, 0, 0)]
+    assert second == [(1, 1, 0)]
+
+
+def test_hook_ctx_released(capi):
+    log = []
+    before = sys.getrefcount(log)
+    r = LRUDict(1)
+    capi.set_hook(r, log)
+    assert sys.getrefcount(log) == before + 1
+    del r
+    assert sys.getrefcount(log) == before
+
+
+@pytest.mark.filterwarnings("ignore::pytest.PytestUnraisableExceptionWarning")
+def test_hook_exception_suppressed(capi):
+    r = LRUDict(1)
+    capi.set_hook(r, True)
+    r[0] = 0
+    r[1] = 1
+    assert r.keys() == [1]
+
+
+def test_hook_on_frozen(capi, r):
+    r.freeze(immortalize=False)
+    with pytest.raises(TypeError):
+        capi.set_hook(r, [])
@@ -0,0 +1,121 @@
+"""Testing the compaction of the internal dict of LRUDict."""
+import pytest
+from lru_ng import LRUDict
+
+
+class Key:
+    deleted = 0
+
+    def __init__(self, n):
+        self.n = n
+
+    def __hash__(self):
+        return self.n
+
+    def __eq__(self, other):
+        return isinstance(other, Key) and self.n == other.n
+
+    def __del__(self):
+        Key.deleted += 1
+
+
+# Needs memory_usage() to see the size of the internal dict.
+measured = pytest.mark.skipif(not hasattr(LRUDict, "memory_usage"),
+                              reason="memory accounting not available")
+
+
+def dict_size(r):
+    return r.memory_usage()["dict"]
+
+
+@measured
+def test_compact():
+    r = LRUDict(10000)
+    keys = [Key(i) for i in range(10000)]
+    for k in keys:
+        r[k] = k.n
+    full = dict_size(r)
+    for k in keys[:9000]:
+        r[k] = None     # replacing does not shrink
+    assert dict_size(r) == full
+    r[keys[-1]]
+    order = r.keys()
+    r.compact()
+    assert dict_size(r) <= full
+    # The nodes and keys themselves are kept.
+    assert r.keys() == order
+    assert all(a is b for a, b in zip(r.keys(), order))
+    assert r.get_stats() == (1, 0)
+
+
+@measured
+def test_auto():
+    r = LRUDict(10000)
+    for i in range(10000):
+        r[i] = i
+    full = dict_size(r)
+    for i in range(7500):
+        del r[i]
+    assert dict_size(r) == full
+    deleted = Key.deleted
+    keys = [Key(i) for i in range(10000, 10100)]
+    for k in keys:
+        r[k] = k.n
+    for k in keys:
+        r.pop(k)
+    r.popitem()
+    # Below a quarter of the peak length
+    assert len(r) < 2500
+    assert dict_size(r) < full / 3
+    assert Key.deleted == deleted
+    assert r.keys() == list(range(9998, 7499, -1))
+    assert all(r[i] == i for i in range(7500, 9999))
+    # Compacting again does not help.
+    small = dict_size(r)
+    r.compact()
+    assert dict_size(r) == small
+
+
+@measured
+def test_after_clear():
+    r = LRUDict(5000)
+    for i in range(5000):
+        r[i] = i
+    r.clear()
+    for i in range(100):
+        r[i] = i
+    small = dict_size(r)
+    del r[0]
+    assert dict_size(r) == small
+
+
+@measured
+def test_shrink():
+    r = LRUDict(10000)
+    for i in range(10000):
+        r[i] = i
+    full = dict_size(r)
+    r.size = 2000
+    assert dict_size(r) < full / 3
+    assert len(r) == 2000 and 9999 in r
+
+
+@measured
+def test_shrink_stepwise():
+    r = LRUDict(10000)
+    for i in range(10000):
+        r[i] = i
+    full = dict_size(r)
+    # Each step evicts one item at a time.
+    for size in range(9950, 1999, -50):
+        r.size = size
+    assert dict_size(r) < full / 3
+    assert len(r) == 2000 and 9999 in r
+
+
+def test_frozen():
+    r = LRUDict(5)
+    r[0] = 0
+    r.freeze(immortalize=False)
+    with pytest.raises(TypeError):
+        r.compact()
@@ -0,0 +1,76 @@
+"""Testing the eviction-age histograms of LRUDict."""
+import time
+import pytest
+from lru_ng import LRUDict
+
+
+pytestmark = pytest.mark.skipif(not hasattr(LRUDict, "track_eviction_age"),
+                                reason="eviction-age recorder not available")
+
+MS = 1000000
+
+
+def ages(r, since):
+    h = r.eviction_age_histogram(since, [0, 100])
+    return h["count"], h["percentiles"][0], h["percentiles"][100]
+
+
+def test_off():
+    r = LRUDict(1)
+    r[0] = 0
+    r[1] = 1
+    assert r.eviction_age_histogram("insert") is None
+    assert r.eviction_age_histogram("access") is None
+
+
+def test_ages():
+    r = LRUDict(2)
+    r["old"] = 0            # not timed
+    r.track_eviction_age(True)
+    r[0] = 0
+    r[1] = 1                # evicts "old"
+    assert ages(r, "insert") == (0, None, None)
+    time.sleep(0.02)
+    r[0]
+    r[2] = 2                # evicts 1: old, unused
+    r[0] = "x"
+    r[3] = 3                # evicts 2: young
+    time.sleep(0.02)
+    r.get(3)
+    r[4] = 4                # evicts 0: old, recently used
+    count, low, high = ages(r, "insert")
+    assert count == 3
+    assert low < 20 * MS <= high
+    count, low, high = ages(r, "access")
+    assert count == 3
+    assert low < 20 * MS <= high
+    h = r.eviction_age_histogram("access")
+    assert sum(c for _, _, c in h["buckets"]) == 3
+    assert sorted(h["percentiles"]) == [50, 90, 99, 99.9]
+    # Restarting discards the histograms but keeps timing the nodes.
+    r.track_eviction_age(True)
+    r[5] = 5                # evicts 3
+    assert ages(r, "insert")[0] == 1
+    r.track_eviction_age(False)
+    r[6] = 6
+    assert r.eviction_age_histogram("insert") is None
+
+
+def test_setdefault_and_update():
+    r = LRUDict(1)
+    r.track_eviction_age(True)
+    r.setdefault(0)
+    r.update({1: 1, 2: 2})
+    r.setdefault(3)
+    assert ages(r, "insert")[0] == 3
+
+
+def test_errors():
+    r = LRUDict(1)
+    r.track_eviction_age(True)
+    with pytest.raises(ValueError):
+        r.eviction_age_histogram("evict")
+    with pytest.raises(TypeError):
+        r.eviction_age_histogram(0)
+    with pytest.raises(ValueError):
+        r.eviction_age_histogram("insert", [-1])
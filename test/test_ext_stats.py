@@ -0,0 +1,99 @@
+"""Testing the extended statistics of LRUDict."""
+import pytest
+from lru_ng import LRUDict
+
+
+class Obj:
+    """Evicting it is staged, unlike a str or an int."""
+
+    def __init__(self, n=None):
+        self.n = n
+
+
+def test_counters():
+    r = LRUDict(2)
+    r[1] = Obj()
+    r[2] = Obj()
+    r[1] = Obj()        # replace
+    r[3] = Obj()        # evicts 2
+    assert 3 in r and 2 not in r and 2 not in r
+    r[1]
+    r.get(2)
+    del r[1]
+    r.pop(3)
+    r.pop(4, None)
+    r["a"] = 0
+    r["b"] = 0
+    r["c"] = 0          # evicts "a", at once
+    r.popitem()
+    s = r.get_ext_stats()
+    assert s == tuple(s)
+    assert (s.hits, s.misses) == (2, 2)
+    assert (s.contains_true, s.contains_false) == (1, 2)
+    assert (s.inserts, s.replacements, s.deletions) == (6, 1, 3)
+    assert (s.evictions, s.evictions_staged, s.evictions_direct) == (2, 1, 1)
+    assert s.purges == 1
+    assert (s.callbacks, s.callback_errors) == (0, 0)
+    assert s.purge_queue_peak == 1
+
+
+@pytest.mark.filterwarnings("ignore::pytest.PytestUnraisableExceptionWarning")
+def test_callbacks():
+    def callback(key, value):
+        if key % 3 == 0:
+            raise ValueError(key)
+
+    r = LRUDict(1, callback=callback)
+    r._suspend_purge = True
+    for i in range(10):
+        r[i] = i
+    assert r.get_ext_stats().purge_queue_peak == 9
+    r._suspend_purge = False
+    r.purge()
+    s = r.get_ext_stats()
+    assert (s.evictions_staged, s.callbacks, s.callback_errors) == (9, 9, 3)
+    assert s.purges == 1
+
+
+def test_clear_and_reset():
+    r = LRUDict(2, callback=lambda k, v: None)
+    r._suspend_purge = True
+    for i in range(5):
+        r[i] = i
+    r[4]
+    r.get(0)
+    assert r.get_stats() == (1, 1)
+    r.clear()
+    assert r.get_stats() == (0, 0)
+    r[0] = 0
+    r[0]
+    assert r.get_stats() == (1, 0)
+    s = r.get_ext_stats()
+    assert (s.hits, s.misses, s.inserts, s.evictions) == (2, 1, 6, 3)
+    r.reset_stats()
+    assert r.get_stats() == (0, 0)
+    s = r.get_ext_stats()
+    assert not any(s[:-1])
+    # The queue still holds the evictions.
+    assert s.purge_queue_peak == 3
+    r.purge()
+    r.reset_stats()
+    assert r.get_ext_stats().purge_queue_peak == 0
+
+
+def test_frozen():
+    r = LRUDict(5)
+    r[0] = 0
+    r[0]
+    assert 0 in r
+    r.freeze(immortalize=False)
+    r[0]
+    r.get(1)
+    assert 0 in r and 1 not in r
+    s = r.get_ext_stats()
+    assert (s.hits, s.misses, s.contains_true, s.contains_false) == (2, 1,
+                                                                     2, 1)
+    r.reset_stats()
+    r[0]
+    assert r.get_stats() == (1, 0)
+    assert r.get_ext_stats()[:4] == (1, 0, 0, 0)
@@ -0,0 +1,153 @@
+"""Testing the read-only "frozen" mode of LRUDict."""
+import gc
+import os
+import sys
+import weakref
+import pytest
+from lru_ng import LRUDict
+
+
+HAVE_IMMORTAL = ((3, 12) <= sys.version_info < (3, 14) and
+                 getattr(sys, "_is_gil_enabled", lambda: True)())
+
+
+@pytest.fixture
+def frozen():
+    r = LRUDict(5)
+    for i in range(5):
+        r[i] = str(i)
+    r.freeze(immortalize=False)
+    return r
+
+
+def test_not_frozen_by_default():
+    r = LRUDict(1)
+    assert not r.frozen
+
+
+def test_frozen_flag(frozen):
+    assert frozen.frozen
+    with pytest.raises(AttributeError):
+        frozen.frozen = False
+
+
+def test_freeze_idempotent(frozen):
+    frozen.freeze()
+    assert frozen.frozen
+
+
+def test_lookup_does_not_promote(frozen):
+    order = frozen.keys()
+    assert frozen[0] == "0"
+    assert frozen.get(1) == "1"
+    assert frozen.setdefault(2) == "2"
+    assert frozen.keys() == order
+    assert frozen.peek_first_item() == (4, "4")
+    assert frozen.peek_last_item() == (0, "0")
+
+
+def test_read_methods(frozen):
+    assert len(frozen) == 5
+    assert 3 in frozen
+    assert 5 not in frozen
+    assert frozen.values() == ["4", "3", "2", "1", "0"]
+    assert frozen.items()[0] == (4, "4")
+    assert list(frozen.to_dict()) == [0, 1, 2, 3, 4]
+    assert frozen.get(10, "x") == "x"
+    with pytest.raises(KeyError):
+        frozen[10]
+
+
+def test_stats_continue_counting():
+    r = LRUDict(2)
+    r[0] = 0
+    r[0]
+    r.get(1)
+    r.freeze(immortalize=False)
+    assert r.get_stats() == (1, 1)
+    r[0]
+    r.get(1)
+    r.get(2)
+    assert r.get_stats() == (2, 3)
+
+
+@pytest.mark.parametrize("action", [
+    lambda r: r.__setitem__(0, "new"),
+    lambda r: r.__setitem__(10, "new"),
+    lambda r: r.__delitem__(0),
+    lambda r: r.pop(0),
+    lambda r: r.pop(10, None),
+    lambda r: r.popitem(),
+    lambda r: r.setdefault(10, "new"),
+    lambda r: r.update({10: "new"}),
+    lambda r: r.clear(),
+    lambda r: setattr(r, "size", 1),
+    lambda r: r.set_size(1),
+    lambda r: setattr(r, "callback", print),
+    lambda r: r.__init__(3),
+])
+def test_modification_fails(frozen, action):
+    before = frozen.items()
+    with pytest.raises(TypeError):
+        action(frozen)
+    assert frozen.items() == before
+
+
+def test_freeze_purges_pending():
+    evicted = []
+    r = LRUDict(1, lambda k, v: evicted.append(k))
+    r._suspend_purge = True
+    r[0] = 0
+    r[1] = 1
+    assert evicted == []
+    r.freeze(immortalize=False)
+    assert evicted == [0]
+    assert r._purge_queue_size == 0
+
+
+@pytest.mark.skipif(not hasattr(os, "fork"), reason="requires os.fork()")
+def test_lookup_in_forked_child(frozen):
+    rfd, wfd = os.pipe()
+    pid = os.fork()
+    if pid == 0:
+        ok = False
+        try:
+            ok = (frozen[1] == "1" and frozen.get(7) is None and
+                  frozen.get_stats() == (1, 1) and frozen.keys()[-1] == 0)
+        finally:
+            os.write(wfd, b"1" if ok else b"0")
+            os._exit(0)
+    os.close(wfd)
+    assert os.read(rfd, 1) == b"1"
+    os.close(rfd)
+    os.waitpid(pid, 0)
+    # Counters of the child are its own.
+    assert frozen.get_stats() == (0, 0)
+
+
+@pytest.mark.skipif(not HAVE_IMMORTAL,
+                    reason="requires immortal objects (CPython 3.12, 3.13)")
+def test_immortalize():
+    r = LRUDict(2)
+    k = object()
+    v = object()
+    r[k] = v
+    r.freeze(immortalize=True)
+    before = sys.getrefcount(v)
+    for i in range(10):
+        r[k]
+    assert sys.getrefcount(v) == before
+
+
+def test_released_by_default():
+    class Value:
+        pass
+
+    r = LRUDict(2)
+    r[0] = Value()
+    ref = weakref.ref(r[0])
+    r.freeze()
+    r[0]
+    del r
+    gc.collect()
+    assert ref() is None
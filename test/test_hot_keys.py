@@ -0,0 +1,134 @@
+"""Testing the hot-key tracker of LRUDict."""
+import gc
+import weakref
+import pytest
+from lru_ng import LRUDict
+
+
+class Key:
+    def __init__(self, n):
+        self.n = n
+
+    def __hash__(self):
+        return self.n
+
+    def __eq__(self, other):
+        return isinstance(other, Key) and self.n == other.n
+
+
+def test_off():
+    r = LRUDict(10)
+    r[0] = 0
+    assert r.top_keys() == []
+    r.track_hot_keys(0)
+    assert r.top_keys() == []
+
+
+def test_exact_when_few_keys():
+    r = LRUDict(3)
+    r.track_hot_keys(5)
+    for i in range(4):
+        r[i] = i            # 0 is evicted
+    r[3]
+    r[3] = "x"
+    r.get(1)
+    r.get(0)
+    with pytest.raises(KeyError):
+        r[0]
+    top = r.top_keys()
+    assert sorted(top[:2]) == [(0, 3, 0), (3, 3, 0)]
+    assert top[2:] == [(1, 2, 0), (2, 1, 0)]
+    assert sorted(r.top_keys(2)) == [(0, 3, 0), (3, 3, 0)]
+    assert r.top_keys(0) == []
+    # Not counted: "in", pop(), setdefault()
+    assert 2 in r
+    r.pop(2)
+    r.setdefault(1)
+    assert r.top_keys()[-1] == (2, 1, 0)
+
+
+def test_heavy_hitters():
+    r = LRUDict(50)
+    r.track_hot_keys(30)
+    total = 0
+    for rnd in range(200):
+        for hot in (7, 8, 9):
+            r[hot] = rnd
+            total += 1
+        for cold in range(20):
+            r.get(1000 + rnd * 20 + cold)
+            total += 1
+    top = r.top_keys()
+    # Each hot key has more than total / 30 accesses.
+    assert len(top) == 30
+    assert sorted(key for key, count, error in top[:3]) == [7, 8, 9]
+    counts = [count for key, count, error in top]
+    assert counts == sorted(counts, reverse=True)
+    for key, count, error in top:
+        assert count - error <= (200 if key in (7, 8, 9) else 1) <= count
+    assert sum(count for key, count, error in top) == total
+
+
+def test_restart_and_refs():
+    r = LRUDict(5)
+    r.track_hot_keys(2)
+    keys = [Key(i) for i in range(4)]
+    refs = [weakref.ref(k) for k in keys]
+    for k in keys:
+        r.get(k)
+    del k, keys
+    gc.collect()
+    # Only the last two keys are held, by the tracker.
+    assert [ref() is None for ref in refs] == [True, True, False, False]
+    assert sorted(key.n for key, count, error in r.top_keys()) == [2, 3]
+    assert [c - e for key, c, e in r.top_keys()] == [1, 1]
+    r.track_hot_keys(3)
+    assert r.top_keys() == []
+    gc.collect()
+    assert all(ref() is None for ref in refs)
+
+
+def test_del_in_retired_key():
+    r = LRUDict(5)
+    r.track_hot_keys(1)
+    log = []
+
+    class Reentrant(Key):
+        def __del__(self):
+            # Runs outside the critical section.
+            r[self.n] = None
+            log.append(self.n)
+
+    r.get(Reentrant(1))
+    r.get(Reentrant(2))
+    gc.collect()
+    assert log[0] == 1
+    assert len(r.top_keys()) == 1
+    assert set(r.keys()) == set(log)
+
+
+def test_errors():
+    r = LRUDict(5)
+    with pytest.raises(ValueError):
+        r.track_hot_keys(-1)
+    with pytest.raises(TypeError):
+        r.track_hot_keys("1")
+    with pytest.raises(TypeError):
+        r.top_keys("1")
+
+
+def test_cycle():
+    collected = []
+
+    class Holder:
+        def __del__(self):
+            collected.append(True)
+
+    r = LRUDict(5)
+    r.track_hot_keys(5)
+    h = Holder()
+    h.r = r
+    r.get(h)
+    del r, h
+    gc.collect()
+    assert collected
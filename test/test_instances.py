@@ -0,0 +1,82 @@
+"""Testing the registry of live LRUDict objects."""
+import gc
+import pytest
+import lru_ng
+from lru_ng import LRUDict
+
+
+class Obj:
+    """Evicting it is staged, unlike a str or an int."""
+
+    def __init__(self, n=None):
+        self.n = n
+
+
+def find(name):
+    found = [info for info in lru_ng.instances() if info.name == name]
+    assert len(found) <= 1
+    return found[0] if found else None
+
+
+def test_name():
+    assert LRUDict(1).name is None
+    assert LRUDict(1, name="x").name == "x"
+    with pytest.raises(TypeError):
+        LRUDict(1, None, "x")
+    with pytest.raises(TypeError):
+        LRUDict(1, name=b"x")
+    with pytest.raises(AttributeError):
+        LRUDict(1).name = "x"
+
+
+def test_snapshot():
+    r = LRUDict(2, name="test_snapshot")
+    r._suspend_purge = True
+    for i in range(4):
+        r[i] = Obj()
+    r[3]
+    r.get(0)
+    info = find("test_snapshot")
+    assert info == tuple(info)
+    assert info == ("test_snapshot", 2, 2, 1, 1, 2, 2)
+    assert (info.size, info.len, info.purge_queue_len) == (2, 2, 2)
+    r._suspend_purge = False
+    r.purge()
+    r.clear()
+    # Cumulative, like get_ext_stats()
+    info = find("test_snapshot")
+    assert (info.len, info.hits, info.misses) == (0, 1, 1)
+    assert (info.evictions, info.purge_queue_len) == (2, 0)
+
+
+def test_lifetime():
+    n = len(lru_ng.instances())
+    r = LRUDict(1, name="test_lifetime")
+    assert len(lru_ng.instances()) == n + 1
+    r.__init__(3, name="renamed")
+    assert len(lru_ng.instances()) == n + 1
+    assert find("test_lifetime") is None
+    assert find("renamed").size == 3
+    del r
+    gc.collect()
+    assert len(lru_ng.instances()) == n
+    assert find("renamed") is None
+
+
+def test_cycle():
+    r = LRUDict(1, name="test_cycle")
+    r[0] = r
+    del r
+    assert find("test_cycle") is not None
+    gc.collect()
+    assert find("test_cycle") is None
+
+
+def test_many():
+    rs = [LRUDict(i + 1, name=str(i)) for i in range(100)]
+    infos = {info.name: info for info in lru_ng.instances()}
+    assert all(infos[str(i)].size == i + 1 for i in range(100))
+    del rs
+    gc.collect()
+    names = {str(i) for i in range(100)}
+    assert not any(info.name in names for info in lru_ng.instances())
@@ -0,0 +1,93 @@
+"""Testing the latency histograms of LRUDict."""
+import time
+import pytest
+from lru_ng import LRUDict
+
+
+pytestmark = pytest.mark.skipif(not hasattr(LRUDict, "track_latency"),
+                                reason="latency recorder not available")
+
+OPS = ("get", "set", "update", "evict", "purge", "callback")
+
+
+def test_off():
+    r = LRUDict(2)
+    r[0] = 0
+    for op in OPS:
+        assert r.latency_histogram(op) is None
+    r.track_latency(False)
+    assert r.latency_histogram("get") is None
+
+
+def test_counts():
+    def callback(key, value):
+        if key == 1:
+            time.sleep(0.002)
+
+    r = LRUDict(2, callback=callback)
+    r.track_latency(True)
+    for i in range(5):
+        r[i] = i                # evicts 0, 1, 2; purges three times
+    r[4]
+    r.get(0)
+    r.update({5: 5, 6: 6})      # evicts 3, 4
+    counts = {op: r.latency_histogram(op)["count"] for op in OPS}
+    assert counts == {"get": 2, "set": 5, "update": 1, "evict": 5,
+                      "purge": 4, "callback": 5}
+    h = r.latency_histogram("callback", [0, 50, 100])
+    assert sum(c for low, high, c in h["buckets"]) == 5
+    assert h["max"] >= 2000000
+    assert h["total"] >= h["max"]
+    assert h["percentiles"][100] == h["max"]
+    assert h["percentiles"][0] <= h["percentiles"][50] < 2000000
+    # A restart discards the counts.
+    r.track_latency(True)
+    assert r.latency_histogram("set")["count"] == 0
+    assert r.latency_histogram("set")["percentiles"] == {50: None, 90: None,
+                                                         99: None, 99.9: None}
+
+
+def test_buckets():
+    r = LRUDict(10)
+    r.track_latency(True)
+    for i in range(1000):
+        r.get(i % 10)
+    h = r.latency_histogram("get")
+    assert h["count"] == 1000
+    prev_high = 0
+    for low, high, count in h["buckets"]:
+        assert prev_high <= low < high and count > 0
+        # Relative width of at most 1/16
+        assert (high - low) * 16 <= max(low, 16)
+        prev_high = high
+    assert h["buckets"][-1][0] <= h["max"] < h["buckets"][-1][1]
+    p = h["percentiles"]
+    assert p[50] <= p[90] <= p[99] <= p[99.9] <= h["max"]
+
+
+def test_callback_stops():
+    r = LRUDict(1)
+
+    def callback(key, value):
+        r.track_latency(False)
+
+    r.callback = callback
+    r.track_latency(True)
+    r[0] = 0
+    r[1] = 1
+    assert r.latency_histogram("callback") is None
+
+
+def test_errors():
+    r = LRUDict(5)
+    r.track_latency(True)
+    with pytest.raises(ValueError):
+        r.latency_histogram("lookup")
+    with pytest.raises(ValueError):
+        r.latency_histogram(0)
+    with pytest.raises(ValueError):
+        r.latency_histogram("get", [101])
+    with pytest.raises(TypeError):
+        r.latency_histogram("get", 50)
+    with pytest.raises(TypeError):
+        r.latency_histogram("get", ["50"])
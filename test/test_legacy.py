@@ -273,6 +273,8 @@ class TestLRU(unittest.TestCase):
             self.assertEqual('popitem(): LRUDict is empty', ke.args[0])
         self.assertEqual((0, 0), l.get_stats())
 
+    @unittest.skipUnless(hasattr(sys, "getrefcount"),
+                         "requires sys.getrefcount")
     def test_popitem_refcount(self):
         l = LRUDict(1)
         value = "A Pythong string"
@@ -0,0 +1,369 @@
+/* C test suite for the lrung core (src/lrung_core.c), independent of Python.
+ * Built and run by test_lrung_core.py; exits with nonzero status on failure,
+ * after printing the failed checks. */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lrung_core.h"
+
+
+static int n_failed = 0;
+
+#define CHECK(cond)                                                     \
+do {                                                                    \
+    if (!(cond)) {                                                      \
+        fprintf(stderr, "%s:%d: %s: check failed: %s\n",                \
+                __FILE__, __LINE__, __func__, #cond);                   \
+        n_failed++;                                                     \
+    }                                                                   \
+} while (0)
+
+
+/* Keys and values are small ints, boxed as heap objects with a refcount, so
+ * that retain/release can be checked for balance. */
+typedef struct {
+    long v;
+    long refcnt;
+} box;
+
+
+typedef struct {
+    long live;          /* boxes retained by the cache */
+    long n_evicted;
+    long last_evicted;
+    lrung_cache *cache; /* for reentrancy tests */
+    int reenter;
+} test_ud;
+
+
+static box *
+box_new(long v)
+{
+    box *b = malloc(sizeof(box));
+    b->v = v;
+    b->refcnt = 1;
+    return b;
+}
+
+
+static void
+box_decref(box *b)
+{
+    if (--b->refcnt == 0) {
+        free(b);
+    }
+}
+
+
+static uint64_t
+t_hash(const void *key, void *ud)
+{
+    (void)ud;
+    /* Deliberately poor, to exercise chaining. */
+    return (uint64_t)(((const box *)key)->v % 5);
+}
+
+
+static int
+t_equal(const void *a, const void *b, void *ud)
+{
+    (void)ud;
+    return ((const box *)a)->v == ((const box *)b)->v;
+}
+
+
+static void
+t_retain(void *obj, void *ud)
+{
+    ((box *)obj)->refcnt++;
+    ((test_ud *)ud)->live++;
+}
+
+
+static void
+t_release(void *obj, void *ud)
+{
+    ((test_ud *)ud)->live--;
+    box_decref(obj);
+}
+
+
+static void
+t_evicted(void *key, void *value, void *ud)
+{
+    test_ud *t = ud;
+    (void)value;
+    t->n_evicted++;
+    t->last_evicted = ((box *)key)->v;
+    if (t->reenter && ((box *)key)->v < 1000) {
+        /* The cache is consistent here, so this is allowed. */
+        box *k = box_new(1000 + ((box *)key)->v);
+        lrung_set(t->cache, k, k);
+        box_decref(k);
+    }
+}
+
+
+static lrung_cache *
+new_cache(size_t capacity, test_ud *ud)
+{
+    lrung_ops ops = {t_hash, t_equal, t_retain, t_release, t_evicted, ud};
+    memset(ud, 0, sizeof(test_ud));
+    ud->cache = lrung_new(capacity, &ops);
+    return ud->cache;
+}
+
+
+/* Insert key i with value 10 * i. */
+static void
+put(lrung_cache *c, long i)
+{
+    box *k = box_new(i);
+    box *v = box_new(10 * i);
+    CHECK(lrung_set(c, k, v) == 0);
+    box_decref(k);
+    box_decref(v);
+}
+
+
+static long
+get(lrung_cache *c, long i)
+{
+    box k = {i, 1};
+    void *v;
+    return lrung_get(c, &k, &v) ? ((box *)v)->v : -1;
+}
+
+
+static void
+test_new_invalid(void)
+{
+    lrung_ops ops = {t_hash, t_equal, NULL, NULL, NULL, NULL};
+    lrung_ops no_hash = {NULL, t_equal, NULL, NULL, NULL, NULL};
+    CHECK(lrung_new(0, &ops) == NULL);
+    CHECK(lrung_new(1, &no_hash) == NULL);
+}
+
+
+static void
+test_basic(void)
+{
+    test_ud ud;
+    lrung_cache *c = new_cache(10, &ud);
+    lrung_stats st;
+
+    for (long i = 0; i < 10; i++) {
+        put(c, i);
+    }
+    CHECK(lrung_len(c) == 10);
+    CHECK(ud.live == 20);
+    CHECK(get(c, 3) == 30);
+    CHECK(get(c, 11) == -1);
+    lrung_get_stats(c, &st);
+    CHECK(st.hits == 1 && st.misses == 1 && st.evictions == 0);
+
+    /* Replace */
+    box *k = box_new(3);
+    box *v = box_new(-3);
+    CHECK(lrung_set(c, k, v) == 0);
+    box_decref(k);
+    box_decref(v);
+    CHECK(get(c, 3) == -3);
+    CHECK(lrung_len(c) == 10);
+    CHECK(ud.live == 20);
+
+    lrung_free(c);
+    CHECK(ud.live == 0);
+    CHECK(ud.n_evicted == 0);
+}
+
+
+static void
+test_order_and_eviction(void)
+{
+    test_ud ud;
+    lrung_cache *c = new_cache(3, &ud);
+    void *key, *value;
+    const void *it = NULL;
+    long order[3];
+    int n = 0;
+
+    put(c, 1);
+    put(c, 2);
+    put(c, 3);
+    get(c, 1);      /* order now 1, 3, 2 */
+    put(c, 4);      /* evicts 2 */
+    CHECK(ud.n_evicted == 1);
+    CHECK(ud.last_evicted == 2);
+    CHECK(get(c, 2) == -1);
+    CHECK(lrung_len(c) == 3);
+    CHECK(ud.live == 6);
+
+    while ((it = lrung_iter_next(c, it, &key, &value)) != NULL) {
+        order[n++] = ((box *)key)->v;
+    }
+    CHECK(n == 3);
+    CHECK(order[0] == 4 && order[1] == 1 && order[2] == 3);
+    it = NULL;
+    n = 0;
+    while ((it = lrung_iter_prev(c, it, &key, &value)) != NULL) {
+        order[n++] = ((box *)key)->v;
+    }
+    CHECK(n == 3);
+    CHECK(order[0] == 3 && order[1] == 1 && order[2] == 4);
+
+    CHECK(lrung_resize(c, 1) == 0);
+    CHECK(ud.n_evicted == 3);
+    CHECK(lrung_len(c) == 1);
+    CHECK(get(c, 4) == 40);
+    CHECK(lrung_resize(c, 0) == -1);
+
+    lrung_free(c);
+    CHECK(ud.live == 0);
+}
+
+
+static void
+test_pop_and_clear(void)
+{
+    test_ud ud;
+    lrung_cache *c = new_cache(10, &ud);
+    box k = {5, 1};
+    void *ko, *vo;
+
+    for (long i = 0; i < 10; i++) {
+        put(c, i);
+    }
+    CHECK(lrung_pop(c, &k, &ko, &vo) == 1);
+    CHECK(((box *)ko)->v == 5 && ((box *)vo)->v == 50);
+    /* Ownership was handed over. */
+    box_decref(ko);
+    box_decref(vo);
+    ud.live -= 2;
+    CHECK(lrung_pop(c, &k, NULL, NULL) == 0);
+    k.v = 6;
+    CHECK(lrung_pop(c, &k, NULL, NULL) == 1);
+    CHECK(lrung_len(c) == 8);
+    CHECK(ud.live == 16);
+
+    lrung_clear(c);
+    CHECK(lrung_len(c) == 0);
+    CHECK(ud.live == 0);
+    CHECK(get(c, 1) == -1);
+    put(c, 1);
+    CHECK(get(c, 1) == 10);
+    lrung_free(c);
+    CHECK(ud.live == 0);
+    CHECK(ud.n_evicted == 0);
+}
+
+
+static void
+test_staging(void)
+{
+    test_ud ud;
+    lrung_cache *c = new_cache(2, &ud);
+
+    lrung_suspend_purge(c, 1);
+    for (long i = 0; i < 5; i++) {
+        put(c, i);
+    }
+    CHECK(ud.n_evicted == 0);
+    CHECK(lrung_staged(c) == 3);
+    /* Staged entries are out of the table but still held. */
+    CHECK(get(c, 0) == -1);
+    CHECK(ud.live == 10);
+    CHECK(lrung_purge(c) == 3);
+    CHECK(ud.n_evicted == 3);
+    CHECK(lrung_staged(c) == 0);
+    CHECK(ud.live == 4);
+
+    /* Taking over staged evictions instead. */
+    put(c, 5);
+    put(c, 6);
+    CHECK(lrung_staged(c) == 2);
+    {
+        void *k, *v;
+        CHECK(lrung_take_staged(c, &k, &v) == 1);
+        CHECK(((box *)k)->v == 3 && ((box *)v)->v == 30);
+        box_decref(k);
+        box_decref(v);
+        ud.live -= 2;
+    }
+    CHECK(lrung_staged(c) == 1);
+    CHECK(ud.n_evicted == 3);
+    CHECK(lrung_purge(c) == 1);
+    CHECK(ud.n_evicted == 4);
+
+    /* Freeing the cache purges what's left. */
+    put(c, 7);
+    lrung_free(c);
+    CHECK(ud.n_evicted == 5);
+    CHECK(ud.live == 0);
+}
+
+
+static void
+test_reentrant_eviction(void)
+{
+    test_ud ud;
+    lrung_cache *c = new_cache(2, &ud);
+
+    ud.reenter = 1;
+    put(c, 1);
+    put(c, 2);
+    put(c, 3);
+    /* Evicting 1 inserts 1001 and evicts 2, which inserts 1002 and evicts 3,
+     * which inserts 1003 and evicts 1001. All in the purge run by put(c, 3).
+     */
+    CHECK(ud.n_evicted == 4);
+    CHECK(lrung_staged(c) == 0);
+    CHECK(lrung_len(c) == 2);
+    CHECK(get(c, 1002) == 1002 && get(c, 1003) == 1003);
+    lrung_free(c);
+    CHECK(ud.live == 0);
+}
+
+
+static void
+test_many(void)
+{
+    test_ud ud;
+    lrung_cache *c = new_cache(1000, &ud);
+    long hits = 0;
+
+    for (long i = 0; i < 5000; i++) {
+        put(c, i);
+        if (get(c, i / 2) >= 0) {
+            hits++;
+        }
+    }
+    CHECK(lrung_len(c) == 1000);
+    CHECK(ud.n_evicted == 4000);
+    CHECK(hits > 0);
+    for (long i = 4000; i < 5000; i++) {
+        CHECK(get(c, i) == 10 * i);
+    }
+    lrung_free(c);
+    CHECK(ud.live == 0);
+}
+
+
+int
+main(void)
+{
+    test_new_invalid();
+    test_basic();
+    test_order_and_eviction();
+    test_pop_and_clear();
+    test_staging();
+    test_reentrant_eviction();
+    test_many();
+    if (n_failed) {
+        fprintf(stderr, "%d check(s) failed\n", n_failed);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
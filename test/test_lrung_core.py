@@ -0,0 +1,14 @@
+"""Build and run the C test suite of the lrung core."""
+import os
+import subprocess
+from cbuild import HERE, SRC_DIR, build_exe
+
+
+def test_core_c_suite(tmp_path):
+    exe = build_exe("test_lrung_core",
+                    [os.path.join(HERE, "test_lrung_core.c"),
+                     os.path.join(SRC_DIR, "lrung_core.c")],
+                    tmp_path, ["-std=c99", "-Wall", "-Wextra", "-Werror"])
+    proc = subprocess.run([exe], stdout=subprocess.PIPE,
+                          stderr=subprocess.STDOUT)
+    assert proc.returncode == 0, proc.stdout.decode(errors="replace")
@@ -0,0 +1,86 @@
+"""Testing the memory accounting of LRUDict."""
+import sys
+import pytest
+from lru_ng import LRUDict
+
+
+pytestmark = pytest.mark.skipif(not hasattr(LRUDict, "memory_usage"),
+                                reason="memory accounting not available")
+
+PARTS = ["object", "dict", "nodes", "purge_queue", "tracking"]
+
+
+def test_sizeof():
+    r = LRUDict(1000)
+    usage = r.memory_usage()
+    assert sorted(usage) == sorted(PARTS)
+    assert sum(usage.values()) == r.__sizeof__() < sys.getsizeof(r)
+    assert usage["tracking"] == 0
+    node = usage["nodes"]       # the root
+    for i in range(1000):
+        r[i] = i
+    grown = r.memory_usage()
+    assert grown["nodes"] == 1001 * node
+    assert grown["dict"] >= sys.getsizeof({i: i for i in range(1000)}) // 2
+    assert grown["object"] == usage["object"]
+    assert sum(grown.values()) == r.__sizeof__()
+    # Timed nodes are larger.
+    r.track_eviction_age(True)
+    r[1000] = 0
+    assert r.memory_usage()["nodes"] == 1001 * node + 16
+
+
+def test_purge_queue_and_deep():
+    r = LRUDict(3, callback=lambda k, v: None)
+    r._suspend_purge = True
+    keys = ["k" * i for i in range(10)]
+    values = [[None] * i for i in range(10)]
+    for k, v in zip(keys, values):
+        r[k] = v
+    usage = r.memory_usage(deep=True)
+    assert sorted(usage) == sorted(PARTS + ["keys", "values"])
+    assert usage["keys"] == sum(map(sys.getsizeof, keys))
+    assert usage["values"] == sum(map(sys.getsizeof, values))
+    assert usage["nodes"] % 4 == 0
+    node = usage["nodes"] // 4
+    assert usage["purge_queue"] >= 7 * node + sys.getsizeof([None] * 7)
+    r._suspend_purge = False
+    r.purge()
+    usage = r.memory_usage(deep=True)
+    assert usage["keys"] == sum(map(sys.getsizeof, keys[-3:]))
+    assert r.memory_usage().keys() <= usage.keys()
+    with pytest.raises(TypeError):
+        r.memory_usage(True)
+
+
+def test_tracking():
+    r = LRUDict(10)
+    r.track_hot_keys(100)
+    hot = r.memory_usage()["tracking"]
+    assert hot > 100 * 16
+    r.track_latency(True)
+    assert r.memory_usage()["tracking"] > hot + 30000
+    r.track_latency(False)
+    r.track_hot_keys(0)
+    assert r.memory_usage()["tracking"] == 0
+
+
+def test_deep_errors():
+    r = LRUDict(10)
+
+    class Bad:
+        def __sizeof__(self):
+            raise ValueError
+
+    class Meddling:
+        def __sizeof__(self):
+            r[0] = 0
+            return 0
+
+    r[1] = Bad()
+    with pytest.raises(ValueError):
+        r.memory_usage(deep=True)
+    r[1] = Meddling()
+    with pytest.raises(RuntimeError):
+        r.memory_usage(deep=True)
+    assert 0 not in r
@@ -0,0 +1,100 @@
+"""Testing the budget of the automatic purges of LRUDict."""
+import time
+import pytest
+from lru_ng import LRUDict
+
+
+class Obj:
+    """Evicting it is staged, unlike a str or an int."""
+
+    def __init__(self, n=None):
+        self.n = n
+
+
+def filled(n, callback):
+    r = LRUDict(n, callback=callback)
+    for i in range(n):
+        r[i] = Obj()
+    return r
+
+
+def test_properties():
+    r = LRUDict(5)
+    assert (r.purge_budget, r.purge_budget_us) == (None, None)
+    r.purge_budget = 10
+    r.purge_budget_us = 500
+    assert (r.purge_budget, r.purge_budget_us) == (10, 500)
+    r.purge_budget = r.purge_budget_us = None
+    assert (r.purge_budget, r.purge_budget_us) == (None, None)
+    with pytest.raises(ValueError):
+        r.purge_budget = 0
+    with pytest.raises(ValueError):
+        r.purge_budget_us = -1
+    with pytest.raises(TypeError):
+        r.purge_budget_us = 0.5
+    with pytest.raises(AttributeError):
+        del r.purge_budget
+
+
+def test_items():
+    evicted = []
+    r = filled(1000, lambda k, v: evicted.append(k))
+    r.purge_budget = 100
+    r.size = 10
+    assert evicted == list(range(100))
+    assert r._purge_queue_size == 890
+    # The next insertions go on.
+    r[-1] = Obj()
+    r[-2] = Obj()
+    assert evicted == list(range(300))
+    assert r._purge_queue_size == 692
+    # Not bounded
+    assert r.purge() == 692
+    assert evicted == list(range(992))
+    s = r.get_ext_stats()
+    assert (s.purges, s.callbacks) == (4, 992)
+
+
+def test_time():
+    evicted = []
+
+    def callback(key, value):
+        evicted.append(key)
+        time.sleep(0.001)
+
+    r = filled(100, callback)
+    r.purge_budget_us = 1
+    r.size = 10
+    # At least one
+    assert evicted == [0]
+    for i in range(100, 105):
+        r[i] = Obj()
+    assert evicted == list(range(6))
+    assert r._purge_queue_size == 89
+    r.purge()
+    assert evicted == list(range(95))
+
+
+def test_reentrant():
+    evicted = []
+    r = LRUDict(20)
+
+    def callback(key, value):
+        evicted.append(key)
+        if key == 0:
+            # Claims the next ones in here
+            r[-1] = Obj()
+
+    for i in range(20):
+        r[i] = Obj()
+    r.callback = callback
+    r._suspend_purge = True
+    r.size = 5
+    r._suspend_purge = False
+    r.purge_budget = 3
+    r.purge_budget_us = 1000000
+    r[20] = Obj()
+    assert evicted == list(range(6))
+    assert r._purge_queue_size == 11
+    r.purge()
+    assert evicted == list(range(17))
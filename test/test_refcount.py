@@ -1,7 +1,10 @@
 """Testing refcount correctness of methods on LRUDict."""
+import sys
 from sys import exc_info
 from unittest import TestCase
 import pytest
+if not hasattr(sys, "getrefcount"):
+    pytest.skip("requires sys.getrefcount", allow_module_level=True)
 from trackrefcount import TrackRCFor
 from lru_ng import LRUDict
 
@@ -18,6 +21,14 @@ from lru_ng import LRUDict
 #   - Avoid re-binding the name for the context manager to something else
 #   - After exiting, it cannot be entered again.
 #   - Contexts are not scopes.
+#   - Since Python 3.12, string constants may be immortal objects, whose
+#     refcount never changes. Use mortal() to get a fresh copy where the
+#     refcount is expected to change.
+
+
+def mortal(s):
+    """Return a new str object equal to s."""
+    return "".join(list(s))
 
 
 class TestRefCount(TestCase):
@@ -39,8 +50,8 @@ class TestRefCount(TestCase):
 
     def test_indexing_assignment(self):
         ldobj = LRUDict(1)
-        k = "lorem"
-        v = "ipsum"
+        k = mortal("lorem")
+        v = mortal("ipsum")
         with TrackRCFor(v) as outer_v:
             with TrackRCFor(k, v) as inner_kv:
                 # insertion increfs k by 2 and v by 1 due to internal node
@@ -153,7 +164,7 @@ class TestRefCount(TestCase):
         # forcibly disable eviction WITH a callback set
         ldobj = LRUDict(1, lambda x, y: (x, y))
         ldobj._suspend_purge = True
-        k, v = "spam", "eggs"
+        k, v = mortal("spam"), mortal("eggs")
         ldobj[k] = v
         with TrackRCFor(k, v) as t:
             ldobj[0] = 0  # this puts k, v on the staging list but not purged
@@ -186,16 +197,16 @@ class TestRefCount(TestCase):
         t.assertEqualRC()
 
     def test_method_setdefault_inserting(self):
-        k = "method"
-        default = "dispatcher"
+        k = mortal("method")
+        default = mortal("dispatcher")
         ldobj = LRUDict(2)
         with TrackRCFor(k, default) as t:
             ldobj.setdefault(k, default)
         t.assertDelta(2, 1)
 
     def test_method_pop_hitting_withdefault(self):
-        k = "poppend"
-        v = "popped by association"
+        k = mortal("poppend")
+        v = mortal("popped by association")
         default = "not touched"
         ldobj = LRUDict(300)
         ldobj[k] = v
@@ -204,8 +215,8 @@ class TestRefCount(TestCase):
         t.assertDelta(-2, -1, 0)
 
     def test_method_pop_hitting_withoutdefault(self):
-        k = "poppend"
-        v = "popped by association"
+        k = mortal("poppend")
+        v = mortal("popped by association")
         ldobj = LRUDict(2)
         ldobj[k] = v
         with TrackRCFor(k, v) as t:
@@ -231,8 +242,8 @@ class TestRefCount(TestCase):
         t.assertEqualRC()
 
     def test_method_popitem(self):
-        k = "item_key"
-        v = "item_value"
+        k = mortal("item_key")
+        v = mortal("item_value")
         ldobj = LRUDict(4)
         with TrackRCFor(k, v) as t:
             ldobj[k] = v
@@ -243,8 +254,8 @@ class TestRefCount(TestCase):
         t.assertEqualRC()
 
     def test_method_clear(self):
-        k = "item_key"
-        v = "item_value"
+        k = mortal("item_key")
+        v = mortal("item_value")
         ldobj = LRUDict(4)
         ldobj[k] = v
         with TrackRCFor(k, v) as t:
@@ -279,7 +290,7 @@ class ManualRefCountContextMixin:
     def setUp(self):
         self.orig_size = 4
         self.lobj = LRUDict(self.orig_size)
-        self.k_special, self.v_special = "ks", "vs"
+        self.k_special, self.v_special = mortal("ks"), mortal("vs")
         self.lobj[self.k_special] = self.v_special
         # Manually enter the refcount tracking context manager
         self.special_tracker = TrackRCFor(self.k_special, self.v_special)
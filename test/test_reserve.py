@@ -0,0 +1,76 @@
+"""Testing the presizing of the internal dict of LRUDict."""
+import pytest
+from lru_ng import LRUDict
+
+
+# Needs memory_usage() to see the size of the internal dict.
+measured = pytest.mark.skipif(not hasattr(LRUDict, "memory_usage"),
+                              reason="memory accounting not available")
+
+
+def dict_size(r):
+    return r.memory_usage()["dict"]
+
+
+@measured
+def test_construction():
+    empty = dict_size(LRUDict(5000, reserve=0))
+    default = dict_size(LRUDict(5000))
+    full = dict_size(LRUDict(5000, reserve=5000))
+    assert empty < default < full
+    assert dict_size(LRUDict(1024)) == default
+    # Up to the size
+    assert dict_size(LRUDict(100, reserve=5000)) == dict_size(LRUDict(100))
+    assert dict_size(LRUDict(5000, reserve=None)) == default
+
+
+@measured
+def test_no_resize():
+    r = LRUDict(5000, reserve=5000)
+    full = dict_size(r)
+    for i in range(5000):
+        r[i] = i
+    assert dict_size(r) == full
+    for i in range(4900):
+        del r[i]
+    # Not compacted below the reservation
+    assert dict_size(r) == full
+    r.compact()
+    assert dict_size(r) == full
+    r.clear()
+    assert dict_size(r) == full
+
+
+@measured
+def test_reserve():
+    r = LRUDict(5000, reserve=0)
+    for i in range(10):
+        r[i] = i
+    small = dict_size(r)
+    r.reserve(5000)
+    full = dict_size(r)
+    assert full > small
+    assert r.keys() == list(range(9, -1, -1))
+    assert all(r[i] == i for i in range(10))
+    r.reserve(100)
+    assert dict_size(r) == full
+    r.compact()
+    assert small < dict_size(r) < full
+    r.reserve(0)
+    r.compact()
+    assert dict_size(r) == small
+
+
+def test_errors():
+    with pytest.raises(ValueError):
+        LRUDict(5, reserve=-1)
+    with pytest.raises(TypeError):
+        LRUDict(5, reserve="1")
+    r = LRUDict(5)
+    with pytest.raises(ValueError):
+        r.reserve(-1)
+    with pytest.raises(TypeError):
+        r.reserve(1.0)
+    r.freeze(immortalize=False)
+    with pytest.raises(TypeError):
+        r.reserve(1)
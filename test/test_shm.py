@@ -0,0 +1,309 @@
+"""Testing SharedLRUCache, the LRU cache in POSIX shared memory."""
+import gc
+import multiprocessing
+import os
+import threading
+import time
+import uuid
+import pytest
+import lru_ng
+
+
+pytestmark = pytest.mark.skipif(not hasattr(lru_ng, "SharedLRUCache"),
+                                reason="POSIX shared memory not available")
+SIZE = 1 << 20
+
+
+@pytest.fixture
+def name():
+    n = "/lru_ng_test_%d_%s" % (os.getpid(), uuid.uuid4().hex[:8])
+    yield n
+    try:
+        lru_ng.SharedLRUCache(n).unlink()
+    except OSError:
+        pass
+
+
+@pytest.fixture
+def cache(name):
+    with lru_ng.SharedLRUCache(name, SIZE) as c:
+        yield c
+
+
+def test_basic(cache):
+    cache[b"a"] = b"1"
+    cache[b"b"] = b"2"
+    assert len(cache) == 2
+    assert cache[b"a"] == b"1"
+    assert b"b" in cache
+    assert b"c" not in cache
+    assert cache.get(b"c") is None
+    assert cache.get(b"c", 3) == 3
+    with pytest.raises(KeyError):
+        cache[b"c"]
+    del cache[b"b"]
+    assert cache.keys() == [b"a"]
+    assert cache.get_stats() == (1, 3)
+
+
+def test_bytes_only(cache):
+    with pytest.raises(TypeError):
+        cache["a"] = b"1"
+    with pytest.raises(TypeError):
+        cache[b"a"] = 1
+    with pytest.raises(TypeError):
+        cache[1]
+
+
+def test_order(cache):
+    for i in range(5):
+        cache[b"%d" % i] = b"v%d" % i
+    cache[b"0"]
+    assert cache.keys() == [b"0", b"4", b"3", b"2", b"1"]
+    assert cache.values()[0] == b"v0"
+    assert cache.items()[-1] == (b"1", b"v1")
+    assert cache.peek_first_item() == (b"0", b"v0")
+    assert cache.peek_last_item() == (b"1", b"v1")
+    assert list(cache.to_dict()) == [b"1", b"2", b"3", b"4", b"0"]
+    assert cache.popitem() == (b"0", b"v0")
+    assert cache.popitem(True) == (b"1", b"v1")
+    assert cache.pop(b"2") == b"v2"
+    assert cache.pop(b"2", None) is None
+    assert cache.setdefault(b"3", b"x") == b"v3"
+    assert cache.setdefault(b"9", b"x") == b"x"
+    cache.update({b"7": b"7"})
+    assert len(cache) == 4
+    cache.clear()
+    assert len(cache) == 0
+    assert cache.get_stats() == (0, 0)
+    with pytest.raises(KeyError):
+        cache.popitem()
+
+
+def test_replace_value_of_other_size(cache):
+    cache[b"k"] = b"short"
+    cache[b"k"] = b"long" * 100
+    assert cache[b"k"] == b"long" * 100
+    cache[b"k"] = b""
+    assert cache[b"k"] == b""
+    assert len(cache) == 1
+
+
+def test_eviction_is_lru(cache):
+    value = b"x" * 1000
+    n = 2 * SIZE // len(value)
+    for i in range(n):
+        cache[b"%d" % i] = value
+        cache[b"0"]     # keep it hot
+    assert 0 < len(cache) < n
+    assert b"0" in cache
+    assert b"1" not in cache
+    assert b"%d" % (n - 1) in cache
+
+
+def test_pages_move_between_classes(cache):
+    for i in range(20000):
+        cache[b"%d" % i] = b"x" * 10
+    n = len(cache)
+    # No page is left for the larger class, until one is taken from the
+    # small items.
+    cache[b"big"] = b"y" * 2000
+    assert cache[b"big"] == b"y" * 2000
+    # One page's worth
+    assert n - n // 10 < len(cache) < n
+    for i in range(400):
+        cache[b"big%d" % i] = b"y" * 2000
+    assert b"big399" in cache
+    assert 0 < len(cache) < 20000
+    # And back
+    for i in range(20000):
+        cache[b"%d" % i] = b"x" * 10
+    assert b"19999" in cache and b"big399" not in cache
+
+
+def test_replace_keeps_old_on_failure(cache):
+    cache[b"k"] = b"v"
+    with pytest.raises(ValueError):
+        cache[b"k"] = b"x" * (cache.max_item_size + 1)
+    assert cache[b"k"] == b"v"
+    # Only the old item's page is left to take.
+    for i in range(5000):
+        cache[b"%d" % i] = b"x" * 100
+    cache[b"k"] = b"y" * 3000
+    assert cache[b"k"] == b"y" * 3000
+
+
+def test_finalizer_during_listing(cache):
+    """A collection started while building the results may run a finalizer
+    that uses the cache."""
+    seen = []
+
+    class Cycle:
+        def __init__(self):
+            self.me = self
+
+        def __del__(self):
+            seen.append(len(cache))
+            cache[b"fin"] = b"1"
+
+    for i in range(100):
+        cache[b"%d" % i] = b"v"
+    threshold = gc.get_threshold()
+    gc.collect()
+    try:
+        gc.set_threshold(1)
+        for i in range(20):
+            Cycle()
+            cache.items()
+            cache.keys()
+            cache.to_dict()
+            cache.popitem()
+            cache.peek_last_item()
+    finally:
+        gc.set_threshold(*threshold)
+    gc.collect()
+    assert seen
+
+
+def test_item_too_large(cache):
+    with pytest.raises(ValueError):
+        cache[b"k"] = b"x" * (cache.max_item_size + 1)
+    cache[b"k"] = b"x" * (cache.max_item_size - 1)
+
+
+def test_attach_and_close(name, cache):
+    cache[b"k"] = b"v"
+    other = lru_ng.SharedLRUCache(name)
+    assert other.size == cache.size == SIZE
+    assert other.name == name
+    assert other[b"k"] == b"v"
+    other.close()
+    assert other.closed
+    with pytest.raises(ValueError):
+        other[b"k"]
+    assert cache[b"k"] == b"v"
+
+
+@pytest.mark.skipif(not os.path.isdir("/dev/shm"),
+                    reason="shared memory is not under /dev/shm")
+def test_attach_bad_geometry(name, cache):
+    # Bytes 24 to 31 of the header hold the page size.
+    with open("/dev/shm" + name, "r+b") as f:
+        f.seek(24)
+        saved = f.read(8)
+        f.seek(24)
+        f.write(b"\xff" * 8)
+        f.flush()
+        try:
+            with pytest.raises(ValueError):
+                lru_ng.SharedLRUCache(name)
+        finally:
+            f.seek(24)
+            f.write(saved)
+    lru_ng.SharedLRUCache(name).close()
+
+
+def test_attach_missing(name):
+    with pytest.raises(OSError):
+        lru_ng.SharedLRUCache(name)
+
+
+def test_failed_create_leaves_nothing(name):
+    # The mapping cannot be that large.
+    with pytest.raises(OSError):
+        lru_ng.SharedLRUCache(name, 1 << 62)
+    with pytest.raises(OSError):
+        lru_ng.SharedLRUCache(name)
+    with lru_ng.SharedLRUCache(name, SIZE) as c:
+        c[b"k"] = b"v"
+
+
+def test_name_gets_slash():
+    n = "lru_ng_test_%s" % uuid.uuid4().hex[:8]
+    c = lru_ng.SharedLRUCache(n, SIZE)
+    try:
+        assert c.name == "/" + n
+    finally:
+        c.unlink()
+
+
+def _child(name, start, count):
+    c = lru_ng.SharedLRUCache(name)
+    for i in range(start, start + count):
+        c[b"%d" % i] = b"%d" % (i * i)
+    for i in range(start, start + count):
+        assert c[b"%d" % i] == b"%d" % (i * i)
+
+
+def test_multiprocess(name, cache):
+    ctx = multiprocessing.get_context("spawn")
+    procs = [ctx.Process(target=_child, args=(name, i * 100, 100))
+             for i in range(4)]
+    for p in procs:
+        p.start()
+    for p in procs:
+        p.join()
+        assert p.exitcode == 0
+    assert len(cache) == 400
+    assert cache[b"399"] == b"%d" % (399 * 399)
+    assert cache.get_stats()[0] == 401
+
+
+def _die_holding_lock(name):
+    c = lru_ng.SharedLRUCache(name)
+    c._acquire_lock()
+    os._exit(0)
+
+
+@pytest.mark.skipif(not hasattr(getattr(lru_ng, "SharedLRUCache", None),
+                                "_acquire_lock"),
+                    reason="mutex is not robust on this platform")
+def test_owner_died(name, cache):
+    cache[b"k"] = b"v"
+    p = multiprocessing.get_context("spawn").Process(target=_die_holding_lock,
+                                                     args=(name,))
+    p.start()
+    p.join()
+    # The cache is recovered, though emptied.
+    assert len(cache) == 0
+    cache[b"k"] = b"v"
+    assert cache[b"k"] == b"v"
+
+
+def _hold_lock(name, held):
+    c = lru_ng.SharedLRUCache(name)
+    c._acquire_lock()
+    held.set()
+    time.sleep(0.5)
+    os._exit(0)
+
+
+@pytest.mark.skipif(not hasattr(getattr(lru_ng, "SharedLRUCache", None),
+                                "_acquire_lock"),
+                    reason="mutex is not robust on this platform")
+def test_close_while_waiting(name, cache):
+    ctx = multiprocessing.get_context("spawn")
+    held = ctx.Event()
+    p = ctx.Process(target=_hold_lock, args=(name, held))
+    p.start()
+    assert held.wait(30)
+    other = lru_ng.SharedLRUCache(name)
+    errors = []
+
+    def wait():
+        try:
+            other.get(b"k")
+        except ValueError as e:
+            errors.append(e)
+
+    t = threading.Thread(target=wait)
+    t.start()
+    time.sleep(0.1)
+    # The waiting thread still uses the mapping, which stays until it is done.
+    other.close()
+    assert other.closed
+    t.join()
+    p.join()
+    assert len(errors) == 1
+    cache[b"k"] = b"v"
+    assert cache[b"k"] == b"v"
@@ -0,0 +1,119 @@
+"""Testing shrinking an LRUDict by many items at once."""
+import gc
+import sys
+import pytest
+from lru_ng import LRUDict
+
+
+class Obj:
+    """Evicting it is staged, unlike a str or an int."""
+
+    def __init__(self, n=None):
+        self.n = n
+
+
+# Fewer than half, and more than half of the items evicted
+SIZES = [(1000, 600), (1000, 100), (100, 1)]
+
+
+@pytest.mark.parametrize("n, m", SIZES)
+@pytest.mark.parametrize("make", [int, Obj])
+def test_content(n, m, make):
+    r = LRUDict(n)
+    for i in range(n):
+        r[i] = make(i)
+    r[0]
+    r.size = m
+    assert len(r) == m
+    assert r.keys() == [0] + list(range(n - 1, n - m, -1))
+    assert all(i in r for i in r.keys())
+    assert not any(i in r for i in range(1, n - m + 1))
+    assert r.peek_last_item()[0] == (n - m + 1 if m > 1 else 0)
+    # Still usable
+    r[-1] = make(-1)
+    assert r.keys()[0] == -1 and len(r) == m
+    s = r.get_ext_stats()
+    assert s.evictions == n - m + 1
+    # Released right after, as by clear()
+    assert s.evictions_direct >= n - m
+
+
+@pytest.mark.parametrize("n, m", SIZES)
+def test_callback(n, m):
+    evicted = []
+    r = LRUDict(n, callback=lambda k, v: evicted.append((k, v.n)))
+    for i in range(n):
+        r[i] = Obj(i)
+    r.set_size(m)
+    assert evicted == [(i, i) for i in range(n - m)]
+    s = r.get_ext_stats()
+    assert (s.evictions_staged, s.purges, s.callbacks) == (n - m, 1, n - m)
+    assert s.purge_queue_peak == n - m
+    assert r._purge_queue_size == 0
+
+
+def test_queue_not_empty():
+    evicted = []
+    r = LRUDict(300, callback=lambda k, v: evicted.append(k))
+    r._suspend_purge = True
+    for i in range(302):
+        r[i] = i
+    r.size = 200
+    r.size = 10
+    assert r._purge_queue_size == 292
+    r._suspend_purge = False
+    r.purge()
+    assert evicted == list(range(292))
+    assert r.get_ext_stats().purge_queue_peak == 292
+
+
+def test_release_outside():
+    log = []
+    r = LRUDict(200)
+
+    class Reentrant(Obj):
+        def __del__(self):
+            # The LRUDict is usable again by now.
+            log.append((self.n, r.get(200) is not None))
+
+    for i in range(1, 201):
+        r[i] = Reentrant(i)
+    r.size = 100
+    gc.collect()
+    assert sorted(log) == [(i, True) for i in range(1, 101)]
+    assert len(r) == 100
+
+
+@pytest.mark.skipif(not hasattr(sys, "getrefcount"),
+                    reason="requires sys.getrefcount")
+def test_refcount():
+    key, value = Obj(0), Obj(0)
+    refs = sys.getrefcount(key), sys.getrefcount(value)
+    for m in (150, 10):
+        r = LRUDict(200, callback=lambda k, v: None)
+        r[key] = value
+        for i in range(199):
+            r[i] = Obj(i)
+        r.size = m
+        assert key not in r
+        assert (sys.getrefcount(key), sys.getrefcount(value)) == refs
+        del r
+    gc.collect()
+    assert (sys.getrefcount(key), sys.getrefcount(value)) == refs
+
+
+@pytest.mark.skipif(not hasattr(LRUDict, "track_latency"),
+                    reason="recorders not available")
+def test_recorders():
+    r = LRUDict(1000)
+    r.track_eviction_age(True)
+    r.track_latency(True)
+    for i in range(1000):
+        r[i] = Obj(i)
+    r.size = 100
+    h = r.eviction_age_histogram("insert")
+    assert h["count"] == 900
+    assert r.latency_histogram("evict")["count"] == 900
+    # Still in bulk
+    assert r.get_ext_stats().evictions_direct == 900
+
@@ -0,0 +1,145 @@
+"""Testing the trace-replay simulator."""
+from array import array
+from collections import OrderedDict
+import pytest
+import lru_ng
+from lru_ng import LRUDict
+
+
+pytestmark = pytest.mark.skipif(not hasattr(lru_ng, "simulate"),
+                                reason="simulator not available")
+
+
+def lrudict_hits(trace, size):
+    r = LRUDict(size)
+    for key in trace:
+        if key in r:
+            r[key]
+        else:
+            r[key] = None
+    return r.get_stats()[0]
+
+
+def clock_hits(trace, size):
+    slots, ref, where = [], [], {}
+    hand = hits = 0
+    for key in trace:
+        if key in where:
+            ref[where[key]] = True
+            hits += 1
+            continue
+        if len(slots) < size:
+            slots.append(key)
+            ref.append(False)
+            where[key] = len(slots) - 1
+            continue
+        while ref[hand]:
+            ref[hand] = False
+            hand = (hand + 1) % size
+        del where[slots[hand]]
+        slots[hand] = key
+        where[key] = hand
+        hand = (hand + 1) % size
+    return hits
+
+
+def slru_hits(trace, size):
+    prob, prot = OrderedDict(), OrderedDict()
+    prot_size = size * 4 // 5
+    hits = 0
+    for key in trace:
+        if key in prot:
+            prot.move_to_end(key)
+        elif key in prob:
+            del prob[key]
+            prot[key] = None
+            if len(prot) > prot_size:
+                prob[prot.popitem(last=False)[0]] = None
+        else:
+            if len(prob) + len(prot) >= size:
+                (prob or prot).popitem(last=False)
+            prob[key] = None
+            continue
+        hits += 1
+    return hits
+
+
+def test_make_trace():
+    t = lru_ng.make_trace("zipf", 10000, 100, seed=1)
+    assert isinstance(t, array) and t.typecode == "q" and len(t) == 10000
+    assert t == lru_ng.make_trace("zipf", 10000, 100, seed=1)
+    assert t != lru_ng.make_trace("zipf", 10000, 100, seed=2)
+    assert min(t) >= 0 and max(t) < 100
+    assert t.count(0) > t.count(99)
+    assert list(lru_ng.make_trace("loop", 7, 3)) == [0, 1, 2, 0, 1, 2, 0]
+    s = lru_ng.make_trace("scan", 400, 100)
+    assert list(s[300:400]) == list(range(100, 200))
+    assert max(s[:300]) < 100
+    assert len(lru_ng.make_trace("zipf", 0, 1)) == 0
+
+
+@pytest.mark.parametrize("kind", ["zipf", "scan", "loop"])
+def test_lru_exact(kind):
+    trace = lru_ng.make_trace(kind, 5000, 300, alpha=0.8, seed=3)
+    sizes = [1, 2, 10, 50, 299, 300, 301, 10000]
+    result = lru_ng.simulate(trace, sizes)
+    assert list(result) == ["lru"]
+    for size, ratio in zip(sizes, result["lru"]):
+        assert ratio * len(trace) == pytest.approx(lrudict_hits(trace, size))
+
+
+def test_reference_models():
+    trace = lru_ng.make_trace("scan", 6000, 200, alpha=0.9, seed=4)
+    sizes = [1, 5, 20, 100, 250]
+    result = lru_ng.simulate(trace, sizes, ["clock", "slru"])
+    for size, c, s in zip(sizes, result["clock"], result["slru"]):
+        assert c * len(trace) == pytest.approx(clock_hits(trace, size))
+        assert s * len(trace) == pytest.approx(slru_hits(trace, size))
+
+
+def test_policies():
+    trace = lru_ng.make_trace("scan", 200000, 2000, alpha=0.8, seed=5)
+    policies = ("lru", "clock", "slru", "arc", "tinylfu")
+    result = lru_ng.simulate(trace, [50, 200, 1000], policies)
+    assert sorted(result) == sorted(policies)
+    for ratios in result.values():
+        assert all(0 < r < 1 for r in ratios)
+        assert ratios == sorted(ratios)
+    # Scan resistance
+    for name in ("slru", "arc", "tinylfu"):
+        assert result[name][1] > result["lru"][1]
+    # A loop larger than the cache defeats LRU and CLOCK.
+    loop = lru_ng.make_trace("loop", 1000, 100)
+    result = lru_ng.simulate(loop, [99, 100], policies)
+    assert result["lru"] == result["clock"] == [0.0, 0.9]
+    assert result["tinylfu"][0] > 0
+
+
+def test_trace_types():
+    keys = ["a", "b", "a", "c", "b", "a"]
+    expected = lru_ng.simulate(array("q", map(hash, keys)), [1, 2, 3],
+                               ("lru", "arc"))
+    assert lru_ng.simulate(keys, [1, 2, 3], ("lru", "arc")) == expected
+    assert lru_ng.simulate(iter(keys), (1, 2, 3),
+                           ["lru", "arc"]) == expected
+    assert lru_ng.simulate(keys, [2], "lru") == {"lru": [1 / 6]}
+    assert lru_ng.simulate([], [1], "arc") == {"arc": [0.0]}
+
+
+def test_errors():
+    with pytest.raises(ValueError):
+        lru_ng.simulate([1], [0])
+    with pytest.raises(ValueError):
+        lru_ng.simulate([1], [1], ["fifo"])
+    with pytest.raises(TypeError):
+        lru_ng.simulate([1], [1], [b"lru"])
+    with pytest.raises(TypeError):
+        lru_ng.simulate([[]], [1])
+    with pytest.raises(TypeError):
+        lru_ng.simulate(1, [1])
+    with pytest.raises(ValueError):
+        lru_ng.make_trace("uniform", 10, 10)
+    with pytest.raises(ValueError):
+        lru_ng.make_trace("zipf", 10, 0)
+    with pytest.raises(ValueError):
+        lru_ng.make_trace("zipf", 10, 10, alpha=-1)
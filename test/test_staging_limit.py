@@ -0,0 +1,240 @@
+"""Testing the bound on the purge queue of LRUDict and the overflow policies."""
+import gc
+import sys
+import pytest
+from lru_ng import LRUDict, LRUDictBusyError
+
+
+class Obj:
+    """Evicting it is staged, unlike a str or an int."""
+
+    def __init__(self, n=None):
+        self.n = n
+
+
+def make(size, limit, policy, evicted):
+    r = LRUDict(size, callback=lambda k, v: evicted.append(k))
+    r.max_staged = limit
+    r.overflow = policy
+    r._suspend_purge = True
+    return r
+
+
+def test_properties():
+    r = LRUDict(5)
+    assert (r.max_staged, r.overflow) == (None, "purge")
+    r.max_staged = 3
+    r.overflow = "drop"
+    assert (r.max_staged, r.overflow) == (3, "drop")
+    r.max_staged = None
+    assert r.max_staged is None
+    with pytest.raises(ValueError):
+        r.max_staged = 0
+    with pytest.raises(TypeError):
+        r.max_staged = 1.0
+    with pytest.raises(ValueError):
+        r.overflow = "ignore"
+    with pytest.raises(TypeError):
+        r.overflow = None
+    with pytest.raises(AttributeError):
+        del r.max_staged
+
+
+def test_purge():
+    evicted = []
+    r = make(10, 5, "purge", evicted)
+    for i in range(30):
+        r[i] = Obj(i)
+    # Purged as the queue fills up, although suspended.
+    assert evicted == list(range(20))
+    s = r.get_ext_stats()
+    assert s.purge_queue_peak == 5
+    assert (s.evictions_staged, s.evictions_dropped) == (20, 0)
+
+
+def test_purge_full():
+    evicted = []
+    r = make(10, 20, "purge", evicted)
+    for i in range(18):
+        r[i] = Obj(i)
+    r.max_staged = 5
+    # Purged before the insertion, to make room
+    r[18] = Obj(18)
+    assert evicted == list(range(8))
+    assert r._purge_queue_size == 1
+    assert r.get_ext_stats().evictions_dropped == 0
+
+
+def test_drop():
+    evicted = []
+    r = make(10, 5, "drop", evicted)
+    for i in range(30):
+        r[i] = Obj(i)
+    assert r._purge_queue_size == 5
+    s = r.get_ext_stats()
+    assert (s.evictions_staged, s.evictions_direct) == (5, 15)
+    assert s.evictions_dropped == 15
+    r.purge()
+    assert evicted == list(range(5))
+
+
+def test_raise():
+    evicted = []
+    r = make(10, 5, "raise", evicted)
+    for i in range(15):
+        r[i] = Obj(i)
+    with pytest.raises(LRUDictBusyError):
+        r[15] = Obj(15)
+    with pytest.raises(LRUDictBusyError):
+        r.setdefault(15, 0)
+    assert 15 not in r and len(r) == 10
+    # Not an insertion, nor an eviction
+    r[14] = Obj(14)
+    r.purge()
+    r[15] = Obj(15)
+    assert evicted == list(range(5))
+    assert r._purge_queue_size == 1
+
+
+def test_raise_no_staging():
+    r = LRUDict(2)
+    r.max_staged = 1
+    r.overflow = "raise"
+    r._suspend_purge = True
+    r[0] = Obj(0)
+    r[1] = Obj(1)
+    r[2] = Obj(2)
+    with pytest.raises(LRUDictBusyError):
+        r[3] = Obj(3)
+    # Evicting 2 would not be staged.
+    r[2] = 2
+    r[1] = 1
+    r[3] = 3
+    assert r.keys() == [3, 1]
+
+
+@pytest.mark.parametrize("policy", ["purge", "drop", "raise"])
+def test_update(policy):
+    evicted = []
+    r = LRUDict(10, callback=lambda k, v: evicted.append(k))
+    r.max_staged = 5
+    r.overflow = policy
+    r.update({i: Obj(i) for i in range(1000)})
+    assert evicted == list(range(990))
+    assert r.get_ext_stats().purge_queue_peak == 5
+
+
+def test_update_suspended():
+    evicted = []
+    r = make(10, 5, "raise", evicted)
+    with pytest.raises(LRUDictBusyError):
+        r.update({i: Obj(i) for i in range(100)})
+    assert len(r) == 10 and r._purge_queue_size == 5
+    evicted = []
+    r = make(10, 5, "drop", evicted)
+    r.update({i: Obj(i) for i in range(1000)})
+    assert r._purge_queue_size == 5
+    assert r.get_ext_stats().evictions_dropped == 985
+
+
+@pytest.mark.parametrize("m", [600, 10])
+def test_shrink(m):
+    evicted = []
+    r = make(1000, 50, "drop", evicted)
+    for i in range(1000):
+        r[i] = Obj(i)
+    r.size = m
+    assert len(r) == m
+    assert r._purge_queue_size == 50
+    assert r.get_ext_stats().evictions_dropped == 950 - m
+    r.purge()
+    assert evicted == list(range(50))
+
+
+@pytest.mark.parametrize("m", [600, 10])
+def test_shrink_purge(m):
+    evicted = []
+    r = make(1000, 50, "purge", evicted)
+    for i in range(1000):
+        r[i] = Obj(i)
+    r.size = m
+    assert len(r) == m
+    assert r._purge_queue_size <= 50
+    r.purge()
+    assert evicted == list(range(1000 - m))
+    s = r.get_ext_stats()
+    assert s.purge_queue_peak == 50 and s.evictions_dropped == 0
+
+
+def test_shrink_refused():
+    evicted = []
+    r = make(1000, 50, "raise", evicted)
+    for i in range(1000):
+        r[i] = Obj(i)
+    with pytest.raises(LRUDictBusyError):
+        r.size = 10
+    assert (r.size, len(r)) == (1000, 1000)
+    r.size = 950
+    assert r._purge_queue_size == 50
+    # Nothing staged without the callback
+    r.callback = None
+    r.size = 10
+    assert len(r) == 10
+
+
+def test_blocked():
+    evicted = []
+    r = LRUDict(5)
+
+    def callback(key, value):
+        evicted.append(key)
+        if key == 0:
+            # Another purge cannot begin in here.
+            for i in range(100, 120):
+                r[i] = Obj(i)
+
+    r.callback = callback
+    r.max_staged = 3
+    r._max_pending_callbacks = 1
+    for i in range(6):
+        r[i] = Obj(i)
+    assert len(r) == 5
+    # Dropped instead
+    assert r.get_ext_stats().evictions_dropped > 0
+    assert r._purge_queue_size <= 3
+
+
+def test_release_dropped():
+    log = []
+
+    class Reentrant(Obj):
+        def __del__(self):
+            # The LRUDict is usable again by now.
+            log.append(r.get(self.n + 3) is not None)
+
+    r = make(3, 2, "drop", [])
+    for i in range(10):
+        r[i] = Reentrant(i)
+    gc.collect()
+    assert log == [True] * 5
+    assert r._purge_queue_size == 2
+
+
+@pytest.mark.skipif(not hasattr(sys, "getrefcount"),
+                    reason="requires sys.getrefcount")
+def test_refcount():
+    key, value = Obj(0), Obj(0)
+    refs = sys.getrefcount(key), sys.getrefcount(value)
+    r = LRUDict(2)
+    r.max_staged = 1
+    r.overflow = "drop"
+    r._suspend_purge = True
+    r[1] = Obj(1)
+    r[key] = value
+    r[2] = Obj(2)
+    r[3] = Obj(3)
+    assert key not in r
+    assert (sys.getrefcount(key), sys.getrefcount(value)) == refs
+    del r
+    gc.collect()
+    assert (sys.getrefcount(key), sys.getrefcount(value)) == refs
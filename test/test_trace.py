@@ -0,0 +1,140 @@
+"""Testing the access-trace recorder of LRUDict."""
+import pytest
+import lru_ng
+from lru_ng import LRUDict
+
+
+pytestmark = pytest.mark.skipif(not hasattr(LRUDict, "start_trace"),
+                                reason="trace recorder not available")
+
+
+def records(path):
+    return list(zip(*lru_ng.read_trace(str(path))))
+
+
+def test_ops(tmp_path):
+    path = tmp_path / "trace.bin"
+    r = LRUDict(2)
+    r.start_trace(str(path))
+    r[1] = "a"          # insert
+    r[1] = "b"          # replace
+    r[1]                # hit
+    r.get(2)            # miss
+    r[2] = "c"
+    r[3] = "d"          # evicts 1
+    del r[2]
+    r.pop(3)
+    r.pop(4, None)      # missing
+    written, dropped = r.stop_trace()
+    assert (written, dropped) == (10, 0)
+    recs = records(path)
+    got = [(op, h, hit) for op, h, hit, t in recs]
+    assert got == [
+        (lru_ng.TRACE_SET, hash(1), 0),
+        (lru_ng.TRACE_SET, hash(1), 1),
+        (lru_ng.TRACE_GET, hash(1), 1),
+        (lru_ng.TRACE_GET, hash(2), 0),
+        (lru_ng.TRACE_SET, hash(2), 0),
+        (lru_ng.TRACE_SET, hash(3), 0),
+        (lru_ng.TRACE_EVICT, hash(1), 1),
+        (lru_ng.TRACE_DEL, hash(2), 1),
+        (lru_ng.TRACE_DEL, hash(3), 1),
+        (lru_ng.TRACE_DEL, hash(4), 0),
+    ]
+    times = [t for op, h, hit, t in recs]
+    assert times == sorted(times)
+    assert r.stop_trace() is None
+
+
+def test_pop_python_hash(tmp_path):
+    class Key:
+        def __hash__(self):
+            return 42
+
+    path = tmp_path / "trace.bin"
+    r = LRUDict(2)
+    r.start_trace(str(path))
+    with pytest.raises(KeyError):
+        r.pop(Key())
+    assert r.pop(Key(), "d") == "d"
+    k = Key()
+    r[k] = "v"
+    assert r.pop(k) == "v"
+    r.stop_trace()
+    got = [(op, h, hit) for op, h, hit, t in records(path)]
+    assert got == [
+        (lru_ng.TRACE_DEL, 42, 0),
+        (lru_ng.TRACE_DEL, 42, 0),
+        (lru_ng.TRACE_SET, 42, 0),
+        (lru_ng.TRACE_DEL, 42, 1),
+    ]
+
+
+def test_arrays(tmp_path):
+    path = tmp_path / "trace.bin"
+    r = LRUDict(10)
+    r.start_trace(str(path))
+    for i in range(100):
+        r[i] = i
+    r.stop_trace()
+    ops, hashes, hits, times = lru_ng.read_trace(str(path))
+    assert ops.typecode == "B" and hashes.typecode == "q"
+    assert len(ops) == len(hashes) == len(hits) == len(times) == 190
+    assert list(hashes[:3]) == [0, 1, 2]
+
+
+def test_sample(tmp_path):
+    path = tmp_path / "trace.bin"
+    r = LRUDict(100000)
+    r.start_trace(str(path), sample=0.25)
+    for i in range(20000):
+        r[i] = None
+    for i in range(20000):
+        r[i]
+    written, dropped = r.stop_trace()
+    assert dropped == 0
+    assert 0.2 * 40000 < written < 0.3 * 40000
+    ops, hashes, hits, times = lru_ng.read_trace(str(path))
+    # Each sampled key is recorded every time.
+    sampled = set(hashes)
+    assert len(ops) == 2 * len(sampled)
+
+
+def test_overflow(tmp_path):
+    path = tmp_path / "trace.bin"
+    r = LRUDict(10)
+    r.start_trace(str(path), buffer_size=2)
+    for i in range(100000):
+        r.get(i)
+    written, dropped = r.stop_trace()
+    assert written + dropped == 100000
+    assert len(lru_ng.read_trace(str(path))[0]) == written
+
+
+def test_errors(tmp_path):
+    r = LRUDict(10)
+    with pytest.raises(ValueError):
+        r.start_trace(str(tmp_path / "t"), sample=0)
+    with pytest.raises(ValueError):
+        r.start_trace(str(tmp_path / "t"), buffer_size=1)
+    with pytest.raises(OSError):
+        r.start_trace(str(tmp_path / "no" / "such" / "dir"))
+    r.start_trace(str(tmp_path / "t"))
+    with pytest.raises(RuntimeError):
+        r.start_trace(str(tmp_path / "u"))
+    r.stop_trace()
+    bad = tmp_path / "bad"
+    bad.write_bytes(b"not a trace file at all, really not")
+    with pytest.raises(ValueError):
+        lru_ng.read_trace(str(bad))
+    with pytest.raises(OSError):
+        lru_ng.read_trace(str(tmp_path / "missing"))
+
+
+def test_dealloc_flushes(tmp_path):
+    path = tmp_path / "trace.bin"
+    r = LRUDict(10)
+    r.start_trace(str(path))
+    r[0] = 0
+    del r
+    assert len(lru_ng.read_trace(str(path))[0]) == 1
@@ -0,0 +1,32 @@
+"""Testing that the USDT probes are in the ELF notes of the extension."""
+import os
+import re
+import shutil
+import subprocess
+import sys
+from importlib.machinery import EXTENSION_SUFFIXES
+import pytest
+import lru_ng
+
+
+PROBES = {"hit", "miss", "insert", "evict", "purge_start", "purge_end",
+          "busy"}
+
+
+def stapsdt_probes(path):
+    out = subprocess.run(["readelf", "--notes", "--wide", path],
+                         stdout=subprocess.PIPE, universal_newlines=True,
+                         check=True).stdout
+    return set(re.findall(r"Provider: (\S+)\s+Name: (\S+)", out))
+
+
+@pytest.mark.skipif(not sys.platform.startswith("linux") or
+                    shutil.which("readelf") is None,
+                    reason="requires Linux and readelf")
+@pytest.mark.skipif(not lru_ng.__file__.endswith(tuple(EXTENSION_SUFFIXES)),
+                    reason="not the C extension module")
+def test_probes_in_notes():
+    found = stapsdt_probes(lru_ng.__file__)
+    if not found and not os.path.exists("/usr/include/sys/sdt.h"):
+        pytest.skip("built without sys/sdt.h")
+    assert {("lru_ng", name) for name in PROBES} <= found